@@ -0,0 +1,100 @@
+#ifndef __FIREFLY_AEAD_H__
+#define __FIREFLY_AEAD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ *  Authenticated Encryption
+ *
+ *  ChaCha20-Poly1305 (RFC 8439), run incrementally so a message can be
+ *  encrypted or decrypted (and authenticated) one chunk at a time as
+ *  it is sent or arrives, without a separate pass over the message.
+ *
+ *  Both primitives use only 32-bit additions, rotations and multiplies,
+ *  so need no tables (which avoids cache timing leaks) and suit a core
+ *  without cryptographic acceleration.
+ *
+ *  A (key, nonce) pair must never be used for more than one message.
+ */
+
+
+#define FFX_AEAD_KEY_LENGTH         (32)
+#define FFX_AEAD_NONCE_LENGTH       (12)
+#define FFX_AEAD_TAG_LENGTH         (16)
+
+
+/**
+ *  The cipher state for a single message.
+ *
+ *  This should not be modified directly! Only use the provided API.
+ */
+typedef struct FfxAead {
+    // ChaCha20 state and the unused tail of the current keystream block
+    uint32_t state[16];
+    uint8_t keystream[64];
+    size_t keystreamOffset;
+
+    // Poly1305 state (in 26-bit limbs) and any partial block
+    uint32_t r[5];
+    uint32_t h[5];
+    uint32_t pad[4];
+    uint8_t block[16];
+    size_t blockLength;
+
+    uint64_t aadLength;
+    uint64_t length;
+} FfxAead;
+
+
+/**
+ *  Initializes %%aead%% for a message using %%key%%
+ *  (FFX_AEAD_KEY_LENGTH bytes) and %%nonce%% (FFX_AEAD_NONCE_LENGTH
+ *  bytes).
+ */
+void ffx_aead_init(FfxAead *aead, const uint8_t *key, const uint8_t *nonce);
+
+/**
+ *  Authenticates (without encrypting) %%data%%. This may only be
+ *  called once, before any data is encrypted or decrypted.
+ */
+void ffx_aead_authenticate(FfxAead *aead, const uint8_t *data,
+  size_t length);
+
+/**
+ *  Encrypts the next %%length%% bytes of %%input%% to %%output%%, which
+ *  may be the same buffer.
+ */
+void ffx_aead_encrypt(FfxAead *aead, uint8_t *output, const uint8_t *input,
+  size_t length);
+
+/**
+ *  Decrypts the next %%length%% bytes of %%input%% to %%output%%, which
+ *  may be the same buffer.
+ */
+void ffx_aead_decrypt(FfxAead *aead, uint8_t *output, const uint8_t *input,
+  size_t length);
+
+/**
+ *  Writes the tag (FFX_AEAD_TAG_LENGTH bytes) for the message so far.
+ */
+void ffx_aead_final(FfxAead *aead, uint8_t *tag);
+
+/**
+ *  Returns true if %%tag%% matches the message so far, in constant
+ *  time. Decrypted data must not be trusted unless this succeeds.
+ */
+bool ffx_aead_verify(FfxAead *aead, const uint8_t *tag);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FIREFLY_AEAD_H__ */
@@ -0,0 +1,295 @@
+#include <string.h>
+
+#include "firefly-aead.h"
+
+
+#define MASK26      (0x3ffffff)
+
+// The high bit of a full Poly1305 block (2^128, in the top limb)
+#define HIBIT       (1 << 24)
+
+
+///////////////////////////////
+// Utilities
+
+static uint32_t read32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) |
+      ((uint32_t)data[3] << 24);
+}
+
+static void write32(uint8_t *data, uint32_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+static void write64(uint8_t *data, uint64_t value) {
+    write32(data, value);
+    write32(&data[4], value >> 32);
+}
+
+
+///////////////////////////////
+// ChaCha20
+
+#define ROTL(v, n)      (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTER(a, b, c, d) \
+    a += b; d ^= a; d = ROTL(d, 16); \
+    c += d; b ^= c; b = ROTL(b, 12); \
+    a += b; d ^= a; d = ROTL(d, 8); \
+    c += d; b ^= c; b = ROTL(b, 7);
+
+// Writes the keystream block for the current counter and advances it
+static void chachaBlock(uint32_t *state, uint8_t *output) {
+    uint32_t x[16];
+    memcpy(x, state, sizeof(x));
+
+    for (int i = 0; i < 10; i++) {
+        QUARTER(x[0], x[4], x[8], x[12]);
+        QUARTER(x[1], x[5], x[9], x[13]);
+        QUARTER(x[2], x[6], x[10], x[14]);
+        QUARTER(x[3], x[7], x[11], x[15]);
+        QUARTER(x[0], x[5], x[10], x[15]);
+        QUARTER(x[1], x[6], x[11], x[12]);
+        QUARTER(x[2], x[7], x[8], x[13]);
+        QUARTER(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int i = 0; i < 16; i++) { write32(&output[4 * i], x[i] + state[i]); }
+
+    state[12]++;
+}
+
+// XORs the next %%length%% bytes of keystream into %%input%%
+static void applyKeystream(FfxAead *aead, uint8_t *output,
+  const uint8_t *input, size_t length) {
+
+    while (length) {
+        if (aead->keystreamOffset == 64) {
+            chachaBlock(aead->state, aead->keystream);
+            aead->keystreamOffset = 0;
+        }
+
+        size_t count = 64 - aead->keystreamOffset;
+        if (count > length) { count = length; }
+
+        const uint8_t *keystream = &aead->keystream[aead->keystreamOffset];
+        for (size_t i = 0; i < count; i++) {
+            output[i] = input[i] ^ keystream[i];
+        }
+
+        aead->keystreamOffset += count;
+        output += count;
+        input += count;
+        length -= count;
+    }
+}
+
+
+///////////////////////////////
+// Poly1305
+
+static void polyInit(FfxAead *aead, const uint8_t *key) {
+    aead->r[0] = read32(&key[0]) & MASK26;
+    aead->r[1] = (read32(&key[3]) >> 2) & 0x3ffff03;
+    aead->r[2] = (read32(&key[6]) >> 4) & 0x3ffc0ff;
+    aead->r[3] = (read32(&key[9]) >> 6) & 0x3f03fff;
+    aead->r[4] = (read32(&key[12]) >> 8) & 0x00fffff;
+
+    memset(aead->h, 0, sizeof(aead->h));
+
+    for (int i = 0; i < 4; i++) { aead->pad[i] = read32(&key[16 + 4 * i]); }
+
+    aead->blockLength = 0;
+}
+
+// Accumulates full 16-byte blocks; h = (h + block) * r (mod 2^130 - 5)
+static void polyBlocks(FfxAead *aead, const uint8_t *data, size_t length) {
+    const uint32_t r0 = aead->r[0], r1 = aead->r[1], r2 = aead->r[2];
+    const uint32_t r3 = aead->r[3], r4 = aead->r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+
+    uint32_t h0 = aead->h[0], h1 = aead->h[1], h2 = aead->h[2];
+    uint32_t h3 = aead->h[3], h4 = aead->h[4];
+
+    while (length >= 16) {
+        h0 += read32(&data[0]) & MASK26;
+        h1 += (read32(&data[3]) >> 2) & MASK26;
+        h2 += (read32(&data[6]) >> 4) & MASK26;
+        h3 += (read32(&data[9]) >> 6) & MASK26;
+        h4 += (read32(&data[12]) >> 8) | HIBIT;
+
+        uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 +
+          (uint64_t)h2 * s3 + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+        uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 +
+          (uint64_t)h2 * s4 + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+        uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 +
+          (uint64_t)h2 * r0 + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+        uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 +
+          (uint64_t)h2 * r1 + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+        uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 +
+          (uint64_t)h2 * r2 + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+        uint32_t c = d0 >> 26; h0 = d0 & MASK26;
+        d1 += c; c = d1 >> 26; h1 = d1 & MASK26;
+        d2 += c; c = d2 >> 26; h2 = d2 & MASK26;
+        d3 += c; c = d3 >> 26; h3 = d3 & MASK26;
+        d4 += c; c = d4 >> 26; h4 = d4 & MASK26;
+        h0 += c * 5; c = h0 >> 26; h0 &= MASK26;
+        h1 += c;
+
+        data += 16;
+        length -= 16;
+    }
+
+    aead->h[0] = h0; aead->h[1] = h1; aead->h[2] = h2;
+    aead->h[3] = h3; aead->h[4] = h4;
+}
+
+static void polyUpdate(FfxAead *aead, const uint8_t *data, size_t length) {
+    if (aead->blockLength) {
+        size_t count = 16 - aead->blockLength;
+        if (count > length) { count = length; }
+        memcpy(&aead->block[aead->blockLength], data, count);
+        aead->blockLength += count;
+        data += count;
+        length -= count;
+
+        if (aead->blockLength < 16) { return; }
+        polyBlocks(aead, aead->block, 16);
+        aead->blockLength = 0;
+    }
+
+    size_t whole = length & ~(size_t)15;
+    if (whole) { polyBlocks(aead, data, whole); }
+
+    if (length > whole) {
+        memcpy(aead->block, &data[whole], length - whole);
+        aead->blockLength = length - whole;
+    }
+}
+
+// Zero-pads any partial block (as the AEAD construction requires)
+static void polyPad(FfxAead *aead) {
+    if (aead->blockLength == 0) { return; }
+    memset(&aead->block[aead->blockLength], 0, 16 - aead->blockLength);
+    polyBlocks(aead, aead->block, 16);
+    aead->blockLength = 0;
+}
+
+static void polyFinal(FfxAead *aead, uint8_t *tag) {
+    uint32_t h0 = aead->h[0], h1 = aead->h[1], h2 = aead->h[2];
+    uint32_t h3 = aead->h[3], h4 = aead->h[4];
+
+    // Fully carry h
+    uint32_t c = h1 >> 26; h1 &= MASK26;
+    h2 += c; c = h2 >> 26; h2 &= MASK26;
+    h3 += c; c = h3 >> 26; h3 &= MASK26;
+    h4 += c; c = h4 >> 26; h4 &= MASK26;
+    h0 += c * 5; c = h0 >> 26; h0 &= MASK26;
+    h1 += c;
+
+    // Compute h - p (i.e. h + 5 - 2^130) and select it if h >= p,
+    // without branching
+    uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= MASK26;
+    uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= MASK26;
+    uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= MASK26;
+    uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= MASK26;
+    uint32_t g4 = h4 + c - (1 << 26);
+
+    uint32_t mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+
+    // h = (h + pad) mod 2^128
+    uint64_t f;
+    f = (uint64_t)(h0 | (h1 << 26)) + aead->pad[0];
+    write32(&tag[0], f);
+    f = (uint64_t)((h1 >> 6) | (h2 << 20)) + aead->pad[1] + (f >> 32);
+    write32(&tag[4], f);
+    f = (uint64_t)((h2 >> 12) | (h3 << 14)) + aead->pad[2] + (f >> 32);
+    write32(&tag[8], f);
+    f = (uint64_t)((h3 >> 18) | (h4 << 8)) + aead->pad[3] + (f >> 32);
+    write32(&tag[12], f);
+}
+
+
+///////////////////////////////
+// API
+
+void ffx_aead_init(FfxAead *aead, const uint8_t *key, const uint8_t *nonce) {
+    memset(aead, 0, sizeof(FfxAead));
+
+    // "expand 32-byte k"
+    aead->state[0] = 0x61707865;
+    aead->state[1] = 0x3320646e;
+    aead->state[2] = 0x79622d32;
+    aead->state[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++) { aead->state[4 + i] = read32(&key[4 * i]); }
+    aead->state[12] = 0;
+    for (int i = 0; i < 3; i++) {
+        aead->state[13 + i] = read32(&nonce[4 * i]);
+    }
+
+    // The Poly1305 key is the first 32 bytes of block 0; the message
+    // is encrypted from block 1
+    uint8_t block[64];
+    chachaBlock(aead->state, block);
+    polyInit(aead, block);
+    memset(block, 0, sizeof(block));
+
+    aead->keystreamOffset = 64;
+}
+
+void ffx_aead_authenticate(FfxAead *aead, const uint8_t *data,
+  size_t length) {
+
+    polyUpdate(aead, data, length);
+    polyPad(aead);
+    aead->aadLength = length;
+}
+
+void ffx_aead_encrypt(FfxAead *aead, uint8_t *output, const uint8_t *input,
+  size_t length) {
+
+    applyKeystream(aead, output, input, length);
+    polyUpdate(aead, output, length);
+    aead->length += length;
+}
+
+void ffx_aead_decrypt(FfxAead *aead, uint8_t *output, const uint8_t *input,
+  size_t length) {
+
+    // Authenticate the ciphertext before it may be overwritten
+    polyUpdate(aead, input, length);
+    applyKeystream(aead, output, input, length);
+    aead->length += length;
+}
+
+void ffx_aead_final(FfxAead *aead, uint8_t *tag) {
+    polyPad(aead);
+
+    uint8_t lengths[16];
+    write64(&lengths[0], aead->aadLength);
+    write64(&lengths[8], aead->length);
+    polyBlocks(aead, lengths, 16);
+
+    polyFinal(aead, tag);
+}
+
+bool ffx_aead_verify(FfxAead *aead, const uint8_t *tag) {
+    uint8_t expected[FFX_AEAD_TAG_LENGTH];
+    ffx_aead_final(aead, expected);
+
+    uint8_t diff = 0;
+    for (int i = 0; i < FFX_AEAD_TAG_LENGTH; i++) {
+        diff |= expected[i] ^ tag[i];
+    }
+
+    return (diff == 0);
+}
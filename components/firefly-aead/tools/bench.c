@@ -0,0 +1,193 @@
+/**
+ *  Host check and benchmark for the AEAD.
+ *
+ *  Build and run (from the component directory):
+ *    cc -O2 -Iinclude src/aead.c tools/bench.c -o bench
+ *    ./bench
+ *
+ *  Checks the RFC 8439 test vector (section 2.8.2), that arbitrarily
+ *  split chunks produce the same ciphertext and tag as a single call,
+ *  and that any corruption fails verification, then reports the
+ *  throughput for a range of message sizes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "firefly-aead.h"
+
+
+// A typical notification payload with a 247 byte MTU
+#define CHUNK_SIZE      (241)
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int checkVector() {
+    uint8_t key[32], nonce[12] = {
+        0x07, 0x00, 0x00, 0x00, 0x40, 0x41, 0x42, 0x43,
+        0x44, 0x45, 0x46, 0x47
+    };
+    for (int i = 0; i < 32; i++) { key[i] = 0x80 + i; }
+
+    const uint8_t aad[] = {
+        0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3,
+        0xc4, 0xc5, 0xc6, 0xc7
+    };
+
+    const char *text = "Ladies and Gentlemen of the class of '99: If I "
+      "could offer you only one tip for the future, sunscreen would be it.";
+    size_t length = strlen(text);
+
+    const uint8_t prefix[] = {
+        0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb,
+        0x7b, 0x86, 0xaf, 0xbc, 0x53, 0xef, 0x7e, 0xc2
+    };
+    const uint8_t expectedTag[] = {
+        0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a,
+        0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91
+    };
+
+    uint8_t data[128], tag[16];
+    memcpy(data, text, length);
+
+    FfxAead aead;
+    ffx_aead_init(&aead, key, nonce);
+    ffx_aead_authenticate(&aead, aad, sizeof(aad));
+    ffx_aead_encrypt(&aead, data, data, length);
+    ffx_aead_final(&aead, tag);
+
+    if (memcmp(data, prefix, sizeof(prefix)) ||
+      memcmp(tag, expectedTag, sizeof(tag))) {
+        fprintf(stderr, "error: RFC 8439 vector mismatch\n");
+        return -1;
+    }
+
+    ffx_aead_init(&aead, key, nonce);
+    ffx_aead_authenticate(&aead, aad, sizeof(aad));
+    ffx_aead_decrypt(&aead, data, data, length);
+    if (!ffx_aead_verify(&aead, tag) || memcmp(data, text, length)) {
+        fprintf(stderr, "error: RFC 8439 vector did not decrypt\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Encrypts %%length%% bytes in random chunks and compares with a single
+// call, then decrypts in different chunks, with and without corruption
+static int checkChunks(size_t length) {
+    uint8_t key[32], nonce[12];
+    for (int i = 0; i < 32; i++) { key[i] = random(); }
+    for (int i = 0; i < 12; i++) { nonce[i] = random(); }
+
+    uint8_t *plain = malloc(length), *single = malloc(length);
+    uint8_t *chunked = malloc(length);
+    for (size_t i = 0; i < length; i++) { plain[i] = random(); }
+
+    int result = -1;
+    do {
+        uint8_t tag[16], chunkedTag[16];
+
+        FfxAead aead;
+        ffx_aead_init(&aead, key, nonce);
+        ffx_aead_encrypt(&aead, single, plain, length);
+        ffx_aead_final(&aead, tag);
+
+        ffx_aead_init(&aead, key, nonce);
+        for (size_t offset = 0; offset < length;) {
+            size_t count = 1 + random() % 100;
+            if (count > length - offset) { count = length - offset; }
+            ffx_aead_encrypt(&aead, &chunked[offset], &plain[offset], count);
+            offset += count;
+        }
+        ffx_aead_final(&aead, chunkedTag);
+
+        if (memcmp(single, chunked, length) || memcmp(tag, chunkedTag, 16)) {
+            fprintf(stderr, "error: chunked encryption mismatch\n");
+            break;
+        }
+
+        ffx_aead_init(&aead, key, nonce);
+        for (size_t offset = 0; offset < length;) {
+            size_t count = 1 + random() % 300;
+            if (count > length - offset) { count = length - offset; }
+            ffx_aead_decrypt(&aead, &chunked[offset], &chunked[offset],
+              count);
+            offset += count;
+        }
+        if (!ffx_aead_verify(&aead, tag) || memcmp(chunked, plain, length)) {
+            fprintf(stderr, "error: chunked decryption failed\n");
+            break;
+        }
+
+        // Any flipped bit must fail
+        single[random() % length] ^= 1 << (random() % 8);
+        ffx_aead_init(&aead, key, nonce);
+        ffx_aead_decrypt(&aead, chunked, single, length);
+        if (ffx_aead_verify(&aead, tag)) {
+            fprintf(stderr, "error: corruption not detected\n");
+            break;
+        }
+
+        result = 0;
+    } while (0);
+
+    free(plain);
+    free(single);
+    free(chunked);
+
+    return result;
+}
+
+int main(int argc, char **argv) {
+    srandom(42);
+
+    if (checkVector()) { return 1; }
+
+    for (int i = 0; i < 1000; i++) {
+        if (checkChunks(1 + random() % 4096)) { return 1; }
+    }
+
+    printf("RFC 8439 vector and 1000 chunked messages OK\n\n");
+
+    const size_t sizes[] = { 64, 1024, 16384 };
+
+    uint8_t key[32] = { 0 }, nonce[12] = { 0 }, tag[16];
+    uint8_t *data = calloc(1, 16384);
+
+    printf("%-8s %12s %12s\n", "size", "msg/s", "MB/s");
+
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t size = sizes[s];
+        int iterations = (64 << 20) / size;
+
+        double t0 = now();
+        for (int i = 0; i < iterations; i++) {
+            nonce[0] = i;
+
+            // As each chunk would be sent
+            FfxAead aead;
+            ffx_aead_init(&aead, key, nonce);
+            for (size_t offset = 0; offset < size; offset += CHUNK_SIZE) {
+                size_t count = size - offset;
+                if (count > CHUNK_SIZE) { count = CHUNK_SIZE; }
+                ffx_aead_encrypt(&aead, &data[offset], &data[offset], count);
+            }
+            ffx_aead_final(&aead, tag);
+        }
+        double dt = now() - t0;
+
+        printf("%-8zu %12.0f %12.1f\n", size, iterations / dt,
+          (double)size * iterations / dt / 1e6);
+    }
+
+    free(data);
+
+    return 0;
+}
@@ -0,0 +1,159 @@
+#ifndef __FIREFLY_ABI_H__
+#define __FIREFLY_ABI_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ *  Application Binary Interface (ABI) Calldata Decoder
+ *
+ *  The first 4 bytes of calldata (the selector) are looked up in a
+ *  table of common function signatures (see tools/selectors.txt),
+ *  which is compiled into flash and binary searched. The remaining
+ *  calldata is then decoded in-place, one parameter at a time, with
+ *  no allocation.
+ *
+ *  Supported types are address, bool, uintN, intN, bytesN, bytes,
+ *  string and dynamic arrays of any of these (T[]), which expose
+ *  only their count.
+ */
+
+
+#define FFX_ABI_SELECTOR_LENGTH     (4)
+#define FFX_ABI_WORD_LENGTH         (32)
+
+
+typedef enum FfxAbiStatus {
+    // Returned at the end of the parameters or when the selector is
+    // not in the table.
+    FfxAbiStatusNotFound          = 5,
+
+    // No error
+    FfxAbiStatusOK                = 0,
+
+    // The calldata is too short for the parameters
+    FfxAbiStatusBufferOverrun     = -31,
+
+    // A value is not correctly encoded for its type (e.g. an address
+    // with non-zero padding)
+    FfxAbiStatusBadData           = -33,
+
+    // The signature contains an unsupported type (e.g. tuples)
+    FfxAbiStatusUnsupportedType   = -52,
+} FfxAbiStatus;
+
+typedef enum FfxAbiType {
+    FfxAbiTypeUnsupported = 0,
+    FfxAbiTypeAddress,
+    FfxAbiTypeBool,
+    FfxAbiTypeUint,
+    FfxAbiTypeInt,
+    FfxAbiTypeFixedBytes,
+    FfxAbiTypeBytes,
+    FfxAbiTypeString,
+    FfxAbiTypeArray,
+} FfxAbiType;
+
+/**
+ *  A cursor used to traverse the parameters of calldata.
+ *
+ *  This should not be modified directly! Only use the provided API.
+ */
+typedef struct FfxAbiCursor {
+    uint8_t *data;
+    size_t length;
+
+    uint32_t selector;
+
+    // The signature from the selector table (or NULL if unknown)
+    const char *signature;
+
+    // The offset within signature of the next parameter
+    size_t offset;
+
+    // The index of the next parameter
+    size_t index;
+} FfxAbiCursor;
+
+/**
+ *  A decoded parameter, which references the calldata.
+ *
+ *  The %%data%% depends on the type:
+ *    - Address: the 20 byte address
+ *    - Bool: a single byte, either 0 or 1
+ *    - Uint and Int: the 32 byte big-endian word
+ *    - FixedBytes: the %%size%% bytes
+ *    - Bytes and String: the %%length%% bytes of payload
+ *    - Array: the first element word (an offset for dynamic
+ *      elements), with %%length%% elements
+ */
+typedef struct FfxAbiParam {
+    FfxAbiType type;
+
+    // The bit-width for uintN and intN or byte-width for bytesN
+    size_t size;
+
+    // The parameter name from the signature (not NULL-terminated)
+    const char *name;
+    size_t nameLength;
+
+    uint8_t *data;
+    size_t length;
+} FfxAbiParam;
+
+
+/**
+ *  Returns the signature for %%selector%%, or NULL if unknown.
+ *
+ *  The signature includes parameter names, for example
+ *  "transfer(address to,uint256 amount)".
+ */
+const char* ffx_abi_lookupSelector(uint32_t selector);
+
+/**
+ *  Initializes %%cursor%% for the calldata %%data%%.
+ *
+ *  If the selector is not known, returns FfxAbiStatusNotFound (the
+ *  selector is still available on the cursor).
+ */
+FfxAbiStatus ffx_abi_init(FfxAbiCursor *cursor, uint8_t *data,
+  size_t length);
+
+/**
+ *  Decodes the next parameter into %%param%%.
+ *
+ *  After the last parameter, returns FfxAbiStatusNotFound.
+ */
+FfxAbiStatus ffx_abi_nextParam(FfxAbiCursor *cursor, FfxAbiParam *param);
+
+/**
+ *  Formats %%param%% as a human-readable value (a checksum address,
+ *  decimal number, hex data, etc.) into %%output%%, which is always
+ *  NULL-terminated and truncated to fit.
+ *
+ *  Returns the string length (excluding the NULL).
+ */
+size_t ffx_abi_formatParam(FfxAbiParam *param, char *output, size_t length);
+
+/**
+ *  Formats the entire call, for example "transfer(to: 0x8ba1..., amount:
+ *  1000)", into %%output%%, which is always NULL-terminated and
+ *  truncated to fit.
+ *
+ *  Returns the string length (excluding the NULL), or 0 if the
+ *  selector is unknown or the calldata cannot be decoded.
+ */
+size_t ffx_abi_formatCall(FfxAbiCursor *cursor, char *output, size_t length);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FIREFLY_ABI_H__ */
@@ -103,7 +103,11 @@ typedef struct FfxCborBuilder {
 
 // Detects if an error occurred during crawl or build... @TODO
 FfxCborStatus ffx_cbor_getStatus(FfxCborCursor *cursor);
-FfxCborStatus ffx_cbor_getBuildStatus(FfxCborCursor *cursor);
+
+// Returns the first error of any append to %%builder%% (e.g. a
+// BufferOverrun), or OK if every append succeeded. A failed append
+// writes nothing, but the values after it are still missing.
+FfxCborStatus ffx_cbor_getBuildStatus(FfxCborBuilder *builder);
 
 void ffx_cbor_init(FfxCborCursor *cursor, uint8_t *data, size_t length);
 void ffx_cbor_clone(FfxCborCursor *dst, FfxCborCursor *src);
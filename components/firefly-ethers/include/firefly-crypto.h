@@ -38,6 +38,10 @@ void ffx_pk_decompressPubkeySecp256k1(uint8_t *compPubkey, uint8_t *pubkey);
 bool ffx_pk_computeSharedSecretSecp256k1(uint8_t *privkey,
   uint8_t *otherPubkey, uint8_t *sharedSecret);
 
+// An ECDH peer key must be checked, as a point off the curve may leak
+// bits of the private key
+bool ffx_pk_isValidPubkeySecp256k1(uint8_t *pubkey);
+
 
 bool ffx_pk_signP256(uint8_t *privkey, uint8_t *digest,
   uint8_t *signature);
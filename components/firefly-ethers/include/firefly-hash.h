@@ -6,6 +6,7 @@ extern "C" {
 #endif  /* __cplusplus */
 
 #include <stddef.h>
+#include <stdint.h>
 
 
 #define FFX_KECCAK256_DIGEST_LENGTH          (32)
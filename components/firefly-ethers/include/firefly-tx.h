@@ -12,6 +12,10 @@ extern "C" {
 #include "firefly-cbor.h"
 
 
+// The most a serialized transaction can grow by when signed
+#define FFX_TX_SIGNATURE_OVERHEAD    (80)
+
+
 typedef enum FfxTxStatus {
     FfxTxStatusOK                    = 0,
     FfxTxStatusBufferOverrun,
@@ -20,11 +24,57 @@ typedef enum FfxTxStatus {
     FfxTxStatusUnsupportedVersion,
 } FfxTxStatus;
 
+/**
+ *  The EIP-2718 Envelope Type. The CBOR transaction may specify this
+ *  with a "type" key; otherwise the presence of "gasPrice" (and
+ *  "accessList") selects a legacy (or EIP-2930) transaction.
+ */
+typedef enum FfxTxType {
+    FfxTxTypeLegacy                  = 0,
+    FfxTxTypeAccessList              = 1,
+    FfxTxTypeFeeMarket               = 2,
+} FfxTxType;
 
+
+/**
+ *  Serializes the unsigned %%tx%% into %%data%%, updating %%length%%
+ *  to the serialized length.
+ *
+ *  Legacy transactions include the EIP-155 chainId (which is
+ *  required), and EIP-2930 and EIP-1559 transactions include the
+ *  "accessList" (an Array of { address, storageKeys } Maps).
+ *
+ *  If %%data%% is too small, FfxTxStatusBufferOverrun is returned
+ *  and %%length%% is updated to the required length.
+ */
 FfxTxStatus ffx_tx_serializeUnsigned(FfxCborCursor *tx, uint8_t *data,
   size_t *length);
 
-//FfxTxStatus ffx_tx_serializeSigned(FfxCborCursor *tx, uint8_t *signature,);
+/**
+ *  Computes the Keccak256 signing %%digest%% of the unsigned %%tx%%.
+ *
+ *  The RLP-encoding is streamed into the hash directly from the
+ *  CBOR data, so no buffer is required regardless of the length
+ *  of the transaction data.
+ */
+FfxTxStatus ffx_tx_hashUnsigned(FfxCborCursor *tx, uint8_t *digest);
+
+/**
+ *  Converts the unsigned transaction in %%data%% (as serialized by
+ *  ffx_tx_serializeUnsigned) to the signed transaction in-place,
+ *  updating %%length%%.
+ *
+ *  The outer list header is patched and the yParity (or EIP-155 v
+ *  for legacy transactions), r and s are appended to the existing
+ *  body, which is never re-encoded. The %%data%% must have at least
+ *  %%maxLength%% bytes, which should allow FFX_TX_SIGNATURE_OVERHEAD
+ *  bytes beyond the unsigned length.
+ *
+ *  The %%signature%% is FFX_SECP256K1_SIGNATURE_LENGTH bytes (r, s
+ *  and v, where v is either 27/28 or 0/1).
+ */
+FfxTxStatus ffx_tx_serializeSigned(uint8_t *data, size_t *length,
+  size_t maxLength, uint8_t *signature);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,38 @@
+// Generated by tools/generate-selectors.py; do not modify
+#ifndef __ABI_SELECTORS_H__
+#define __ABI_SELECTORS_H__
+
+#include <stdint.h>
+
+// Sorted by selector, for binary search
+static const AbiSelector abiSelectors[] = {
+    { 0x095ea7b3, "approve(address spender,uint256 amount)" },
+    { 0x18cbafe5, "swapExactTokensForETH(uint256 amountIn,uint256 amountOutMin,address[] path,address to,uint256 deadline)" },
+    { 0x23b872dd, "transferFrom(address from,address to,uint256 amount)" },
+    { 0x24856bc3, "execute(bytes commands,bytes[] inputs)" },
+    { 0x2e1a7d4d, "withdraw(uint256 amount)" },
+    { 0x2eb2c2d6, "safeBatchTransferFrom(address from,address to,uint256[] ids,uint256[] amounts,bytes data)" },
+    { 0x3593564c, "execute(bytes commands,bytes[] inputs,uint256 deadline)" },
+    { 0x38ed1739, "swapExactTokensForTokens(uint256 amountIn,uint256 amountOutMin,address[] path,address to,uint256 deadline)" },
+    { 0x39509351, "increaseAllowance(address spender,uint256 addedValue)" },
+    { 0x3ff9dcb1, "invalidateUnorderedNonces(uint256 wordPos,uint256 mask)" },
+    { 0x42842e0e, "safeTransferFrom(address from,address to,uint256 tokenId)" },
+    { 0x4a25d94a, "swapTokensForExactETH(uint256 amountOut,uint256 amountInMax,address[] path,address to,uint256 deadline)" },
+    { 0x5ae401dc, "multicall(uint256 deadline,bytes[] data)" },
+    { 0x65d9723c, "invalidateNonces(address token,address spender,uint48 newNonce)" },
+    { 0x7ff36ab5, "swapExactETHForTokens(uint256 amountOutMin,address[] path,address to,uint256 deadline)" },
+    { 0x87517c45, "approve(address token,address spender,uint160 amount,uint48 expiration)" },
+    { 0x8803dbee, "swapTokensForExactTokens(uint256 amountOut,uint256 amountInMax,address[] path,address to,uint256 deadline)" },
+    { 0xa22cb465, "setApprovalForAll(address operator,bool approved)" },
+    { 0xa457c2d7, "decreaseAllowance(address spender,uint256 subtractedValue)" },
+    { 0xa9059cbb, "transfer(address to,uint256 amount)" },
+    { 0xac9650d8, "multicall(bytes[] data)" },
+    { 0xb88d4fde, "safeTransferFrom(address from,address to,uint256 tokenId,bytes data)" },
+    { 0xc47f0027, "setName(string name)" },
+    { 0xd0e30db0, "deposit()" },
+    { 0xd505accf, "permit(address owner,address spender,uint256 value,uint256 deadline,uint8 v,bytes32 r,bytes32 s)" },
+    { 0xf242432a, "safeTransferFrom(address from,address to,uint256 id,uint256 amount,bytes data)" },
+    { 0xfb3bdb41, "swapETHForExactTokens(uint256 amountOut,address[] path,address to,uint256 deadline)" },
+};
+
+#endif /* __ABI_SELECTORS_H__ */
@@ -0,0 +1,438 @@
+#include <string.h>
+
+#include "firefly-abi.h"
+
+#include "firefly-address.h"
+
+
+typedef struct AbiSelector {
+    uint32_t selector;
+    const char *signature;
+} AbiSelector;
+
+// Generated; see tools/generate-selectors.py
+#include "abi-selectors.h"
+
+
+///////////////////////////////
+// Output - utils
+
+typedef struct Output {
+    char *data;
+    size_t offset;
+    size_t length;
+} Output;
+
+static void appendChars(Output *output, const char *data, size_t length) {
+    if (output->length == 0) { return; }
+
+    // Always leave room for the NULL-termination
+    size_t remaining = output->length - 1 - output->offset;
+    if (length > remaining) { length = remaining; }
+
+    memmove(&output->data[output->offset], data, length);
+    output->offset += length;
+    output->data[output->offset] = 0;
+}
+
+static void appendString(Output *output, const char *data) {
+    appendChars(output, data, strlen(data));
+}
+
+static void appendHex(Output *output, uint8_t *data, size_t length) {
+    const char * const HexNibbles = "0123456789abcdef";
+
+    appendString(output, "0x");
+    for (int i = 0; i < length; i++) {
+        char hex[2] = {
+            HexNibbles[data[i] >> 4], HexNibbles[data[i] & 0xf]
+        };
+        appendChars(output, hex, 2);
+    }
+}
+
+// Appends the 32-byte big-endian %%value%% in base-10.
+static void appendDecimal(Output *output, const uint8_t *value) {
+    uint8_t v[FFX_ABI_WORD_LENGTH];
+    memmove(v, value, FFX_ABI_WORD_LENGTH);
+
+    // Digits are generated in reverse; 78 digits fits any 256-bit value
+    char digits[78];
+    size_t count = 0;
+
+    size_t start = 0;
+    while (start < FFX_ABI_WORD_LENGTH && v[start] == 0) { start++; }
+
+    while (start < FFX_ABI_WORD_LENGTH) {
+        uint32_t remainder = 0;
+        for (int i = start; i < FFX_ABI_WORD_LENGTH; i++) {
+            uint32_t current = (remainder << 8) | v[i];
+            v[i] = current / 10;
+            remainder = current % 10;
+        }
+        digits[count++] = '0' + remainder;
+
+        while (start < FFX_ABI_WORD_LENGTH && v[start] == 0) { start++; }
+    }
+
+    if (count == 0) { digits[count++] = '0'; }
+
+    for (int i = count - 1; i >= 0; i--) {
+        appendChars(output, &digits[i], 1);
+    }
+}
+
+
+///////////////////////////////
+// Decoding - utils
+
+static bool isZero(uint8_t *data, size_t length) {
+    for (int i = 0; i < length; i++) {
+        if (data[i]) { return false; }
+    }
+    return true;
+}
+
+// Parses an unsigned decimal from %%text%% of %%length%%, returning
+// 0 if it is not a number.
+static size_t parseSize(const char *text, size_t length) {
+    if (length == 0 || length > 3) { return 0; }
+
+    size_t value = 0;
+    for (int i = 0; i < length; i++) {
+        if (text[i] < '0' || text[i] > '9') { return 0; }
+        value = (value * 10) + (text[i] - '0');
+    }
+
+    return value;
+}
+
+static FfxAbiType getType(const char *type, size_t length, size_t *size) {
+    *size = 0;
+
+    // Dynamic arrays; only the count is exposed, so the elements may
+    // be dynamic too (e.g. the bytes[] of multicall), in which case the
+    // element words are their offsets
+    if (length > 2 && type[length - 2] == '[' && type[length - 1] == ']') {
+        FfxAbiType elementType = getType(type, length - 2, size);
+        if (elementType == FfxAbiTypeUnsupported) {
+            return FfxAbiTypeUnsupported;
+        }
+        return FfxAbiTypeArray;
+    }
+
+    if (length == 7 && strncmp(type, "address", 7) == 0) {
+        *size = 160;
+        return FfxAbiTypeAddress;
+    }
+
+    if (length == 4 && strncmp(type, "bool", 4) == 0) {
+        return FfxAbiTypeBool;
+    }
+
+    if (length == 6 && strncmp(type, "string", 6) == 0) {
+        return FfxAbiTypeString;
+    }
+
+    if (length == 5 && strncmp(type, "bytes", 5) == 0) {
+        return FfxAbiTypeBytes;
+    }
+
+    if (length > 5 && strncmp(type, "bytes", 5) == 0) {
+        *size = parseSize(&type[5], length - 5);
+        if (*size == 0 || *size > 32) { return FfxAbiTypeUnsupported; }
+        return FfxAbiTypeFixedBytes;
+    }
+
+    if (length >= 4 && strncmp(type, "uint", 4) == 0) {
+        *size = (length == 4) ? 256: parseSize(&type[4], length - 4);
+        if (*size == 0 || *size > 256 || (*size % 8)) {
+            return FfxAbiTypeUnsupported;
+        }
+        return FfxAbiTypeUint;
+    }
+
+    if (length >= 3 && strncmp(type, "int", 3) == 0) {
+        *size = (length == 3) ? 256: parseSize(&type[3], length - 3);
+        if (*size == 0 || *size > 256 || (*size % 8)) {
+            return FfxAbiTypeUnsupported;
+        }
+        return FfxAbiTypeInt;
+    }
+
+    return FfxAbiTypeUnsupported;
+}
+
+// Reads a word as an offset or length, which must fit in the calldata.
+static FfxAbiStatus readLength(FfxAbiCursor *cursor, size_t offset,
+  size_t *value) {
+
+    if (offset + FFX_ABI_WORD_LENGTH > cursor->length) {
+        return FfxAbiStatusBufferOverrun;
+    }
+
+    uint8_t *word = &cursor->data[offset];
+    if (!isZero(word, FFX_ABI_WORD_LENGTH - 4)) { return FfxAbiStatusBadData; }
+
+    *value = ((size_t)word[28] << 24) | (word[29] << 16) | (word[30] << 8) |
+      word[31];
+
+    if (*value > cursor->length) { return FfxAbiStatusBufferOverrun; }
+
+    return FfxAbiStatusOK;
+}
+
+
+///////////////////////////////
+// API
+
+const char* ffx_abi_lookupSelector(uint32_t selector) {
+    size_t lo = 0, hi = sizeof(abiSelectors) / sizeof(abiSelectors[0]);
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        uint32_t value = abiSelectors[mid].selector;
+        if (value == selector) { return abiSelectors[mid].signature; }
+        if (value < selector) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+FfxAbiStatus ffx_abi_init(FfxAbiCursor *cursor, uint8_t *data,
+  size_t length) {
+
+    memset(cursor, 0, sizeof(FfxAbiCursor));
+
+    if (length < FFX_ABI_SELECTOR_LENGTH) { return FfxAbiStatusBufferOverrun; }
+
+    cursor->data = &data[FFX_ABI_SELECTOR_LENGTH];
+    cursor->length = length - FFX_ABI_SELECTOR_LENGTH;
+    cursor->selector = ((uint32_t)data[0] << 24) | (data[1] << 16) |
+      (data[2] << 8) | data[3];
+
+    cursor->signature = ffx_abi_lookupSelector(cursor->selector);
+    if (cursor->signature == NULL) { return FfxAbiStatusNotFound; }
+
+    // Skip the function name
+    const char *paren = strchr(cursor->signature, '(');
+    cursor->offset = paren - cursor->signature + 1;
+
+    return FfxAbiStatusOK;
+}
+
+FfxAbiStatus ffx_abi_nextParam(FfxAbiCursor *cursor, FfxAbiParam *param) {
+    memset(param, 0, sizeof(FfxAbiParam));
+
+    if (cursor->signature == NULL) { return FfxAbiStatusNotFound; }
+
+    // Parse the next "type name" from the signature
+    const char *type = &cursor->signature[cursor->offset];
+    if (type[0] == ')') { return FfxAbiStatusNotFound; }
+
+    size_t typeLength = strcspn(type, " ,)");
+    size_t next = typeLength;
+    if (type[next] == ' ') {
+        param->name = &type[next + 1];
+        param->nameLength = strcspn(param->name, ",)");
+        next += 1 + param->nameLength;
+    }
+    if (type[next] == ',') { next++; }
+
+    param->type = getType(type, typeLength, &param->size);
+    if (param->type == FfxAbiTypeUnsupported) {
+        return FfxAbiStatusUnsupportedType;
+    }
+
+    size_t head = cursor->index * FFX_ABI_WORD_LENGTH;
+    if (head + FFX_ABI_WORD_LENGTH > cursor->length) {
+        return FfxAbiStatusBufferOverrun;
+    }
+
+    uint8_t *word = &cursor->data[head];
+
+    switch (param->type) {
+        case FfxAbiTypeAddress:
+            if (!isZero(word, 12)) { return FfxAbiStatusBadData; }
+            param->data = &word[12];
+            param->length = 20;
+            break;
+
+        case FfxAbiTypeBool:
+            if (!isZero(word, 31) || word[31] > 1) {
+                return FfxAbiStatusBadData;
+            }
+            param->data = &word[31];
+            param->length = 1;
+            break;
+
+        case FfxAbiTypeUint:
+            if (!isZero(word, FFX_ABI_WORD_LENGTH - param->size / 8)) {
+                return FfxAbiStatusBadData;
+            }
+            param->data = word;
+            param->length = FFX_ABI_WORD_LENGTH;
+            break;
+
+        case FfxAbiTypeInt:
+            param->data = word;
+            param->length = FFX_ABI_WORD_LENGTH;
+            break;
+
+        case FfxAbiTypeFixedBytes:
+            if (!isZero(&word[param->size], FFX_ABI_WORD_LENGTH - param->size)) {
+                return FfxAbiStatusBadData;
+            }
+            param->data = word;
+            param->length = param->size;
+            break;
+
+        case FfxAbiTypeBytes: case FfxAbiTypeString: case FfxAbiTypeArray: {
+            size_t offset = 0, count = 0;
+            FfxAbiStatus status = readLength(cursor, head, &offset);
+            if (status) { return status; }
+
+            status = readLength(cursor, offset, &count);
+            if (status) { return status; }
+
+            size_t start = offset + FFX_ABI_WORD_LENGTH;
+            size_t size = count;
+            if (param->type == FfxAbiTypeArray) {
+                size = count * FFX_ABI_WORD_LENGTH;
+            }
+            if (start + size > cursor->length) {
+                return FfxAbiStatusBufferOverrun;
+            }
+
+            param->data = &cursor->data[start];
+            param->length = count;
+            break;
+        }
+
+        default:
+            return FfxAbiStatusUnsupportedType;
+    }
+
+    cursor->offset += next;
+    cursor->index++;
+
+    return FfxAbiStatusOK;
+}
+
+size_t ffx_abi_formatParam(FfxAbiParam *param, char *_output, size_t length) {
+    Output output = { .data = _output, .length = length };
+    if (length) { _output[0] = 0; }
+
+    switch (param->type) {
+        case FfxAbiTypeAddress: {
+            char address[FFX_ADDRESS_STRING_LENGTH] = { 0 };
+            ffx_eth_checksumAddress(param->data, address);
+            appendString(&output, address);
+            break;
+        }
+
+        case FfxAbiTypeBool:
+            appendString(&output, param->data[0] ? "true": "false");
+            break;
+
+        case FfxAbiTypeUint:
+            appendDecimal(&output, param->data);
+            break;
+
+        case FfxAbiTypeInt:
+            if (param->data[0] & 0x80) {
+                // Two's complement to get the magnitude
+                uint8_t value[FFX_ABI_WORD_LENGTH];
+                uint32_t carry = 1;
+                for (int i = FFX_ABI_WORD_LENGTH - 1; i >= 0; i--) {
+                    carry += (uint8_t)~param->data[i];
+                    value[i] = carry;
+                    carry >>= 8;
+                }
+                appendString(&output, "-");
+                appendDecimal(&output, value);
+            } else {
+                appendDecimal(&output, param->data);
+            }
+            break;
+
+        case FfxAbiTypeFixedBytes: case FfxAbiTypeBytes:
+            appendHex(&output, param->data, param->length);
+            break;
+
+        case FfxAbiTypeString:
+            for (int i = 0; i < param->length; i++) {
+                char c = param->data[i];
+                if (c < 32 || c >= 127) { c = '?'; }
+                appendChars(&output, &c, 1);
+            }
+            break;
+
+        case FfxAbiTypeArray: {
+            char count[16];
+            size_t offset = sizeof(count);
+            size_t value = param->length;
+            do {
+                count[--offset] = '0' + (value % 10);
+                value /= 10;
+            } while (value);
+
+            appendString(&output, "[");
+            appendChars(&output, &count[offset], sizeof(count) - offset);
+            appendString(&output, param->length == 1 ? " item]": " items]");
+            break;
+        }
+
+        default:
+            appendString(&output, "?");
+            break;
+    }
+
+    return output.offset;
+}
+
+size_t ffx_abi_formatCall(FfxAbiCursor *_cursor, char *_output,
+  size_t length) {
+
+    Output output = { .data = _output, .length = length };
+    if (length) { _output[0] = 0; }
+
+    if (_cursor->signature == NULL) { return 0; }
+
+    // Do not advance the caller's cursor
+    FfxAbiCursor cursor;
+    memmove(&cursor, _cursor, sizeof(FfxAbiCursor));
+
+    appendChars(&output, cursor.signature, cursor.offset);
+
+    FfxAbiParam param;
+    FfxAbiStatus status = ffx_abi_nextParam(&cursor, &param);
+    while (status == FfxAbiStatusOK) {
+        if (cursor.index > 1) { appendString(&output, ", "); }
+
+        if (param.nameLength) {
+            appendChars(&output, param.name, param.nameLength);
+            appendString(&output, ": ");
+        }
+
+        if (output.offset + 1 < output.length) {
+            output.offset += ffx_abi_formatParam(&param,
+              &output.data[output.offset], output.length - output.offset);
+        }
+
+        status = ffx_abi_nextParam(&cursor, &param);
+    }
+
+    if (status != FfxAbiStatusNotFound) {
+        if (length) { _output[0] = 0; }
+        return 0;
+    }
+
+    appendString(&output, ")");
+
+    return output.offset;
+}
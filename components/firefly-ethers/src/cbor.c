@@ -523,13 +523,20 @@ void ffx_cbor_dump(FfxCborCursor *cursor) {
 ///////////////////////////////
 // Builder - utils
 
+// Records the first failed append, so a builder which overflowed can
+// be detected after any number of appends
+static FfxCborStatus _fail(FfxCborBuilder *builder, FfxCborStatus status) {
+    if (builder->status == FfxCborStatusOK) { builder->status = status; }
+    return status;
+}
+
 static FfxCborStatus _appendHeader(FfxCborBuilder *builder, FfxCborType type,
   uint64_t value) {
 
     size_t remaining = builder->length - builder->offset;
 
     if (value < 23) {
-        if (remaining < 1) { return FfxCborStatusBufferOverrun; }
+        if (remaining < 1) { return _fail(builder, FfxCborStatusBufferOverrun); }
         builder->data[builder->offset++] = (type << 5) | value;
         return FfxCborStatusOK;
     }
@@ -548,7 +555,7 @@ static FfxCborStatus _appendHeader(FfxCborBuilder *builder, FfxCborType type,
     uint8_t count = counts[inset];
     inset = 8 - (1 << (count - 24));
 
-    if (remaining < 1 + (8 - inset)) { return FfxCborStatusBufferOverrun; }
+    if (remaining < 1 + (8 - inset)) { return _fail(builder, FfxCborStatusBufferOverrun); }
 
     size_t offset = builder->offset;
     builder->data[offset++] = (type << 5) | count;
@@ -568,6 +575,12 @@ void ffx_cbor_build(FfxCborBuilder *builder, uint8_t *data, size_t length) {
     builder->data = data;
     builder->length = length;
     builder->offset = 0;
+    builder->sparse = false;
+    builder->status = FfxCborStatusOK;
+}
+
+FfxCborStatus ffx_cbor_getBuildStatus(FfxCborBuilder *builder) {
+    return builder->status;
 }
 
 size_t ffx_cbor_getBuildLength(FfxCborBuilder *builder) {
@@ -576,7 +589,7 @@ size_t ffx_cbor_getBuildLength(FfxCborBuilder *builder) {
 
 FfxCborStatus ffx_cbor_appendBoolean(FfxCborBuilder *builder, bool value) {
     size_t remaining = builder->length - builder->offset;
-    if (remaining < 1) { return FfxCborStatusBufferOverrun; }
+    if (remaining < 1) { return _fail(builder, FfxCborStatusBufferOverrun); }
     size_t offset = builder->offset;
     builder->data[offset++] = (7 << 5) | (value ? 21: 20);
     builder->offset = offset;
@@ -585,7 +598,7 @@ FfxCborStatus ffx_cbor_appendBoolean(FfxCborBuilder *builder, bool value) {
 
 FfxCborStatus ffx_cbor_appendNull(FfxCborBuilder *builder) {
     size_t remaining = builder->length - builder->offset;
-    if (remaining < 1) { return FfxCborStatusBufferOverrun; }
+    if (remaining < 1) { return _fail(builder, FfxCborStatusBufferOverrun); }
     size_t offset = builder->offset;
     builder->data[offset++] = (7 << 5) | 22;
     builder->offset = offset;
@@ -597,11 +610,17 @@ FfxCborStatus ffx_cbor_appendNumber(FfxCborBuilder *builder, uint64_t value) {
 }
 
 FfxCborStatus ffx_cbor_appendData(FfxCborBuilder *builder, uint8_t *data, size_t length) {
+    size_t offset = builder->offset;
+
     FfxCborStatus status = _appendHeader(builder, 2, length);
     if (status) { return status; }
 
+    // Never leave a header without its data
     size_t remaining = builder->length - builder->offset;
-    if (remaining < length) { return FfxCborStatusBufferOverrun; }
+    if (remaining < length) {
+        builder->offset = offset;
+        return _fail(builder, FfxCborStatusBufferOverrun);
+    }
 
     memmove(&builder->data[builder->offset], data, length);
     builder->offset += length;
@@ -612,11 +631,17 @@ FfxCborStatus ffx_cbor_appendData(FfxCborBuilder *builder, uint8_t *data, size_t
 FfxCborStatus ffx_cbor_appendString(FfxCborBuilder *builder, char* str) {
     size_t length = strlen(str);
 
+    size_t offset = builder->offset;
+
     FfxCborStatus status = _appendHeader(builder, 3, length);
     if (status) { return status; }
 
+    // Never leave a header without its data
     size_t remaining = builder->length - builder->offset;
-    if (remaining < length) { return FfxCborStatusBufferOverrun; }
+    if (remaining < length) {
+        builder->offset = offset;
+        return _fail(builder, FfxCborStatusBufferOverrun);
+    }
 
     memmove(&builder->data[builder->offset], str, length);
     builder->offset += length;
@@ -634,7 +659,7 @@ FfxCborStatus ffx_cbor_appendMap(FfxCborBuilder *builder, size_t count) {
 
 FfxCborStatus ffx_cbor_appendArrayMutable(FfxCborBuilder *builder, FfxCborBuilderTag *tag) {
     size_t remaining = builder->length - builder->offset;
-    if (remaining < 3) { return FfxCborStatusBufferOverrun; }
+    if (remaining < 3) { return _fail(builder, FfxCborStatusBufferOverrun); }
 
     builder->data[builder->offset++] = (4 << 5) | 25;
 
@@ -648,7 +673,7 @@ FfxCborStatus ffx_cbor_appendArrayMutable(FfxCborBuilder *builder, FfxCborBuilde
 
 FfxCborStatus ffx_cbor_appendMapMutable(FfxCborBuilder *builder, FfxCborBuilderTag *tag) {
     size_t remaining = builder->length - builder->offset;
-    if (remaining < 3) { return FfxCborStatusBufferOverrun; }
+    if (remaining < 3) { return _fail(builder, FfxCborStatusBufferOverrun); }
 
     builder->data[builder->offset++] = (5 << 5) | 25;
 
@@ -670,7 +695,9 @@ FfxCborStatus ffx_cbor_appendCborRaw(FfxCborBuilder *builder, uint8_t *data,
   size_t length) {
 
     size_t remaining = builder->length - builder->offset;
-    if (remaining < length) { return FfxCborStatusBufferOverrun; }
+    if (remaining < length) {
+        return _fail(builder, FfxCborStatusBufferOverrun);
+    }
 
     size_t offset = builder->offset;
     memmove(&builder->data[offset], data, length);
@@ -1846,6 +1846,10 @@ bool ffx_pk_computeSharedSecretSecp256k1(uint8_t *privkey,
       uECC_secp256k1());
 }
 
+bool ffx_pk_isValidPubkeySecp256k1(uint8_t *pubkey) {
+    return uECC_valid_public_key(pubkey, uECC_secp256k1());
+}
+
 
 bool ffx_pk_signP256(uint8_t *privkey, uint8_t *digest,
   uint8_t *signature) {
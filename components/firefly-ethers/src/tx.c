@@ -1,3 +1,21 @@
+/**
+ *  Transaction serialization
+ *
+ *  Each supported EIP-2718 Envelope is described by a table of its
+ *  fields, which are read from a CBOR map (keyed by the JSON-RPC
+ *  names) and written as RLP.
+ *
+ *  Serialization is performed in two passes:
+ *    - the prepare pass locates and validates every field, exposing
+ *      its payload within the CBOR data and tallying the RLP length
+ *    - the write pass streams the RLP headers and payloads to either
+ *      a buffer or a Keccak256 context (or both)
+ *
+ *  Since all lengths are known before anything is written, no
+ *  intermediate RLP needs to be compacted and the CBOR data is never
+ *  copied when hashing.
+ */
+
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -5,122 +23,703 @@
 #include "firefly-tx.h"
 
 #include "firefly-cbor.h"
-#include "firefly-rlp.h"
+#include "firefly-hash.h"
+
+
+#define TAG_ARRAY         (0xc0)
+#define TAG_DATA          (0x80)
+
+// The most fields any Envelope has (EIP-1559)
+#define MAX_FIELDS        (9)
+
+#define ADDRESS_LENGTH    (20)
+#define STORAGE_LENGTH    (32)
+
+
+typedef enum Format {
+    FormatData = 0,
+    FormatNumber,
+    FormatAddress,
+    FormatNullableAddress,
+
+    // A non-zero number (i.e. EIP-155 replay protection)
+    FormatChainId,
 
+    // An empty Data, with no corresponding key (i.e. the EIP-155
+    // placeholders for r and s)
+    FormatEmpty,
 
+    // An EIP-2930 access list
+    FormatAccessList,
+} Format;
+
+typedef struct FieldDesc {
+    Format format;
+    const char *key;
+} FieldDesc;
+
+typedef struct Envelope {
+    FfxTxType type;
+    size_t count;
+    FieldDesc fields[MAX_FIELDS];
+} Envelope;
+
+static const Envelope envelopes[] = { {
+    // Legacy; with EIP-155 replay protection folded in
+    .type = FfxTxTypeLegacy,
+    .count = 9,
+    .fields = {
+        { FormatNumber, "nonce" },
+        { FormatNumber, "gasPrice" },
+        { FormatNumber, "gasLimit" },
+        { FormatNullableAddress, "to" },
+        { FormatNumber, "value" },
+        { FormatData, "data" },
+        { FormatChainId, "chainId" },
+        { FormatEmpty, NULL },
+        { FormatEmpty, NULL },
+    }
+}, {
+    // EIP-2930
+    .type = FfxTxTypeAccessList,
+    .count = 8,
+    .fields = {
+        { FormatNumber, "chainId" },
+        { FormatNumber, "nonce" },
+        { FormatNumber, "gasPrice" },
+        { FormatNumber, "gasLimit" },
+        { FormatNullableAddress, "to" },
+        { FormatNumber, "value" },
+        { FormatData, "data" },
+        { FormatAccessList, "accessList" },
+    }
+}, {
+    // EIP-1559
+    .type = FfxTxTypeFeeMarket,
+    .count = 9,
+    .fields = {
+        { FormatNumber, "chainId" },
+        { FormatNumber, "nonce" },
+        { FormatNumber, "maxPriorityFeePerGas" },
+        { FormatNumber, "maxFeePerGas" },
+        { FormatNumber, "gasLimit" },
+        { FormatNullableAddress, "to" },
+        { FormatNumber, "value" },
+        { FormatData, "data" },
+        { FormatAccessList, "accessList" },
+    }
+} };
+
+/**
+ *  A Field references its payload within the source CBOR data, so
+ *  it can be streamed without first being materialized as RLP.
+ *
+ *  For an access list, %%data%% is unused and %%length%% is the
+ *  length of its RLP payload.
+ */
+typedef struct Field {
+    uint8_t *data;
+    size_t length;
+} Field;
+
+typedef struct Tx {
+    const Envelope *envelope;
+    Field fields[MAX_FIELDS];
+
+    // The access list (if any) is re-crawled during the write pass
+    FfxCborCursor accessList;
+
+    // The length of the outer RLP list payload
+    size_t length;
+} Tx;
+
+/**
+ *  The output of the write pass. If %%data%% is non-NULL the RLP is
+ *  written to it and if %%hash%% is non-NULL the RLP is hashed.
+ */
 typedef struct TxBuilder {
     uint8_t *data;
     size_t offset;
     size_t length;
+
+    FfxKeccak256Context *hash;
 } TxBuilder;
 
 
-static FfxTxStatus mungeStatus(FfxRlpStatus status) {
-    switch(status) {
-        case FfxRlpStatusOK:
-            return FfxTxStatusOK;
-        case FfxRlpStatusBufferOverrun:
-            return FfxTxStatusBufferOverrun;
-        case FfxRlpStatusOverflow:
-            return FfxTxStatusOverflow;
+///////////////////////////////
+// RLP utils
+
+static size_t getByteCount(size_t value) {
+    if (value < 0x100) { return 1; }
+    if (value < 0x10000) { return 2; }
+    if (value < 0x1000000) { return 3; }
+    return 4;
+}
+
+// Writes the RLP header for a Data or Array with a payload of
+// %%length%% bytes, returning the header length (at most 5 bytes).
+static size_t encodeHeader(uint8_t *header, uint8_t tag, size_t length) {
+    if (length <= 55) {
+        header[0] = tag + length;
+        return 1;
     }
 
-    return FfxTxStatusBadData;
+    size_t byteCount = getByteCount(length);
+    header[0] = tag + 55 + byteCount;
+    for (int i = 0; i < byteCount; i++) {
+        header[1 + i] = length >> (8 * (byteCount - 1 - i));
+    }
+
+    return 1 + byteCount;
 }
 
-typedef enum Format {
-    FormatData = 0,
-    FormatNumber,
-    FormatAddress,
-    FormatNullableAddress,
-} Format;
+static size_t getHeaderLength(size_t length) {
+    if (length <= 55) { return 1; }
+    return 1 + getByteCount(length);
+}
+
+// The length of an RLP-encoded Data, including its header.
+static size_t getDataLength(uint8_t *data, size_t length) {
+    if (length == 1 && data[0] <= 127) { return 1; }
+    return getHeaderLength(length) + length;
+}
+
+
+///////////////////////////////
+// Prepare pass
+
+// Locates the %%key%% in the %%tx%% and validates it against %%format%%,
+// exposing the underlying CBOR data (without copying). A missing key
+// is treated as empty data.
+static FfxTxStatus getField(FfxCborCursor *tx, Format format,
+  const char* key, uint8_t **data, size_t *length) {
 
-static FfxTxStatus append(FfxRlpBuilder *rlp, Format format, FfxCborCursor *tx,
-  const char* key) {
+    *data = NULL;
+    *length = 0;
+
+    if (format == FormatEmpty) { return FfxTxStatusOK; }
 
     FfxCborCursor value;
     ffx_cbor_clone(&value, tx);
 
     FfxCborStatus status = ffx_cbor_followKey(&value, key);
     if (status == FfxCborStatusNotFound) {
-        return mungeStatus(ffx_rlp_appendData(rlp, NULL, 0));
+        if (format == FormatChainId) { return FfxTxStatusBadData; }
+        return FfxTxStatusOK;
     }
 
     if (status || ffx_cbor_getType(&value) != FfxCborTypeData) {
         return FfxTxStatusBadData;
     }
 
-    size_t length = 0;
-    uint8_t *data = NULL;
-    status = ffx_cbor_getData(&value, &data, &length);
+    status = ffx_cbor_getData(&value, data, length);
     if (status) { return FfxTxStatusBadData; }
 
     // Consume any leading 0 bytes
-    if (format == FormatNumber) {
-        while (length) {
-            if (data[0]) { break; }
-            data++;
-            length--;
+    if (format == FormatNumber || format == FormatChainId) {
+        while (*length) {
+            if ((*data)[0]) { break; }
+            (*data)++;
+            (*length)--;
+        }
+        if (*length > 32) { return FfxTxStatusOverflow; }
+        if (format == FormatChainId && *length == 0) {
+            return FfxTxStatusBadData;
         }
-        if (length > 32) { return FfxTxStatusOverflow; }
 
     } else if (format == FormatAddress) {
-        if (length != 20) { return FfxTxStatusBadData; }
+        if (*length != ADDRESS_LENGTH) { return FfxTxStatusBadData; }
 
     } else if (format == FormatNullableAddress) {
-        if (length != 0 && length != 20) { return FfxTxStatusBadData; }
+        if (*length != 0 && *length != ADDRESS_LENGTH) {
+            return FfxTxStatusBadData;
+        }
     }
 
-    return mungeStatus(ffx_rlp_appendData(rlp, data, length));
+    return FfxTxStatusOK;
 }
 
-FfxTxStatus ffx_tx_serializeUnsigned(FfxCborCursor *tx, uint8_t *data, size_t *_length) {
-    size_t length = *_length;
+// Exposes the Data for %%key%% in the access list %%entry%%, which
+// must be exactly %%length%% bytes.
+static FfxTxStatus getEntryData(FfxCborCursor *entry, const char *key,
+  uint8_t **data, size_t length) {
 
-    if (length < 1) { return FfxTxStatusBufferOverrun; }
+    FfxCborCursor value;
+    ffx_cbor_clone(&value, entry);
 
-    // Add the EIP-2718 Envelope Type
-    data[0] = 2;
+    FfxCborStatus status = ffx_cbor_followKey(&value, key);
+    if (status || ffx_cbor_getType(&value) != FfxCborTypeData) {
+        return FfxTxStatusBadData;
+    }
 
-    // Skip the Envelope Type
-    FfxRlpBuilder rlp = { 0 };
-    ffx_rlp_build(&rlp, &data[1], length - 1);
+    size_t actual = 0;
+    status = ffx_cbor_getData(&value, data, &actual);
+    if (status || actual != length) { return FfxTxStatusBadData; }
 
-    // @TODO: for non-1559: FfxTxStatusUnsupportedVersion,
+    return FfxTxStatusOK;
+}
 
-    FfxRlpStatus rlpStatus = ffx_rlp_appendArray(&rlp, 9);
-    if (rlpStatus) { return mungeStatus(rlpStatus); }
+// Moves %%entry%% to the storageKeys of an access list entry and
+// returns the number of keys.
+static FfxTxStatus getStorageKeys(FfxCborCursor *entry, size_t *count) {
+    *count = 0;
 
-    FfxTxStatus status = FfxTxStatusOK;
+    FfxCborStatus status = ffx_cbor_followKey(entry, "storageKeys");
+    if (status == FfxCborStatusNotFound) { return FfxTxStatusOK; }
+    if (status || ffx_cbor_getType(entry) != FfxCborTypeArray) {
+        return FfxTxStatusBadData;
+    }
 
-    status = append(&rlp, FormatNumber, tx, "chainId");
-    if (status) { return status; }
+    status = ffx_cbor_getLength(entry, count);
+    if (status) { return FfxTxStatusBadData; }
 
-    status = append(&rlp, FormatNumber, tx, "nonce");
-    if (status) { return status; }
+    return FfxTxStatusOK;
+}
 
-    status = append(&rlp, FormatNumber, tx, "maxPriorityFeePerGas");
-    if (status) { return status; }
+// The RLP payload length of an access list entry with %%count%% keys;
+// [ address, [ storageKey, ... ] ]
+static size_t getEntryLength(size_t count) {
+    size_t keysLength = count * (1 + STORAGE_LENGTH);
+    return (1 + ADDRESS_LENGTH) + getHeaderLength(keysLength) + keysLength;
+}
 
-    status = append(&rlp, FormatNumber, tx, "maxFeePerGas");
-    if (status) { return status; }
+// Validates the access list, which is an Array of Maps with the
+// keys address and storageKeys, computing its RLP payload length.
+static FfxTxStatus prepareAccessList(FfxCborCursor *accessList,
+  size_t *length) {
+
+    *length = 0;
+
+    if (ffx_cbor_getType(accessList) != FfxCborTypeArray) {
+        return FfxTxStatusBadData;
+    }
+
+    FfxCborCursor entry;
+    ffx_cbor_clone(&entry, accessList);
+
+    FfxCborStatus status = ffx_cbor_firstValue(&entry, NULL);
+    while (status == FfxCborStatusOK) {
+        if (ffx_cbor_getType(&entry) != FfxCborTypeMap) {
+            return FfxTxStatusBadData;
+        }
+
+        uint8_t *data = NULL;
+        FfxTxStatus txStatus = getEntryData(&entry, "address", &data,
+          ADDRESS_LENGTH);
+        if (txStatus) { return txStatus; }
+
+        FfxCborCursor keys;
+        ffx_cbor_clone(&keys, &entry);
+
+        size_t count = 0;
+        txStatus = getStorageKeys(&keys, &count);
+        if (txStatus) { return txStatus; }
+
+        if (count) {
+            FfxCborCursor key;
+            ffx_cbor_clone(&key, &keys);
+
+            FfxCborStatus keyStatus = ffx_cbor_firstValue(&key, NULL);
+            while (keyStatus == FfxCborStatusOK) {
+                if (ffx_cbor_getType(&key) != FfxCborTypeData) {
+                    return FfxTxStatusBadData;
+                }
+
+                size_t keyLength = 0;
+                keyStatus = ffx_cbor_getData(&key, &data, &keyLength);
+                if (keyStatus || keyLength != STORAGE_LENGTH) {
+                    return FfxTxStatusBadData;
+                }
+
+                keyStatus = ffx_cbor_nextValue(&key, NULL);
+            }
+            if (keyStatus != FfxCborStatusNotFound) {
+                return FfxTxStatusBadData;
+            }
+        }
+
+        size_t entryLength = getEntryLength(count);
+        *length += getHeaderLength(entryLength) + entryLength;
+
+        status = ffx_cbor_nextValue(&entry, NULL);
+    }
+
+    if (status != FfxCborStatusNotFound) { return FfxTxStatusBadData; }
+
+    return FfxTxStatusOK;
+}
+
+// Determines the Envelope from the type key, or if absent, from the
+// fields present (i.e. gasPrice indicates a pre-EIP-1559 transaction).
+static FfxTxStatus getEnvelope(FfxCborCursor *tx, const Envelope **envelope) {
+    *envelope = NULL;
+
+    FfxTxType type = FfxTxTypeFeeMarket;
+
+    FfxCborCursor value;
+    ffx_cbor_clone(&value, tx);
+
+    FfxCborStatus status = ffx_cbor_followKey(&value, "type");
+    if (status == FfxCborStatusOK) {
+        uint64_t v = 0;
+        if (ffx_cbor_getType(&value) != FfxCborTypeNumber ||
+          ffx_cbor_getValue(&value, &v)) {
+            return FfxTxStatusBadData;
+        }
+        type = v;
+
+    } else if (status == FfxCborStatusNotFound) {
+        ffx_cbor_clone(&value, tx);
+        if (ffx_cbor_followKey(&value, "gasPrice") == FfxCborStatusOK) {
+            ffx_cbor_clone(&value, tx);
+            if (ffx_cbor_followKey(&value, "accessList") == FfxCborStatusOK) {
+                type = FfxTxTypeAccessList;
+            } else {
+                type = FfxTxTypeLegacy;
+            }
+        }
 
-    status = append(&rlp, FormatNumber, tx, "gasLimit");
+    } else {
+        return FfxTxStatusBadData;
+    }
+
+    for (int i = 0; i < sizeof(envelopes) / sizeof(envelopes[0]); i++) {
+        if (envelopes[i].type == type) {
+            *envelope = &envelopes[i];
+            return FfxTxStatusOK;
+        }
+    }
+
+    return FfxTxStatusUnsupportedVersion;
+}
+
+static FfxTxStatus prepare(Tx *result, FfxCborCursor *tx) {
+    memset(result, 0, sizeof(Tx));
+
+    if (ffx_cbor_getType(tx) != FfxCborTypeMap) { return FfxTxStatusBadData; }
+
+    FfxTxStatus status = getEnvelope(tx, &result->envelope);
     if (status) { return status; }
 
-    status = append(&rlp, FormatNullableAddress, tx, "to");
+    const Envelope *envelope = result->envelope;
+
+    for (int i = 0; i < envelope->count; i++) {
+        const FieldDesc *desc = &envelope->fields[i];
+        Field *field = &result->fields[i];
+
+        if (desc->format == FormatAccessList) {
+            // Missing access lists are empty
+            ffx_cbor_clone(&result->accessList, tx);
+            FfxCborStatus cborStatus = ffx_cbor_followKey(&result->accessList,
+              desc->key);
+
+            if (cborStatus == FfxCborStatusOK) {
+                status = prepareAccessList(&result->accessList,
+                  &field->length);
+                if (status) { return status; }
+            } else if (cborStatus != FfxCborStatusNotFound) {
+                return FfxTxStatusBadData;
+            }
+
+            result->length += getHeaderLength(field->length) + field->length;
+            continue;
+        }
+
+        status = getField(tx, desc->format, desc->key, &field->data,
+          &field->length);
+        if (status) { return status; }
+
+        result->length += getDataLength(field->data, field->length);
+    }
+
+    return FfxTxStatusOK;
+}
+
+// The length of the serialized unsigned transaction.
+static size_t getLength(Tx *tx) {
+    size_t length = getHeaderLength(tx->length) + tx->length;
+    if (tx->envelope->type != FfxTxTypeLegacy) { length++; }
+    return length;
+}
+
+
+///////////////////////////////
+// Write pass
+
+static void writeBytes(TxBuilder *builder, const uint8_t *data,
+  size_t length) {
+
+    if (builder->data) {
+        memmove(&builder->data[builder->offset], data, length);
+    }
+    if (builder->hash) {
+        ffx_hash_updateKeccak256(builder->hash, data, length);
+    }
+    builder->offset += length;
+}
+
+static void writeHeader(TxBuilder *builder, uint8_t tag, size_t length) {
+    uint8_t header[5];
+    writeBytes(builder, header, encodeHeader(header, tag, length));
+}
+
+static void writeData(TxBuilder *builder, uint8_t *data, size_t length) {
+    if (length == 1 && data[0] <= 127) {
+        writeBytes(builder, data, 1);
+        return;
+    }
+
+    writeHeader(builder, TAG_DATA, length);
+    writeBytes(builder, data, length);
+}
+
+// The access list was validated during prepare, so each value is
+// known to be present and well-formed.
+static void writeAccessList(TxBuilder *builder, FfxCborCursor *accessList,
+  size_t length) {
+
+    writeHeader(builder, TAG_ARRAY, length);
+    if (length == 0) { return; }
+
+    FfxCborCursor entry;
+    ffx_cbor_clone(&entry, accessList);
+
+    FfxCborStatus status = ffx_cbor_firstValue(&entry, NULL);
+    while (status == FfxCborStatusOK) {
+        uint8_t *data = NULL;
+        getEntryData(&entry, "address", &data, ADDRESS_LENGTH);
+
+        FfxCborCursor key;
+        ffx_cbor_clone(&key, &entry);
+
+        size_t count = 0;
+        getStorageKeys(&key, &count);
+
+        writeHeader(builder, TAG_ARRAY, getEntryLength(count));
+        writeData(builder, data, ADDRESS_LENGTH);
+        writeHeader(builder, TAG_ARRAY, count * (1 + STORAGE_LENGTH));
+
+        FfxCborStatus keyStatus = count ? ffx_cbor_firstValue(&key, NULL):
+          FfxCborStatusNotFound;
+        while (keyStatus == FfxCborStatusOK) {
+            size_t keyLength = 0;
+            ffx_cbor_getData(&key, &data, &keyLength);
+            writeData(builder, data, keyLength);
+            keyStatus = ffx_cbor_nextValue(&key, NULL);
+        }
+
+        status = ffx_cbor_nextValue(&entry, NULL);
+    }
+}
+
+static void writeTx(TxBuilder *builder, Tx *tx) {
+    const Envelope *envelope = tx->envelope;
+
+    // Add the EIP-2718 Envelope Type
+    if (envelope->type != FfxTxTypeLegacy) {
+        uint8_t type = envelope->type;
+        writeBytes(builder, &type, 1);
+    }
+
+    writeHeader(builder, TAG_ARRAY, tx->length);
+
+    for (int i = 0; i < envelope->count; i++) {
+        Field *field = &tx->fields[i];
+        if (envelope->fields[i].format == FormatAccessList) {
+            writeAccessList(builder, &tx->accessList, field->length);
+        } else {
+            writeData(builder, field->data, field->length);
+        }
+    }
+}
+
+
+///////////////////////////////
+// Signing
+
+// Decodes the RLP header at %%data%%, which must be fully contained
+// within %%length%% bytes.
+static FfxTxStatus decodeHeader(uint8_t *data, size_t length,
+  size_t *headerLength, size_t *payloadLength) {
+
+    if (length < 1) { return FfxTxStatusBadData; }
+
+    uint8_t v = data[0];
+
+    if (v <= 127) {
+        *headerLength = 0;
+        *payloadLength = 1;
+        return FfxTxStatusOK;
+    }
+
+    v &= 0x3f;
+    if (v <= 55) {
+        *headerLength = 1;
+        *payloadLength = v;
+
+    } else {
+        v -= 55;
+        if (v > 4 || length < 1 + v) { return FfxTxStatusOverflow; }
+
+        size_t value = 0;
+        for (int i = 0; i < v; i++) { value = (value << 8) | data[1 + i]; }
+
+        *headerLength = 1 + v;
+        *payloadLength = value;
+    }
+
+    if (length - *headerLength < *payloadLength) { return FfxTxStatusBadData; }
+
+    return FfxTxStatusOK;
+}
+
+// Appends the minimally-encoded big-endian %%data%% as an RLP Data,
+// returning the number of bytes written.
+static size_t appendNumber(uint8_t *output, uint8_t *data, size_t length) {
+    while (length && data[0] == 0) {
+        data++;
+        length--;
+    }
+
+    TxBuilder builder = { .data = output };
+    writeData(&builder, data, length);
+    return builder.offset;
+}
+
+///////////////////////////////
+// API
+
+FfxTxStatus ffx_tx_serializeUnsigned(FfxCborCursor *tx, uint8_t *data, size_t *_length) {
+    Tx prepared;
+    FfxTxStatus status = prepare(&prepared, tx);
     if (status) { return status; }
 
-    status = append(&rlp, FormatNumber, tx, "value");
+    size_t length = getLength(&prepared);
+    if (length > *_length) {
+        *_length = length;
+        return FfxTxStatusBufferOverrun;
+    }
+
+    TxBuilder builder = { .data = data, .length = length };
+    writeTx(&builder, &prepared);
+
+    *_length = builder.offset;
+
+    return FfxTxStatusOK;
+}
+
+FfxTxStatus ffx_tx_hashUnsigned(FfxCborCursor *tx, uint8_t *digest) {
+    Tx prepared;
+    FfxTxStatus status = prepare(&prepared, tx);
     if (status) { return status; }
 
-    status = append(&rlp, FormatData, tx, "data");
+    FfxKeccak256Context ctx;
+    ffx_hash_initKeccak256(&ctx);
+
+    TxBuilder builder = { .hash = &ctx };
+    writeTx(&builder, &prepared);
+
+    ffx_hash_finalKeccak256(&ctx, digest);
+
+    return FfxTxStatusOK;
+}
+
+FfxTxStatus ffx_tx_serializeSigned(uint8_t *data, size_t *_length,
+  size_t maxLength, uint8_t *signature) {
+
+    size_t length = *_length;
+    if (length < 1) { return FfxTxStatusBadData; }
+
+    // Typed transactions begin with the EIP-2718 Envelope Type
+    bool legacy = (data[0] >= TAG_ARRAY);
+    size_t offset = legacy ? 0: 1;
+
+    size_t headerLength = 0, payloadLength = 0;
+    FfxTxStatus status = decodeHeader(&data[offset], length - offset,
+      &headerLength, &payloadLength);
     if (status) { return status; }
 
-    rlpStatus = ffx_rlp_appendArray(&rlp, 0);
-    if (rlpStatus) { return mungeStatus(rlpStatus); }
+    size_t payloadOffset = offset + headerLength;
+    if (data[offset] < TAG_ARRAY || payloadOffset + payloadLength != length) {
+        return FfxTxStatusBadData;
+    }
+
+    uint8_t yParity = signature[64];
+    if (yParity >= 27) { yParity -= 27; }
+    if (yParity > 1) { return FfxTxStatusBadData; }
+
+    // The new trailing fields; the longest is (v, r, s) for a legacy
+    // transaction with a 7-byte chainId
+    uint8_t tail[9 + 33 + 33];
+    size_t tailLength = 0;
+
+    // The end of the unsigned body to keep
+    size_t bodyEnd = length;
+
+    if (legacy) {
+        // Skip to the EIP-155 (chainId, 0, 0), which are replaced by
+        // (v, r, s) where v = chainId * 2 + 35 + yParity
+        size_t itemOffset = payloadOffset;
+        for (int i = 0; i < 6; i++) {
+            size_t itemHeader = 0, itemPayload = 0;
+            status = decodeHeader(&data[itemOffset], length - itemOffset,
+              &itemHeader, &itemPayload);
+            if (status) { return status; }
+            itemOffset += itemHeader + itemPayload;
+        }
+        bodyEnd = itemOffset;
+
+        size_t itemHeader = 0, itemPayload = 0;
+        status = decodeHeader(&data[itemOffset], length - itemOffset,
+          &itemHeader, &itemPayload);
+        if (status) { return status; }
+
+        // The chainId, r and s placeholders must end the payload
+        if (itemOffset + itemHeader + itemPayload + 2 != length ||
+          data[length - 2] != TAG_DATA || data[length - 1] != TAG_DATA) {
+            return FfxTxStatusBadData;
+        }
+
+        if (itemPayload > 7) { return FfxTxStatusOverflow; }
+
+        uint64_t chainId = 0;
+        for (int i = 0; i < itemPayload; i++) {
+            chainId = (chainId << 8) | data[itemOffset + itemHeader + i];
+        }
+
+        uint64_t v = chainId * 2 + 35 + yParity;
+
+        uint8_t value[8];
+        for (int i = 0; i < 8; i++) { value[i] = v >> (8 * (7 - i)); }
+        tailLength += appendNumber(&tail[tailLength], value, 8);
+
+    } else {
+        tailLength += appendNumber(&tail[tailLength], &yParity, 1);
+    }
+
+    tailLength += appendNumber(&tail[tailLength], &signature[0], 32);
+    tailLength += appendNumber(&tail[tailLength], &signature[32], 32);
+
+    // Patch the outer list header, shifting the body if its length
+    // crossed a header size boundary
+    size_t bodyLength = bodyEnd - payloadOffset;
+    uint8_t header[5];
+    size_t newHeaderLength = encodeHeader(header, TAG_ARRAY,
+      bodyLength + tailLength);
+
+    size_t signedLength = offset + newHeaderLength + bodyLength + tailLength;
+    if (signedLength > maxLength) { return FfxTxStatusBufferOverrun; }
+
+    if (newHeaderLength != headerLength) {
+        memmove(&data[offset + newHeaderLength], &data[payloadOffset],
+          bodyLength);
+    }
+    memmove(&data[offset], header, newHeaderLength);
+
+    // Append the signature
+    memmove(&data[offset + newHeaderLength + bodyLength], tail, tailLength);
 
-    *_length = ffx_rlp_finalize(&rlp) + 1;
+    *_length = signedLength;
 
     return FfxTxStatusOK;
 }
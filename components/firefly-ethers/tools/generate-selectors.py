@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+
+# Generates the sorted ABI selector table (see src/abi.c) from a list
+# of function signatures.
+#
+# Usage: generate-selectors.py selectors.txt > ../src/abi-selectors.h
+
+import re
+import sys
+
+
+# Keccak256 (the pre-NIST padding, so hashlib.sha3_256 cannot be used)
+
+RC = [
+    0x0000000000000001, 0x0000000000008082, 0x800000000000808a,
+    0x8000000080008000, 0x000000000000808b, 0x0000000080000001,
+    0x8000000080008081, 0x8000000000008009, 0x000000000000008a,
+    0x0000000000000088, 0x0000000080008009, 0x000000008000000a,
+    0x000000008000808b, 0x800000000000008b, 0x8000000000008089,
+    0x8000000000008003, 0x8000000000008002, 0x8000000000000080,
+    0x000000000000800a, 0x800000008000000a, 0x8000000080008081,
+    0x8000000000008080, 0x0000000080000001, 0x8000000080008008,
+]
+
+ROT = [
+    [0, 36, 3, 41, 18], [1, 44, 10, 45, 2], [62, 6, 43, 15, 61],
+    [28, 55, 25, 21, 56], [27, 20, 39, 8, 14],
+]
+
+MASK = (1 << 64) - 1
+
+def rotl(v, n):
+    return ((v << n) | (v >> (64 - n))) & MASK if n else v
+
+def permute(A):
+    for rc in RC:
+        C = [A[x][0] ^ A[x][1] ^ A[x][2] ^ A[x][3] ^ A[x][4] for x in range(5)]
+        D = [C[(x - 1) % 5] ^ rotl(C[(x + 1) % 5], 1) for x in range(5)]
+        A = [[A[x][y] ^ D[x] for y in range(5)] for x in range(5)]
+        B = [[0] * 5 for _ in range(5)]
+        for x in range(5):
+            for y in range(5):
+                B[y][(2 * x + 3 * y) % 5] = rotl(A[x][y], ROT[x][y])
+        A = [[B[x][y] ^ ((~B[(x + 1) % 5][y]) & B[(x + 2) % 5][y])
+          for y in range(5)] for x in range(5)]
+        A[0][0] ^= rc
+    return A
+
+def keccak256(data):
+    rate = 136
+    data = bytearray(data) + b'\x01'
+    data += b'\x00' * (-len(data) % rate)
+    data[-1] |= 0x80
+    A = [[0] * 5 for _ in range(5)]
+    for offset in range(0, len(data), rate):
+        block = data[offset:offset + rate]
+        for i in range(rate // 8):
+            A[i % 5][i // 5] ^= int.from_bytes(block[8 * i: 8 * i + 8], 'little')
+        A = permute(A)
+    return b''.join(A[i % 5][i // 5].to_bytes(8, 'little') for i in range(4))
+
+
+def parse(line):
+    match = re.match(r'^\s*([A-Za-z_][A-Za-z0-9_]*)\((.*)\)\s*$', line)
+    if not match:
+        raise ValueError('invalid signature: %s' % line)
+
+    name, params = match.groups()
+
+    types, display = [], []
+    for param in [p.strip() for p in params.split(',') if p.strip()]:
+        parts = param.split()
+        types.append(parts[0])
+        display.append(' '.join(parts))
+
+    canonical = '%s(%s)' % (name, ','.join(types))
+    return (canonical, '%s(%s)' % (name, ','.join(display)))
+
+
+def main(path):
+    entries = { }
+    for line in open(path):
+        line = line.split('#')[0].strip()
+        if not line: continue
+
+        canonical, display = parse(line)
+        selector = keccak256(canonical.encode())[:4].hex()
+        if selector in entries and entries[selector] != display:
+            raise ValueError('selector collision: %s' % canonical)
+        entries[selector] = display
+
+    print('// Generated by tools/generate-selectors.py; do not modify')
+    print('#ifndef __ABI_SELECTORS_H__')
+    print('#define __ABI_SELECTORS_H__')
+    print('')
+    print('#include <stdint.h>')
+    print('')
+    print('// Sorted by selector, for binary search')
+    print('static const AbiSelector abiSelectors[] = {')
+    for selector in sorted(entries):
+        print('    { 0x%s, "%s" },' % (selector, entries[selector]))
+    print('};')
+    print('')
+    print('#endif /* __ABI_SELECTORS_H__ */')
+
+
+if __name__ == '__main__':
+    main(sys.argv[1])
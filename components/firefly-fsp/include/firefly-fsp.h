@@ -0,0 +1,504 @@
+#ifndef __FIREFLY_FSP_H__
+#define __FIREFLY_FSP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "firefly-aead.h"
+#include "firefly-cbor.h"
+#include "firefly-crypto.h"
+#include "firefly-hash.h"
+#include "firefly-lz.h"
+
+
+/**
+ *  Firefly Serial Protocol (FSP)
+ *
+ *  A host uploads a message (a 32 byte SHA-256 checksum followed by a
+ *  CBOR request) as a series of frames, and the device replies the
+ *  same way. This library implements the framing and message state
+ *  machine independent of the link, which is provided by a transport
+ *  (BLE, a serial port, a socket, etc.).
+ *
+ *  A transport delivers each incoming frame to ffx_fsp_receive (or a
+ *  byte stream to ffx_fsp_receiveStream) and calls ffx_fsp_pump from
+ *  its own task whenever woken, which sends any pending reply.
+ *
+ *  Completed uploads are handed back to the transport (see received),
+ *  which should verify and decode them with ffx_fsp_processMessage
+ *  off the receive path.
+ *
+ *  A message may also be a batch; an array of requests, which are
+ *  dispatched one at a time, in order, and answered with a single
+ *  array of replies (in the same order). The replies are collected in
+ *  the buffer after the requests, so together they must fit within
+ *  FFX_FSP_MESSAGE_CAPACITY.
+ *
+ *  A host may begin a session (see ffx_fsp_setIdentity), after which
+ *  every message is encrypted and authenticated on the wire.
+ */
+
+
+// The largest CBOR request or reply
+#define FFX_FSP_MAX_MESSAGE_SIZE    (1 << 14)
+
+// The largest frame (a BLE attribute is at most 512 bytes)
+#define FFX_FSP_MAX_FRAME_SIZE      (1024)
+
+// The number of messages which may be in flight at once (e.g. one
+// uploading, one processing and one replying)
+#define FFX_FSP_POOL_SIZE           (4)
+
+// The buffer capacity required for the largest message, including
+// the checksum and reply envelope
+#define FFX_FSP_MESSAGE_CAPACITY    (FFX_FSP_MAX_MESSAGE_SIZE + 128)
+
+// Message buffers are carved from an arena of fixed blocks, so the
+// pool depth only costs the slot metadata
+#define FFX_FSP_BLOCK_SIZE          (512)
+
+// The arena size required to hold a single message of any size; an
+// arena of twice this allows an upload while a reply is being sent
+#define FFX_FSP_MESSAGE_ARENA_SIZE  (FFX_FSP_BLOCK_SIZE * \
+                                      ((FFX_FSP_MESSAGE_CAPACITY + \
+                                      FFX_FSP_BLOCK_SIZE - 1) / \
+                                      FFX_FSP_BLOCK_SIZE))
+
+#define FFX_FSP_MAX_ARENA_BLOCKS    (2 * FFX_FSP_MESSAGE_ARENA_SIZE / \
+                                      FFX_FSP_BLOCK_SIZE)
+
+#define FFX_FSP_METHOD_LENGTH       (32)
+
+// The most requests a batch may contain
+#define FFX_FSP_MAX_BATCH           (16)
+
+// The number of outstanding retransmit ranges a host may request
+#define FFX_FSP_MAX_RETRANSMITS     (8)
+
+// The stream frame header (see ffx_fsp_encodeStreamHeader)
+#define FFX_FSP_STREAM_HEADER       (4)
+
+// A session resumption ticket (see CMD_RESUME)
+#define FFX_FSP_TICKET_LENGTH       (16)
+
+// The number of sessions a host may resume without a new handshake
+#define FFX_FSP_MAX_TICKETS         (4)
+
+// How long after its handshake a session may be resumed (in ms)
+#define FFX_FSP_TICKET_LIFETIME     (12 * 60 * 60 * 1000)
+
+
+typedef enum FfxFspMessageState {
+    // Slot is free; no data
+    FfxFspMessageStateReady     = 0,
+
+    // Receiving data; data = rx
+    FfxFspMessageStateReceiving,
+
+    // Received data; data = rx
+    FfxFspMessageStateReceived,
+
+    // Processing data; data = rx
+    FfxFspMessageStateProcessing,
+
+    // Reply complete, waiting for any earlier replies to be sent;
+    // data = tx
+    FfxFspMessageStateQueued,
+
+    // Sending data; data = tx
+    FfxFspMessageStateSending,
+
+    // All data sent, but retained until the host acknowledges it (with
+    // CMD_ACK or CMD_RESET), so any lost ranges can be retransmitted;
+    // data = tx
+    FfxFspMessageStateSent
+} FfxFspMessageState;
+
+/**
+ *  A message slot.
+ *
+ *  This should not be modified directly! Only use the provided API.
+ *  Once processed, the %%messageId%%, %%method%% and %%params%% may
+ *  be read.
+ */
+typedef struct FfxFspMessage {
+    FfxFspMessageState state;
+
+    // Unique id for each message (across all instances)
+    uint32_t messageId;
+
+    // An ID to reply with
+    uint32_t replyId;
+
+    FfxCborCursor message;
+    char method[FFX_FSP_METHOD_LENGTH];
+    FfxCborCursor params;
+
+    // The buffer, allocated from the arena (NULL if Ready)
+    uint8_t *data;
+    size_t capacity;
+
+    // Next expected offset for an incoming message, or the next offset
+    // to send for a reply
+    size_t offset;
+
+    // Total expected message size
+    size_t length;
+
+    // The payload (following the checksum) is LZ compressed on the
+    // wire (see CMD_START_COMPRESSED)
+    bool compressed;
+
+    // The uncompressed message size (equal to length unless compressed)
+    size_t rawLength;
+
+    // The number of (uncompressed) bytes of an incoming message in data
+    size_t filled;
+
+    FfxLzDecoder decoder;
+
+    // The running checksum of an incoming message, updated as each
+    // chunk arrives (chunks always arrive in order)
+    FfxSha256Context checksum;
+
+    // Offset of the result slot of a borrowed reply builder (relative
+    // to the CBOR data)
+    size_t replyOffset;
+
+    // Replies are sent in the order they are completed
+    uint32_t sequence;
+
+    // For a batch, the number of requests and the index of the one
+    // being dispatched (whose id is the messageId), otherwise 0
+    size_t batchCount;
+    size_t batchIndex;
+
+    // The request being dispatched, within the batch
+    FfxCborCursor batchRequest;
+
+    // Where the replies of a batch are collected (following the
+    // requests in the same buffer), and the length of their CBOR so far
+    uint8_t *batchReply;
+    size_t batchLength;
+
+    // The message is encrypted on the wire (within a session), using
+    // its sequence number as the nonce, and followed by its tag
+    bool sealed;
+    uint32_t counter;
+
+    // The session a sealed reply was built in
+    uint32_t epoch;
+
+    // How much of a sealed reply has been encrypted; each chunk is
+    // encrypted as it is first sent
+    size_t sealedOffset;
+
+    // The tag of an incoming sealed message, and whether it matched
+    uint8_t tag[FFX_AEAD_TAG_LENGTH];
+    bool authentic;
+} FfxFspMessage;
+
+/**
+ *  The link a protocol instance runs over. All callbacks (except
+ *  random) are required.
+ */
+typedef struct FfxFspTransport {
+    void *context;
+
+    // Sends a single frame, returning 0 on success. A non-zero result
+    // (e.g. out of buffers) is retried on the next pump.
+    int (*send)(void *context, const uint8_t *data, size_t length);
+
+    // Requests ffx_fsp_pump be called soon, on the transport task
+    void (*wake)(void *context);
+
+    // A message has been uploaded, and should be passed to
+    // ffx_fsp_processMessage off the receive path. For a batch, this
+    // is called again for each further request once the previous one
+    // has been replied to (on the replying task).
+    void (*received)(void *context, FfxFspMessage *message);
+
+    // Guards the shared state for very short periods; must not block
+    void (*lock)(void *context);
+    void (*unlock)(void *context);
+
+    // A monotonic clock (in ms)
+    uint32_t (*now)(void *context);
+
+    // Fills %%data%% with secure random bytes; only required if the
+    // device has an identity (see ffx_fsp_setIdentity)
+    void (*random)(void *context, uint8_t *data, size_t length);
+
+    // The link applies its own back-pressure (e.g. a blocking write),
+    // so replies are not limited by credits granted by the host
+    bool flowControlled;
+} FfxFspTransport;
+
+/**
+ *  A session which may be resumed (see CMD_RESUME).
+ */
+typedef struct FfxFspTicket {
+    uint8_t ticket[FFX_FSP_TICKET_LENGTH];
+    uint8_t secret[32];
+
+    // When the session was first established (resuming does not
+    // extend its lifetime)
+    uint32_t issued;
+    bool valid;
+} FfxFspTicket;
+
+typedef struct FfxFspRange {
+    uint16_t offset;
+    uint16_t length;
+} FfxFspRange;
+
+/**
+ *  A protocol instance, for a single link.
+ *
+ *  This should not be modified directly! Only use the provided API.
+ */
+typedef struct FfxFsp {
+    FfxFspTransport transport;
+
+    uint32_t state;
+
+    uint32_t modelNumber;
+    uint32_t serialNumber;
+
+    // The largest frame the transport can carry
+    size_t frameSize;
+
+    // The number of frames the host is prepared to receive (see
+    // CMD_CREDIT)
+    int32_t credits;
+
+    // Ranges of a sent message the host has requested again, which take
+    // priority over new data (see CMD_RETRANSMIT)
+    FfxFspRange retransmits[FFX_FSP_MAX_RETRANSMITS];
+    size_t retransmitCount;
+
+    // When the last chunk of a message was sent (see
+    // FfxFspMessageStateSent)
+    uint32_t sentTime;
+
+    // The host has acknowledged the sent message; it is released by
+    // the transport task, which owns the sending message
+    bool acknowledged;
+
+    FfxFspMessage messages[FFX_FSP_POOL_SIZE];
+
+    // The message being uploaded by the host (only one at a time, as
+    // chunks are not tagged with a message)
+    FfxFspMessage *receiving;
+
+    // The reply being sent to the host (owned by the transport task)
+    FfxFspMessage *sending;
+
+    uint32_t nextSequence;
+
+    uint8_t *arena;
+    size_t arenaBlocks;
+
+    // The message owning each arena block (as its index + 1), or 0 if
+    // free
+    uint8_t arenaOwner[FFX_FSP_MAX_ARENA_BLOCKS];
+
+    // The outgoing chunk being built by the transport task
+    uint8_t frame[FFX_FSP_MAX_FRAME_SIZE];
+
+    // The device session key (see ffx_fsp_setIdentity)
+    bool hasIdentity;
+    bool sessionRequired;
+    uint8_t privkey[FFX_PRIVKEY_LENGTH];
+    uint8_t pubkey[FFX_COMP_PUBKEY_LENGTH];
+
+    // The keys of the current session (one for each direction) and
+    // the last sequence number used in each direction
+    uint8_t hostKey[FFX_AEAD_KEY_LENGTH];
+    uint8_t deviceKey[FFX_AEAD_KEY_LENGTH];
+    uint32_t hostCounter;
+    uint32_t deviceCounter;
+
+    // Advanced whenever a session begins or ends, so a reply sealed
+    // in an earlier session is dropped rather than sent
+    uint32_t epoch;
+
+    // A handshake waiting for the transport task, which performs the
+    // ECDH off the receive path (the host key and nonce)
+    bool helloPending;
+    uint8_t hello[FFX_COMP_PUBKEY_LENGTH + 16];
+
+    FfxFspTicket tickets[FFX_FSP_MAX_TICKETS];
+
+    // The ciphers of the message being received (on the receive
+    // context) and of the reply being sent (on the transport task)
+    FfxAead rxCipher;
+    FfxAead txCipher;
+
+    // The compressor workspace, used by one reply at a time (a reply
+    // which finds it in use is sent uncompressed)
+    uint16_t lzTable[FFX_LZ_TABLE_SIZE];
+    bool lzBusy;
+} FfxFsp;
+
+/**
+ *  Reassembles frames from a byte stream (see ffx_fsp_receiveStream).
+ */
+typedef struct FfxFspStream {
+    uint8_t frame[FFX_FSP_MAX_FRAME_SIZE];
+    size_t length;
+    size_t offset;
+    uint8_t crc;
+    int state;
+} FfxFspStream;
+
+
+/**
+ *  Initializes %%fsp%% to run over %%transport%% (which is copied),
+ *  allocating messages from %%arena%% of %%arenaSize%% bytes, which
+ *  should be at least FFX_FSP_MESSAGE_ARENA_SIZE (any beyond twice
+ *  that is unused).
+ *
+ *  The %%modelNumber%% and %%serialNumber%% are reported to a host
+ *  which queries the device.
+ */
+void ffx_fsp_init(FfxFsp *fsp, const FfxFspTransport *transport,
+  uint32_t modelNumber, uint32_t serialNumber, uint8_t *arena,
+  size_t arenaSize);
+
+/**
+ *  Sets the largest frame the transport can currently carry, such as
+ *  when a BLE MTU is negotiated.
+ */
+void ffx_fsp_setFrameSize(FfxFsp *fsp, size_t frameSize);
+
+/**
+ *  The link was lost; forget any host-granted state (credits, opt-ins,
+ *  retransmit requests and the session) and abandon any partial
+ *  upload. The session may be resumed by the next host.
+ *
+ *  This must be called from the receive context.
+ */
+void ffx_fsp_reset(FfxFsp *fsp);
+
+/**
+ *  Enables sessions, authenticating the device with %%privkey%% (a
+ *  secp256k1 private key, which should persist so a host can pin its
+ *  public key). A host which begins a session (see CMD_HELLO) has
+ *  every message encrypted and authenticated; if %%required%%, a host
+ *  must do so before sending any message.
+ *
+ *  Returns false if %%privkey%% is NULL or invalid, or the transport
+ *  provides no random callback, in which case no session can begin;
+ *  if %%required%%, every message is then refused (with
+ *  ERROR_NO_SESSION), so a device whose key is unavailable fails
+ *  closed.
+ */
+bool ffx_fsp_setIdentity(FfxFsp *fsp, const uint8_t *privkey,
+  bool required);
+
+/**
+ *  Returns true if a session is in progress, so messages are sealed.
+ */
+bool ffx_fsp_isSealed(FfxFsp *fsp);
+
+/**
+ *  Returns true if the host has granted credits, so frames may be
+ *  sent without a link-layer acknowledgement (e.g. BLE notifications
+ *  rather than indications).
+ */
+bool ffx_fsp_isCredited(FfxFsp *fsp);
+
+/**
+ *  Returns true if a message is being received or a reply is waiting
+ *  to be (or being) sent, so the link should favour latency over
+ *  power. A message being processed (e.g. awaiting the user) is not
+ *  considered busy.
+ */
+bool ffx_fsp_isBusy(FfxFsp *fsp);
+
+/**
+ *  Handles an incoming %%frame%%, sending any response.
+ */
+void ffx_fsp_receive(FfxFsp *fsp, const uint8_t *frame, size_t length);
+
+/**
+ *  Handles incoming bytes of a stream, which may contain frames (see
+ *  ffx_fsp_encodeStreamHeader) split arbitrarily and interleaved with
+ *  other traffic (such as console logging), which is skipped.
+ */
+void ffx_fsp_receiveStream(FfxFsp *fsp, FfxFspStream *stream,
+  const uint8_t *data, size_t length);
+
+/**
+ *  Writes the header for a stream frame of %%length%% bytes to
+ *  %%header%% (FFX_FSP_STREAM_HEADER bytes) and returns the trailer
+ *  byte, which follows the frame.
+ */
+uint8_t ffx_fsp_encodeStreamHeader(uint8_t *header, const uint8_t *frame,
+  size_t length);
+
+/**
+ *  Verifies and decodes an uploaded %%message%%, returning true if it
+ *  is a valid request. Otherwise the message is released.
+ *
+ *  For a batch, this decodes the first valid request (any invalid ones
+ *  are answered with an error) and returns true immediately for each
+ *  subsequent request handed back to the transport.
+ */
+bool ffx_fsp_processMessage(FfxFsp *fsp, FfxFspMessage *message);
+
+/**
+ *  Sends as much of any pending reply as the link allows. This must
+ *  only be called from the transport task.
+ */
+void ffx_fsp_pump(FfxFsp *fsp);
+
+
+///////////////////////////////
+// Reply API
+
+/**
+ *  Claims the received message %%id%%, optionally setting %%params%%
+ *  to the request. Returns false if %%fsp%% has no such message.
+ */
+bool ffx_fsp_acceptMessage(FfxFsp *fsp, uint32_t id, FfxCborCursor *params);
+
+/**
+ *  Borrows the reply buffer for message %%id%%, setting %%result%% to
+ *  a builder for the result value. The request is released, so its
+ *  params must already have been consumed (except within a batch,
+ *  whose requests are retained until every one is replied to).
+ */
+bool ffx_fsp_beginReply(FfxFsp *fsp, uint32_t id, FfxCborBuilder *result);
+
+/**
+ *  Sends the reply built with %%result%% (from ffx_fsp_beginReply).
+ *  If any append to %%result%% failed (e.g. it did not fit) or nothing
+ *  was appended, the request is answered with an internal error
+ *  (32603) instead, and false is returned.
+ */
+bool ffx_fsp_commitReply(FfxFsp *fsp, uint32_t id, FfxCborBuilder *result);
+
+/**
+ *  Sends a copy of %%result%% as the reply to message %%id%%.
+ */
+bool ffx_fsp_sendReply(FfxFsp *fsp, uint32_t id, FfxCborBuilder *result);
+
+/**
+ *  Sends an error reply to message %%id%%.
+ */
+bool ffx_fsp_sendErrorReply(FfxFsp *fsp, uint32_t id, uint32_t code,
+  const char *message);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FIREFLY_FSP_H__ */
@@ -0,0 +1,2000 @@
+/**
+ *  Firefly Serial Protocol
+ *
+ *  The message state machine formerly within the BLE task. Frames are
+ *  handled on the receive context of the transport, replies are sent
+ *  by the transport task (see ffx_fsp_pump) and messages are verified
+ *  and decoded on whichever task the transport hands them to.
+ *
+ *  The message states and arena are shared by all of these (and any
+ *  panel replying), as are the credits, retransmit ranges and session
+ *  keys, so each is guarded by the transport lock.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "firefly-fsp.h"
+
+
+#define STATE_CREDITS           (1 << 0)
+
+// The host accepts compressed replies (see CMD_QUERY)
+#define STATE_COMPRESS          (1 << 1)
+
+// A session is in progress, so every message is sealed
+#define STATE_SESSION           (1 << 2)
+
+// The FSP header of a chunk (command and 16-bit length or offset)
+#define FSP_HEADER              (3)
+
+// The sequence number which follows the lengths in the first chunk of
+// a sealed message
+#define SEALED_HEADER           (4)
+
+// The random nonce each side contributes to a session
+#define NONCE_LENGTH            (16)
+
+#define TAG_LENGTH              (FFX_AEAD_TAG_LENGTH)
+
+// The smallest frame (a BLE notification with the default MTU)
+#define MIN_FRAME_SIZE          (20)
+
+// The maximum number of outstanding credits a host may grant
+#define MAX_CREDITS             (64)
+
+// How long a sent message is retained awaiting acknowledgement (in ms)
+#define SENT_TIMEOUT            (5000)
+
+// Replies shorter than this are not worth compressing
+#define MIN_COMPRESS_LENGTH     (128)
+
+// The room held back in a batch reply for each request yet to be
+// replied to, so an error reply always fits (see batchAvailable)
+#define BATCH_REPLY_RESERVE     (64)
+
+// Stream frames begin with a sync pattern, which never occurs in
+// console output (as 0xf5 is not valid ASCII or a UTF-8 lead byte)
+#define STREAM_SYNC0            (0xf5)
+#define STREAM_SYNC1            (0x50)
+
+typedef enum StreamState {
+    StreamStateSync0 = 0,
+    StreamStateSync1,
+    StreamStateLength0,
+    StreamStateLength1,
+    StreamStateFrame,
+    StreamStateCrc
+} StreamState;
+
+
+///////////////////////////////
+// Protocol Description
+
+#define CMD_QUERY                                   (0x03)
+#define CMD_RESET                                   (0x02)
+#define CMD_START_MESSAGE                           (0x06)
+#define CMD_CONTINUE_MESSAGE                        (0x07)
+#define CMD_CREDIT                                  (0x08)
+#define CMD_RETRANSMIT                              (0x09)
+#define CMD_ACK                                     (0x0a)
+#define CMD_START_COMPRESSED                        (0x0b)
+#define CMD_IDENTITY                                (0x0c)
+#define CMD_HELLO                                   (0x0d)
+#define CMD_RESUME                                  (0x0e)
+
+// CMD_QUERY flags from the host
+#define QUERY_FLAG_COMPRESS                         (1 << 0)
+
+// CMD_QUERY capabilities of the device
+#define CAPABILITY_CREDITS                          (1 << 0)
+#define CAPABILITY_RETRANSMIT                       (1 << 1)
+#define CAPABILITY_COMPRESS                         (1 << 2)
+#define CAPABILITIES                                (CAPABILITY_CREDITS | \
+                                                     CAPABILITY_RETRANSMIT | \
+                                                     CAPABILITY_COMPRESS)
+
+// Only offered once the device has an identity
+#define CAPABILITY_SESSION                          (1 << 3)
+
+#define STATUS_OK                                   (0x00)
+#define ERROR_BUSY                                  (0x91)
+#define ERROR_UNSUPPORTED_VERSION                   (0x81)
+#define ERROR_BAD_COMMAND                           (0x82)
+#define ERROR_BUFFER_OVERRUN                        (0x84)
+#define ERROR_MISSING_MESSAGE                       (0x85)
+#define ERROR_BAD_DATA                              (0x86)
+#define ERROR_NO_SESSION                            (0x87)
+#define ERROR_UNKNOWN                               (0x8f)
+
+// Internal value used to skip responding; must not collide with
+// any other STATUS_* or ERROR_*. The ERROR bit is clear.
+#define STATUS_SKIP                                  (0x7f)
+
+// Error reply codes (as in JSON-RPC)
+#define REPLY_INVALID_REQUEST                       (32600)
+#define REPLY_INTERNAL_ERROR                        (32603)
+
+
+// Shared by all instances, so a message id identifies its instance
+// (messages must be processed on a single task)
+static uint32_t nextMessageId = 1;
+
+
+///////////////////////////////
+// Transport
+
+static void lock(FfxFsp *fsp) {
+    fsp->transport.lock(fsp->transport.context);
+}
+
+static void unlock(FfxFsp *fsp) {
+    fsp->transport.unlock(fsp->transport.context);
+}
+
+static void wake(FfxFsp *fsp) {
+    fsp->transport.wake(fsp->transport.context);
+}
+
+static int sendFrame(FfxFsp *fsp, const uint8_t *data, size_t length) {
+    return fsp->transport.send(fsp->transport.context, data, length);
+}
+
+static uint32_t now(FfxFsp *fsp) {
+    return fsp->transport.now(fsp->transport.context);
+}
+
+static void fillRandom(FfxFsp *fsp, uint8_t *data, size_t length) {
+    fsp->transport.random(fsp->transport.context, data, length);
+}
+
+
+///////////////////////////////
+// Message Pool
+
+// The blocks of a buffer for the largest message
+#define MESSAGE_BLOCKS          (FFX_FSP_MESSAGE_ARENA_SIZE / \
+                                  FFX_FSP_BLOCK_SIZE)
+
+// Allocates a buffer for the largest message to %%message%%. Buffers
+// only begin on a multiple of that size, so releasing any one always
+// leaves room for another (the arena never fragments).
+static bool arenaAlloc(FfxFsp *fsp, FfxFspMessage *message) {
+    uint8_t owner = (message - fsp->messages) + 1;
+
+    bool found = false;
+
+    lock(fsp);
+
+    size_t start = 0;
+    for (; start + MESSAGE_BLOCKS <= fsp->arenaBlocks;
+      start += MESSAGE_BLOCKS) {
+        if (fsp->arenaOwner[start] == 0) {
+            memset(&fsp->arenaOwner[start], owner, MESSAGE_BLOCKS);
+            found = true;
+            break;
+        }
+    }
+
+    unlock(fsp);
+
+    if (!found) { return false; }
+
+    message->data = &fsp->arena[start * FFX_FSP_BLOCK_SIZE];
+    message->capacity = MESSAGE_BLOCKS * FFX_FSP_BLOCK_SIZE;
+
+    return true;
+}
+
+// Returns the buffer of %%message%% to the arena
+static void arenaFree(FfxFsp *fsp, FfxFspMessage *message) {
+    if (message->data == NULL) { return; }
+
+    size_t start = (message->data - fsp->arena) / FFX_FSP_BLOCK_SIZE;
+
+    lock(fsp);
+    memset(&fsp->arenaOwner[start], 0, MESSAGE_BLOCKS);
+    unlock(fsp);
+
+    message->data = NULL;
+    message->capacity = 0;
+}
+
+// Reserves a free message slot for an upload of %%length%% bytes. The
+// buffer always has room for the largest message, so the reply (which
+// is written in place of the request) never depends on what else is in
+// flight; if the arena cannot spare that, the upload must wait.
+static FfxFspMessage* acquireMessage(FfxFsp *fsp, size_t length) {
+    FfxFspMessage *message = NULL;
+
+    lock(fsp);
+    for (int i = 0; i < FFX_FSP_POOL_SIZE; i++) {
+        if (fsp->messages[i].state != FfxFspMessageStateReady) { continue; }
+        message = &fsp->messages[i];
+        message->state = FfxFspMessageStateReceiving;
+        break;
+    }
+    unlock(fsp);
+
+    if (message == NULL) { return NULL; }
+
+    if (!arenaAlloc(fsp, message)) {
+        message->state = FfxFspMessageStateReady;
+        return NULL;
+    }
+
+    message->offset = 0;
+    message->length = length;
+    message->rawLength = length;
+    message->filled = 0;
+    message->compressed = false;
+    ffx_hash_initSha256(&message->checksum);
+
+    return message;
+}
+
+// Appends the next (decrypted) chunk of an incoming %%message%%,
+// decompressing it if needed and hashing any of it beyond the leading
+// checksum.
+static FfxLzStatus appendPlain(FfxFspMessage *message, const uint8_t *data,
+  size_t length) {
+
+    size_t filled = message->filled;
+
+    if (message->compressed) {
+        // The checksum precedes the compressed payload, uncompressed
+        size_t count = 0;
+        if (filled < 32) {
+            count = 32 - filled;
+            if (count > length) { count = length; }
+            memcpy(&message->data[filled], data, count);
+            message->filled += count;
+        }
+
+        if (count < length) {
+            FfxLzStatus status = ffx_lz_decode(&message->decoder,
+              &data[count], length - count);
+            if (status) { return status; }
+
+            message->filled = 32 +
+              ffx_lz_getDecodedLength(&message->decoder);
+        }
+
+    } else {
+        memcpy(&message->data[filled], data, length);
+        message->filled += length;
+    }
+
+    // Hash any newly available bytes beyond the checksum (the tag
+    // authenticates a sealed message instead)
+    size_t start = (filled < 32) ? 32: filled;
+    if (!message->sealed && message->filled > start) {
+        ffx_hash_updateSha256(&message->checksum, &message->data[start],
+          message->filled - start);
+    }
+
+    return FfxLzStatusOK;
+}
+
+// Appends the next chunk of an incoming %%message%%. A sealed message
+// is decrypted (and authenticated) a block at a time as it arrives,
+// and its tag is checked once the last chunk arrives.
+static FfxLzStatus appendChunk(FfxFsp *fsp, FfxFspMessage *message,
+  const uint8_t *data, size_t length) {
+
+    if (!message->sealed) {
+        message->offset += length;
+        return appendPlain(message, data, length);
+    }
+
+    size_t cipherLength = message->length - TAG_LENGTH;
+
+    uint8_t block[64];
+    while (length) {
+        size_t offset = message->offset;
+
+        // The tag follows the ciphertext
+        if (offset >= cipherLength) {
+            memcpy(&message->tag[offset - cipherLength], data, length);
+            message->offset += length;
+            break;
+        }
+
+        size_t count = cipherLength - offset;
+        if (count > sizeof(block)) { count = sizeof(block); }
+        if (count > length) { count = length; }
+
+        ffx_aead_decrypt(&fsp->rxCipher, block, data, count);
+        message->offset += count;
+
+        FfxLzStatus status = appendPlain(message, block, count);
+        if (status) { return status; }
+
+        data += count;
+        length -= count;
+    }
+
+    if (message->offset == message->length) {
+        message->authentic = ffx_aead_verify(&fsp->rxCipher, message->tag);
+
+        // Only an authentic message advances the sequence, so a forged
+        // one cannot block the host
+        if (message->authentic) { fsp->hostCounter = message->counter; }
+    }
+
+    return FfxLzStatusOK;
+}
+
+// Returns the buffer to the arena and frees the slot
+static void releaseMessage(FfxFsp *fsp, FfxFspMessage *message) {
+    message->batchReply = NULL;
+    message->batchCount = 0;
+    message->batchIndex = 0;
+    message->batchLength = 0;
+
+    arenaFree(fsp, message);
+    message->messageId = 0;
+    message->replyId = 0;
+    message->offset = 0;
+    message->length = 0;
+    message->rawLength = 0;
+    message->filled = 0;
+    message->compressed = false;
+    message->sealed = false;
+    message->counter = 0;
+    message->sealedOffset = 0;
+    message->authentic = false;
+    message->state = FfxFspMessageStateReady;
+}
+
+static FfxFspMessage* findMessage(FfxFsp *fsp, uint32_t id,
+  FfxFspMessageState state) {
+
+    if (id == 0) { return NULL; }
+
+    for (int i = 0; i < FFX_FSP_POOL_SIZE; i++) {
+        FfxFspMessage *message = &fsp->messages[i];
+        if (message->messageId == id && message->state == state) {
+            return message;
+        }
+    }
+
+    return NULL;
+}
+
+// Takes the earliest completed reply, if any
+static FfxFspMessage* takeQueued(FfxFsp *fsp) {
+    FfxFspMessage *result = NULL;
+
+    lock(fsp);
+    for (int i = 0; i < FFX_FSP_POOL_SIZE; i++) {
+        FfxFspMessage *message = &fsp->messages[i];
+        if (message->state != FfxFspMessageStateQueued) { continue; }
+        if (result == NULL ||
+          (int32_t)(message->sequence - result->sequence) < 0) {
+            result = message;
+        }
+    }
+    unlock(fsp);
+
+    return result;
+}
+
+
+///////////////////////////////
+// Credits and Retransmits
+
+static void addCredits(FfxFsp *fsp, int32_t count) {
+    lock(fsp);
+    fsp->credits += count;
+    if (fsp->credits > MAX_CREDITS) { fsp->credits = MAX_CREDITS; }
+    unlock(fsp);
+}
+
+static bool takeCredit(FfxFsp *fsp) {
+    bool result = false;
+    lock(fsp);
+    if (fsp->credits > 0) {
+        fsp->credits--;
+        result = true;
+    }
+    unlock(fsp);
+    return result;
+}
+
+static bool addRetransmit(FfxFsp *fsp, uint16_t offset, uint16_t length) {
+    bool result = false;
+    lock(fsp);
+    if (fsp->retransmitCount < FFX_FSP_MAX_RETRANSMITS) {
+        fsp->retransmits[fsp->retransmitCount++] = (FfxFspRange){
+            .offset = offset, .length = length
+        };
+        result = true;
+    }
+    unlock(fsp);
+    return result;
+}
+
+// Gets the next range to retransmit, returning false if there are none
+static bool peekRetransmit(FfxFsp *fsp, FfxFspRange *range) {
+    bool result = false;
+    lock(fsp);
+    if (fsp->retransmitCount) {
+        *range = fsp->retransmits[0];
+        result = true;
+    }
+    unlock(fsp);
+    return result;
+}
+
+// Marks %%length%% bytes of the next retransmit range as sent
+static void consumeRetransmit(FfxFsp *fsp, size_t length) {
+    lock(fsp);
+    if (fsp->retransmitCount) {
+        FfxFspRange *range = &fsp->retransmits[0];
+        if (length < range->length) {
+            range->offset += length;
+            range->length -= length;
+        } else {
+            fsp->retransmitCount--;
+            memmove(&fsp->retransmits[0], &fsp->retransmits[1],
+              fsp->retransmitCount * sizeof(FfxFspRange));
+        }
+    }
+    unlock(fsp);
+}
+
+static void clearRetransmits(FfxFsp *fsp) {
+    lock(fsp);
+    fsp->retransmitCount = 0;
+    unlock(fsp);
+}
+
+
+///////////////////////////////
+// Sessions
+
+// A session is established with a single ECDH between an ephemeral
+// host key and the device key (which the host pins), so only the
+// device can derive the session keys; the host is authenticated by the
+// usual user approval. Resuming a session derives fresh keys from the
+// previous secret, which costs a few hashes rather than an ECDH.
+
+static void write32(uint8_t *data, uint32_t value) {
+    data[0] = value >> 24;
+    data[1] = value >> 16;
+    data[2] = value >> 8;
+    data[3] = value;
+}
+
+static uint32_t read32(const uint8_t *data) {
+    return ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) |
+      data[3];
+}
+
+// Writes HMAC-SHA256(%%key%%, %%label%% || %%data%%) to %%output%%
+static void derive(uint8_t *output, const uint8_t *key, const char *label,
+  const uint8_t *data, size_t length) {
+
+    uint8_t pad[64];
+    uint8_t inner[32];
+    FfxSha256Context ctx;
+
+    memset(pad, 0x36, sizeof(pad));
+    for (int i = 0; i < 32; i++) { pad[i] ^= key[i]; }
+
+    ffx_hash_initSha256(&ctx);
+    ffx_hash_updateSha256(&ctx, pad, sizeof(pad));
+    ffx_hash_updateSha256(&ctx, (const uint8_t*)label, strlen(label));
+    if (length) { ffx_hash_updateSha256(&ctx, data, length); }
+    ffx_hash_finalSha256(&ctx, inner);
+
+    memset(pad, 0x5c, sizeof(pad));
+    for (int i = 0; i < 32; i++) { pad[i] ^= key[i]; }
+
+    ffx_hash_initSha256(&ctx);
+    ffx_hash_updateSha256(&ctx, pad, sizeof(pad));
+    ffx_hash_updateSha256(&ctx, inner, sizeof(inner));
+    ffx_hash_finalSha256(&ctx, output);
+}
+
+// The nonce of the message with sequence number %%counter%%
+static void getNonce(uint8_t *nonce, uint32_t counter) {
+    memset(nonce, 0, FFX_AEAD_NONCE_LENGTH);
+    write32(&nonce[FFX_AEAD_NONCE_LENGTH - 4], counter);
+}
+
+// A session may only begin while no message is in flight, so every
+// message is sealed with the keys of the session it began in (a sent
+// message awaiting release is already sealed)
+static bool isIdle(FfxFsp *fsp) {
+    if (fsp->receiving) { return false; }
+
+    bool idle = !fsp->helloPending;
+
+    lock(fsp);
+    for (int i = 0; i < FFX_FSP_POOL_SIZE && idle; i++) {
+        FfxFspMessageState state = fsp->messages[i].state;
+        idle = (state == FfxFspMessageStateReady ||
+          state == FfxFspMessageStateSent);
+    }
+    unlock(fsp);
+
+    return idle;
+}
+
+// Returns the ticket for a new session, replacing the oldest
+static FfxFspTicket* allocTicket(FfxFsp *fsp) {
+    uint32_t when = now(fsp);
+
+    FfxFspTicket *result = &fsp->tickets[0];
+    for (int i = 0; i < FFX_FSP_MAX_TICKETS; i++) {
+        FfxFspTicket *ticket = &fsp->tickets[i];
+        if (!ticket->valid) { return ticket; }
+        if (when - ticket->issued > when - result->issued) {
+            result = ticket;
+        }
+    }
+
+    return result;
+}
+
+// Finds the unexpired session for %%ticket%%, comparing every ticket
+// in full so the timing reveals nothing
+static FfxFspTicket* findTicket(FfxFsp *fsp, const uint8_t *ticket) {
+    uint32_t when = now(fsp);
+
+    FfxFspTicket *result = NULL;
+    for (int i = 0; i < FFX_FSP_MAX_TICKETS; i++) {
+        FfxFspTicket *entry = &fsp->tickets[i];
+
+        uint8_t diff = 0;
+        for (int j = 0; j < FFX_FSP_TICKET_LENGTH; j++) {
+            diff |= entry->ticket[j] ^ ticket[j];
+        }
+
+        if (diff == 0 && entry->valid &&
+          when - entry->issued < FFX_FSP_TICKET_LIFETIME) {
+            result = entry;
+        }
+    }
+
+    return result;
+}
+
+// Begins the session derived from %%secret%%, which is stored in
+// %%ticket%% (under a new ticket, which the host derives too) so the
+// session can be resumed once
+static void beginSession(FfxFsp *fsp, const uint8_t *secret,
+  FfxFspTicket *ticket) {
+
+    uint8_t hostKey[FFX_AEAD_KEY_LENGTH];
+    uint8_t deviceKey[FFX_AEAD_KEY_LENGTH];
+    uint8_t ticketId[32];
+
+    derive(hostKey, secret, "fsp host", NULL, 0);
+    derive(deviceKey, secret, "fsp device", NULL, 0);
+    derive(ticketId, secret, "fsp ticket", NULL, 0);
+
+    memcpy(ticket->ticket, ticketId, FFX_FSP_TICKET_LENGTH);
+    memcpy(ticket->secret, secret, sizeof(ticket->secret));
+    ticket->valid = true;
+
+    lock(fsp);
+    memcpy(fsp->hostKey, hostKey, sizeof(hostKey));
+    memcpy(fsp->deviceKey, deviceKey, sizeof(deviceKey));
+    fsp->hostCounter = 0;
+    fsp->deviceCounter = 0;
+    fsp->epoch++;
+    fsp->state |= STATE_SESSION;
+    unlock(fsp);
+
+    memset(hostKey, 0, sizeof(hostKey));
+    memset(deviceKey, 0, sizeof(deviceKey));
+}
+
+static void endSession(FfxFsp *fsp) {
+    lock(fsp);
+    memset(fsp->hostKey, 0, sizeof(fsp->hostKey));
+    memset(fsp->deviceKey, 0, sizeof(fsp->deviceKey));
+    fsp->epoch++;
+    fsp->state &= ~STATE_SESSION;
+    unlock(fsp);
+}
+
+// Resumes the session for %%ticket%% with the host %%nonce%%, writing
+// the device nonce to %%response%%. Returns false if there is no such
+// session.
+static bool resumeSession(FfxFsp *fsp, const uint8_t *ticket,
+  const uint8_t *nonce, uint8_t *response) {
+
+    FfxFspTicket *entry = findTicket(fsp, ticket);
+    if (entry == NULL) { return false; }
+
+    uint8_t nonces[2 * NONCE_LENGTH];
+    memcpy(nonces, nonce, NONCE_LENGTH);
+    fillRandom(fsp, &nonces[NONCE_LENGTH], NONCE_LENGTH);
+
+    uint8_t secret[32];
+    derive(secret, entry->secret, "fsp resume", nonces, sizeof(nonces));
+    beginSession(fsp, secret, entry);
+    memset(secret, 0, sizeof(secret));
+
+    memcpy(response, &nonces[NONCE_LENGTH], NONCE_LENGTH);
+
+    return true;
+}
+
+// Completes a CMD_HELLO; the ECDH is far too slow for the receive
+// context, so this runs on the transport task
+static void completeHello(FfxFsp *fsp) {
+    uint8_t resp[2 + NONCE_LENGTH] = { STATUS_OK, CMD_HELLO };
+    size_t length = sizeof(resp);
+
+    // The host key and nonce, followed by the device key and nonce
+    uint8_t transcript[sizeof(fsp->hello) + sizeof(fsp->pubkey) +
+      NONCE_LENGTH];
+    memcpy(transcript, fsp->hello, sizeof(fsp->hello));
+    memcpy(&transcript[sizeof(fsp->hello)], fsp->pubkey,
+      sizeof(fsp->pubkey));
+
+    uint8_t pubkey[FFX_PUBKEY_LENGTH];
+    uint8_t shared[FFX_SHARED_SECRET_LENGTH];
+
+    bool valid = (transcript[0] == 0x02 || transcript[0] == 0x03);
+    if (valid) {
+        ffx_pk_decompressPubkeySecp256k1(transcript, pubkey);
+        valid = ffx_pk_isValidPubkeySecp256k1(pubkey) &&
+          ffx_pk_computeSharedSecretSecp256k1(fsp->privkey, pubkey, shared);
+    }
+
+    if (valid) {
+        uint8_t *nonce = &transcript[sizeof(fsp->hello) +
+          sizeof(fsp->pubkey)];
+        fillRandom(fsp, nonce, NONCE_LENGTH);
+
+        FfxFspTicket *ticket = allocTicket(fsp);
+        ticket->issued = now(fsp);
+
+        uint8_t secret[32];
+        derive(secret, shared, "fsp hello", transcript, sizeof(transcript));
+        beginSession(fsp, secret, ticket);
+        memset(secret, 0, sizeof(secret));
+        memset(shared, 0, sizeof(shared));
+
+        memcpy(&resp[2], nonce, NONCE_LENGTH);
+
+    } else {
+        resp[0] = ERROR_BAD_DATA;
+        length = 2;
+    }
+
+    lock(fsp);
+    fsp->helloPending = false;
+    unlock(fsp);
+
+    // Like any response, a lost one is retried by the host
+    sendFrame(fsp, resp, length);
+}
+
+// Encrypts a sealed reply through %%end%% (as each chunk is first
+// sent), writing the tag once the ciphertext is complete
+static void sealThrough(FfxFsp *fsp, FfxFspMessage *message, size_t end) {
+    size_t sealed = message->sealedOffset;
+    if (sealed >= end) { return; }
+
+    size_t cipherLength = message->length - TAG_LENGTH;
+
+    size_t stop = (end < cipherLength) ? end: cipherLength;
+    if (stop > sealed) {
+        ffx_aead_encrypt(&fsp->txCipher, &message->data[sealed],
+          &message->data[sealed], stop - sealed);
+        sealed = stop;
+    }
+
+    if (sealed == cipherLength && end > cipherLength) {
+        ffx_aead_final(&fsp->txCipher, &message->data[cipherLength]);
+        sealed = message->length;
+    }
+
+    message->sealedOffset = sealed;
+}
+
+
+///////////////////////////////
+// Lifecycle
+
+void ffx_fsp_init(FfxFsp *fsp, const FfxFspTransport *transport,
+  uint32_t modelNumber, uint32_t serialNumber, uint8_t *arena,
+  size_t arenaSize) {
+
+    memset(fsp, 0, sizeof(FfxFsp));
+
+    fsp->transport = *transport;
+    fsp->modelNumber = modelNumber;
+    fsp->serialNumber = serialNumber;
+    fsp->frameSize = FFX_FSP_MAX_FRAME_SIZE;
+
+    fsp->arena = arena;
+    fsp->arenaBlocks = arenaSize / FFX_FSP_BLOCK_SIZE;
+    if (fsp->arenaBlocks > FFX_FSP_MAX_ARENA_BLOCKS) {
+        fsp->arenaBlocks = FFX_FSP_MAX_ARENA_BLOCKS;
+    }
+}
+
+void ffx_fsp_setFrameSize(FfxFsp *fsp, size_t frameSize) {
+    if (frameSize < MIN_FRAME_SIZE) { frameSize = MIN_FRAME_SIZE; }
+    if (frameSize > FFX_FSP_MAX_FRAME_SIZE) {
+        frameSize = FFX_FSP_MAX_FRAME_SIZE;
+    }
+    fsp->frameSize = frameSize;
+}
+
+void ffx_fsp_reset(FfxFsp *fsp) {
+    lock(fsp);
+    fsp->state = 0;
+    fsp->credits = 0;
+    fsp->retransmitCount = 0;
+    fsp->helloPending = false;
+    unlock(fsp);
+
+    // The session ends with the link (though its ticket remains)
+    endSession(fsp);
+
+    if (fsp->receiving) {
+        releaseMessage(fsp, fsp->receiving);
+        fsp->receiving = NULL;
+    }
+
+    // No one is left to acknowledge any sent message
+    fsp->acknowledged = true;
+    wake(fsp);
+}
+
+bool ffx_fsp_setIdentity(FfxFsp *fsp, const uint8_t *privkey,
+  bool required) {
+
+    // Even without a usable key, a device which requires sessions must
+    // refuse plain messages rather than silently accept them
+    fsp->sessionRequired = required;
+
+    if (privkey == NULL || fsp->transport.random == NULL) { return false; }
+
+    uint8_t pubkey[FFX_PUBKEY_LENGTH];
+    memcpy(fsp->privkey, privkey, FFX_PRIVKEY_LENGTH);
+    if (!ffx_pk_computePubkeySecp256k1(fsp->privkey, pubkey)) {
+        memset(fsp->privkey, 0, FFX_PRIVKEY_LENGTH);
+        return false;
+    }
+
+    ffx_pk_compressPubkeySecp256k1(pubkey, fsp->pubkey);
+    fsp->hasIdentity = true;
+
+    return true;
+}
+
+bool ffx_fsp_isSealed(FfxFsp *fsp) {
+    return (fsp->state & STATE_SESSION) ? true: false;
+}
+
+bool ffx_fsp_isCredited(FfxFsp *fsp) {
+    return (fsp->state & STATE_CREDITS) ? true: false;
+}
+
+bool ffx_fsp_isBusy(FfxFsp *fsp) {
+    bool busy = (fsp->receiving != NULL || fsp->helloPending);
+
+    lock(fsp);
+    for (int i = 0; i < FFX_FSP_POOL_SIZE && !busy; i++) {
+        FfxFspMessageState state = fsp->messages[i].state;
+        busy = (state == FfxFspMessageStateQueued ||
+          state == FfxFspMessageStateSending);
+    }
+    unlock(fsp);
+
+    return busy;
+}
+
+
+///////////////////////////////
+// Receiving
+
+void ffx_fsp_receive(FfxFsp *fsp, const uint8_t *req, size_t length) {
+
+    // Response; maximum length is 35 bytes (CMD_IDENTITY)
+    uint8_t resp[2 + FFX_COMP_PUBKEY_LENGTH] = { 0 };
+    resp[0] = STATUS_SKIP;
+    size_t offset = 1;
+
+    do {
+        // No data to work with at all
+        if (length < 1) {
+            resp[0] = ERROR_BUFFER_OVERRUN;
+            break;
+        }
+
+        uint8_t cmd = req[0];
+
+        resp[offset++] = cmd;
+
+        if (cmd == CMD_QUERY) {
+            resp[0] = STATUS_OK;
+
+            resp[offset++] = CMD_QUERY;
+            resp[offset++] = 0x01;
+
+            // The progress of any message being uploaded
+            FfxFspMessage *message = fsp->receiving;
+            size_t msgOffset = message ? message->offset: 0;
+            size_t msgLength = message ? message->length: 0;
+
+            resp[offset++] = msgOffset >> 8;
+            resp[offset++] = msgOffset & 0xff;
+
+            resp[offset++] = msgLength >> 8;
+            resp[offset++] = msgLength & 0xff;
+
+            uint32_t v = fsp->modelNumber;
+            resp[offset++] = (v >> 24) & 0xff;
+            resp[offset++] = (v >> 16) & 0xff;
+            resp[offset++] = (v >> 8) & 0xff;
+            resp[offset++] = v & 0xff;
+
+            v = fsp->serialNumber;
+            resp[offset++] = (v >> 24) & 0xff;
+            resp[offset++] = (v >> 16) & 0xff;
+            resp[offset++] = (v >> 8) & 0xff;
+            resp[offset++] = v & 0xff;
+
+            resp[offset++] = fsp->frameSize >> 8;
+            resp[offset++] = fsp->frameSize & 0xff;
+
+            resp[offset++] = CAPABILITIES |
+              (fsp->hasIdentity ? CAPABILITY_SESSION: 0);
+
+            // The host may opt in to compressed replies
+            lock(fsp);
+            if (length >= 2 && (req[1] & QUERY_FLAG_COMPRESS)) {
+                fsp->state |= STATE_COMPRESS;
+            } else {
+                fsp->state &= ~STATE_COMPRESS;
+            }
+            unlock(fsp);
+
+        } else if (cmd == CMD_RESET) {
+
+            // Acknowledges any sent message
+            fsp->acknowledged = true;
+            wake(fsp);
+
+            // Abandon any partially uploaded message; messages being
+            // processed or replied to are unaffected
+            if (fsp->receiving) {
+                releaseMessage(fsp, fsp->receiving);
+                fsp->receiving = NULL;
+            }
+
+        } else if (cmd == CMD_ACK) {
+            fsp->acknowledged = true;
+            wake(fsp);
+
+        } else if (cmd == CMD_START_MESSAGE || cmd == CMD_START_COMPRESSED) {
+
+            // A compressed message also includes the uncompressed
+            // length (following the wire length)
+            bool compressed = (cmd == CMD_START_COMPRESSED);
+            size_t headerLength = compressed ? 5: 3;
+
+            // Within a session, a message also includes its sequence
+            // number and is followed by its tag (within the length)
+            bool sealed = ffx_fsp_isSealed(fsp);
+            size_t tagLength = 0;
+            if (sealed) {
+                headerLength += SEALED_HEADER;
+                tagLength = TAG_LENGTH;
+            }
+
+            // A message is already being uploaded (or a session is
+            // being established)
+            if (fsp->receiving || fsp->helloPending) {
+                resp[0] = ERROR_BUSY;
+                break;
+            }
+
+            // The device only accepts messages within a session
+            if (!sealed && fsp->sessionRequired) {
+                resp[0] = ERROR_NO_SESSION;
+                break;
+            }
+
+            // Missing length parameter(s)
+            if (length < headerLength) {
+                resp[0] = ERROR_BUFFER_OVERRUN;
+                break;
+            }
+
+            uint16_t msgLen = (req[1] << 8) | req[2];
+
+            uint16_t rawLen = msgLen - tagLength;
+            if (compressed) { rawLen = (req[3] << 8) | req[4]; }
+
+            // No message
+            if (msgLen <= tagLength || length <= headerLength ||
+              (compressed && rawLen <= 32)) {
+                resp[0] = ERROR_MISSING_MESSAGE;
+                break;
+            }
+
+            // Message is too large (or the first chunk overruns it)
+            if (rawLen > FFX_FSP_MESSAGE_CAPACITY ||
+              length - headerLength > msgLen) {
+                resp[0] = ERROR_BUFFER_OVERRUN;
+                break;
+            }
+
+            // A replayed (or reordered) message
+            uint32_t counter = 0;
+            if (sealed) {
+                counter = read32(&req[headerLength - SEALED_HEADER]);
+                if (counter <= fsp->hostCounter) {
+                    resp[0] = ERROR_BAD_DATA;
+                    break;
+                }
+            }
+
+            // No free slot or no room in the arena until a message
+            // completes
+            FfxFspMessage *message = acquireMessage(fsp, rawLen);
+            if (message == NULL) {
+                resp[0] = ERROR_BUSY;
+                break;
+            }
+
+            message->length = msgLen;
+
+            if (compressed) {
+                message->compressed = true;
+                ffx_lz_initDecoder(&message->decoder, &message->data[32],
+                  rawLen - 32);
+            }
+
+            if (sealed) {
+                uint8_t nonce[FFX_AEAD_NONCE_LENGTH];
+                getNonce(nonce, counter);
+
+                // The header (the lengths, compression and sequence
+                // number) is authenticated along with the message
+                lock(fsp);
+                ffx_aead_init(&fsp->rxCipher, fsp->hostKey, nonce);
+                ffx_aead_authenticate(&fsp->rxCipher, req, headerLength);
+                unlock(fsp);
+
+                message->sealed = true;
+                message->counter = counter;
+            }
+
+            // Update the message
+            FfxLzStatus status = appendChunk(fsp, message,
+              &req[headerLength], length - headerLength);
+            if (status) {
+                releaseMessage(fsp, message);
+                resp[0] = ERROR_BAD_DATA;
+                break;
+            }
+
+            // Message ready to process!
+            if (message->offset == message->length) {
+                fsp->transport.received(fsp->transport.context, message);
+            } else {
+                fsp->receiving = message;
+            }
+
+        } else if (cmd == CMD_CONTINUE_MESSAGE) {
+            FfxFspMessage *message = fsp->receiving;
+
+            // No message to continue
+            if (message == NULL) {
+                resp[0] = ERROR_MISSING_MESSAGE;
+                break;
+            }
+
+            // Missing length parameter
+            if (length < 3) {
+                resp[0] = ERROR_BUFFER_OVERRUN;
+                break;
+            }
+
+            uint16_t msgOffset = (req[1] << 8) | req[2];
+
+            // Message offset is out of sync
+            if (length < 4 || msgOffset != message->offset) {
+                resp[0] = ERROR_MISSING_MESSAGE;
+                break;
+            }
+
+            // Chunk overruns the message
+            if (message->offset + length - 1 - 2 > message->length) {
+                resp[0] = ERROR_BUFFER_OVERRUN;
+                break;
+            }
+
+            // Update the message
+            FfxLzStatus status = appendChunk(fsp, message, &req[3],
+              length - 1 - 2);
+            if (status) {
+                fsp->receiving = NULL;
+                releaseMessage(fsp, message);
+                resp[0] = ERROR_BAD_DATA;
+                break;
+            }
+
+            // Message ready to process!
+            if (message->offset == message->length) {
+                fsp->receiving = NULL;
+                fsp->transport.received(fsp->transport.context, message);
+            }
+
+        } else if (cmd == CMD_CREDIT) {
+
+            // Missing count parameter
+            if (length < 2) {
+                resp[0] = ERROR_BUFFER_OVERRUN;
+                break;
+            }
+
+            // Switch to credited sending; the host has opted in to
+            // acknowledging chunks by granting credits
+            lock(fsp);
+            fsp->state |= STATE_CREDITS;
+            unlock(fsp);
+            addCredits(fsp, req[1]);
+
+            // Resume any sending which was waiting on credits
+            wake(fsp);
+
+        } else if (cmd == CMD_RETRANSMIT) {
+
+            // Missing offset and length parameters
+            if (length < 5) {
+                resp[0] = ERROR_BUFFER_OVERRUN;
+                break;
+            }
+
+            // No reply being sent
+            FfxFspMessage *message = fsp->sending;
+            if (message == NULL) {
+                resp[0] = ERROR_MISSING_MESSAGE;
+                break;
+            }
+
+            uint16_t msgOffset = (req[1] << 8) | req[2];
+            uint16_t msgLength = (req[3] << 8) | req[4];
+
+            // The range must have already been sent
+            if (msgLength == 0 || msgOffset + msgLength > message->offset) {
+                resp[0] = ERROR_MISSING_MESSAGE;
+                break;
+            }
+
+            if (!addRetransmit(fsp, msgOffset, msgLength)) {
+                resp[0] = ERROR_BUSY;
+                break;
+            }
+
+            wake(fsp);
+
+        } else if (cmd == CMD_IDENTITY) {
+            if (!fsp->hasIdentity) {
+                resp[0] = ERROR_BAD_COMMAND;
+                break;
+            }
+
+            // The link cannot carry the key yet (e.g. before an MTU
+            // exchange)
+            if (fsp->frameSize < sizeof(resp)) {
+                resp[0] = ERROR_BUFFER_OVERRUN;
+                break;
+            }
+
+            resp[0] = STATUS_OK;
+            memcpy(&resp[offset], fsp->pubkey, FFX_COMP_PUBKEY_LENGTH);
+            offset += FFX_COMP_PUBKEY_LENGTH;
+
+        } else if (cmd == CMD_HELLO) {
+            if (!fsp->hasIdentity) {
+                resp[0] = ERROR_BAD_COMMAND;
+                break;
+            }
+
+            // Missing the host key and nonce
+            if (length < 1 + sizeof(fsp->hello)) {
+                resp[0] = ERROR_BUFFER_OVERRUN;
+                break;
+            }
+
+            if (!isIdle(fsp)) {
+                resp[0] = ERROR_BUSY;
+                break;
+            }
+
+            // The transport task responds once the keys are derived
+            memcpy(fsp->hello, &req[1], sizeof(fsp->hello));
+            lock(fsp);
+            fsp->helloPending = true;
+            unlock(fsp);
+
+            wake(fsp);
+
+        } else if (cmd == CMD_RESUME) {
+            if (!fsp->hasIdentity) {
+                resp[0] = ERROR_BAD_COMMAND;
+                break;
+            }
+
+            // Missing the ticket and host nonce
+            if (length < 1 + FFX_FSP_TICKET_LENGTH + NONCE_LENGTH) {
+                resp[0] = ERROR_BUFFER_OVERRUN;
+                break;
+            }
+
+            if (!isIdle(fsp)) {
+                resp[0] = ERROR_BUSY;
+                break;
+            }
+
+            // Unknown or expired; the host must begin a new session
+            if (!resumeSession(fsp, &req[1], &req[1 + FFX_FSP_TICKET_LENGTH],
+              &resp[offset])) {
+                resp[0] = ERROR_NO_SESSION;
+                break;
+            }
+
+            resp[0] = STATUS_OK;
+            offset += NONCE_LENGTH;
+
+        } else {
+            resp[0] = ERROR_BAD_COMMAND;
+        }
+
+    } while (0);
+
+    // Send response if there is a response or error.
+    if (resp[0] != STATUS_SKIP) { sendFrame(fsp, resp, offset); }
+}
+
+// CRC-8 (polynomial 0x07), which covers the length and frame of a
+// stream frame
+static uint8_t crc8(uint8_t crc, uint8_t value) {
+    crc ^= value;
+    for (int i = 0; i < 8; i++) {
+        crc = (crc & 0x80) ? ((crc << 1) ^ 0x07): (crc << 1);
+    }
+    return crc;
+}
+
+uint8_t ffx_fsp_encodeStreamHeader(uint8_t *header, const uint8_t *frame,
+  size_t length) {
+
+    header[0] = STREAM_SYNC0;
+    header[1] = STREAM_SYNC1;
+    header[2] = length >> 8;
+    header[3] = length & 0xff;
+
+    uint8_t crc = crc8(crc8(0, header[2]), header[3]);
+    for (size_t i = 0; i < length; i++) { crc = crc8(crc, frame[i]); }
+
+    return crc;
+}
+
+void ffx_fsp_receiveStream(FfxFsp *fsp, FfxFspStream *stream,
+  const uint8_t *data, size_t length) {
+
+    for (size_t i = 0; i < length; i++) {
+        uint8_t value = data[i];
+
+        switch (stream->state) {
+            case StreamStateSync0:
+                if (value == STREAM_SYNC0) { stream->state++; }
+                break;
+
+            case StreamStateSync1:
+                if (value == STREAM_SYNC1) {
+                    stream->state++;
+                } else if (value != STREAM_SYNC0) {
+                    stream->state = StreamStateSync0;
+                }
+                break;
+
+            case StreamStateLength0:
+                stream->length = value << 8;
+                stream->crc = crc8(0, value);
+                stream->state++;
+                break;
+
+            case StreamStateLength1:
+                stream->length |= value;
+                stream->crc = crc8(stream->crc, value);
+                stream->offset = 0;
+                stream->state++;
+
+                // Not a frame; resume looking for one
+                if (stream->length == 0 ||
+                  stream->length > FFX_FSP_MAX_FRAME_SIZE) {
+                    stream->state = StreamStateSync0;
+                }
+                break;
+
+            case StreamStateFrame: {
+                // Copy as much of the frame as is available at once
+                size_t count = stream->length - stream->offset;
+                if (count > length - i) { count = length - i; }
+                memcpy(&stream->frame[stream->offset], &data[i], count);
+                for (size_t j = 0; j < count; j++) {
+                    stream->crc = crc8(stream->crc, data[i + j]);
+                }
+                stream->offset += count;
+                i += count - 1;
+
+                if (stream->offset == stream->length) { stream->state++; }
+                break;
+            }
+
+            case StreamStateCrc:
+                // A corrupt (e.g. interleaved) frame is dropped, and
+                // any lost chunk is recovered by the host
+                if (value == stream->crc) {
+                    ffx_fsp_receive(fsp, stream->frame, stream->length);
+                }
+                stream->state = StreamStateSync0;
+                break;
+        }
+    }
+}
+
+
+///////////////////////////////
+// Requests
+
+// The room for the CBOR of a reply in %%message%%, leaving space for
+// the checksum before it and a tag after it (in case it is sealed)
+static size_t replyCapacity(FfxFspMessage *message) {
+    return message->capacity - 32 - TAG_LENGTH;
+}
+
+// Reserves %%count%% consecutive message ids, returning the first
+static uint32_t reserveIds(FfxFsp *fsp, size_t count) {
+    lock(fsp);
+    if (nextMessageId + count > 0x7fffffff) { nextMessageId = 1; }
+    uint32_t id = nextMessageId;
+    nextMessageId += count;
+    unlock(fsp);
+
+    return id;
+}
+
+// Decodes the %%request%% ({ v, id, method, params }) into %%message%%,
+// returning true if it is valid. The replyId is set whenever the id
+// is, so even an invalid request within a batch can be answered.
+static bool decodeRequest(FfxFspMessage *message, FfxCborCursor *request) {
+    ffx_cbor_clone(&message->message, request);
+
+    uint32_t replyId = 0;
+    do {
+        FfxCborCursor cursor;
+        ffx_cbor_clone(&cursor, &message->message);
+
+        FfxCborStatus status = ffx_cbor_followKey(&cursor, "id");
+        if (status || ffx_cbor_getType(&cursor) != FfxCborTypeNumber) {
+            break;
+        }
+
+        uint64_t value;
+        status = ffx_cbor_getValue(&cursor, &value);
+        if (value == 0 || value > 0x7fffffff) { break; }
+
+        replyId = value;
+    } while(0);
+
+    message->replyId = replyId;
+    if (replyId == 0) { return false; }
+
+    {
+        FfxCborCursor cursor;
+        ffx_cbor_clone(&cursor, &message->message);
+
+        FfxCborStatus status = ffx_cbor_followKey(&cursor, "method");
+        if (status || ffx_cbor_getType(&cursor) != FfxCborTypeString) {
+            return false;
+        }
+
+        // The copy returns a status (not a length); a truncated method
+        // could match the wrong handler, so is rejected too
+        memset(message->method, 0, FFX_FSP_METHOD_LENGTH);
+        status = ffx_cbor_copyData(&cursor, (uint8_t*)message->method,
+          FFX_FSP_METHOD_LENGTH - 1);
+
+        if (status || message->method[0] == 0) { return false; }
+    }
+
+    {
+        FfxCborCursor *cursor = &message->params;
+        ffx_cbor_clone(cursor, &message->message);
+
+        FfxCborStatus status = ffx_cbor_followKey(cursor, "params");
+        if (status || (ffx_cbor_getType(cursor) != FfxCborTypeArray &&
+          ffx_cbor_getType(cursor) != FfxCborTypeMap)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Writes the reply envelope ({ v, id, <key>: ... }) to %%builder%%,
+// leaving it positioned at the value slot
+static FfxCborStatus appendEnvelope(FfxCborBuilder *builder,
+  uint32_t replyId, char *key) {
+
+    FfxCborStatus status = ffx_cbor_appendMap(builder, 3);
+    if (status == 0) { status = ffx_cbor_appendString(builder, "v"); }
+    if (status == 0) { status = ffx_cbor_appendNumber(builder, 1); }
+    if (status == 0) { status = ffx_cbor_appendString(builder, "id"); }
+    if (status == 0) { status = ffx_cbor_appendNumber(builder, replyId); }
+    if (status == 0) { status = ffx_cbor_appendString(builder, key); }
+    return status;
+}
+
+// Writes an error reply ({ v, id, error: { code, message } })
+static FfxCborStatus appendError(FfxCborBuilder *builder, uint32_t replyId,
+  uint32_t code, const char *message) {
+
+    FfxCborStatus status = appendEnvelope(builder, replyId, "error");
+    if (status == 0) { status = ffx_cbor_appendMap(builder, 2); }
+    if (status == 0) { status = ffx_cbor_appendString(builder, "code"); }
+    if (status == 0) { status = ffx_cbor_appendNumber(builder, code); }
+    if (status == 0) { status = ffx_cbor_appendString(builder, "message"); }
+    if (status == 0) {
+        status = ffx_cbor_appendString(builder, (char*)message);
+    }
+    return status;
+}
+
+
+///////////////////////////////
+// Batches
+
+// A batch dispatches one request at a time (with the messageId
+// advancing along with it) and collects each reply in order, so the
+// batch costs the host a single round trip. The replies are written to
+// the remainder of the request's buffer, so the room for them depends
+// only on the size of the request.
+
+static void sendMessage(FfxFsp *fsp, FfxFspMessage *message,
+  size_t cborLength);
+
+// Where the reply to the current request of a batch begins
+static uint8_t* batchEntry(FfxFspMessage *message) {
+    return &message->batchReply[message->batchLength];
+}
+
+// The room for the reply to the current request of a batch, leaving
+// enough for an error reply to each request after it
+static size_t batchAvailable(FfxFspMessage *message) {
+    size_t limit = replyCapacity(message) -
+      (message->batchReply - &message->data[32]);
+    if (limit > FFX_FSP_MAX_MESSAGE_SIZE) {
+        limit = FFX_FSP_MAX_MESSAGE_SIZE;
+    }
+
+    size_t later = message->batchCount - message->batchIndex - 1;
+    size_t used = message->batchLength + later * BATCH_REPLY_RESERVE;
+
+    return (used < limit) ? limit - used: 0;
+}
+
+// Answers the current request of a batch with an error
+static void appendBatchError(FfxFspMessage *message, uint32_t code,
+  const char *text) {
+
+    FfxCborBuilder builder;
+    ffx_cbor_build(&builder, batchEntry(message), batchAvailable(message));
+
+    if (appendError(&builder, message->replyId, code, text)) {
+        // The reserve always fits this
+        ffx_cbor_build(&builder, batchEntry(message),
+          batchAvailable(message));
+        appendError(&builder, message->replyId, REPLY_INTERNAL_ERROR,
+          "reply overflow");
+    }
+
+    message->batchLength += ffx_cbor_getBuildLength(&builder);
+}
+
+// Replaces the requests with the collected replies and queues them
+static void finishBatch(FfxFsp *fsp, FfxFspMessage *message) {
+    size_t length = message->batchLength;
+    memmove(&message->data[32], message->batchReply, length);
+
+    message->batchReply = NULL;
+    message->batchCount = 0;
+    message->batchIndex = 0;
+    message->batchLength = 0;
+
+    sendMessage(fsp, message, length);
+}
+
+// Moves to the next request of a batch (which has the next id)
+static void advanceBatch(FfxFspMessage *message) {
+    message->batchIndex++;
+    message->messageId++;
+    if (message->batchIndex < message->batchCount) {
+        ffx_cbor_nextValue(&message->batchRequest, NULL);
+    }
+}
+
+// Decodes the current request of a batch, answering any invalid ones
+// with an error, until one is ready to dispatch. Returns false once
+// the batch is complete (and its reply queued).
+static bool nextRequest(FfxFsp *fsp, FfxFspMessage *message) {
+    while (message->batchIndex < message->batchCount) {
+        FfxCborCursor request;
+        ffx_cbor_clone(&request, &message->batchRequest);
+
+        if (decodeRequest(message, &request)) {
+            message->state = FfxFspMessageStateReceived;
+            return true;
+        }
+
+        appendBatchError(message, REPLY_INVALID_REQUEST, "invalid request");
+        advanceBatch(message);
+    }
+
+    finishBatch(fsp, message);
+
+    return false;
+}
+
+// The current request of a batch has been replied to; hand the next
+// to the transport, to be dispatched just like a new message
+static void completeRequest(FfxFsp *fsp, FfxFspMessage *message) {
+    advanceBatch(message);
+    if (nextRequest(fsp, message)) {
+        fsp->transport.received(fsp->transport.context, message);
+    }
+}
+
+// Sets up the batch %%message%% (an array of requests), collecting the
+// replies after the requests
+static bool beginBatch(FfxFsp *fsp, FfxFspMessage *message) {
+    size_t count = 0;
+    FfxCborStatus status = ffx_cbor_getLength(&message->message, &count);
+    if (status || count == 0 || count > FFX_FSP_MAX_BATCH) {
+        releaseMessage(fsp, message);
+        return false;
+    }
+
+    message->batchReply = &message->data[message->filled];
+    message->batchCount = count;
+    message->batchIndex = 0;
+    message->batchLength = 0;
+
+    FfxCborBuilder builder;
+    ffx_cbor_build(&builder, batchEntry(message), batchAvailable(message));
+    ffx_cbor_appendArray(&builder, count);
+    message->batchLength = ffx_cbor_getBuildLength(&builder);
+
+    // Not even enough room to answer every request with an error
+    if (batchAvailable(message) < BATCH_REPLY_RESERVE) {
+        releaseMessage(fsp, message);
+        return false;
+    }
+
+    message->messageId = reserveIds(fsp, count);
+
+    ffx_cbor_clone(&message->batchRequest, &message->message);
+    ffx_cbor_firstValue(&message->batchRequest, NULL);
+
+    return nextRequest(fsp, message);
+}
+
+
+///////////////////////////////
+// Processing
+
+bool ffx_fsp_processMessage(FfxFsp *fsp, FfxFspMessage *message) {
+
+    // The next request of a batch, decoded once the previous one was
+    // replied to
+    if (message->state == FfxFspMessageStateReceived) { return true; }
+
+    // A compressed payload must be complete and exactly fill the message
+    bool complete = (message->filled == message->rawLength);
+    if (message->compressed) {
+        complete = complete && ffx_lz_isComplete(&message->decoder);
+    }
+
+    if (message->filled < 32 || !complete) {
+        releaseMessage(fsp, message);
+        return false;
+    }
+
+    if (message->sealed) {
+        // The tag was checked as the last chunk arrived
+        if (!message->authentic) {
+            releaseMessage(fsp, message);
+            return false;
+        }
+
+    } else {
+        // The checksum has been accumulating as each chunk arrived
+        uint8_t checksum[32];
+        ffx_hash_finalSha256(&message->checksum, checksum);
+
+        if (memcmp(checksum, message->data, 32)) {
+            releaseMessage(fsp, message);
+            return false;
+        }
+    }
+
+    ffx_cbor_init(&message->message, &message->data[32],
+      message->filled - 32);
+
+    if (ffx_cbor_getType(&message->message) == FfxCborTypeArray) {
+        return beginBatch(fsp, message);
+    }
+
+    message->messageId = reserveIds(fsp, 1);
+
+    FfxCborCursor request;
+    ffx_cbor_clone(&request, &message->message);
+
+    if (!decodeRequest(message, &request)) {
+        releaseMessage(fsp, message);
+        return false;
+    }
+
+    message->state = FfxFspMessageStateReceived;
+
+    return true;
+}
+
+
+///////////////////////////////
+// Sending
+
+// The sent message is no longer needed, so return it to the pool and
+// start the next reply (must be called on the transport task)
+static void releaseSent(FfxFsp *fsp) {
+    FfxFspMessage *message = fsp->sending;
+    if (message == NULL || message->state != FfxFspMessageStateSent) {
+        return;
+    }
+
+    fsp->sending = NULL;
+    clearRetransmits(fsp);
+    releaseMessage(fsp, message);
+
+    wake(fsp);
+}
+
+// Writes the header of the first chunk of %%message%% to %%header%%,
+// returning its length. The first chunk of a compressed message also
+// carries the uncompressed length, and of a sealed message its
+// sequence number.
+static size_t writeStartHeader(FfxFspMessage *message, uint8_t *header) {
+    header[0] = message->compressed ? CMD_START_COMPRESSED:
+      CMD_START_MESSAGE;
+    header[1] = message->length >> 8;
+    header[2] = message->length & 0xff;
+
+    size_t length = FSP_HEADER;
+
+    if (message->compressed) {
+        header[3] = message->rawLength >> 8;
+        header[4] = message->rawLength & 0xff;
+        length += 2;
+    }
+
+    if (message->sealed) {
+        write32(&header[length], message->counter);
+        length += SEALED_HEADER;
+    }
+
+    return length;
+}
+
+// Sends the chunk of %%message%% at %%offset%%, up to %%length%%
+// bytes (limited by the frame size), tagged with its offset so the
+// host can place it regardless of order. Returns the number of bytes
+// sent, or 0 if the chunk could not be queued.
+static size_t sendChunk(FfxFsp *fsp, FfxFspMessage *message, size_t offset,
+  size_t length) {
+
+    uint8_t *chunk = fsp->frame;
+
+    size_t headerLength = FSP_HEADER;
+    if (offset == 0) {
+        headerLength = writeStartHeader(message, chunk);
+    } else {
+        chunk[0] = CMD_CONTINUE_MESSAGE;
+        chunk[1] = offset >> 8;
+        chunk[2] = offset & 0xff;
+    }
+
+    size_t chunkSize = fsp->frameSize - headerLength;
+    if (length > chunkSize) { length = chunkSize; }
+
+    if (message->sealed) { sealThrough(fsp, message, offset + length); }
+
+    memcpy(&chunk[headerLength], &message->data[offset], length);
+
+    if (sendFrame(fsp, chunk, headerLength + length)) { return 0; }
+
+    return length;
+}
+
+void ffx_fsp_pump(FfxFsp *fsp) {
+
+    // The host acknowledged the reply, or never did; either way,
+    // stop retaining it
+    if (fsp->acknowledged) {
+        fsp->acknowledged = false;
+        releaseSent(fsp);
+    }
+
+    if (fsp->sending && fsp->sending->state == FfxFspMessageStateSent &&
+      now(fsp) - fsp->sentTime > SENT_TIMEOUT) {
+        releaseSent(fsp);
+    }
+
+    if (fsp->helloPending) { completeHello(fsp); }
+
+    // A flow-controlled link sends as fast as it accepts frames, while
+    // otherwise each frame requires a credit or (if the host grants
+    // none) a link-layer confirmation
+    bool flowControlled = fsp->transport.flowControlled;
+    bool credited = flowControlled || ffx_fsp_isCredited(fsp);
+
+    // Begin the next reply once the previous has been released
+    if (fsp->sending == NULL) {
+        FfxFspMessage *message = takeQueued(fsp);
+
+        // Sealed for a session which has since ended, so no host could
+        // read it
+        while (message && message->sealed && message->epoch != fsp->epoch) {
+            releaseMessage(fsp, message);
+            message = takeQueued(fsp);
+        }
+
+        if (message) {
+            // Announce the reply
+            uint8_t resetMessage[] = { CMD_RESET };
+            if (sendFrame(fsp, resetMessage, sizeof(resetMessage)) == 0) {
+                clearRetransmits(fsp);
+                message->state = FfxFspMessageStateSending;
+                fsp->sending = message;
+
+                // Each reply has the next sequence number of the session
+                // (which its header, authenticated with it, carries)
+                if (message->sealed) {
+                    uint8_t nonce[FFX_AEAD_NONCE_LENGTH];
+                    uint8_t header[FSP_HEADER + 2 + SEALED_HEADER];
+
+                    lock(fsp);
+                    message->counter = ++fsp->deviceCounter;
+                    getNonce(nonce, message->counter);
+                    ffx_aead_init(&fsp->txCipher, fsp->deviceKey, nonce);
+                    ffx_aead_authenticate(&fsp->txCipher, header,
+                      writeStartHeader(message, header));
+                    unlock(fsp);
+
+                    message->sealedOffset = 0;
+                }
+
+                // Must wait for the confirmation
+                if (!credited) { return; }
+            }
+        }
+    }
+
+    // If pending send message, send the next chunk(s)
+    FfxFspMessage *message = fsp->sending;
+    while (message) {
+
+        // Retransmit requests take priority over new data
+        FfxFspRange range;
+        bool resend = peekRetransmit(fsp, &range);
+
+        if (!resend) {
+            if (message->state == FfxFspMessageStateSent) { break; }
+
+            range.offset = message->offset;
+            range.length = message->length - message->offset;
+        }
+
+        if (range.length == 0) {
+            // Frames may be lost by the host, so retain the message
+            // until it is acknowledged
+            message->state = FfxFspMessageStateSent;
+            fsp->sentTime = now(fsp);
+
+            if (!credited) { releaseSent(fsp); }
+            break;
+        }
+
+        bool useCredit = (credited && !flowControlled);
+        if (useCredit && !takeCredit(fsp)) { break; }
+
+        size_t length = sendChunk(fsp, message, range.offset, range.length);
+
+        // Out of buffers; retry once a pending frame completes
+        if (length == 0) {
+            if (useCredit) { addCredits(fsp, 1); }
+            break;
+        }
+
+        if (resend) {
+            consumeRetransmit(fsp, length);
+        } else {
+            message->offset += length;
+        }
+
+        if (!credited) { break; }
+    }
+}
+
+
+///////////////////////////////
+// Reply API
+
+bool ffx_fsp_acceptMessage(FfxFsp *fsp, uint32_t id, FfxCborCursor *params) {
+    FfxFspMessage *message = findMessage(fsp, id, FfxFspMessageStateReceived);
+    if (message == NULL) { return false; }
+
+    message->state = FfxFspMessageStateProcessing;
+
+    if (params) { ffx_cbor_clone(params, &message->message); }
+
+    return true;
+}
+
+// Compresses the reply payload of %%cborLength%% bytes in place, if
+// that makes it any smaller. The output is built in the unused tail of
+// the message buffer, so a reply too large to leave room for it is
+// sent uncompressed.
+static void compressReply(FfxFsp *fsp, FfxFspMessage *message,
+  size_t cborLength) {
+
+    if (__atomic_exchange_n(&fsp->lzBusy, true, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    uint8_t *output = &message->data[32 + cborLength];
+    size_t available = message->capacity - 32 - cborLength;
+    if (available > cborLength - 1) { available = cborLength - 1; }
+
+    // Fails if the output would not fit (or be any smaller)
+    size_t length = ffx_lz_compress(&message->data[32], cborLength, output,
+      available, fsp->lzTable);
+
+    __atomic_store_n(&fsp->lzBusy, false, __ATOMIC_RELEASE);
+
+    if (length) {
+        memmove(&message->data[32], output, length);
+        message->length = length + 32;
+        message->compressed = true;
+    }
+}
+
+// Queues the reply of %%cborLength%% bytes, which has already been
+// written to the message buffer following the checksum.
+static void sendMessage(FfxFsp *fsp, FfxFspMessage *message,
+  size_t cborLength) {
+
+    lock(fsp);
+    bool sealed = ffx_fsp_isSealed(fsp);
+    message->epoch = fsp->epoch;
+    unlock(fsp);
+
+    // Within a session the tag authenticates the reply (as it is
+    // encrypted by the transport task), so the checksum is left zero
+    if (sealed) {
+        memset(message->data, 0, 32);
+    } else {
+        FfxSha256Context ctx;
+        ffx_hash_initSha256(&ctx);
+        ffx_hash_updateSha256(&ctx, &message->data[32], cborLength);
+        ffx_hash_finalSha256(&ctx, message->data);
+    }
+
+    message->length = cborLength + 32;
+    message->rawLength = cborLength + 32;
+    message->compressed = false;
+    message->sealed = sealed;
+
+    // Compress the payload (the checksum remains over the uncompressed
+    // CBOR) if the host accepts it
+    if ((fsp->state & STATE_COMPRESS) && cborLength >= MIN_COMPRESS_LENGTH) {
+        compressReply(fsp, message, cborLength);
+    }
+
+    // The tag follows the (compressed) payload
+    if (sealed) { message->length += TAG_LENGTH; }
+
+    message->offset = 0;
+    message->messageId = 0;
+
+    // The checksum must be complete before the transport task may
+    // send it
+    lock(fsp);
+    message->sequence = fsp->nextSequence++;
+    message->state = FfxFspMessageStateQueued;
+    unlock(fsp);
+
+    wake(fsp);
+}
+
+// Writes the reply envelope ({ v, id, <key>: ... }) over the request
+// of %%message%% (which is no longer needed), leaving %%builder%%
+// positioned at the value slot. The buffer was sized for the largest
+// message when the upload began.
+static bool prepareReply(FfxFsp *fsp, FfxFspMessage *message,
+  FfxCborBuilder *builder, char *key) {
+
+    if (message->data == NULL) { return false; }
+
+    ffx_cbor_build(builder, &message->data[32], replyCapacity(message));
+    appendEnvelope(builder, message->replyId, key);
+
+    return true;
+}
+
+bool ffx_fsp_sendErrorReply(FfxFsp *fsp, uint32_t id, uint32_t code,
+  const char *message) {
+
+    size_t length = strlen(message);
+    if (length > 128) { return false; }
+
+    FfxFspMessage *msg = findMessage(fsp, id, FfxFspMessageStateProcessing);
+    if (msg == NULL) { return false; }
+
+    if (msg->batchCount) {
+        appendBatchError(msg, code, message);
+        completeRequest(fsp, msg);
+        return true;
+    }
+
+    FfxCborBuilder builder;
+    if (!prepareReply(fsp, msg, &builder, "error")) {
+        // No memory to reply at all; drop the message
+        releaseMessage(fsp, msg);
+        return false;
+    }
+
+    // Append the Error payload (error: { code, message })
+    ffx_cbor_appendMap(&builder, 2);
+    {
+        ffx_cbor_appendString(&builder, "code");
+        ffx_cbor_appendNumber(&builder, code);
+
+        ffx_cbor_appendString(&builder, "message");
+        ffx_cbor_appendString(&builder, (char*)message);
+    }
+
+    sendMessage(fsp, msg, ffx_cbor_getBuildLength(&builder));
+
+    return true;
+}
+
+bool ffx_fsp_beginReply(FfxFsp *fsp, uint32_t id, FfxCborBuilder *result) {
+    FfxFspMessage *message = findMessage(fsp, id,
+      FfxFspMessageStateProcessing);
+    if (message == NULL) { return false; }
+
+    // Within a batch, the reply is written to the batch reply (after
+    // any earlier replies) and the request is retained
+    if (message->batchCount) {
+        uint8_t *entry = batchEntry(message);
+        size_t available = batchAvailable(message);
+
+        FfxCborBuilder builder;
+        ffx_cbor_build(&builder, entry, available);
+        appendEnvelope(&builder, message->replyId, "result");
+
+        size_t offset = ffx_cbor_getBuildLength(&builder);
+        ffx_cbor_build(result, &entry[offset], available - offset);
+
+        message->replyOffset = offset;
+
+        return true;
+    }
+
+    FfxCborBuilder builder;
+    if (!prepareReply(fsp, message, &builder, "result")) {
+        releaseMessage(fsp, message);
+        return false;
+    }
+
+    // Hand out the remainder of the message buffer, beginning at the
+    // result slot
+    size_t offset = ffx_cbor_getBuildLength(&builder);
+    ffx_cbor_build(result, &message->data[32 + offset],
+      replyCapacity(message) - offset);
+
+    message->replyOffset = offset;
+
+    return true;
+}
+
+bool ffx_fsp_commitReply(FfxFsp *fsp, uint32_t id, FfxCborBuilder *result) {
+    FfxFspMessage *message = findMessage(fsp, id,
+      FfxFspMessageStateProcessing);
+    if (message == NULL) { return false; }
+
+    if (message->batchCount) {
+        if (result->data != &batchEntry(message)[message->replyOffset]) {
+            return false;
+        }
+
+        // Some of the result did not fit (or nothing was built); replace
+        // the entry with an error rather than a truncated result, so the
+        // batch still completes
+        size_t length = ffx_cbor_getBuildLength(result);
+        if (ffx_cbor_getBuildStatus(result) || length == 0) {
+            appendBatchError(message, REPLY_INTERNAL_ERROR,
+              length ? "reply overflow": "empty reply");
+            completeRequest(fsp, message);
+            return false;
+        }
+
+        message->batchLength += message->replyOffset + length;
+        completeRequest(fsp, message);
+
+        return true;
+    }
+
+    // The builder must be the one borrowed from ffx_fsp_beginReply
+    if (message->data == NULL ||
+      result->data != &message->data[32 + message->replyOffset]) {
+        return false;
+    }
+
+    // The host is still waiting, so always answer it
+    size_t length = ffx_cbor_getBuildLength(result);
+    if (ffx_cbor_getBuildStatus(result) ||
+      message->replyOffset + length > FFX_FSP_MAX_MESSAGE_SIZE) {
+        ffx_fsp_sendErrorReply(fsp, id, REPLY_INTERNAL_ERROR,
+          "reply overflow");
+        return false;
+    }
+
+    if (length == 0) {
+        ffx_fsp_sendErrorReply(fsp, id, REPLY_INTERNAL_ERROR,
+          "empty reply");
+        return false;
+    }
+
+    sendMessage(fsp, message, message->replyOffset + length);
+
+    return true;
+}
+
+bool ffx_fsp_sendReply(FfxFsp *fsp, uint32_t id, FfxCborBuilder *result) {
+    if (ffx_cbor_getBuildLength(result) > FFX_FSP_MAX_MESSAGE_SIZE) {
+        return false;
+    }
+
+    FfxCborBuilder reply;
+    if (!ffx_fsp_beginReply(fsp, id, &reply)) { return false; }
+
+    // The reply buffer (or what remains of a batch reply) is too small;
+    // don't leave the host waiting
+    FfxCborStatus status = ffx_cbor_appendCborBuilder(&reply, result);
+    if (status) {
+        ffx_fsp_sendErrorReply(fsp, id, REPLY_INTERNAL_ERROR,
+          "reply overflow");
+        return false;
+    }
+
+    return ffx_fsp_commitReply(fsp, id, &reply);
+}
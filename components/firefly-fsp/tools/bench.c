@@ -0,0 +1,1206 @@
+/**
+ *  Host benchmark and stress test for FSP.
+ *
+ *  Build (from the component directory):
+ *    cc -O2 -pthread -Iinclude -I../firefly-ethers/include \
+ *      -I../firefly-lz/include -I../firefly-aead/include src/fsp.c \
+ *      ../firefly-lz/src/lz.c ../firefly-aead/src/aead.c \
+ *      ../firefly-ethers/src/cbor.c ../firefly-ethers/src/sha2.c \
+ *      ../firefly-ethers/src/ecc.c tools/posix.c tools/bench.c -o bench
+ *
+ *  Usage:
+ *    ./bench                  Echo throughput over a socketpair
+ *    ./bench --stress N       N randomized requests (sizes, frame sizes,
+ *                             compression and interleaved console noise)
+ *    ./bench --serve          Serve the echo device on a pty
+ *    ./bench --connect PATH   Run the throughput table against a tty
+ *                             serving the echo method
+ *    ./bench --batch          Echo requests sent one at a time vs as
+ *                             batches
+ *    ./bench --session        Session handshakes, resumption, replay
+ *                             rejection and sealed throughput
+ *
+ *  The client is a minimal FSP host over the stream framing: it uploads
+ *  each request with CMD_START and CMD_CONTINUE, reassembles the reply,
+ *  verifies its checksum (or within a session, its tag) and
+ *  acknowledges it with CMD_ACK.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "firefly-aead.h"
+#include "firefly-cbor.h"
+#include "firefly-crypto.h"
+#include "firefly-fsp.h"
+#include "firefly-hash.h"
+#include "firefly-lz.h"
+
+#include "posix.h"
+
+
+#define CMD_RESET                   (0x02)
+#define CMD_QUERY                   (0x03)
+#define CMD_START_MESSAGE           (0x06)
+#define CMD_CONTINUE_MESSAGE        (0x07)
+#define CMD_ACK                     (0x0a)
+#define CMD_START_COMPRESSED        (0x0b)
+#define CMD_IDENTITY                (0x0c)
+#define CMD_HELLO                   (0x0d)
+#define CMD_RESUME                  (0x0e)
+
+#define QUERY_FLAG_COMPRESS         (1 << 0)
+
+#define ERROR_BAD_DATA              (0x86)
+#define ERROR_NO_SESSION            (0x87)
+#define ERROR_BUSY                  (0x91)
+
+#define NONCE_LENGTH                (16)
+#define TAG_LENGTH                  (FFX_AEAD_TAG_LENGTH)
+
+// The largest echo payload which fits in a reply
+#define MAX_PAYLOAD                 (16000)
+
+// The device is busy until a previous reply is released
+#define RESULT_BUSY                 (-2)
+#define MAX_ATTEMPTS                (100)
+
+typedef struct Client {
+    int fd;
+
+    // The device frame size (from CMD_QUERY)
+    size_t frameSize;
+
+    // Upload frame size (0 for the device frame size)
+    size_t uploadSize;
+
+    // Compress uploads and opt in to compressed replies
+    bool compress;
+
+    // Interleave console-like output between frames
+    bool noise;
+
+    uint32_t nextId;
+
+    uint8_t buffer[4096];
+    size_t bufferOffset;
+    size_t bufferLength;
+
+    // Bytes on the wire
+    size_t sent;
+    size_t received;
+
+    // Uploads retried as the device was busy
+    size_t retries;
+
+    // The device key (from CMD_IDENTITY), which a real host would pin
+    uint8_t pubkey[FFX_PUBKEY_LENGTH];
+
+    // The current session (see hello and resume)
+    bool sealed;
+    uint8_t hostKey[FFX_AEAD_KEY_LENGTH];
+    uint8_t deviceKey[FFX_AEAD_KEY_LENGTH];
+    uint32_t hostCounter;
+    uint32_t deviceCounter;
+
+    // The secret and ticket to resume the session with
+    uint8_t secret[32];
+    uint8_t ticket[FFX_FSP_TICKET_LENGTH];
+} Client;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+///////////////////////////////
+// Echo Device
+
+static void echo(Posix *posix, FfxFspMessage *message) {
+    FfxFsp *fsp = &posix->fsp;
+    uint32_t id = message->messageId;
+
+    if (!ffx_fsp_acceptMessage(fsp, id, NULL)) { return; }
+
+    FfxCborCursor cursor;
+    ffx_cbor_clone(&cursor, &message->params);
+
+    uint8_t *data = NULL;
+    size_t length = 0;
+    if (strcmp(message->method, "echo") ||
+      ffx_cbor_followIndex(&cursor, 0) ||
+      ffx_cbor_getData(&cursor, &data, &length)) {
+        ffx_fsp_sendErrorReply(fsp, id, 1, "bad request");
+        return;
+    }
+
+    // The request buffer is released by ffx_fsp_beginReply
+    uint8_t *copy = malloc(length + 1);
+    memcpy(copy, data, length);
+
+    FfxCborBuilder result;
+    if (ffx_fsp_beginReply(fsp, id, &result)) {
+        // The commit answers a reply which did not fit with an error
+        if (ffx_cbor_appendData(&result, copy, length)) {
+            fprintf(stderr, "echo: reply overflow (id=%u length=%zu)\n",
+              id, length);
+        }
+        ffx_fsp_commitReply(fsp, id, &result);
+    }
+
+    free(copy);
+}
+
+
+///////////////////////////////
+// Client
+
+static int writeAll(int fd, const uint8_t *data, size_t length) {
+    while (length) {
+        ssize_t count = write(fd, data, length);
+        if (count <= 0) { return -1; }
+        data += count;
+        length -= count;
+    }
+    return 0;
+}
+
+static int writeFrame(Client *client, const uint8_t *data, size_t length) {
+    uint8_t frame[FFX_FSP_STREAM_HEADER + FFX_FSP_MAX_FRAME_SIZE + 1];
+    uint8_t crc = ffx_fsp_encodeStreamHeader(frame, data, length);
+    memcpy(&frame[FFX_FSP_STREAM_HEADER], data, length);
+    frame[FFX_FSP_STREAM_HEADER + length] = crc;
+
+    length += FFX_FSP_STREAM_HEADER + 1;
+
+    if (client->noise && (random() % 4) == 0) {
+        const char *log = "I (1234) [main] high-water: io=1024\n";
+        if (writeAll(client->fd, (uint8_t*)log, strlen(log))) { return -1; }
+    }
+
+    client->sent += length;
+
+    return writeAll(client->fd, frame, length);
+}
+
+static int readByte(Client *client) {
+    if (client->bufferOffset == client->bufferLength) {
+        ssize_t length = read(client->fd, client->buffer,
+          sizeof(client->buffer));
+        if (length <= 0) { return -1; }
+        client->bufferOffset = 0;
+        client->bufferLength = length;
+        client->received += length;
+    }
+    return client->buffer[client->bufferOffset++];
+}
+
+// Reads the next valid frame, skipping anything else
+static int readFrame(Client *client, uint8_t *frame) {
+    int value = readByte(client);
+    while (value >= 0) {
+        if (value != 0xf5) {
+            value = readByte(client);
+            continue;
+        }
+
+        value = readByte(client);
+        if (value != 0x50) { continue; }
+
+        int hi = readByte(client);
+        int lo = readByte(client);
+        if (hi < 0 || lo < 0) { return -1; }
+
+        size_t length = (hi << 8) | lo;
+        if (length == 0 || length > FFX_FSP_MAX_FRAME_SIZE) {
+            value = readByte(client);
+            continue;
+        }
+
+        for (size_t i = 0; i < length; i++) {
+            value = readByte(client);
+            if (value < 0) { return -1; }
+            frame[i] = value;
+        }
+
+        value = readByte(client);
+        if (value < 0) { return -1; }
+
+        uint8_t header[FFX_FSP_STREAM_HEADER];
+        if (ffx_fsp_encodeStreamHeader(header, frame, length) == value) {
+            return length;
+        }
+
+        value = readByte(client);
+    }
+
+    return -1;
+}
+
+static int query(Client *client) {
+    uint8_t req[] = { CMD_QUERY, client->compress ? QUERY_FLAG_COMPRESS: 0 };
+    if (writeFrame(client, req, sizeof(req))) { return -1; }
+
+    uint8_t frame[FFX_FSP_MAX_FRAME_SIZE];
+    while (1) {
+        int length = readFrame(client, frame);
+        if (length < 0) { return -1; }
+        if (length < 19 || frame[0] != 0 || frame[1] != CMD_QUERY) {
+            continue;
+        }
+
+        client->frameSize = (frame[16] << 8) | frame[17];
+        return 0;
+    }
+}
+
+static void write32(uint8_t *data, uint32_t value) {
+    data[0] = value >> 24;
+    data[1] = value >> 16;
+    data[2] = value >> 8;
+    data[3] = value;
+}
+
+static uint32_t read32(const uint8_t *data) {
+    return ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) |
+      data[3];
+}
+
+static void getNonce(uint8_t *nonce, uint32_t counter) {
+    memset(nonce, 0, FFX_AEAD_NONCE_LENGTH);
+    write32(&nonce[FFX_AEAD_NONCE_LENGTH - 4], counter);
+}
+
+// HMAC-SHA256(%%key%%, %%label%% || %%data%%), as the device derives
+// its session keys
+static void derive(uint8_t *output, const uint8_t *key, const char *label,
+  const uint8_t *data, size_t length) {
+
+    uint8_t pad[64], inner[32];
+    FfxSha256Context ctx;
+
+    memset(pad, 0x36, sizeof(pad));
+    for (int i = 0; i < 32; i++) { pad[i] ^= key[i]; }
+    ffx_hash_initSha256(&ctx);
+    ffx_hash_updateSha256(&ctx, pad, sizeof(pad));
+    ffx_hash_updateSha256(&ctx, (const uint8_t*)label, strlen(label));
+    ffx_hash_updateSha256(&ctx, data, length);
+    ffx_hash_finalSha256(&ctx, inner);
+
+    memset(pad, 0x5c, sizeof(pad));
+    for (int i = 0; i < 32; i++) { pad[i] ^= key[i]; }
+    ffx_hash_initSha256(&ctx);
+    ffx_hash_updateSha256(&ctx, pad, sizeof(pad));
+    ffx_hash_updateSha256(&ctx, inner, sizeof(inner));
+    ffx_hash_finalSha256(&ctx, output);
+}
+
+static void beginSession(Client *client, const uint8_t *secret) {
+    uint8_t ticket[32];
+
+    derive(client->hostKey, secret, "fsp host", NULL, 0);
+    derive(client->deviceKey, secret, "fsp device", NULL, 0);
+    derive(ticket, secret, "fsp ticket", NULL, 0);
+
+    memcpy(client->ticket, ticket, FFX_FSP_TICKET_LENGTH);
+    memcpy(client->secret, secret, 32);
+
+    client->hostCounter = 0;
+    client->deviceCounter = 0;
+    client->sealed = true;
+}
+
+// Sends the command %%req%% and reads its response into %%resp%%,
+// returning the response status (or -1 on a link error)
+static int command(Client *client, const uint8_t *req, size_t length,
+  uint8_t *resp, size_t *respLength) {
+
+    if (writeFrame(client, req, length)) { return -1; }
+
+    uint8_t frame[FFX_FSP_MAX_FRAME_SIZE];
+    while (1) {
+        int frameLength = readFrame(client, frame);
+        if (frameLength < 0) { return -1; }
+        if (frameLength < 2 || frame[1] != req[0]) { continue; }
+
+        memcpy(resp, frame, frameLength);
+        *respLength = frameLength;
+        return frame[0];
+    }
+}
+
+// Fetches the device key, which a real host would pin on first use
+static int identity(Client *client) {
+    uint8_t req[] = { CMD_IDENTITY }, resp[FFX_FSP_MAX_FRAME_SIZE];
+    size_t length = 0;
+
+    int status = command(client, req, sizeof(req), resp, &length);
+    if (status || length != 2 + FFX_COMP_PUBKEY_LENGTH) { return -1; }
+
+    ffx_pk_decompressPubkeySecp256k1(&resp[2], client->pubkey);
+
+    return 0;
+}
+
+// Begins a session with an ephemeral key
+static int hello(Client *client) {
+    uint8_t privkey[FFX_PRIVKEY_LENGTH], pubkey[FFX_PUBKEY_LENGTH];
+    do {
+        for (int i = 0; i < FFX_PRIVKEY_LENGTH; i++) {
+            privkey[i] = random();
+        }
+    } while (!ffx_pk_computePubkeySecp256k1(privkey, pubkey));
+
+    uint8_t req[1 + FFX_COMP_PUBKEY_LENGTH + NONCE_LENGTH] = { CMD_HELLO };
+    ffx_pk_compressPubkeySecp256k1(pubkey, &req[1]);
+    for (int i = 0; i < NONCE_LENGTH; i++) {
+        req[1 + FFX_COMP_PUBKEY_LENGTH + i] = random();
+    }
+
+    // The device is sealed from the moment it responds
+    client->sealed = false;
+
+    uint8_t resp[FFX_FSP_MAX_FRAME_SIZE];
+    size_t length = 0;
+    int status = command(client, req, sizeof(req), resp, &length);
+    if (status || length != 2 + NONCE_LENGTH) { return -1; }
+
+    uint8_t shared[FFX_SHARED_SECRET_LENGTH];
+    if (!ffx_pk_computeSharedSecretSecp256k1(privkey, client->pubkey,
+      shared)) {
+        return -1;
+    }
+
+    // The host key and nonce, followed by the device key and nonce
+    uint8_t transcript[sizeof(req) - 1 + FFX_COMP_PUBKEY_LENGTH +
+      NONCE_LENGTH];
+    memcpy(transcript, &req[1], sizeof(req) - 1);
+    ffx_pk_compressPubkeySecp256k1(client->pubkey,
+      &transcript[sizeof(req) - 1]);
+    memcpy(&transcript[sizeof(req) - 1 + FFX_COMP_PUBKEY_LENGTH], &resp[2],
+      NONCE_LENGTH);
+
+    uint8_t secret[32];
+    derive(secret, shared, "fsp hello", transcript, sizeof(transcript));
+    beginSession(client, secret);
+
+    return 0;
+}
+
+// Resumes the previous session (without an ECDH), returning the
+// response status
+static int resume(Client *client) {
+    uint8_t req[1 + FFX_FSP_TICKET_LENGTH + NONCE_LENGTH] = { CMD_RESUME };
+    memcpy(&req[1], client->ticket, FFX_FSP_TICKET_LENGTH);
+
+    uint8_t nonces[2 * NONCE_LENGTH];
+    for (int i = 0; i < NONCE_LENGTH; i++) { nonces[i] = random(); }
+    memcpy(&req[1 + FFX_FSP_TICKET_LENGTH], nonces, NONCE_LENGTH);
+
+    client->sealed = false;
+
+    uint8_t resp[FFX_FSP_MAX_FRAME_SIZE];
+    size_t length = 0;
+    int status = command(client, req, sizeof(req), resp, &length);
+    if (status) { return status; }
+    if (length != 2 + NONCE_LENGTH) { return -1; }
+
+    memcpy(&nonces[NONCE_LENGTH], &resp[2], NONCE_LENGTH);
+
+    uint8_t secret[32];
+    derive(secret, client->secret, "fsp resume", nonces, sizeof(nonces));
+    beginSession(client, secret);
+
+    return 0;
+}
+
+// Writes the header of the first frame of a message to %%frame%%,
+// returning its length; within a session, it is also authenticated
+static size_t writeStartHeader(Client *client, uint8_t *frame,
+  size_t length, bool compressed, size_t rawLength) {
+
+    size_t header = 3;
+
+    frame[0] = compressed ? CMD_START_COMPRESSED: CMD_START_MESSAGE;
+    frame[1] = length >> 8;
+    frame[2] = length & 0xff;
+    if (compressed) {
+        frame[3] = rawLength >> 8;
+        frame[4] = rawLength & 0xff;
+        header = 5;
+    }
+    if (client->sealed) {
+        write32(&frame[header], client->hostCounter);
+        header += 4;
+    }
+
+    return header;
+}
+
+// Uploads %%wire%% (the checksum and CBOR, possibly compressed),
+// returning the number of frames sent
+static int upload(Client *client, const uint8_t *wire, size_t length,
+  bool compressed, size_t rawLength) {
+
+    size_t frameSize = client->frameSize;
+    if (client->uploadSize && client->uploadSize < frameSize) {
+        frameSize = client->uploadSize;
+    }
+
+    uint8_t frame[FFX_FSP_MAX_FRAME_SIZE];
+
+    int frames = 0;
+    size_t offset = 0;
+    while (offset < length) {
+        size_t header = 3;
+        if (offset == 0) {
+            header = writeStartHeader(client, frame, length, compressed,
+              rawLength);
+        } else {
+            frame[0] = CMD_CONTINUE_MESSAGE;
+            frame[1] = offset >> 8;
+            frame[2] = offset & 0xff;
+        }
+
+        size_t count = length - offset;
+        if (count > frameSize - header) { count = frameSize - header; }
+        memcpy(&frame[header], &wire[offset], count);
+
+        if (writeFrame(client, frame, header + count)) { return -1; }
+        offset += count;
+        frames++;
+    }
+
+    return frames;
+}
+
+// Reads the %%count%% errors which follow a rejected upload (one for
+// each of its remaining chunks)
+static int drainErrors(Client *client, int count) {
+    uint8_t frame[FFX_FSP_MAX_FRAME_SIZE];
+    while (count) {
+        int length = readFrame(client, frame);
+        if (length < 0) { return -1; }
+        if (length >= 2 && frame[0] >= 0x80 &&
+          frame[1] == CMD_CONTINUE_MESSAGE) {
+            count--;
+        }
+    }
+    return 0;
+}
+
+// Reads the next reply into %%reply%% (the checksum and CBOR), which
+// must hold FFX_FSP_MESSAGE_CAPACITY bytes.
+static int readReply(Client *client, uint8_t *reply) {
+    uint8_t frame[FFX_FSP_MAX_FRAME_SIZE];
+    uint8_t *wire = malloc(FFX_FSP_MESSAGE_CAPACITY);
+
+    size_t length = 0, rawLength = 0, filled = 0;
+    bool compressed = false, started = false;
+    uint32_t counter = 0;
+
+    // The header of the first frame, which the tag also covers
+    uint8_t start[9];
+    size_t startLength = 0;
+
+    int result = -1;
+    while (1) {
+        int frameLength = readFrame(client, frame);
+        if (frameLength < 0) { break; }
+
+        uint8_t cmd = frame[0];
+
+        // A response to a command is always an error here
+        if ((cmd == 0 || cmd >= 0x80) && frameLength >= 2) {
+            if (cmd == ERROR_BUSY && (frame[1] == CMD_START_MESSAGE ||
+              frame[1] == CMD_START_COMPRESSED)) {
+                result = RESULT_BUSY;
+                break;
+            }
+            fprintf(stderr, "error: status=0x%02x cmd=0x%02x\n", cmd,
+              frame[1]);
+            break;
+        }
+
+        if (cmd == CMD_RESET) {
+            started = false;
+            filled = 0;
+            continue;
+        }
+
+        size_t header = 3, offset = 0;
+        if (cmd == CMD_START_MESSAGE || cmd == CMD_START_COMPRESSED) {
+            compressed = (cmd == CMD_START_COMPRESSED);
+            length = rawLength = (frame[1] << 8) | frame[2];
+            if (compressed) {
+                rawLength = (frame[3] << 8) | frame[4];
+                header = 5;
+            }
+            if (client->sealed) {
+                counter = read32(&frame[header]);
+                header += 4;
+            }
+            memcpy(start, frame, header);
+            startLength = header;
+            started = true;
+        } else if (cmd == CMD_CONTINUE_MESSAGE && started) {
+            offset = (frame[1] << 8) | frame[2];
+        } else {
+            continue;
+        }
+
+        size_t count = frameLength - header;
+        if (offset + count > length || length > FFX_FSP_MESSAGE_CAPACITY) {
+            break;
+        }
+        memcpy(&wire[offset], &frame[header], count);
+        filled += count;
+
+        if (filled < length) { continue; }
+
+        // Acknowledge the reply, so the device can send the next
+        uint8_t ack[] = { CMD_ACK };
+        if (writeFrame(client, ack, sizeof(ack))) { break; }
+
+        if (client->sealed) {
+            if (length < 32 + TAG_LENGTH || counter <= client->deviceCounter) {
+                fprintf(stderr, "error: bad reply sequence\n");
+                break;
+            }
+
+            length -= TAG_LENGTH;
+            if (!compressed) { rawLength = length; }
+
+            uint8_t nonce[FFX_AEAD_NONCE_LENGTH];
+            getNonce(nonce, counter);
+
+            FfxAead aead;
+            ffx_aead_init(&aead, client->deviceKey, nonce);
+            ffx_aead_authenticate(&aead, start, startLength);
+            ffx_aead_decrypt(&aead, wire, wire, length);
+            if (!ffx_aead_verify(&aead, &wire[length])) {
+                fprintf(stderr, "error: bad reply tag\n");
+                break;
+            }
+
+            client->deviceCounter = counter;
+        }
+
+        memcpy(reply, wire, 32);
+        if (compressed) {
+            FfxLzDecoder decoder;
+            ffx_lz_initDecoder(&decoder, &reply[32], rawLength - 32);
+            if (ffx_lz_decode(&decoder, &wire[32], length - 32) ||
+              !ffx_lz_isComplete(&decoder)) {
+                break;
+            }
+        } else {
+            memcpy(reply, wire, length);
+        }
+
+        // The tag authenticates a sealed reply (with no checksum)
+        uint8_t checksum[32] = { 0 };
+        if (!client->sealed) {
+            FfxSha256Context ctx;
+            ffx_hash_initSha256(&ctx);
+            ffx_hash_updateSha256(&ctx, &reply[32], rawLength - 32);
+            ffx_hash_finalSha256(&ctx, checksum);
+        }
+        if (memcmp(checksum, reply, 32)) {
+            fprintf(stderr, "error: bad reply checksum\n");
+            break;
+        }
+
+        result = rawLength;
+        break;
+    }
+
+    free(wire);
+    return result;
+}
+
+// Appends an echo request ({ v, id, method, params: [ payload ] }),
+// returning the status of the builder
+static FfxCborStatus appendEcho(FfxCborBuilder *builder, uint32_t id,
+  uint8_t *payload, size_t length) {
+
+    ffx_cbor_appendMap(builder, 4);
+    ffx_cbor_appendString(builder, "v");
+    ffx_cbor_appendNumber(builder, 1);
+    ffx_cbor_appendString(builder, "id");
+    ffx_cbor_appendNumber(builder, id);
+    ffx_cbor_appendString(builder, "method");
+    ffx_cbor_appendString(builder, "echo");
+    ffx_cbor_appendString(builder, "params");
+    ffx_cbor_appendArray(builder, 1);
+    ffx_cbor_appendData(builder, payload, length);
+
+    return ffx_cbor_getBuildStatus(builder);
+}
+
+// Sends the request of %%cborLength%% bytes (following room for the
+// checksum in %%message%%), retrying while the device is busy, and
+// reads the reply into %%reply%%, returning its length.
+static int exchange(Client *client, uint8_t *message, size_t cborLength,
+  uint8_t *reply) {
+
+    static uint16_t table[FFX_LZ_TABLE_SIZE];
+
+    // Within a session, the tag replaces the checksum
+    memset(message, 0, 32);
+    if (!client->sealed) {
+        FfxSha256Context ctx;
+        ffx_hash_initSha256(&ctx);
+        ffx_hash_updateSha256(&ctx, &message[32], cborLength);
+        ffx_hash_finalSha256(&ctx, message);
+    }
+
+    uint8_t *wire = malloc(FFX_FSP_MESSAGE_CAPACITY + TAG_LENGTH);
+
+    size_t rawLength = 32 + cborLength;
+    size_t wireLength = 0;
+    bool compressed = false;
+    if (client->compress) {
+        memcpy(wire, message, 32);
+        wireLength = ffx_lz_compress(&message[32], cborLength, &wire[32],
+          cborLength - 1, table);
+        if (wireLength) {
+            wireLength += 32;
+            compressed = true;
+        }
+    }
+    if (!compressed) {
+        memcpy(wire, message, rawLength);
+        wireLength = rawLength;
+    }
+
+    if (client->sealed) {
+        uint8_t nonce[FFX_AEAD_NONCE_LENGTH];
+        getNonce(nonce, ++client->hostCounter);
+
+        uint8_t header[9];
+        size_t headerLength = writeStartHeader(client, header,
+          wireLength + TAG_LENGTH, compressed, rawLength);
+
+        FfxAead aead;
+        ffx_aead_init(&aead, client->hostKey, nonce);
+        ffx_aead_authenticate(&aead, header, headerLength);
+        ffx_aead_encrypt(&aead, wire, wire, wireLength);
+        ffx_aead_final(&aead, &wire[wireLength]);
+        wireLength += TAG_LENGTH;
+    }
+
+    int result = -1;
+    for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+        int frames = upload(client, wire, wireLength, compressed, rawLength);
+        if (frames < 0) { break; }
+
+        result = readReply(client, reply);
+        if (result != RESULT_BUSY) { break; }
+
+        if (drainErrors(client, frames - 1)) { break; }
+        client->retries++;
+        usleep(1000);
+    }
+
+    free(wire);
+
+    return result;
+}
+
+// Verifies %%cursor%% is the echo of %%payload%% for request %%id%%
+static int verifyEcho(FfxCborCursor *cursor, uint32_t id, uint8_t *payload,
+  size_t length) {
+
+    FfxCborCursor follow;
+    ffx_cbor_clone(&follow, cursor);
+
+    uint64_t value = 0;
+    if (ffx_cbor_followKey(&follow, "id") ||
+      ffx_cbor_getValue(&follow, &value) || value != id) {
+        fprintf(stderr, "error: reply id mismatch\n");
+        return -1;
+    }
+
+    ffx_cbor_clone(&follow, cursor);
+
+    uint8_t *data = NULL;
+    size_t dataLength = 0;
+    if (ffx_cbor_followKey(&follow, "result") ||
+      ffx_cbor_getData(&follow, &data, &dataLength)) {
+        fprintf(stderr, "error: missing result\n");
+        return -1;
+    }
+
+    if (dataLength != length || memcmp(data, payload, length)) {
+        fprintf(stderr, "error: echo mismatch\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Sends an echo request for %%payload%% and verifies the reply
+static int request(Client *client, uint8_t *payload, size_t length) {
+    uint8_t *message = malloc(FFX_FSP_MESSAGE_CAPACITY);
+    uint8_t *reply = malloc(FFX_FSP_MESSAGE_CAPACITY);
+
+    uint32_t id = ++client->nextId;
+
+    FfxCborBuilder builder;
+    ffx_cbor_build(&builder, &message[32], FFX_FSP_MESSAGE_CAPACITY - 32);
+    int result = -1;
+    if (appendEcho(&builder, id, payload, length)) {
+        fprintf(stderr, "error: request overflow\n");
+    } else {
+        result = exchange(client, message, ffx_cbor_getBuildLength(&builder),
+          reply);
+    }
+
+    if (result >= 0) {
+        FfxCborCursor cursor;
+        ffx_cbor_init(&cursor, &reply[32], result - 32);
+        result = verifyEcho(&cursor, id, payload, length);
+    }
+
+    free(message);
+    free(reply);
+
+    return result;
+}
+
+// Sends %%count%% echo requests (each of %%length%% bytes from
+// %%payload%%) as a single batch and verifies each reply. The request
+// at %%invalid%% (if less than count) omits its method, which must be
+// answered with an error.
+static int batch(Client *client, uint8_t *payload, size_t length,
+  size_t count, size_t invalid) {
+
+    uint8_t *message = malloc(FFX_FSP_MESSAGE_CAPACITY);
+    uint8_t *reply = malloc(FFX_FSP_MESSAGE_CAPACITY);
+
+    uint32_t firstId = client->nextId + 1;
+    client->nextId += count;
+
+    FfxCborBuilder builder;
+    ffx_cbor_build(&builder, &message[32], FFX_FSP_MESSAGE_CAPACITY - 32);
+    ffx_cbor_appendArray(&builder, count);
+    for (size_t i = 0; i < count; i++) {
+        if (i == invalid) {
+            ffx_cbor_appendMap(&builder, 2);
+            ffx_cbor_appendString(&builder, "id");
+            ffx_cbor_appendNumber(&builder, firstId + i);
+            ffx_cbor_appendString(&builder, "params");
+            ffx_cbor_appendArray(&builder, 0);
+            continue;
+        }
+        appendEcho(&builder, firstId + i, &payload[i * length], length);
+    }
+
+    int result = -1;
+    if (ffx_cbor_getBuildStatus(&builder)) {
+        fprintf(stderr, "error: batch request overflow\n");
+    } else {
+        result = exchange(client, message, ffx_cbor_getBuildLength(&builder),
+          reply);
+    }
+
+    do {
+        if (result < 0) { break; }
+
+        FfxCborCursor cursor;
+        ffx_cbor_init(&cursor, &reply[32], result - 32);
+        result = -1;
+
+        size_t replies = 0;
+        if (ffx_cbor_getType(&cursor) != FfxCborTypeArray ||
+          ffx_cbor_getLength(&cursor, &replies) || replies != count) {
+            fprintf(stderr, "error: batch reply count mismatch\n");
+            break;
+        }
+
+        FfxCborCursor entry;
+        ffx_cbor_clone(&entry, &cursor);
+        ffx_cbor_firstValue(&entry, NULL);
+
+        size_t i = 0;
+        for (; i < count; i++) {
+            if (i == invalid) {
+                FfxCborCursor follow;
+                ffx_cbor_clone(&follow, &entry);
+                if (ffx_cbor_followKey(&follow, "error")) {
+                    fprintf(stderr, "error: invalid request accepted\n");
+                    break;
+                }
+            } else if (verifyEcho(&entry, firstId + i, &payload[i * length],
+              length)) {
+                break;
+            }
+            ffx_cbor_nextValue(&entry, NULL);
+        }
+        if (i != count) { break; }
+
+        result = 0;
+    } while (0);
+
+    free(message);
+    free(reply);
+
+    return result;
+}
+
+// Fills %%data%% with calldata-like content: 32 byte words of small
+// numbers and zero-padded addresses
+static void fillPayload(uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        size_t word = i / 32, index = i % 32;
+        switch (word % 3) {
+            case 0:
+                data[i] = (index < 12) ? 0: (random() & 0xff);
+                break;
+            case 1:
+                data[i] = (index < 28) ? 0: (random() & 0xff);
+                break;
+            default:
+                data[i] = random() & 0xff;
+        }
+    }
+}
+
+
+///////////////////////////////
+// Modes
+
+static int runTable(int fd) {
+    const size_t sizes[] = { 16, 256, 1024, 4096, MAX_PAYLOAD };
+
+    uint8_t *payload = malloc(MAX_PAYLOAD);
+
+    printf("%-8s %-10s %10s %12s %12s %8s\n", "size", "mode", "req/s",
+      "payload/s", "wire/s", "ratio");
+
+    for (int compress = 0; compress < 2; compress++) {
+        Client client = { .fd = fd, .compress = compress };
+        if (query(&client)) {
+            fprintf(stderr, "query failed\n");
+            return 1;
+        }
+
+        for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            size_t size = sizes[s];
+            int iterations = (4 << 20) / (size + 256);
+            if (iterations > 2000) { iterations = 2000; }
+
+            fillPayload(payload, size);
+
+            client.sent = client.received = 0;
+            double t0 = now();
+            for (int i = 0; i < iterations; i++) {
+                if (request(&client, payload, size)) {
+                    fprintf(stderr, "request failed: size=%zu\n", size);
+                    return 1;
+                }
+            }
+            double dt = now() - t0;
+
+            double payloadBytes = 2.0 * size * iterations;
+            double wireBytes = client.sent + client.received;
+            printf("%-8zu %-10s %10.0f %10.2fMB %10.2fMB %8.3f\n", size,
+              compress ? "lz": "plain", iterations / dt,
+              payloadBytes / dt / 1e6, wireBytes / dt / 1e6,
+              wireBytes / payloadBytes);
+            fflush(stdout);
+        }
+    }
+
+    free(payload);
+    return 0;
+}
+
+// Compares %%count%% echo requests sent one at a time to the same
+// requests sent as a single batch
+static int runBatch(int fd) {
+    const size_t counts[] = { 1, 4, 16 };
+    const size_t size = 32;
+
+    uint8_t *payload = malloc(FFX_FSP_MAX_BATCH * size);
+    fillPayload(payload, FFX_FSP_MAX_BATCH * size);
+
+    printf("%-8s %-10s %12s %12s\n", "count", "mode", "req/s", "wire/req");
+
+    Client client = { .fd = fd };
+    if (query(&client)) {
+        fprintf(stderr, "query failed\n");
+        return 1;
+    }
+
+    for (int c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        size_t count = counts[c];
+        int iterations = 2000 / count;
+
+        for (int batched = 0; batched < 2; batched++) {
+            client.sent = client.received = 0;
+            double t0 = now();
+            for (int i = 0; i < iterations; i++) {
+                int result = 0;
+                if (batched) {
+                    result = batch(&client, payload, size, count, count);
+                } else {
+                    for (size_t j = 0; j < count && result == 0; j++) {
+                        result = request(&client, &payload[j * size], size);
+                    }
+                }
+                if (result) {
+                    fprintf(stderr, "request failed: count=%zu\n", count);
+                    return 1;
+                }
+            }
+            double dt = now() - t0;
+
+            double requests = (double)count * iterations;
+            printf("%-8zu %-10s %12.0f %12.1f\n", count,
+              batched ? "batch": "single", requests / dt,
+              (client.sent + client.received) / requests);
+            fflush(stdout);
+        }
+    }
+
+    free(payload);
+    return 0;
+}
+
+// Measures the request rate for each size (before and within a session)
+static int measure(Client *client, uint8_t *payload, const char *mode) {
+    const size_t sizes[] = { 16, 1024, MAX_PAYLOAD };
+
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t size = sizes[s];
+        int iterations = (4 << 20) / (size + 256);
+        if (iterations > 4000) { iterations = 4000; }
+
+        client->sent = client->received = 0;
+        double t0 = now();
+        for (int i = 0; i < iterations; i++) {
+            if (request(client, payload, size)) {
+                fprintf(stderr, "request failed: size=%zu\n", size);
+                return 1;
+            }
+        }
+        double dt = now() - t0;
+
+        printf("%-8zu %-8s %10.0f %12.1f\n", size, mode, iterations / dt,
+          (double)(client->sent + client->received) / iterations);
+        fflush(stdout);
+    }
+
+    return 0;
+}
+
+// Checks that sessions begin, resume (once per ticket) and reject
+// replays, then compares the throughput of plain and sealed messages
+// and the cost of beginning and resuming a session
+static int runSession(int fd) {
+    uint8_t *payload = malloc(MAX_PAYLOAD);
+    fillPayload(payload, MAX_PAYLOAD);
+
+    Client client = { .fd = fd };
+    if (query(&client)) { return 1; }
+
+    printf("%-8s %-8s %10s %12s\n", "size", "mode", "req/s", "wire/req");
+
+    // Once a session begins, it lasts until the link is reset
+    if (measure(&client, payload, "plain")) { return 1; }
+
+    if (identity(&client) || hello(&client) || request(&client, payload, 32)) {
+        fprintf(stderr, "session failed\n");
+        return 1;
+    }
+
+    if (measure(&client, payload, "sealed")) { return 1; }
+
+    // A replayed sequence number is rejected
+    client.hostCounter--;
+    upload(&client, payload, 64, false, 64);
+    uint8_t frame[FFX_FSP_MAX_FRAME_SIZE];
+    int length = readFrame(&client, frame);
+    if (length < 1 || frame[0] != ERROR_BAD_DATA) {
+        fprintf(stderr, "replay accepted\n");
+        return 1;
+    }
+    client.hostCounter++;
+
+    // A ticket may only be used once
+    uint8_t ticket[FFX_FSP_TICKET_LENGTH];
+    memcpy(ticket, client.ticket, sizeof(ticket));
+    if (resume(&client) || request(&client, payload, 32)) {
+        fprintf(stderr, "resume failed\n");
+        return 1;
+    }
+    Client stale = client;
+    memcpy(stale.ticket, ticket, sizeof(ticket));
+    if (resume(&stale) != ERROR_NO_SESSION) {
+        fprintf(stderr, "stale ticket accepted\n");
+        return 1;
+    }
+
+    // The failed resume left the session in place
+    if (request(&client, payload, 32)) {
+        fprintf(stderr, "session lost\n");
+        return 1;
+    }
+
+    const int iterations = 200;
+
+    double t0 = now();
+    for (int i = 0; i < iterations; i++) {
+        if (hello(&client)) { return 1; }
+    }
+    double helloTime = (now() - t0) / iterations;
+
+    t0 = now();
+    for (int i = 0; i < iterations; i++) {
+        if (resume(&client)) { return 1; }
+    }
+    double resumeTime = (now() - t0) / iterations;
+
+    printf("\nhandshake, resume and replay rejection OK\n");
+    printf("hello  %8.3fms (both sides; two ECDHs)\n", helloTime * 1000);
+    printf("resume %8.3fms\n", resumeTime * 1000);
+
+    free(payload);
+    return 0;
+}
+
+static int runStress(int fd, int count) {
+    uint8_t *payload = malloc(MAX_PAYLOAD);
+
+    Client client = { .fd = fd, .compress = true, .noise = true };
+    if (query(&client) || identity(&client)) { return 1; }
+
+    for (int i = 0; i < count; i++) {
+        // The second half runs in a session, resumed every so often
+        if (i == count / 2 && hello(&client)) {
+            fprintf(stderr, "stress failed: hello\n");
+            return 1;
+        }
+        if (i > count / 2 && (i % 50) == 0 && resume(&client)) {
+            fprintf(stderr, "stress failed: resume\n");
+            return 1;
+        }
+
+        size_t size = 1 + random() % MAX_PAYLOAD;
+        if (random() % 2) { fillPayload(payload, size); }
+        else { for (size_t j = 0; j < size; j++) { payload[j] = random(); } }
+
+        client.compress = random() % 2;
+        client.uploadSize = 20 + random() % client.frameSize;
+
+        // Every few requests, a batch (sometimes with an invalid entry),
+        // whose requests and replies must together fit one message
+        if ((i % 3) == 0) {
+            size_t batchCount = 1 + random() % FFX_FSP_MAX_BATCH;
+            size_t batchSize = 1 + random() % (MAX_PAYLOAD / 4 / batchCount);
+            size_t invalid = random() % (4 * batchCount);
+            if (batch(&client, payload, batchSize, batchCount, invalid)) {
+                fprintf(stderr, "stress failed: batch=%d count=%zu "
+                  "size=%zu\n", i, batchCount, batchSize);
+                return 1;
+            }
+            continue;
+        }
+
+        if (request(&client, payload, size)) {
+            fprintf(stderr, "stress failed: request=%d size=%zu\n", i, size);
+            return 1;
+        }
+    }
+
+    printf("stress: %d requests OK (%zu busy retries)\n", count,
+      client.retries);
+
+    free(payload);
+    return 0;
+}
+
+static int makeRaw(int fd) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio)) { return -1; }
+    cfmakeraw(&tio);
+    return tcsetattr(fd, TCSANOW, &tio);
+}
+
+static Posix device;
+
+// Any key will do; a device keeps its key so a host can pin it
+static void setIdentity(Posix *posix) {
+    uint8_t privkey[32];
+    for (int i = 0; i < sizeof(privkey); i++) { privkey[i] = i + 1; }
+    if (!ffx_fsp_setIdentity(&posix->fsp, privkey, false)) {
+        fprintf(stderr, "invalid identity\n");
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv) {
+    srandom(42);
+
+    if (argc >= 2 && strcmp(argv[1], "--serve") == 0) {
+        int fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd < 0 || grantpt(fd) || unlockpt(fd) || makeRaw(fd)) {
+            perror("pty");
+            return 1;
+        }
+
+        printf("serving on %s\n", ptsname(fd));
+        fflush(stdout);
+
+        posix_start(&device, fd, echo);
+        setIdentity(&device);
+        posix_join(&device);
+        return 0;
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "--connect") == 0) {
+        int fd = open(argv[2], O_RDWR | O_NOCTTY);
+        if (fd < 0 || makeRaw(fd)) {
+            perror("open");
+            return 1;
+        }
+        return runTable(fd);
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+        perror("socketpair");
+        return 1;
+    }
+
+    posix_start(&device, fds[1], echo);
+    setIdentity(&device);
+
+    int result = 0;
+    if (argc >= 3 && strcmp(argv[1], "--stress") == 0) {
+        result = runStress(fds[0], atoi(argv[2]));
+    } else if (argc >= 2 && strcmp(argv[1], "--batch") == 0) {
+        result = runBatch(fds[0]);
+    } else if (argc >= 2 && strcmp(argv[1], "--session") == 0) {
+        result = runSession(fds[0]);
+    } else {
+        result = runTable(fds[0]);
+    }
+
+    close(fds[0]);
+    posix_join(&device);
+
+    return result;
+}
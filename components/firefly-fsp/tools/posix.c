@@ -0,0 +1,215 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "posix.h"
+
+
+// How often the transport thread pumps without being woken (e.g. to
+// expire an unacknowledged reply)
+#define PUMP_INTERVAL       (100)
+
+
+///////////////////////////////
+// Transport callbacks
+
+static int writeAll(int fd, const uint8_t *data, size_t length) {
+    while (length) {
+        ssize_t count = write(fd, data, length);
+        if (count < 0) {
+            if (errno == EINTR) { continue; }
+            return -1;
+        }
+        data += count;
+        length -= count;
+    }
+    return 0;
+}
+
+static int posixSend(void *context, const uint8_t *data, size_t length) {
+    Posix *posix = context;
+
+    uint8_t header[FFX_FSP_STREAM_HEADER];
+    uint8_t crc = ffx_fsp_encodeStreamHeader(header, data, length);
+
+    // Frames are sent from both the receive and transport threads
+    pthread_mutex_lock(&posix->writeLock);
+    int result = writeAll(posix->fd, header, sizeof(header));
+    if (result == 0) { result = writeAll(posix->fd, data, length); }
+    if (result == 0) { result = writeAll(posix->fd, &crc, 1); }
+    pthread_mutex_unlock(&posix->writeLock);
+
+    return result;
+}
+
+static void posixWake(void *context) {
+    Posix *posix = context;
+    pthread_mutex_lock(&posix->wakeLock);
+    posix->woken = true;
+    pthread_cond_signal(&posix->wakeCond);
+    pthread_mutex_unlock(&posix->wakeLock);
+}
+
+static void posixReceived(void *context, FfxFspMessage *message) {
+    Posix *posix = context;
+    pthread_mutex_lock(&posix->pendingLock);
+    posix->pending[posix->pendingCount++] = message;
+    pthread_cond_signal(&posix->pendingCond);
+    pthread_mutex_unlock(&posix->pendingLock);
+}
+
+static void posixLock(void *context) {
+    pthread_mutex_lock(&((Posix*)context)->lock);
+}
+
+static void posixUnlock(void *context) {
+    pthread_mutex_unlock(&((Posix*)context)->lock);
+}
+
+static uint32_t posixNow(void *context) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void posixRandom(void *context, uint8_t *data, size_t length) {
+    int fd = open("/dev/urandom", O_RDONLY);
+    while (fd >= 0 && length) {
+        ssize_t count = read(fd, data, length);
+        if (count <= 0) { break; }
+        data += count;
+        length -= count;
+    }
+    if (fd >= 0) { close(fd); }
+}
+
+
+///////////////////////////////
+// Threads
+
+static void* receiveThread(void *context) {
+    Posix *posix = context;
+
+    uint8_t buffer[4096];
+    while (1) {
+        ssize_t length = read(posix->fd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) { continue; }
+        if (length <= 0) { break; }
+        ffx_fsp_receiveStream(&posix->fsp, &posix->stream, buffer, length);
+    }
+
+    posix->done = true;
+
+    pthread_mutex_lock(&posix->wakeLock);
+    pthread_cond_broadcast(&posix->wakeCond);
+    pthread_mutex_unlock(&posix->wakeLock);
+
+    pthread_mutex_lock(&posix->pendingLock);
+    pthread_cond_broadcast(&posix->pendingCond);
+    pthread_mutex_unlock(&posix->pendingLock);
+
+    return NULL;
+}
+
+static void* transportThread(void *context) {
+    Posix *posix = context;
+
+    while (!posix->done) {
+        pthread_mutex_lock(&posix->wakeLock);
+        if (!posix->woken && !posix->done) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += PUMP_INTERVAL * 1000000L;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&posix->wakeCond, &posix->wakeLock, &ts);
+        }
+        posix->woken = false;
+        pthread_mutex_unlock(&posix->wakeLock);
+
+        ffx_fsp_pump(&posix->fsp);
+    }
+
+    return NULL;
+}
+
+static void* workerThread(void *context) {
+    Posix *posix = context;
+
+    while (1) {
+        pthread_mutex_lock(&posix->pendingLock);
+        while (posix->pendingCount == 0 && !posix->done) {
+            pthread_cond_wait(&posix->pendingCond, &posix->pendingLock);
+        }
+
+        if (posix->pendingCount == 0) {
+            pthread_mutex_unlock(&posix->pendingLock);
+            break;
+        }
+
+        FfxFspMessage *message = posix->pending[0];
+        posix->pendingCount--;
+        memmove(&posix->pending[0], &posix->pending[1],
+          posix->pendingCount * sizeof(FfxFspMessage*));
+        pthread_mutex_unlock(&posix->pendingLock);
+
+        if (ffx_fsp_processMessage(&posix->fsp, message)) {
+            posix->handler(posix, message);
+        }
+    }
+
+    return NULL;
+}
+
+
+///////////////////////////////
+// API
+
+int posix_start(Posix *posix, int fd, PosixHandler handler) {
+    memset(posix, 0, sizeof(Posix) - sizeof(posix->arena));
+
+    posix->fd = fd;
+    posix->handler = handler;
+
+    pthread_mutex_init(&posix->lock, NULL);
+    pthread_mutex_init(&posix->writeLock, NULL);
+    pthread_mutex_init(&posix->wakeLock, NULL);
+    pthread_cond_init(&posix->wakeCond, NULL);
+    pthread_mutex_init(&posix->pendingLock, NULL);
+    pthread_cond_init(&posix->pendingCond, NULL);
+
+    FfxFspTransport transport = {
+        .context = posix,
+        .send = posixSend,
+        .wake = posixWake,
+        .received = posixReceived,
+        .lock = posixLock,
+        .unlock = posixUnlock,
+        .now = posixNow,
+        .random = posixRandom,
+        .flowControlled = true
+    };
+
+    ffx_fsp_init(&posix->fsp, &transport, 0, 0, posix->arena,
+      sizeof(posix->arena));
+
+    void* (*funcs[])(void*) = {
+        receiveThread, transportThread, workerThread
+    };
+
+    for (int i = 0; i < 3; i++) {
+        int status = pthread_create(&posix->threads[i], NULL, funcs[i],
+          posix);
+        if (status) { return status; }
+    }
+
+    return 0;
+}
+
+void posix_join(Posix *posix) {
+    for (int i = 0; i < 3; i++) { pthread_join(posix->threads[i], NULL); }
+}
@@ -0,0 +1,62 @@
+#ifndef __POSIX_H__
+#define __POSIX_H__
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "firefly-fsp.h"
+
+
+/**
+ *  A POSIX backend, which serves FSP over a stream file descriptor
+ *  (a socket, pipe or pty) using three threads, mirroring the device:
+ *    - the receive thread feeds incoming bytes to ffx_fsp_receiveStream
+ *    - the transport thread pumps replies whenever woken
+ *    - the worker thread processes uploaded messages and passes each
+ *      valid request to the handler
+ */
+
+typedef struct Posix Posix;
+
+// Called on the worker for each request; the handler must reply with
+// the ffx_fsp_*Reply functions (on any thread)
+typedef void (*PosixHandler)(Posix *posix, FfxFspMessage *message);
+
+struct Posix {
+    FfxFsp fsp;
+    FfxFspStream stream;
+
+    int fd;
+
+    PosixHandler handler;
+
+    pthread_mutex_t lock;
+    pthread_mutex_t writeLock;
+
+    pthread_mutex_t wakeLock;
+    pthread_cond_t wakeCond;
+    bool woken;
+
+    // Messages waiting for the worker
+    pthread_mutex_t pendingLock;
+    pthread_cond_t pendingCond;
+    FfxFspMessage *pending[FFX_FSP_POOL_SIZE];
+    size_t pendingCount;
+
+    pthread_t threads[3];
+    volatile bool done;
+
+    uint8_t arena[2 * FFX_FSP_MESSAGE_ARENA_SIZE];
+};
+
+/**
+ *  Starts serving on %%fd%%, until the peer closes it.
+ */
+int posix_start(Posix *posix, int fd, PosixHandler handler);
+
+/**
+ *  Waits for the peer to close the connection and stops the threads.
+ */
+void posix_join(Posix *posix);
+
+#endif /* __POSIX_H__ */
@@ -0,0 +1,202 @@
+#ifndef __FIREFLY_GOVERNOR_H__
+#define __FIREFLY_GOVERNOR_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/**
+ *  BLE Link Governor
+ *
+ *  A policy for the connection parameters and advertising of a
+ *  peripheral, trading latency against idle power:
+ *    - while a transfer is in progress, request a short connection
+ *      interval (7.5ms to 15ms) with no peripheral latency
+ *    - once idle for a while, add peripheral latency, so the radio
+ *      can sleep through most connection events while keeping the
+ *      interval (and so the switch back) short
+ *    - after a disconnect, advertise quickly for a while (so a host
+ *      can reconnect promptly), then slowly
+ *
+ *  This is a pure state machine with no BLE stack dependency; the
+ *  caller feeds it link events and the time (in ms), and applies the
+ *  parameters it asks for. This allows simulating it on a host (see
+ *  tools/sim.c).
+ *
+ *  All values use the BLE units: intervals in 1.25ms (connection) or
+ *  0.625ms (advertising) units and supervision timeouts in 10ms units.
+ */
+
+
+// Default active profile (7.5ms to 15ms, no latency, 4s timeout)
+#define FFX_GOVERNOR_ACTIVE_MIN         (6)
+#define FFX_GOVERNOR_ACTIVE_MAX         (12)
+#define FFX_GOVERNOR_ACTIVE_LATENCY     (0)
+#define FFX_GOVERNOR_ACTIVE_TIMEOUT     (400)
+
+// Default idle profile (7.5ms, skipping up to 9 events, so waking at
+// most every 75ms, 6s timeout); keeping the interval short means a new
+// request waits at most 75ms for the radio to wake, and the switch back
+// to the active profile (which takes effect at least 6 events later)
+// lands within 45ms, rather than after hundreds of ms
+#define FFX_GOVERNOR_IDLE_MIN           (6)
+#define FFX_GOVERNOR_IDLE_MAX           (6)
+#define FFX_GOVERNOR_IDLE_LATENCY       (9)
+#define FFX_GOVERNOR_IDLE_TIMEOUT       (600)
+
+// Fast advertising (20ms to 30ms) for 30s after a disconnect, then
+// slow (1022.5ms to 1285ms) until connected
+#define FFX_GOVERNOR_ADV_FAST_MIN       (32)
+#define FFX_GOVERNOR_ADV_FAST_MAX       (48)
+#define FFX_GOVERNOR_ADV_FAST_DURATION  (30000)
+#define FFX_GOVERNOR_ADV_SLOW_MIN       (1636)
+#define FFX_GOVERNOR_ADV_SLOW_MAX       (2056)
+
+// How long the link must be idle before relaxing (in ms)
+#define FFX_GOVERNOR_IDLE_DELAY         (1000)
+
+// How long to wait for a requested update to complete (in ms)
+#define FFX_GOVERNOR_REQUEST_TIMEOUT    (3000)
+
+// The delay before re-requesting a profile the central declined,
+// which doubles on each failure (in ms)
+#define FFX_GOVERNOR_RETRY_DELAY        (5000)
+#define FFX_GOVERNOR_MAX_RETRY_DELAY    (60000)
+
+
+typedef struct FfxGovernorConnParams {
+    uint16_t minInterval;
+    uint16_t maxInterval;
+    uint16_t latency;
+    uint16_t timeout;
+} FfxGovernorConnParams;
+
+typedef struct FfxGovernorAdvParams {
+    uint16_t minInterval;
+    uint16_t maxInterval;
+
+    // How long to advertise for (in ms), or 0 for forever
+    uint32_t duration;
+} FfxGovernorAdvParams;
+
+typedef enum FfxGovernorProfile {
+    // No preference has been requested (e.g. just connected)
+    FfxGovernorProfileNone = 0,
+    FfxGovernorProfileActive,
+    FfxGovernorProfileIdle
+} FfxGovernorProfile;
+
+/**
+ *  The governor state.
+ *
+ *  This should not be modified directly! Only use the provided API.
+ */
+typedef struct FfxGovernor {
+    FfxGovernorConnParams active;
+    FfxGovernorConnParams idle;
+
+    bool connected;
+
+    // A transfer is in progress
+    bool busy;
+
+    // When the last transfer ended
+    uint32_t idleTime;
+
+    // The parameters currently in use by the link
+    uint16_t interval;
+    uint16_t latency;
+
+    // The profile the link is in (or has been requested)
+    FfxGovernorProfile profile;
+
+    // A request is awaiting its update event
+    bool pending;
+    uint32_t requestTime;
+
+    // Backoff for a profile the central declined
+    FfxGovernorProfile declined;
+    uint32_t declinedTime;
+    uint32_t retryDelay;
+
+    // When the current fast advertising period began
+    uint32_t advertiseTime;
+    bool advertiseFast;
+} FfxGovernor;
+
+
+/**
+ *  Initializes %%governor%% with the default profiles.
+ */
+void ffx_governor_init(FfxGovernor *governor, uint32_t now);
+
+/**
+ *  Overrides the default active and idle profiles.
+ */
+void ffx_governor_setProfiles(FfxGovernor *governor,
+  const FfxGovernorConnParams *active, const FfxGovernorConnParams *idle);
+
+/**
+ *  Sets whether a transfer is in progress (e.g. a message is being
+ *  received or sent). Returns true if the governor should be polled
+ *  immediately.
+ */
+bool ffx_governor_setBusy(FfxGovernor *governor, uint32_t now, bool busy);
+
+/**
+ *  A connection was established, using %%interval%% and %%latency%%.
+ */
+void ffx_governor_connected(FfxGovernor *governor, uint32_t now,
+  uint16_t interval, uint16_t latency);
+
+/**
+ *  The connection was lost; fast advertising begins again.
+ */
+void ffx_governor_disconnected(FfxGovernor *governor, uint32_t now);
+
+/**
+ *  The connection parameters were updated (if %%status%% is 0, to
+ *  %%interval%% and %%latency%%), or an update failed.
+ */
+void ffx_governor_updated(FfxGovernor *governor, uint32_t now, int status,
+  uint16_t interval, uint16_t latency);
+
+/**
+ *  Returns true if the central's request to change the connection
+ *  parameters to %%params%% should be accepted. A request which would
+ *  slow the link during a transfer is declined.
+ */
+bool ffx_governor_acceptRequest(FfxGovernor *governor,
+  const FfxGovernorConnParams *params);
+
+/**
+ *  Returns true if the connection parameters should be changed, in
+ *  which case %%params%% is populated with the request.
+ */
+bool ffx_governor_poll(FfxGovernor *governor, uint32_t now,
+  FfxGovernorConnParams *params);
+
+/**
+ *  Returns how long until ffx_governor_poll may next have anything
+ *  to do (in ms), or 0 if it is waiting on an event.
+ */
+uint32_t ffx_governor_getTimeout(FfxGovernor *governor, uint32_t now);
+
+/**
+ *  Populates %%params%% for (re)starting advertising. Once the fast
+ *  period expires (e.g. the stack reports advertising completed) this
+ *  returns the slow parameters.
+ */
+void ffx_governor_getAdvertising(FfxGovernor *governor, uint32_t now,
+  FfxGovernorAdvParams *params);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FIREFLY_GOVERNOR_H__ */
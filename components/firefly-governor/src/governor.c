@@ -0,0 +1,293 @@
+#include <string.h>
+
+#include "firefly-governor.h"
+
+
+///////////////////////////////
+// Utilities
+
+static const FfxGovernorConnParams* getProfile(FfxGovernor *governor,
+  FfxGovernorProfile profile) {
+
+    switch (profile) {
+        case FfxGovernorProfileActive:
+            return &governor->active;
+        case FfxGovernorProfileIdle:
+            return &governor->idle;
+        case FfxGovernorProfileNone:
+            break;
+    }
+
+    return NULL;
+}
+
+// Whether the link parameters already satisfy %%params%%; the latency
+// must match exactly, since less costs power and more costs latency
+static bool matches(const FfxGovernorConnParams *params, uint16_t interval,
+  uint16_t latency) {
+
+    return (interval >= params->minInterval &&
+      interval <= params->maxInterval && latency == params->latency);
+}
+
+static bool hasElapsed(uint32_t now, uint32_t start, uint32_t delay) {
+    return (now - start >= delay);
+}
+
+// Lowers %%timeout%% to the time remaining until %%start%% + %%delay%%,
+// if that is still in the future
+static void earliest(uint32_t *timeout, uint32_t now, uint32_t start,
+  uint32_t delay) {
+
+    uint32_t elapsed = now - start;
+    if (elapsed >= delay) { return; }
+
+    uint32_t remaining = delay - elapsed;
+    if (*timeout == 0 || remaining < *timeout) { *timeout = remaining; }
+}
+
+// The central declined (or ignored) a request for %%profile%%; don't
+// ask again for a while, backing off further on each repeat
+static void decline(FfxGovernor *governor, uint32_t now,
+  FfxGovernorProfile profile) {
+
+    if (governor->declined == profile) {
+        governor->retryDelay *= 2;
+        if (governor->retryDelay > FFX_GOVERNOR_MAX_RETRY_DELAY) {
+            governor->retryDelay = FFX_GOVERNOR_MAX_RETRY_DELAY;
+        }
+    } else {
+        governor->retryDelay = FFX_GOVERNOR_RETRY_DELAY;
+    }
+
+    governor->declined = profile;
+    governor->declinedTime = now;
+}
+
+static FfxGovernorProfile getDesired(FfxGovernor *governor, uint32_t now) {
+    if (governor->busy) { return FfxGovernorProfileActive; }
+
+    // Hold the current profile briefly, so bursts of requests don't
+    // bounce the link between profiles
+    if (!hasElapsed(now, governor->idleTime, FFX_GOVERNOR_IDLE_DELAY)) {
+        return governor->profile;
+    }
+
+    return FfxGovernorProfileIdle;
+}
+
+
+///////////////////////////////
+// API
+
+void ffx_governor_init(FfxGovernor *governor, uint32_t now) {
+    memset(governor, 0, sizeof(FfxGovernor));
+
+    governor->active = (FfxGovernorConnParams){
+        .minInterval = FFX_GOVERNOR_ACTIVE_MIN,
+        .maxInterval = FFX_GOVERNOR_ACTIVE_MAX,
+        .latency = FFX_GOVERNOR_ACTIVE_LATENCY,
+        .timeout = FFX_GOVERNOR_ACTIVE_TIMEOUT
+    };
+
+    governor->idle = (FfxGovernorConnParams){
+        .minInterval = FFX_GOVERNOR_IDLE_MIN,
+        .maxInterval = FFX_GOVERNOR_IDLE_MAX,
+        .latency = FFX_GOVERNOR_IDLE_LATENCY,
+        .timeout = FFX_GOVERNOR_IDLE_TIMEOUT
+    };
+
+    governor->retryDelay = FFX_GOVERNOR_RETRY_DELAY;
+
+    governor->advertiseTime = now;
+    governor->advertiseFast = true;
+}
+
+void ffx_governor_setProfiles(FfxGovernor *governor,
+  const FfxGovernorConnParams *active, const FfxGovernorConnParams *idle) {
+
+    if (active) { governor->active = *active; }
+    if (idle) { governor->idle = *idle; }
+}
+
+bool ffx_governor_setBusy(FfxGovernor *governor, uint32_t now, bool busy) {
+    if (governor->busy == busy) { return false; }
+
+    governor->busy = busy;
+    if (!busy) { governor->idleTime = now; }
+
+    // Becoming busy should speed up the link right away; becoming
+    // idle waits for the idle delay anyway
+    return (busy && governor->connected);
+}
+
+void ffx_governor_connected(FfxGovernor *governor, uint32_t now,
+  uint16_t interval, uint16_t latency) {
+
+    governor->connected = true;
+    governor->interval = interval;
+    governor->latency = latency;
+
+    governor->profile = FfxGovernorProfileNone;
+    governor->pending = false;
+    governor->declined = FfxGovernorProfileNone;
+    governor->retryDelay = FFX_GOVERNOR_RETRY_DELAY;
+
+    // A new connection is usually followed by a request, so start out
+    // holding whatever the central chose
+    governor->idleTime = now;
+
+    governor->advertiseFast = false;
+}
+
+void ffx_governor_disconnected(FfxGovernor *governor, uint32_t now) {
+    governor->connected = false;
+    governor->busy = false;
+    governor->pending = false;
+    governor->profile = FfxGovernorProfileNone;
+
+    // The host may be just out of range; make reconnecting quick
+    governor->advertiseTime = now;
+    governor->advertiseFast = true;
+}
+
+void ffx_governor_updated(FfxGovernor *governor, uint32_t now, int status,
+  uint16_t interval, uint16_t latency) {
+
+    if (!governor->connected) { return; }
+
+    if (status == 0) {
+        governor->interval = interval;
+        governor->latency = latency;
+    }
+
+    // A central-initiated update; the next poll decides if it suits
+    if (!governor->pending) { return; }
+    governor->pending = false;
+
+    const FfxGovernorConnParams *params = getProfile(governor,
+      governor->profile);
+
+    if (status == 0 && matches(params, interval, latency)) {
+        if (governor->declined == governor->profile) {
+            governor->declined = FfxGovernorProfileNone;
+            governor->retryDelay = FFX_GOVERNOR_RETRY_DELAY;
+        }
+        return;
+    }
+
+    // Rejected, or accepted with other parameters
+    decline(governor, now, governor->profile);
+}
+
+bool ffx_governor_acceptRequest(FfxGovernor *governor,
+  const FfxGovernorConnParams *params) {
+
+    // Out of range of the specification
+    if (params->minInterval < 6 || params->maxInterval > 3200) {
+        return false;
+    }
+    if (params->minInterval > params->maxInterval) { return false; }
+    if (params->latency > 499) { return false; }
+    if (params->timeout < 10 || params->timeout > 3200) { return false; }
+
+    // The supervision timeout must span at least two (latent) events,
+    // i.e. timeout * 10ms > 2 * (1 + latency) * maxInterval * 1.25ms
+    uint32_t span = (1 + params->latency) * params->maxInterval;
+    if (4 * (uint32_t)params->timeout <= span) { return false; }
+
+    // Don't let the link slow down mid-transfer
+    if (governor->busy) {
+        if (params->minInterval > governor->active.maxInterval) {
+            return false;
+        }
+        if (params->latency > governor->active.latency) { return false; }
+    }
+
+    return true;
+}
+
+bool ffx_governor_poll(FfxGovernor *governor, uint32_t now,
+  FfxGovernorConnParams *params) {
+
+    if (!governor->connected) { return false; }
+
+    if (governor->pending) {
+        if (!hasElapsed(now, governor->requestTime,
+          FFX_GOVERNOR_REQUEST_TIMEOUT)) {
+            return false;
+        }
+
+        // The central never responded
+        governor->pending = false;
+        decline(governor, now, governor->profile);
+    }
+
+    FfxGovernorProfile desired = getDesired(governor, now);
+    if (desired == FfxGovernorProfileNone) { return false; }
+
+    const FfxGovernorConnParams *target = getProfile(governor, desired);
+
+    // The link already suits (e.g. the central chose it)
+    if (matches(target, governor->interval, governor->latency)) {
+        governor->profile = desired;
+        return false;
+    }
+
+    // Recently declined; don't pester the central
+    if (desired == governor->declined && !hasElapsed(now,
+      governor->declinedTime, governor->retryDelay)) {
+        return false;
+    }
+
+    governor->profile = desired;
+    governor->pending = true;
+    governor->requestTime = now;
+
+    *params = *target;
+
+    return true;
+}
+
+uint32_t ffx_governor_getTimeout(FfxGovernor *governor, uint32_t now) {
+    if (!governor->connected) { return 0; }
+
+    uint32_t timeout = 0;
+
+    if (governor->pending) {
+        earliest(&timeout, now, governor->requestTime,
+          FFX_GOVERNOR_REQUEST_TIMEOUT);
+        return timeout;
+    }
+
+    if (!governor->busy && governor->profile != FfxGovernorProfileIdle) {
+        earliest(&timeout, now, governor->idleTime, FFX_GOVERNOR_IDLE_DELAY);
+    }
+
+    if (governor->declined != FfxGovernorProfileNone) {
+        earliest(&timeout, now, governor->declinedTime,
+          governor->retryDelay);
+    }
+
+    return timeout;
+}
+
+void ffx_governor_getAdvertising(FfxGovernor *governor, uint32_t now,
+  FfxGovernorAdvParams *params) {
+
+    if (governor->advertiseFast) {
+        uint32_t elapsed = now - governor->advertiseTime;
+        if (elapsed < FFX_GOVERNOR_ADV_FAST_DURATION) {
+            params->minInterval = FFX_GOVERNOR_ADV_FAST_MIN;
+            params->maxInterval = FFX_GOVERNOR_ADV_FAST_MAX;
+            params->duration = FFX_GOVERNOR_ADV_FAST_DURATION - elapsed;
+            return;
+        }
+
+        governor->advertiseFast = false;
+    }
+
+    params->minInterval = FFX_GOVERNOR_ADV_SLOW_MIN;
+    params->maxInterval = FFX_GOVERNOR_ADV_SLOW_MAX;
+    params->duration = 0;
+}
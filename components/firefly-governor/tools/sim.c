@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "firefly-governor.h"
+
+
+/**
+ *  Simulates a peripheral serving requests over a BLE connection, to
+ *  compare the governor against fixed connection parameters.
+ *
+ *  The model is simple, but captures what matters for the policy:
+ *    - the central sends and the peripheral replies with up to
+ *      FRAMES_PER_EVENT frames per connection event it attends
+ *    - with peripheral latency, the peripheral only attends an event
+ *      if it has data to send or has skipped %%latency%% events, so
+ *      uploads (which it cannot anticipate) slow down
+ *    - an accepted update takes effect UPDATE_EVENTS events later
+ *    - each event the peripheral attends costs a radio wake-up, the
+ *      proxy for power
+ */
+
+
+#define FRAME_PAYLOAD       (182)
+#define FRAMES_PER_EVENT    (4)
+#define UPDATE_EVENTS       (6)
+
+// Connection interval units (1.25ms) to ms
+#define CONN_MS(v)          ((double)(v) * 1.25)
+
+// Advertising interval units (0.625ms) to ms
+#define ADV_MS(v)           ((double)(v) * 0.625)
+
+// The NimBLE defaults for connectable advertising (when the interval
+// is left 0) is 30ms to 60ms
+#define ADV_DEFAULT_MIN     (48)
+#define ADV_DEFAULT_MAX     (96)
+
+
+typedef struct Config {
+    int requests;
+    double gap;             // mean time between requests (ms)
+    int upload;             // bytes
+    int reply;              // bytes
+    double process;         // time to process each request (ms)
+    int reject;             // % of requests the central declines
+    uint32_t seed;
+} Config;
+
+typedef struct Result {
+    double duration;        // ms
+    double totalLatency;
+    double maxLatency;
+    uint32_t wakes;
+    uint32_t requested;
+    uint32_t declined;
+} Result;
+
+typedef enum Phase {
+    PhaseIdle = 0,
+    PhaseUpload,
+    PhaseProcess,
+    PhaseReply
+} Phase;
+
+
+///////////////////////////////
+// Random
+
+static uint32_t rngState = 1;
+
+static uint32_t nextRandom() {
+    uint32_t x = rngState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rngState = x;
+    return x;
+}
+
+static double uniform() {
+    return (double)(nextRandom() >> 8) / (double)(1 << 24);
+}
+
+// Exponentially distributed, with %%mean%%
+static double exponential(double mean) {
+    double u = uniform();
+    if (u < 1e-9) { u = 1e-9; }
+    double result = 0;
+
+    // -mean * ln(u), without libm
+    double y = (u - 1) / (u + 1), y2 = y * y, term = y;
+    for (int i = 1; i < 60; i += 2) {
+        result += term / i;
+        term *= y2;
+    }
+    return -2 * mean * result;
+}
+
+
+///////////////////////////////
+// Connection
+
+static Result simulate(const Config *config, FfxGovernor *governor,
+  uint16_t interval, uint16_t latency) {
+
+    Result result = { 0 };
+
+    rngState = config->seed ? config->seed: 1;
+
+    double now = 0;
+    uint32_t event = 0, skipped = 0;
+
+    // A pending update applied at event %%applyAt%%
+    bool updating = false;
+    int updateStatus = 0;
+    uint32_t applyAt = 0;
+    uint16_t nextInterval = 0, nextLatency = 0;
+
+    int uploadFrames = (config->upload + FRAME_PAYLOAD - 1) / FRAME_PAYLOAD;
+    int replyFrames = (config->reply + FRAME_PAYLOAD - 1) / FRAME_PAYLOAD;
+
+    Phase phase = PhaseIdle;
+    int frames = 0, completed = 0;
+    double arrival = exponential(config->gap), processed = 0;
+
+    if (governor) { ffx_governor_connected(governor, 0, interval, latency); }
+
+    while (completed < config->requests) {
+        uint32_t ms = (uint32_t)now;
+
+        if (updating && event >= applyAt) {
+            updating = false;
+            if (updateStatus == 0) {
+                interval = nextInterval;
+                latency = nextLatency;
+            }
+            ffx_governor_updated(governor, ms, updateStatus, interval,
+              latency);
+        }
+
+        bool busy = false;
+        if (phase == PhaseIdle && now >= arrival) {
+            phase = PhaseUpload;
+            frames = 0;
+            busy = true;
+        } else if (phase == PhaseProcess && now >= processed) {
+            phase = PhaseReply;
+            frames = 0;
+            busy = true;
+        }
+        if (busy && governor) { ffx_governor_setBusy(governor, ms, true); }
+
+        // The peripheral only skips events with nothing to send
+        bool attend = (phase == PhaseReply || skipped >= latency);
+
+        if (attend) {
+            skipped = 0;
+            result.wakes++;
+
+            if (phase == PhaseUpload) {
+                frames += FRAMES_PER_EVENT;
+                if (frames >= uploadFrames) {
+                    phase = PhaseProcess;
+                    processed = now + config->process;
+                    if (governor) {
+                        ffx_governor_setBusy(governor, ms, false);
+                    }
+                }
+
+            } else if (phase == PhaseReply) {
+                frames += FRAMES_PER_EVENT;
+                if (frames >= replyFrames) {
+                    double elapsed = now - arrival;
+                    result.totalLatency += elapsed;
+                    if (elapsed > result.maxLatency) {
+                        result.maxLatency = elapsed;
+                    }
+
+                    completed++;
+                    phase = PhaseIdle;
+                    arrival = now + exponential(config->gap);
+                    if (governor) {
+                        ffx_governor_setBusy(governor, ms, false);
+                    }
+                }
+            }
+        } else {
+            skipped++;
+        }
+
+        FfxGovernorConnParams params;
+        if (governor && !updating && ffx_governor_poll(governor, ms,
+          &params)) {
+            result.requested++;
+
+            updating = true;
+            if ((int)(nextRandom() % 100) < config->reject) {
+                result.declined++;
+                updateStatus = 1;
+                applyAt = event + 1;
+            } else {
+                // Centrals tend to pick the longest allowed interval
+                updateStatus = 0;
+                applyAt = event + UPDATE_EVENTS;
+                nextInterval = params.maxInterval;
+                nextLatency = params.latency;
+            }
+        }
+
+        now += CONN_MS(interval);
+        event++;
+    }
+
+    result.duration = now;
+
+    return result;
+}
+
+static void printResult(const char *name, const Config *config,
+  const Result *result) {
+
+    printf("%-22s  %9.1f  %9.1f  %9.2f  %5d/%d\n", name,
+      result->totalLatency / config->requests, result->maxLatency,
+      1000.0 * result->wakes / result->duration, result->requested,
+      result->declined);
+}
+
+
+///////////////////////////////
+// Advertising
+
+#define MAX_ADVERTISEMENTS    (1 << 20)
+
+static double advertisements[MAX_ADVERTISEMENTS];
+
+// Simulates advertising for %%duration%% ms after a disconnect,
+// returning the number of advertisements
+static size_t advertise(FfxGovernor *governor, uint32_t duration) {
+    size_t count = 0;
+
+    if (governor) { ffx_governor_disconnected(governor, 0); }
+
+    double now = 0, end = 0;
+    uint16_t minInterval = ADV_DEFAULT_MIN, maxInterval = ADV_DEFAULT_MAX;
+
+    while (now < duration && count < MAX_ADVERTISEMENTS) {
+        if (governor && now >= end) {
+            FfxGovernorAdvParams params;
+            ffx_governor_getAdvertising(governor, (uint32_t)now, &params);
+            minInterval = params.minInterval;
+            maxInterval = params.maxInterval;
+            end = params.duration ? now + params.duration: duration;
+        }
+
+        advertisements[count++] = now;
+
+        // The interval plus the mandatory 0ms to 10ms random delay
+        double interval = ADV_MS(minInterval) +
+          (ADV_MS(maxInterval) - ADV_MS(minInterval)) * uniform();
+        now += interval + 10 * uniform();
+    }
+
+    return count;
+}
+
+// The mean time a host which begins scanning (at 100% duty) between
+// %%start%% and %%end%% ms waits for an advertisement
+static double discovery(size_t count, double start, double end) {
+    double total = 0;
+    int samples = 0;
+
+    size_t index = 0;
+    for (double t = start; t < end; t += 7.3) {
+        while (index < count && advertisements[index] < t) { index++; }
+        if (index == count) { break; }
+        total += advertisements[index] - t;
+        samples++;
+    }
+
+    return samples ? total / samples: 0;
+}
+
+
+///////////////////////////////
+// Main
+
+static int parseInt(const char *value) { return (int)strtol(value, NULL, 0); }
+
+int main(int argc, char **argv) {
+    Config config = {
+        .requests = 200,
+        .gap = 10000,
+        .upload = 1024,
+        .reply = 2048,
+        .process = 50,
+        .reject = 0,
+        .seed = 42
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1]: NULL;
+        if (value == NULL) {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return 1;
+        }
+
+        if (strcmp(arg, "--requests") == 0) {
+            config.requests = parseInt(value);
+        } else if (strcmp(arg, "--gap") == 0) {
+            config.gap = parseInt(value);
+        } else if (strcmp(arg, "--upload") == 0) {
+            config.upload = parseInt(value);
+        } else if (strcmp(arg, "--reply") == 0) {
+            config.reply = parseInt(value);
+        } else if (strcmp(arg, "--process") == 0) {
+            config.process = parseInt(value);
+        } else if (strcmp(arg, "--reject") == 0) {
+            config.reject = parseInt(value);
+        } else if (strcmp(arg, "--seed") == 0) {
+            config.seed = parseInt(value);
+        } else {
+            fprintf(stderr, "usage: sim [--requests N] [--gap MS] "
+              "[--upload BYTES] [--reply BYTES] [--process MS] "
+              "[--reject PERCENT] [--seed N]\n");
+            return 1;
+        }
+        i++;
+    }
+
+    printf("requests=%d gap=%.0fms upload=%d reply=%d process=%.0fms "
+      "reject=%d%%\n\n", config.requests, config.gap, config.upload,
+      config.reply, config.process, config.reject);
+
+    printf("%-22s  %9s  %9s  %9s  %s\n", "policy", "mean (ms)",
+      "max (ms)", "wakes/s", "requests/declined");
+
+    Result result;
+
+    // What the central picks when nothing is requested
+    result = simulate(&config, NULL, 24, 0);
+    printResult("fixed 30ms", &config, &result);
+
+    result = simulate(&config, NULL, 6, 0);
+    printResult("fixed 7.5ms", &config, &result);
+
+    result = simulate(&config, NULL, FFX_GOVERNOR_IDLE_MAX,
+      FFX_GOVERNOR_IDLE_LATENCY);
+    printResult("fixed idle profile", &config, &result);
+
+    FfxGovernor governor;
+    ffx_governor_init(&governor, 0);
+    result = simulate(&config, &governor, 24, 0);
+    printResult("governor", &config, &result);
+
+    printf("\n%-22s  %12s  %12s  %12s\n", "advertising", "events/hour",
+      "find <30s", "find later");
+
+    for (int i = 0; i < 2; i++) {
+        FfxGovernor *g = i ? &governor: NULL;
+        size_t count = advertise(g, 3600000);
+        printf("%-22s  %12zu  %10.1fms  %10.1fms\n",
+          i ? "governor": "default 30ms-60ms", count,
+          discovery(count, 0, FFX_GOVERNOR_ADV_FAST_DURATION),
+          discovery(count, FFX_GOVERNOR_ADV_FAST_DURATION, 3600000));
+    }
+
+    return 0;
+}
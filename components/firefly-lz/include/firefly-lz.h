@@ -0,0 +1,118 @@
+#ifndef __FIREFLY_LZ_H__
+#define __FIREFLY_LZ_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ *  LZ Compression
+ *
+ *  A small LZ77 codec using LZ4-style sequences (without the LZ4
+ *  end-of-block restrictions), intended for messages which are fully
+ *  buffered in RAM. The decoder uses the
+ *  output buffer itself as the window, so it needs no history buffer
+ *  of its own and can be fed arbitrarily split chunks as they arrive.
+ *
+ *  The stream is a series of sequences:
+ *    - a token; the top nibble is the literal count and the bottom
+ *      nibble is the match length (minus FFX_LZ_MIN_MATCH); a nibble
+ *      of 15 is extended by following bytes, each added to it until
+ *      one is not 255
+ *    - the literal bytes
+ *    - a 2-byte little-endian match distance (omitted in the final
+ *      sequence, which only contains literals)
+ *
+ *  Inputs are limited to 64kb, so positions fit in a uint16_t.
+ */
+
+
+#define FFX_LZ_MIN_MATCH        (4)
+#define FFX_LZ_MAX_LENGTH       (0xffff)
+
+// The number of entries in the compressor's hash table
+#define FFX_LZ_TABLE_BITS       (10)
+#define FFX_LZ_TABLE_SIZE       (1 << FFX_LZ_TABLE_BITS)
+
+
+typedef enum FfxLzStatus {
+    // No error
+    FfxLzStatusOK                = 0,
+
+    // The output would exceed its buffer
+    FfxLzStatusBufferOverrun     = -31,
+
+    // The stream is not valid (e.g. a match before the start of the
+    // output or a truncated sequence)
+    FfxLzStatusBadData           = -33,
+} FfxLzStatus;
+
+/**
+ *  The streaming decoder state.
+ *
+ *  This should not be modified directly! Only use the provided API.
+ */
+typedef struct FfxLzDecoder {
+    uint8_t *data;
+    size_t length;
+    size_t offset;
+
+    uint8_t state;
+    uint8_t token;
+    uint16_t distance;
+    size_t count;
+} FfxLzDecoder;
+
+
+/**
+ *  Returns the largest possible compressed length of %%length%% bytes
+ *  (i.e. when no matches are found).
+ */
+size_t ffx_lz_getBound(size_t length);
+
+/**
+ *  Compresses %%data%% into %%output%%, using %%table%% (of
+ *  FFX_LZ_TABLE_SIZE entries) as workspace.
+ *
+ *  Returns the compressed length, or 0 if it would exceed
+ *  %%outputLength%% or %%length%% exceeds FFX_LZ_MAX_LENGTH.
+ */
+size_t ffx_lz_compress(const uint8_t *data, size_t length, uint8_t *output,
+  size_t outputLength, uint16_t *table);
+
+/**
+ *  Initializes %%decoder%% to decompress into %%output%%, which can
+ *  hold up to %%length%% bytes.
+ */
+void ffx_lz_initDecoder(FfxLzDecoder *decoder, uint8_t *output,
+  size_t length);
+
+/**
+ *  Decompresses the next %%length%% bytes of the stream. The stream
+ *  may be split at any point.
+ */
+FfxLzStatus ffx_lz_decode(FfxLzDecoder *decoder, const uint8_t *data,
+  size_t length);
+
+/**
+ *  Returns the number of bytes decompressed so far.
+ */
+size_t ffx_lz_getDecodedLength(FfxLzDecoder *decoder);
+
+/**
+ *  Returns true if the stream so far ends on a sequence boundary (i.e.
+ *  is complete, if no further data is expected).
+ */
+bool ffx_lz_isComplete(FfxLzDecoder *decoder);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FIREFLY_LZ_H__ */
@@ -0,0 +1,267 @@
+#include <string.h>
+
+#include "firefly-lz.h"
+
+
+typedef enum State {
+    StateToken = 0,
+    StateLiteralLength,
+    StateLiterals,
+    StateDistance0,
+    StateDistance1,
+    StateMatchLength,
+} State;
+
+typedef struct Output {
+    uint8_t *data;
+    size_t length;
+    size_t offset;
+} Output;
+
+
+///////////////////////////////
+// Compression
+
+static uint32_t read32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) |
+      ((uint32_t)data[3] << 24);
+}
+
+// Fibonacci hashing of the next FFX_LZ_MIN_MATCH bytes
+static size_t getHash(uint32_t value) {
+    return (value * 2654435761u) >> (32 - FFX_LZ_TABLE_BITS);
+}
+
+static bool writeByte(Output *output, uint8_t value) {
+    if (output->offset >= output->length) { return false; }
+    output->data[output->offset++] = value;
+    return true;
+}
+
+// Writes the extension bytes for a nibble of 15 (%%value%% excludes
+// the 15 already in the nibble)
+static bool writeLength(Output *output, size_t value) {
+    while (value >= 255) {
+        if (!writeByte(output, 255)) { return false; }
+        value -= 255;
+    }
+    return writeByte(output, value);
+}
+
+// Writes a sequence; a %%matchLength%% of 0 indicates the final sequence
+static bool writeSequence(Output *output, const uint8_t *literals,
+  size_t literalCount, size_t distance, size_t matchLength) {
+
+    size_t matchNibble = 0;
+    if (matchLength) { matchNibble = matchLength - FFX_LZ_MIN_MATCH; }
+
+    uint8_t token = ((literalCount < 15) ? literalCount: 15) << 4;
+    token |= (matchNibble < 15) ? matchNibble: 15;
+    if (!writeByte(output, token)) { return false; }
+
+    if (literalCount >= 15 && !writeLength(output, literalCount - 15)) {
+        return false;
+    }
+
+    if (output->offset + literalCount > output->length) { return false; }
+    memcpy(&output->data[output->offset], literals, literalCount);
+    output->offset += literalCount;
+
+    if (matchLength == 0) { return true; }
+
+    if (!writeByte(output, distance & 0xff)) { return false; }
+    if (!writeByte(output, distance >> 8)) { return false; }
+
+    if (matchNibble >= 15 && !writeLength(output, matchNibble - 15)) {
+        return false;
+    }
+
+    return true;
+}
+
+size_t ffx_lz_getBound(size_t length) {
+    return length + (length / 255) + 16;
+}
+
+size_t ffx_lz_compress(const uint8_t *data, size_t length, uint8_t *output,
+  size_t outputLength, uint16_t *table) {
+
+    if (length > FFX_LZ_MAX_LENGTH) { return 0; }
+
+    Output out = { .data = output, .length = outputLength, .offset = 0 };
+
+    // Stale entries are harmless; every candidate is compared
+    memset(table, 0, FFX_LZ_TABLE_SIZE * sizeof(uint16_t));
+
+    size_t anchor = 0, pos = 0;
+    while (pos + FFX_LZ_MIN_MATCH <= length) {
+        uint32_t value = read32(&data[pos]);
+        size_t hash = getHash(value);
+        size_t candidate = table[hash];
+        table[hash] = pos;
+
+        if (candidate >= pos || read32(&data[candidate]) != value) {
+            pos++;
+            continue;
+        }
+
+        // Extend the match forward...
+        size_t matchLength = FFX_LZ_MIN_MATCH;
+        while (pos + matchLength < length &&
+          data[candidate + matchLength] == data[pos + matchLength]) {
+            matchLength++;
+        }
+
+        // ...and backward into any pending literals
+        while (pos > anchor && candidate > 0 &&
+          data[pos - 1] == data[candidate - 1]) {
+            pos--;
+            candidate--;
+            matchLength++;
+        }
+
+        if (!writeSequence(&out, &data[anchor], pos - anchor,
+          pos - candidate, matchLength)) {
+            return 0;
+        }
+
+        pos += matchLength;
+        anchor = pos;
+    }
+
+    if (!writeSequence(&out, &data[anchor], length - anchor, 0, 0)) {
+        return 0;
+    }
+
+    return out.offset;
+}
+
+
+///////////////////////////////
+// Decompression
+
+void ffx_lz_initDecoder(FfxLzDecoder *decoder, uint8_t *output,
+  size_t length) {
+    memset(decoder, 0, sizeof(FfxLzDecoder));
+    decoder->data = output;
+    decoder->length = length;
+    decoder->state = StateToken;
+}
+
+// Copies a match of %%length%% bytes; the source may overlap the
+// destination (e.g. a run), so this must go forward a byte at a time
+static FfxLzStatus copyMatch(FfxLzDecoder *decoder, size_t length) {
+    if (decoder->offset + length > decoder->length) {
+        return FfxLzStatusBufferOverrun;
+    }
+
+    uint8_t *data = decoder->data;
+    size_t offset = decoder->offset;
+    size_t distance = decoder->distance;
+    for (size_t i = 0; i < length; i++) {
+        data[offset + i] = data[offset + i - distance];
+    }
+    decoder->offset += length;
+
+    decoder->state = StateToken;
+
+    return FfxLzStatusOK;
+}
+
+FfxLzStatus ffx_lz_decode(FfxLzDecoder *decoder, const uint8_t *data,
+  size_t length) {
+
+    size_t index = 0;
+    while (index < length) {
+        switch (decoder->state) {
+            case StateToken: {
+                uint8_t token = data[index++];
+                decoder->token = token;
+                decoder->count = token >> 4;
+                if (decoder->count == 15) {
+                    decoder->state = StateLiteralLength;
+                } else if (decoder->count) {
+                    decoder->state = StateLiterals;
+                } else {
+                    decoder->state = StateDistance0;
+                }
+                break;
+            }
+
+            case StateLiteralLength: {
+                uint8_t value = data[index++];
+                decoder->count += value;
+                if (value != 255) { decoder->state = StateLiterals; }
+                break;
+            }
+
+            case StateLiterals: {
+                size_t count = length - index;
+                if (count > decoder->count) { count = decoder->count; }
+
+                if (decoder->offset + count > decoder->length) {
+                    return FfxLzStatusBufferOverrun;
+                }
+
+                memcpy(&decoder->data[decoder->offset], &data[index], count);
+                decoder->offset += count;
+                decoder->count -= count;
+                index += count;
+
+                if (decoder->count == 0) { decoder->state = StateDistance0; }
+                break;
+            }
+
+            case StateDistance0:
+                decoder->distance = data[index++];
+                decoder->state = StateDistance1;
+                break;
+
+            case StateDistance1: {
+                decoder->distance |= data[index++] << 8;
+                if (decoder->distance == 0 ||
+                  decoder->distance > decoder->offset) {
+                    return FfxLzStatusBadData;
+                }
+
+                decoder->count = decoder->token & 0x0f;
+                if (decoder->count == 15) {
+                    decoder->state = StateMatchLength;
+                    break;
+                }
+
+                FfxLzStatus status = copyMatch(decoder,
+                  decoder->count + FFX_LZ_MIN_MATCH);
+                if (status) { return status; }
+                break;
+            }
+
+            case StateMatchLength: {
+                uint8_t value = data[index++];
+                decoder->count += value;
+                if (value == 255) { break; }
+
+                FfxLzStatus status = copyMatch(decoder,
+                  decoder->count + FFX_LZ_MIN_MATCH);
+                if (status) { return status; }
+                break;
+            }
+
+            default:
+                return FfxLzStatusBadData;
+        }
+    }
+
+    return FfxLzStatusOK;
+}
+
+size_t ffx_lz_getDecodedLength(FfxLzDecoder *decoder) {
+    return decoder->offset;
+}
+
+bool ffx_lz_isComplete(FfxLzDecoder *decoder) {
+    // The final sequence omits the distance, so the stream may end
+    // either before a token or where a distance would begin
+    return (decoder->state == StateToken ||
+      decoder->state == StateDistance0);
+}
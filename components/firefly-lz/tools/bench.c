@@ -0,0 +1,182 @@
+/**
+ *  Host benchmark for the LZ codec.
+ *
+ *  Build and run (from the component directory; or tools/bench.sh to
+ *  run it against the bundled corpus):
+ *    cc -O2 -Iinclude src/lz.c tools/bench.c -o bench
+ *    ./bench corpus.txt [more files...]
+ *
+ *  Each file is either text, with one hex-encoded message per line
+ *  (an optional 0x prefix is ignored), such as raw transactions or
+ *  calldata exported from a node, or binary, as a single message (such
+ *  as an FSP message or asset).
+ *
+ *  Messages are decoded in CHUNK_SIZE pieces, as they would arrive
+ *  over BLE.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "firefly-lz.h"
+
+
+// A typical notification payload with a 247 byte MTU
+#define CHUNK_SIZE      (241)
+
+// Repeat each message to get measurable timings
+#define ITERATIONS      (200)
+
+typedef struct Stats {
+    size_t count;
+    size_t length;
+    size_t compressed;
+    double compressTime;
+    double decodeTime;
+} Stats;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int getNibble(int c) {
+    if (c >= '0' && c <= '9') { return c - '0'; }
+    if (c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+    if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+    return -1;
+}
+
+static void bench(const uint8_t *data, size_t length, Stats *stats) {
+    if (length == 0 || length > FFX_LZ_MAX_LENGTH) { return; }
+
+    static uint16_t table[FFX_LZ_TABLE_SIZE];
+
+    size_t bound = ffx_lz_getBound(length);
+    uint8_t *compressed = malloc(bound);
+    uint8_t *output = malloc(length);
+
+    size_t compressedLength = 0;
+    double start = now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        compressedLength = ffx_lz_compress(data, length, compressed, bound,
+          table);
+    }
+    stats->compressTime += now() - start;
+
+    start = now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        FfxLzDecoder decoder;
+        ffx_lz_initDecoder(&decoder, output, length);
+        for (size_t offset = 0; offset < compressedLength;
+          offset += CHUNK_SIZE) {
+            size_t count = compressedLength - offset;
+            if (count > CHUNK_SIZE) { count = CHUNK_SIZE; }
+            ffx_lz_decode(&decoder, &compressed[offset], count);
+        }
+    }
+    stats->decodeTime += now() - start;
+
+    if (memcmp(data, output, length)) {
+        fprintf(stderr, "round-trip mismatch (length=%zu)\n", length);
+        exit(1);
+    }
+
+    stats->count++;
+    stats->length += length;
+    stats->compressed += compressedLength;
+
+    free(compressed);
+    free(output);
+}
+
+static void benchFile(const char *filename, Stats *stats) {
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "cannot open: %s\n", filename);
+        exit(1);
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size_t length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    uint8_t *data = malloc(length + 1);
+    if (fread(data, 1, length, fp) != length) {
+        fprintf(stderr, "cannot read: %s\n", filename);
+        exit(1);
+    }
+    fclose(fp);
+
+    bool isText = true;
+    for (size_t i = 0; i < length && isText; i++) {
+        if (!isxdigit(data[i]) && !isspace(data[i]) && data[i] != 'x') {
+            isText = false;
+        }
+    }
+
+    if (!isText) {
+        bench(data, length, stats);
+        free(data);
+        return;
+    }
+
+    // Decode each line into a message
+    uint8_t *message = malloc(length / 2 + 1);
+    size_t offset = 0;
+    while (offset < length) {
+        size_t end = offset;
+        while (end < length && data[end] != '\n') { end++; }
+
+        size_t start = offset;
+        if (end - start >= 2 && data[start] == '0' && data[start + 1] == 'x') {
+            start += 2;
+        }
+
+        size_t count = 0;
+        for (size_t i = start; i + 1 < end; i += 2) {
+            int hi = getNibble(data[i]), lo = getNibble(data[i + 1]);
+            if (hi < 0 || lo < 0) { break; }
+            message[count++] = (hi << 4) | lo;
+        }
+
+        bench(message, count, stats);
+
+        offset = end + 1;
+    }
+
+    free(message);
+    free(data);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s FILE [FILE ...]\n", argv[0]);
+        return 1;
+    }
+
+    Stats stats = { 0 };
+    for (int i = 1; i < argc; i++) { benchFile(argv[i], &stats); }
+
+    if (stats.count == 0) {
+        fprintf(stderr, "no messages\n");
+        return 1;
+    }
+
+    double mb = (double)stats.length * ITERATIONS / (1024 * 1024);
+    printf("messages:    %zu\n", stats.count);
+    printf("input:       %zu bytes (avg %zu)\n", stats.length,
+      stats.length / stats.count);
+    printf("compressed:  %zu bytes (ratio %.3f, saves %.1f%%)\n",
+      stats.compressed, (double)stats.compressed / stats.length,
+      100.0 * (1.0 - (double)stats.compressed / stats.length));
+    printf("compress:    %.1f MB/s\n", mb / stats.compressTime);
+    printf("decode:      %.1f MB/s (in %d byte chunks)\n",
+      mb / stats.decodeTime, CHUNK_SIZE);
+
+    return 0;
+}
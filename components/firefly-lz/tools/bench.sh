@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# Builds the benchmark and runs it against the bundled transaction
+# corpus (see generate-corpus.py), each transaction alone (as a signing
+# request would carry it) and all of them as a single message (as a
+# batch would).
+#
+# Usage (from anywhere): tools/bench.sh [FILE ...]
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"' EXIT
+
+cc -O2 -Iinclude src/lz.c tools/bench.c -o "$BUILD/bench"
+
+if [ $# -gt 0 ]; then
+    "$BUILD/bench" "$@"
+    exit
+fi
+
+echo "Each transaction:"
+"$BUILD/bench" tools/corpus.txt
+
+# The whole corpus as one binary message
+grep -o '[0-9a-f]*$' tools/corpus.txt | tr -d '\n' | xxd -r -p > "$BUILD/all.bin"
+
+echo
+echo "All transactions as one message:"
+"$BUILD/bench" "$BUILD/all.bin"
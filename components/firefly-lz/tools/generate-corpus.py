@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+
+# Generates a corpus of signed transactions (one hex string per line)
+# for the benchmark, shaped like typical mainnet traffic: EIP-1559 and
+# legacy transactions sending ether, ERC-20 transfers and approvals,
+# Uniswap swaps, Universal Router executes, multicalls and NFT
+# transfers, to the well-known token and router contracts.
+#
+# Keys, amounts and signatures are random (from a fixed seed, so the
+# output is reproducible); the signatures are not valid, but have the
+# same entropy, so the compression ratio is representative.
+#
+# Usage: generate-corpus.py [count] > corpus.txt
+
+import random
+import sys
+
+
+TOKENS = [
+    "a0b86991c6218b36c1d19d4a2e9eb0ce3606eb48",     # USDC
+    "dac17f958d2ee523a2206206994597c13d831ec7",     # USDT
+    "6b175474e89094c44da98b954eedeac495271d0f",     # DAI
+    "c02aaa39b223fe8d0a0e5c4f27ead9083c756cc2",     # WETH
+    "2260fac5e5542a773aa44fbcfedf7c193bc2c599",     # WBTC
+    "514910771af9ca656af840dff83e8264ecf986ca",     # LINK
+]
+
+WETH = "c02aaa39b223fe8d0a0e5c4f27ead9083c756cc2"
+UNISWAP_V2_ROUTER = "7a250d5630b4cf539739df2c5dacb4c659f2488d"
+UNISWAP_V3_ROUTER = "68b3465833fb72a70ecdf485e0e4c7bd8665fc45"
+UNIVERSAL_ROUTER = "3fc91a3afd70395cd496c647d5a6cc9d4b2b7fad"
+PERMIT2 = "000000000022d473030f116ddee9f6b43ac78ba3"
+
+
+###############################
+# RLP
+
+def rlpLength(length, offset):
+    if length < 56:
+        return bytes([ offset + length ])
+    encoded = length.to_bytes((length.bit_length() + 7) // 8, "big")
+    return bytes([ offset + 55 + len(encoded) ]) + encoded
+
+def rlp(value):
+    if isinstance(value, list):
+        payload = b"".join(rlp(v) for v in value)
+        return rlpLength(len(payload), 0xc0) + payload
+    if isinstance(value, int):
+        value = value.to_bytes((value.bit_length() + 7) // 8, "big")
+    if len(value) == 1 and value[0] < 0x80:
+        return value
+    return rlpLength(len(value), 0x80) + value
+
+
+###############################
+# ABI
+
+def word(value):
+    if isinstance(value, str):
+        return bytes(12) + bytes.fromhex(value)
+    if isinstance(value, bool):
+        value = int(value)
+    return value.to_bytes(32, "big")
+
+def dynamic(data):
+    padded = data + bytes((32 - len(data) % 32) % 32)
+    return word(len(data)) + padded
+
+# Encodes %%params%%, where a bytes value is dynamic and a list is a
+# dynamic array (of addresses or of bytes)
+def encode(selector, params):
+    heads, tails = [], []
+    offset = 32 * len(params)
+    for param in params:
+        if isinstance(param, bytes):
+            tail = dynamic(param)
+        elif isinstance(param, list) and param and isinstance(param[0], bytes):
+            inner = encode(b"", param)
+            tail = word(len(param)) + inner
+        elif isinstance(param, list):
+            tail = word(len(param)) + b"".join(word(v) for v in param)
+        else:
+            heads.append(word(param))
+            continue
+        heads.append(word(offset))
+        tails.append(tail)
+        offset += len(tail)
+    return selector + b"".join(heads) + b"".join(tails)
+
+
+###############################
+# Calls
+
+def address():
+    return "%040x" % random.getrandbits(160)
+
+def amount(decimals):
+    return random.randint(1, 50000) * 10 ** random.randint(0, decimals)
+
+def deadline():
+    return 1700000000 + random.randint(0, 50000000)
+
+def transfer():
+    token = random.choice(TOKENS)
+    return (token, 0, encode(bytes.fromhex("a9059cbb"),
+      [ address(), amount(18) ]))
+
+def approve():
+    spender = random.choice([ UNISWAP_V2_ROUTER, PERMIT2, address() ])
+    value = random.choice([ (1 << 256) - 1, amount(18) ])
+    return (random.choice(TOKENS), 0, encode(bytes.fromhex("095ea7b3"),
+      [ spender, value ]))
+
+def transferFrom():
+    return (random.choice(TOKENS), 0, encode(bytes.fromhex("23b872dd"),
+      [ address(), address(), amount(18) ]))
+
+def swapTokens():
+    path = random.sample(TOKENS, random.choice([ 2, 3 ]))
+    return (UNISWAP_V2_ROUTER, 0, encode(bytes.fromhex("38ed1739"),
+      [ amount(18), amount(18), path, address(), deadline() ]))
+
+def swapEth():
+    path = [ WETH ] + random.sample(TOKENS[:3], 1)
+    return (UNISWAP_V2_ROUTER, amount(17), encode(bytes.fromhex("7ff36ab5"),
+      [ amount(6), path, address(), deadline() ]))
+
+def execute():
+    count = random.randint(1, 4)
+    commands = bytes(random.choice([ 0x00, 0x08, 0x0a, 0x0b, 0x0c ])
+      for _ in range(count))
+    inputs = []
+    for _ in range(count):
+        path = b"".join(bytes.fromhex(t) + random.choice([ 500, 3000,
+          10000 ]).to_bytes(3, "big") for t in random.sample(TOKENS, 2))
+        inputs.append(encode(b"", [ address(), amount(18), amount(6),
+          path[:-3], True ]))
+    return (UNIVERSAL_ROUTER, random.choice([ 0, amount(17) ]),
+      encode(bytes.fromhex("3593564c"), [ commands, inputs, deadline() ]))
+
+def multicall():
+    calls = [ transfer()[2] for _ in range(random.randint(2, 4)) ]
+    return (UNISWAP_V3_ROUTER, 0, encode(bytes.fromhex("ac9650d8"),
+      [ calls ]))
+
+def deposit():
+    return (WETH, amount(18), bytes.fromhex("d0e30db0"))
+
+def setApprovalForAll():
+    return (address(), 0, encode(bytes.fromhex("a22cb465"),
+      [ address(), True ]))
+
+def safeTransferFrom():
+    return (address(), 0, encode(bytes.fromhex("42842e0e"),
+      [ address(), address(), random.randint(1, 20000) ]))
+
+def send():
+    return (address(), amount(18), b"")
+
+CALLS = [
+    (send, 20), (transfer, 25), (approve, 12), (transferFrom, 4),
+    (swapTokens, 8), (swapEth, 6), (execute, 12), (multicall, 4),
+    (deposit, 3), (setApprovalForAll, 3), (safeTransferFrom, 3),
+]
+
+
+###############################
+# Transactions
+
+def signature():
+    return (random.getrandbits(256), random.getrandbits(256))
+
+def transaction():
+    call = random.choices([ c for c, _ in CALLS ],
+      weights=[ w for _, w in CALLS ])[0]
+    to, value, data = call()
+
+    nonce = random.randint(0, 3000)
+    gasLimit = 21000 if not data else random.randint(45000, 350000)
+    r, s = signature()
+
+    # Legacy (EIP-155); a minority of traffic
+    if random.random() < 0.15:
+        gasPrice = random.randint(5, 80) * 10 ** 9
+        v = 1 * 2 + 35 + random.randint(0, 1)
+        return rlp([ nonce, gasPrice, gasLimit, bytes.fromhex(to), value,
+          data, v, r, s ])
+
+    # EIP-1559
+    priorityFee = random.randint(1, 3) * 10 ** random.choice([ 8, 9 ])
+    maxFee = priorityFee + random.randint(5, 80) * 10 ** 9
+    return b"\x02" + rlp([ 1, nonce, priorityFee, maxFee, gasLimit,
+      bytes.fromhex(to), value, data, [], random.randint(0, 1), r, s ])
+
+
+if __name__ == "__main__":
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 100
+
+    random.seed(0x46465821)
+    for _ in range(count):
+        print("0x" + transaction().hex())
@@ -10,3 +10,5 @@ node ../firefly-scene/tools/lib/test-cli --rgba assets/ship.png --tag ship > mai
 node ../firefly-scene/tools/lib/test-cli --rgb assets/text-dead.png --tag textdead > main/images/image-text-dead.h
 node ../firefly-scene/tools/lib/test-cli --rgb assets/text-win.png --tag textwin > main/images/image-text-win.h
 node ../firefly-scene/tools/lib/test-cli --rgb assets/text-hold.png --tag texthold > main/images/image-text-hold.h
+
+python3 components/firefly-ethers/tools/generate-selectors.py components/firefly-ethers/tools/selectors.txt > components/firefly-ethers/src/abi-selectors.h
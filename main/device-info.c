@@ -5,8 +5,10 @@
 #include "esp_efuse.h"
 #include "esp_heap_caps.h"
 #include "esp_random.h"
+#include "bootloader_random.h"
 #include "nvs_flash.h"
 
+#include "firefly-crypto.h"
 #include "firefly-hash.h"
 
 #include "device-info.h"
@@ -28,6 +30,9 @@ static uint8_t attestProof[64] = { 0 };
 static uint8_t pubkeyN[384] = { 0 };
 esp_ds_data_t *cipherdata = NULL;
 
+static DeviceStatus sessionReady = DeviceStatusNotInitialized;
+static uint8_t sessionKey[SESSION_KEY_LENGTH] = { 0 };
+
 static void reverseBytes(uint8_t *data, size_t length) {
     for (int i = 0; i < length / 2; i++) {
         uint8_t tmp = data[i];
@@ -143,6 +148,53 @@ DeviceStatus device_init() {
     return ready;
 }
 
+DeviceStatus device_initSessionKey() {
+    if (sessionReady != DeviceStatusNotInitialized) { return sessionReady; }
+
+    nvs_handle_t nvs;
+    if (nvs_open("fsp", NVS_READWRITE, &nvs)) {
+        sessionReady = DeviceStatusMissingNvs;
+        return sessionReady;
+    }
+
+    uint8_t pubkey[FFX_PUBKEY_LENGTH];
+
+    size_t olen = SESSION_KEY_LENGTH;
+    int ret = nvs_get_blob(nvs, "identity", sessionKey, &olen);
+    if (ret || olen != SESSION_KEY_LENGTH ||
+      !ffx_pk_computePubkeySecp256k1(sessionKey, pubkey)) {
+
+        // The RF subsystem is not running yet, so enable an entropy
+        // source for the RNG; retry the (astronomically unlikely)
+        // keys outside the curve order
+        bootloader_random_enable();
+        do {
+            esp_fill_random(sessionKey, SESSION_KEY_LENGTH);
+        } while (!ffx_pk_computePubkeySecp256k1(sessionKey, pubkey));
+        bootloader_random_disable();
+
+        ret = nvs_set_blob(nvs, "identity", sessionKey, SESSION_KEY_LENGTH);
+        if (ret == ESP_OK) { ret = nvs_commit(nvs); }
+        if (ret) {
+            nvs_close(nvs);
+            memset(sessionKey, 0, SESSION_KEY_LENGTH);
+            sessionReady = DeviceStatusMissingNvs;
+            return sessionReady;
+        }
+    }
+
+    nvs_close(nvs);
+
+    sessionReady = DeviceStatusOk;
+    return sessionReady;
+}
+
+DeviceStatus device_getSessionKey(uint8_t *privkey) {
+    if (sessionReady != DeviceStatusOk) { return sessionReady; }
+    memcpy(privkey, sessionKey, SESSION_KEY_LENGTH);
+    return DeviceStatusOk;
+}
+
 DeviceStatus device_attest(uint8_t *challenge, DeviceAttestation *attest) {
     if (!ready) { return ready; }
 
@@ -38,6 +38,15 @@ DeviceStatus device_getModelName(char *output, size_t length);
 
 DeviceStatus device_canAttest();
 
+#define SESSION_KEY_LENGTH  (32)
+
+// Loads the FSP session key (a secp256k1 private key), creating it on
+// first boot. It is kept in NVS (unlike the attestation key, which is
+// provisioned) so hosts can pin its public key. Requires NVS.
+DeviceStatus device_initSessionKey();
+
+DeviceStatus device_getSessionKey(uint8_t *privkey);
+
 #define CHALLENGE_LENGTH    (32)
 
 typedef struct DeviceAttestation {
@@ -11,34 +11,144 @@ extern "C" {
  */
 
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "events.h"
 #include "panel.h"
 
+
+// The most render filters per panel which are coalesced (each panel
+// normally has one)
+#define MAX_RENDER_FILTERS  (2)
+
+// Default gesture timing (see panel_setKeyTiming)
+#define KEY_LONG_PRESS        (1000)
+#define KEY_REPEAT_DELAY      (400)
+#define KEY_REPEAT_INTERVAL   (100)
+
+typedef struct KeyTiming {
+    uint32_t longPress;
+    uint32_t repeatDelay;
+    uint32_t repeatInterval;
+} KeyTiming;
+
+/**
+ *  The struct stored in the Task Queue for a Panel to manage
+ *  pending events.
+ */
+typedef struct EventDispatch {
+    EventCallback callback;
+    void* arg;
+    EventPayload payload;
+} EventDispatch;
+
 /**
  *  The struct storing a Panels state. This is stored on the stack of
- *  the Panel and is reclaimed when the task exists. It should not have
- *  any references maintained to it as it could vanish at any time.
+ *  the Panel's task and is reclaimed when the panel pops. It should not
+ *  have any references maintained to it as it could vanish at any time.
  */
 typedef struct PanelContext {
+    // Keys, messages, panel and custom events, in order
     QueueHandle_t events;
+
+    // Frame ticks, kept separately so they never displace the events
+    // above; a pending render is replaced by each newer one, so only
+    // the latest is dispatched (once the events queue is empty)
+    EventDispatch renders[MAX_RENDER_FILTERS];
+    uint8_t renderPending;
+
+    // Notified whenever an event is added to either
+    TaskHandle_t task;
+
+    // Read by the IO task while the panel is active
+    KeyTiming keyTiming;
+
     int id;
     uint8_t *state;
     FfxNode node;
     struct PanelContext *parent;
     PanelStyle style;
+
+    // Set by panel_pop; the event loop ends after the current callback
+    bool popped;
+
+    size_t stateSize;
+
+    // Whether the panel may hibernate (see panel_enableHibernate) and,
+    // while it does, its compressed state
+    bool hibernate;
+    uint8_t *compact;
+    size_t compactLength;
+
+    // The callback being dispatched (event is 0 between callbacks) and
+    // the frames its queue has been full for; read by the IO task
+    EventName dispatchEvent;
+    EventCallback dispatchCallback;
+    uint32_t fullFrames;
 } PanelContext;
 
 /**
- *  The struct stored in the Task Queue for a Panel to manage
- *  pending events.
+ *  Counts of events since boot, across all panels.
  */
-typedef struct EventDispatch {
+typedef struct EventStats {
+    // Events added to a panel queue (or render lane)
+    uint32_t queued;
+
+    // Render events replaced by a newer one before being dispatched
+    uint32_t coalesced;
+
+    // Events lost because a panel queue was full
+    uint32_t dropped;
+} EventStats;
+
+/**
+ *  Counts of panel pushes since boot.
+ */
+typedef struct PanelStats {
+    uint32_t pushes;
+
+    // Time (in us) from panel_push until the new panel is active
+    uint32_t lastPushTime;
+    uint32_t maxPushTime;
+
+    // Panel slots in use, now and at most
+    uint32_t active;
+    uint32_t maxActive;
+
+    // The least stack remaining (in bytes) on any panel task
+    uint32_t stackFree;
+
+    // Panels hibernating and the size of their compressed state
+    uint32_t hibernating;
+    uint32_t hibernateBytes;
+
+    // Callbacks over the budget, and panels whose queue stayed full
+    // (see panel_setWatchdog)
+    uint32_t slowCallbacks;
+    uint32_t stalls;
+
+    // Pushes which found their panel preloaded, and which did not
+    uint32_t preloadHits;
+    uint32_t preloadMisses;
+} PanelStats;
+
+#define CALLBACK_BUCKETS    (8)
+
+/**
+ *  The durations of the callbacks for one filter (by event name and
+ *  callback) since boot. Bucket i counts durations under (250us << i)
+ *  and the last bucket counts the rest.
+ */
+typedef struct CallbackProfile {
+    EventName event;
     EventCallback callback;
-    void* arg;
-    EventPayload payload;
-} EventDispatch;
+
+    uint32_t count;
+    uint32_t slow;
+    uint32_t maxTime;
+    uint32_t buckets[CALLBACK_BUCKETS];
+} CallbackProfile;
 
 /**
  *  Reference to the current activePanel. Do not store a reference to
@@ -51,11 +161,91 @@ extern PanelContext *activePanel;
  */
 void events_init();
 
+/**
+ *  Creates the panel tasks. Must be called before the first panel_push.
+ */
+void panel_init();
+
+/**
+ *  Copies the panel counters into %%stats%%.
+ */
+void panel_getStats(PanelStats *stats);
+
+/**
+ *  Warn about any callback which takes longer than %%budget%% us, and
+ *  flag any panel whose queue is full for %%stallFrames%% frames.
+ */
+void panel_setWatchdog(uint32_t budget, uint32_t stallFrames);
+
+/**
+ *  Copies up to %%count%% callback profiles into %%profiles%%, slowest
+ *  (by maxTime) first, returning the number copied.
+ */
+size_t panel_getProfiles(CallbackProfile *profiles, size_t count);
+
+/**
+ *  Checks each panel queue for a stall. Called by the IO task once per
+ *  frame.
+ */
+void panel_checkStalls();
+
+/**
+ *  Discards any scene batch the calling panel is still recording and
+ *  waits until any committed batch has been applied, so none refers to
+ *  the nodes of a panel about to be removed. Called by panel_pop.
+ */
+void panel_flushScene();
+
+/**
+ *  The number of scene batches split since boot because they staged
+ *  more commands (or text) than a batch holds.
+ */
+uint32_t panel_getSceneOverflows();
+
 /**
  *  Remove all filters for %%panel%%. Used when a Panel is destroyed.
+ *  Once this returns, no emit can still be delivering to %%panel%%.
  */
 void events_clearFilters(PanelContext *panel);
 
+/**
+ *  Stops delivering events to %%panel%%, which is hibernating; any
+ *  event (or timer) for it is dropped until events_resume. Once this
+ *  returns, no emit can still be delivering to it.
+ */
+void events_suspend(PanelContext *panel);
+
+/**
+ *  Resumes delivering events to %%panel%% on the calling task, once its
+ *  state has moved from %%oldState%% to panel->state. Any filter or timer
+ *  arg which pointed into the old state is moved with it.
+ */
+void events_resume(PanelContext *panel, uint8_t *oldState);
+
+/**
+ *  Waits up to %%timeout%% ticks for the next event for %%panel%%,
+ *  which must be the calling task's. Any queued events are returned
+ *  before a pending render. Returns false on timeout.
+ */
+bool events_receive(PanelContext *panel, EventDispatch *dispatch,
+  TickType_t timeout);
+
+/**
+ *  Dispatches any timers due at %%now%%. Called by the IO task.
+ */
+void events_tickTimers(uint32_t now);
+
+/**
+ *  Returns the event name a message for %%method%% is emitted as, which
+ *  routes it to any handler for the method (see panel_onMessage).
+ */
+EventName events_messageName(const char *method);
+
+/**
+ *  Copies the event counters into %%stats%%.
+ */
+void events_getStats(EventStats *stats);
+
 
 
 #ifdef __cplusplus
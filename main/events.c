@@ -1,14 +1,28 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #include "events-private.h"
 
 #include "panel.h"
+#include "utils.h"
 
 
 #define MAX_EVENT_FILTERS  (32)
 
+// Filters are bucketed by category, so an emit only visits the
+// filters which could match it
+typedef enum EventCategory {
+    EventCategoryRenderScene = 0,
+    EventCategoryMessage,
+    EventCategoryKeys,
+    EventCategoryPanel,
+    EventCategoryCustom,
+    EventCategoryCount
+} EventCategory;
+
 typedef struct EventFilter {
     int id;
 
@@ -19,13 +33,461 @@ typedef struct EventFilter {
     void *arg;
 } EventFilter;
 
-// List of filters
-static EventFilter eventFilters[MAX_EVENT_FILTERS] = { 0 };
-
-// Lock to acquire before modifying eventFilters.
+// The filters, sorted by category and then owning panel; the filters
+// for a category are [ offsets[category], offsets[category + 1] )
+typedef struct EventTable {
+    uint8_t offsets[EventCategoryCount + 1];
+    EventFilter filters[MAX_EVENT_FILTERS];
+} EventTable;
+
+// The table is double-buffered, so emitting (on the IO task, every
+// frame) never takes a lock. A writer updates the inactive table and
+// publishes it; before reusing a table it waits for any emit still
+// reading it to finish.
+static EventTable tables[2] = { 0 };
+static uint32_t activeTable = 0;
+static uint32_t readers[2] = { 0 };
+
+// Lock to acquire before modifying the tables (only held by writers)
 static StaticSemaphore_t lockEventsBuffer;
 static SemaphoreHandle_t lockEvents;
 
+static int nextFilterId = 1;
+
+// Guards each panel's render lane
+static portMUX_TYPE lockRender = portMUX_INITIALIZER_UNLOCKED;
+
+
+#define MAX_TIMERS          (16)
+
+// The timer wheel has a slot per ms (a tick), so the IO task only
+// visits the timers in the slots which have passed; a timer further
+// away than a full turn is skipped on each turn until it is due
+#define TIMER_SLOTS         (64)
+
+#define NO_TIMER            (-1)
+
+typedef struct Timer {
+    // 0 if free
+    int id;
+
+    PanelContext *panel;
+    EventCallback callback;
+    void *arg;
+
+    uint32_t deadline;
+
+    // 0 for a timeout
+    uint32_t interval;
+
+    // The next timer in the same slot
+    int8_t next;
+} Timer;
+
+static Timer timers[MAX_TIMERS] = { 0 };
+static int8_t wheel[TIMER_SLOTS];
+
+// The first tick not yet processed
+static uint32_t wheelTime = 0;
+
+static int nextTimerId = 1;
+
+// Guards the timers and wheel
+static portMUX_TYPE lockTimers = portMUX_INITIALIZER_UNLOCKED;
+
+static EventStats stats = { 0 };
+
+
+#define MAX_MESSAGE_ROUTES  (8)
+
+// A registered message handler; the filter for it has the route as its
+// arg and dispatchMessage as its callback
+typedef struct MessageRoute {
+    // 0 if free
+    int filterId;
+
+    PanelContext *panel;
+    const MessageHandler *handler;
+    void *arg;
+} MessageRoute;
+
+// Guarded by lockEvents
+static MessageRoute routes[MAX_MESSAGE_ROUTES] = { 0 };
+
+static void dispatchMessage(EventPayload event, void *arg);
+
+
+///////////////////////////////
+// Table
+
+static int getCategory(EventName event) {
+    if (event & EventNameCustom) { return EventCategoryCustom; }
+
+    switch (event & EventNameCategoryMask) {
+        case EventNameKeys:
+            return EventCategoryKeys;
+        case EventNamePanel:
+            return EventCategoryPanel;
+    }
+
+    switch (event & EventNameMask) {
+        case EventNameRenderScene:
+            return EventCategoryRenderScene;
+        case EventNameMessage:
+            return EventCategoryMessage;
+    }
+
+    return -1;
+}
+
+// Returns the index of the first filter in %%category%% owned by
+// %%panel%% (or where it would be inserted)
+static int findPanel(const EventTable *table, int category,
+  const PanelContext *panel) {
+
+    int lo = table->offsets[category], hi = table->offsets[category + 1];
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if ((uintptr_t)table->filters[mid].panel < (uintptr_t)panel) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Pins the published table for reading; this never blocks
+static const EventTable* beginRead(uint32_t *index) {
+    while (1) {
+        uint32_t active = __atomic_load_n(&activeTable, __ATOMIC_ACQUIRE);
+        __atomic_add_fetch(&readers[active], 1, __ATOMIC_ACQ_REL);
+
+        // A writer may have begun reusing this table before it was
+        // pinned, in which case another has since been published
+        if (__atomic_load_n(&activeTable, __ATOMIC_ACQUIRE) == active) {
+            *index = active;
+            return &tables[active];
+        }
+
+        __atomic_sub_fetch(&readers[active], 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void endRead(uint32_t index) {
+    __atomic_sub_fetch(&readers[index], 1, __ATOMIC_RELEASE);
+}
+
+// Returns a copy of the published table to modify. Caller must own
+// the lockEvents mutex.
+static EventTable* beginWrite() {
+    uint32_t next = activeTable ^ 1;
+
+    // Wait for any emit still reading the table from the last write
+    while (__atomic_load_n(&readers[next], __ATOMIC_ACQUIRE)) { delay(1); }
+
+    tables[next] = tables[activeTable];
+    return &tables[next];
+}
+
+static void endWrite() {
+    __atomic_store_n(&activeTable, activeTable ^ 1, __ATOMIC_RELEASE);
+}
+
+// Waits for any emit already in progress to finish
+static void waitForReaders() {
+    for (int i = 0; i < 2; i++) {
+        while (__atomic_load_n(&readers[i], __ATOMIC_ACQUIRE)) { delay(1); }
+    }
+}
+
+static void removeFilter(EventTable *table, int category, int index) {
+    const EventFilter *filter = &table->filters[index];
+    if (filter->callback == dispatchMessage) {
+        MessageRoute *route = filter->arg;
+        route->filterId = 0;
+    }
+
+    int end = table->offsets[EventCategoryCount];
+    memmove(&table->filters[index], &table->filters[index + 1],
+      (end - index - 1) * sizeof(EventFilter));
+    for (int i = category + 1; i <= EventCategoryCount; i++) {
+        table->offsets[i]--;
+    }
+}
+
+
+///////////////////////////////
+// Lanes
+
+static void countEvent(uint32_t *counter) {
+    __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
+
+// Sets (or replaces) the pending render for the filter of %%event%%
+static bool queueRender(PanelContext *panel, const EventDispatch *event) {
+    bool queued = false, coalesced = false;
+
+    taskENTER_CRITICAL(&lockRender);
+
+    int slot = -1;
+    for (int i = 0; i < MAX_RENDER_FILTERS; i++) {
+        if (!(panel->renderPending & (1 << i))) {
+            if (slot == -1) { slot = i; }
+            continue;
+        }
+
+        if (panel->renders[i].payload.eventId == event->payload.eventId) {
+            slot = i;
+            coalesced = true;
+            break;
+        }
+    }
+
+    if (slot >= 0) {
+        panel->renders[slot] = *event;
+        panel->renderPending |= (1 << slot);
+        queued = true;
+    }
+
+    taskEXIT_CRITICAL(&lockRender);
+
+    if (coalesced) {
+        countEvent(&stats.coalesced);
+    } else if (queued) {
+        countEvent(&stats.queued);
+    }
+
+    return queued;
+}
+
+static bool takeRender(PanelContext *panel, EventDispatch *dispatch) {
+    bool found = false;
+
+    taskENTER_CRITICAL(&lockRender);
+
+    for (int i = 0; i < MAX_RENDER_FILTERS; i++) {
+        if (!(panel->renderPending & (1 << i))) { continue; }
+        *dispatch = panel->renders[i];
+        panel->renderPending &= ~(1 << i);
+        found = true;
+        break;
+    }
+
+    taskEXIT_CRITICAL(&lockRender);
+
+    return found;
+}
+
+
+///////////////////////////////
+// Timers
+
+// Caller must own lockTimers
+static void insertTimer(int index) {
+    int8_t *slot = &wheel[timers[index].deadline % TIMER_SLOTS];
+    timers[index].next = *slot;
+    *slot = index;
+}
+
+// Caller must own lockTimers
+static void unlinkTimer(int index) {
+    int8_t *link = &wheel[timers[index].deadline % TIMER_SLOTS];
+    while (*link != NO_TIMER) {
+        if (*link == index) {
+            *link = timers[index].next;
+            break;
+        }
+        link = &timers[*link].next;
+    }
+}
+
+// Caller must own lockTimers
+static void removeTimer(int index) {
+    unlinkTimer(index);
+    timers[index].id = 0;
+}
+
+static int setTimer(EventCallback callback, uint32_t delay,
+  uint32_t interval, void *arg) {
+
+    PanelContext *ctx = (void*)xTaskGetApplicationTaskTag(NULL);
+    if (ctx == NULL) { return 0; }
+
+    int timerId = -1;
+
+    taskENTER_CRITICAL(&lockTimers);
+
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        Timer *timer = &timers[i];
+        if (timer->id) { continue; }
+
+        timerId = nextTimerId++;
+
+        timer->id = timerId;
+        timer->panel = ctx;
+        timer->callback = callback;
+        timer->arg = arg;
+        timer->interval = interval;
+
+        // Never in a slot the IO task has already passed
+        timer->deadline = ticks() + (delay ? delay: 1);
+        if ((int32_t)(timer->deadline - wheelTime) < 0) {
+            timer->deadline = wheelTime;
+        }
+
+        insertTimer(i);
+        break;
+    }
+
+    taskEXIT_CRITICAL(&lockTimers);
+
+    if (timerId == -1) { printf("No timer\n"); }
+
+    return timerId;
+}
+
+// Removes any timer for %%panel%% (if %%timerId%% is 0) or only
+// %%timerId%%
+static void clearTimers(PanelContext *panel, int timerId) {
+    taskENTER_CRITICAL(&lockTimers);
+
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        Timer *timer = &timers[i];
+        if (timer->id == 0 || timer->panel != panel) { continue; }
+        if (timerId && timer->id != timerId) { continue; }
+        removeTimer(i);
+    }
+
+    taskEXIT_CRITICAL(&lockTimers);
+}
+
+
+///////////////////////////////
+// Messages
+
+// Returns true if %%filter%% is a handler for %%method%% (which hashed
+// to %%eventName%%); the hash only rules out other handlers, so any
+// collision is caught here
+static bool isHandler(const EventFilter *filter, EventName eventName,
+  const char *method) {
+
+    if (filter->event != eventName || filter->callback != dispatchMessage) {
+        return false;
+    }
+
+    const MessageRoute *route = filter->arg;
+    return (strcmp(route->handler->method, method) == 0);
+}
+
+// Binds the %%params%% of a message into %%output%% in a single pass
+// over the map. Returns false if a param has the wrong type or a
+// required param is missing.
+static bool bindParams(const MessageHandler *handler, FfxCborCursor *params,
+  uint8_t *output) {
+
+    memset(output, 0, handler->paramsSize);
+
+    uint32_t required = 0, found = 0;
+    for (int i = 0; i < handler->paramCount; i++) {
+        const MessageParam *param = &handler->params[i];
+        if (param->required) { required |= ((uint32_t)1 << i); }
+
+        if (param->key == NULL) {
+            ffx_cbor_clone((FfxCborCursor*)&output[param->offset], params);
+            found |= ((uint32_t)1 << i);
+        }
+    }
+
+    if (ffx_cbor_getType(params) == FfxCborTypeMap) {
+        FfxCborCursor value, key;
+        ffx_cbor_clone(&value, params);
+
+        FfxCborStatus status = ffx_cbor_firstValue(&value, &key);
+        while (status == FfxCborStatusOK) {
+            uint8_t *name = NULL;
+            size_t length = 0;
+            if (ffx_cbor_getData(&key, &name, &length)) { return false; }
+
+            for (int i = 0; i < handler->paramCount; i++) {
+                const MessageParam *param = &handler->params[i];
+                if (param->key == NULL || strlen(param->key) != length ||
+                  memcmp(param->key, name, length)) {
+                    continue;
+                }
+
+                FfxCborType type = ffx_cbor_getType(&value);
+                uint8_t *field = &output[param->offset];
+                uint64_t number = 0;
+
+                switch (param->type) {
+                    case MessageParamTypeNumber:
+                    case MessageParamTypeBoolean:
+                        if (type != ((param->type == MessageParamTypeNumber) ?
+                          FfxCborTypeNumber: FfxCborTypeBoolean)) {
+                            return false;
+                        }
+                        if (ffx_cbor_getValue(&value, &number)) {
+                            return false;
+                        }
+                        if (param->type == MessageParamTypeNumber) {
+                            *(uint64_t*)field = number;
+                        } else {
+                            *(bool*)field = (number != 0);
+                        }
+                        break;
+
+                    case MessageParamTypeData:
+                    case MessageParamTypeString: {
+                        if (type != ((param->type == MessageParamTypeData) ?
+                          FfxCborTypeData: FfxCborTypeString)) {
+                            return false;
+                        }
+                        MessageData *data = (MessageData*)field;
+                        if (ffx_cbor_getData(&value, (uint8_t**)&data->data,
+                          &data->length)) {
+                            return false;
+                        }
+                        break;
+                    }
+
+                    case MessageParamTypeCbor:
+                        ffx_cbor_clone((FfxCborCursor*)field, &value);
+                        break;
+
+                    default:
+                        return false;
+                }
+
+                found |= ((uint32_t)1 << i);
+                break;
+            }
+
+            status = ffx_cbor_nextValue(&value, &key);
+        }
+
+        if (status != FfxCborStatusNotFound) { return false; }
+    }
+
+    return ((found & required) == required);
+}
+
+static void dispatchMessage(EventPayload event, void *arg) {
+    MessageRoute *route = arg;
+
+    // Removed since the message was queued
+    if (route->filterId != event.eventId) { return; }
+
+    const MessageHandler *handler = route->handler;
+
+    uint64_t params[MAX_MESSAGE_PARAMS_SIZE / sizeof(uint64_t)];
+    bool valid = bindParams(handler, &event.props.message.params,
+      (uint8_t*)params);
+
+    handler->callback(event.props.message.id, valid ? params: NULL,
+      route->arg);
+}
+
 
 ///////////////////////////////
 // Private API (events-private.h)
@@ -33,57 +495,249 @@ static SemaphoreHandle_t lockEvents;
 void events_init() {
     lockEvents = xSemaphoreCreateBinaryStatic(&lockEventsBuffer);
     xSemaphoreGive(lockEvents);
+
+    for (int i = 0; i < TIMER_SLOTS; i++) { wheel[i] = NO_TIMER; }
+    wheelTime = ticks();
 }
 
 void events_clearFilters(PanelContext *panel) {
+    clearTimers(panel, 0);
+
     xSemaphoreTake(lockEvents, portMAX_DELAY);
 
-    for (int i = 0; i < MAX_EVENT_FILTERS; i++) {
-        EventFilter *filter = &eventFilters[i];
-        if (filter->event == 0 || filter->panel != panel) { continue; }
-        filter->event = 0;
+    EventTable *table = beginWrite();
+
+    for (int category = 0; category < EventCategoryCount; category++) {
+        int index = findPanel(table, category, panel);
+        while (index < table->offsets[category + 1] &&
+          table->filters[index].panel == panel) {
+            removeFilter(table, category, index);
+        }
     }
 
+    endWrite();
+
+    // The panel's task (and queue) is reused, so wait for any emit
+    // still reading the table which included its filters
+    waitForReaders();
+
     xSemaphoreGive(lockEvents);
 }
 
+// Returns %%arg%%, moved with the state if it pointed into it
+static void* moveArg(void *arg, const uint8_t *oldState,
+  uint8_t *state, size_t stateSize) {
+
+    uintptr_t offset = (uintptr_t)arg - (uintptr_t)oldState;
+    if (offset >= stateSize) { return arg; }
+    return &state[offset];
+}
+
+void events_suspend(PanelContext *panel) {
+    __atomic_store_n(&panel->task, NULL, __ATOMIC_RELEASE);
+
+    waitForReaders();
+
+    taskENTER_CRITICAL(&lockRender);
+    panel->renderPending = 0;
+    taskEXIT_CRITICAL(&lockRender);
+}
+
+void events_resume(PanelContext *panel, uint8_t *oldState) {
+    if (oldState != panel->state) {
+        xSemaphoreTake(lockEvents, portMAX_DELAY);
+
+        EventTable *table = beginWrite();
+        for (int i = 0; i < table->offsets[EventCategoryCount]; i++) {
+            EventFilter *filter = &table->filters[i];
+            if (filter->panel != panel) { continue; }
+            filter->arg = moveArg(filter->arg, oldState, panel->state,
+              panel->stateSize);
+        }
+        endWrite();
+
+        for (int i = 0; i < MAX_MESSAGE_ROUTES; i++) {
+            MessageRoute *route = &routes[i];
+            if (route->filterId == 0 || route->panel != panel) { continue; }
+            route->arg = moveArg(route->arg, oldState, panel->state,
+              panel->stateSize);
+        }
+
+        xSemaphoreGive(lockEvents);
+
+        taskENTER_CRITICAL(&lockTimers);
+        for (int i = 0; i < MAX_TIMERS; i++) {
+            Timer *timer = &timers[i];
+            if (timer->id == 0 || timer->panel != panel) { continue; }
+            timer->arg = moveArg(timer->arg, oldState, panel->state,
+              panel->stateSize);
+        }
+        taskEXIT_CRITICAL(&lockTimers);
+    }
+
+    __atomic_store_n(&panel->task, xTaskGetCurrentTaskHandle(),
+      __ATOMIC_RELEASE);
+}
+
+bool events_receive(PanelContext *panel, EventDispatch *dispatch,
+  TickType_t timeout) {
+
+    while (1) {
+        if (xQueueReceive(panel->events, dispatch, 0) == pdPASS) {
+            return true;
+        }
+
+        if (takeRender(panel, dispatch)) { return true; }
+
+        // Any event added since the checks above has already notified
+        if (ulTaskNotifyTake(pdTRUE, timeout) == 0) { return false; }
+    }
+}
+
+void events_tickTimers(uint32_t now) {
+    EventDispatch due[MAX_TIMERS];
+    PanelContext *panels[MAX_TIMERS];
+    int count = 0;
+
+    taskENTER_CRITICAL(&lockTimers);
+
+    // Each slot need only be visited once, however far behind
+    uint32_t elapsed = now + 1 - wheelTime;
+    if (elapsed > TIMER_SLOTS) {
+        wheelTime = now + 1 - TIMER_SLOTS;
+    }
+
+    while ((int32_t)(now - wheelTime) >= 0) {
+        int8_t index = wheel[wheelTime % TIMER_SLOTS];
+        while (index != NO_TIMER) {
+            Timer *timer = &timers[index];
+            int8_t next = timer->next;
+
+            if ((int32_t)(timer->deadline - now) <= 0) {
+                EventDispatch *event = &due[count];
+                panels[count++] = timer->panel;
+
+                event->callback = timer->callback;
+                event->arg = timer->arg;
+                event->payload.event = EventNameTimer;
+                event->payload.eventId = timer->id;
+                event->payload.props.timer.ticks = now;
+
+                if (timer->interval) {
+                    // Skip any intervals missed while the panel was
+                    // busy (rather than delivering them in a burst)
+                    uint32_t deadline = timer->deadline + timer->interval;
+                    if ((int32_t)(deadline - now) <= 0) {
+                        deadline = now + timer->interval;
+                    }
+
+                    unlinkTimer(index);
+                    timer->deadline = deadline;
+                    insertTimer(index);
+
+                } else {
+                    removeTimer(index);
+                }
+            }
+
+            index = next;
+        }
+
+        wheelTime++;
+    }
+
+    taskEXIT_CRITICAL(&lockTimers);
+
+    // Through the same queue as keys, so ordered with them
+    for (int i = 0; i < count; i++) {
+        PanelContext *panel = panels[i];
+
+        // Hibernating
+        TaskHandle_t task = __atomic_load_n(&panel->task, __ATOMIC_ACQUIRE);
+
+        if (task && xQueueSendToBack(panel->events, &due[i], 0) == pdTRUE) {
+            countEvent(&stats.queued);
+            xTaskNotifyGive(task);
+        } else {
+            countEvent(&stats.dropped);
+        }
+    }
+}
+
+EventName events_messageName(const char *method) {
+    // FNV-1a, folded to the filter info bits
+    uint32_t hash = 0x811c9dc5;
+    while (*method) {
+        hash ^= (uint8_t)*method++;
+        hash *= 0x01000193;
+    }
+
+    // An info of 0 is the filter for any message, so never produce it
+    uint32_t info = (hash >> 24) ^ (hash & EventNameInfoMask);
+    if (info == 0) { info = 1; }
+
+    return EventNameMessage | info;
+}
+
+void events_getStats(EventStats *result) {
+    result->queued = __atomic_load_n(&stats.queued, __ATOMIC_RELAXED);
+    result->coalesced = __atomic_load_n(&stats.coalesced, __ATOMIC_RELAXED);
+    result->dropped = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+}
+
 
 ///////////////////////////////
 // API
 
 void panel_emitEvent(EventName eventName, EventPayloadProps props) {
 
-     EventDispatch event = { 0 };
-
-     xSemaphoreTake(lockEvents, portMAX_DELAY);
-
-    static uint32_t countOk = 0, countFail = 0;
-    for (int i = 0; i < MAX_EVENT_FILTERS; i++) {
-        EventFilter *filter = &eventFilters[i];
+    int category = getCategory(eventName);
+    if (category < 0) {
+        printf("emit: unknown event: 0x%08x\n", eventName);
+        return;
+    }
 
-        // Filter events (and munge/set payload props)
+    PanelContext *panel = activePanel;
 
-        if (filter->event == 0 || filter->panel != activePanel) {
-            // Not an event or not an event for the active panel
-            continue;
+    EventDispatch event = { 0 };
 
-        } else if (eventName == EventNameRenderScene) {
-            if (filter->event != EventNameRenderScene) { continue; }
+    uint32_t index;
+    const EventTable *table = beginRead(&index);
 
-            event.payload.props = props; // Does this work?
+    // Hibernating (while being popped back to)
+    TaskHandle_t task = NULL;
+    if (panel) { task = __atomic_load_n(&panel->task, __ATOMIC_ACQUIRE); }
+    if (task == NULL) {
+        endRead(index);
+        return;
+    }
 
-        } else if (eventName == EventNameMessage) {
-            if (filter->event != EventNameMessage) { continue; }
+    int start = findPanel(table, category, panel);
+    int end = table->offsets[category + 1];
+
+    // A message goes to the panel's handler for its method or, only if
+    // it has none, to its EventNameMessage filters
+    bool routed = false;
+    if (category == EventCategoryMessage && eventName != EventNameMessage) {
+        for (int i = start; i < end; i++) {
+            const EventFilter *filter = &table->filters[i];
+            if (filter->panel != panel) { break; }
+            if (isHandler(filter, eventName, props.message.method)) {
+                routed = true;
+                break;
+            }
+        }
+    }
 
-            event.payload.props = props; // Does this work?
+    for (int i = start; i < end; i++) {
+        const EventFilter *filter = &table->filters[i];
 
-        } else if (eventName & EventNamePanel) {
-            if (filter->event != eventName) { continue; }
+        // Only events for the active panel
+        if (filter->panel != panel) { break; }
 
-            event.payload.props = props; // Does this work?
+        // Filter events (and munge/set payload props)
 
-        } else if (eventName & EventNameKeys) {
-            if (!(filter->event & EventNameKeys)) { continue; }
+        if (category == EventCategoryKeys) {
 
             // This keys this event cares about
             Keys keys = filter->event & KeyAll;
@@ -93,28 +747,48 @@ void panel_emitEvent(EventName eventName, EventPayloadProps props) {
             // No keys for this event changed
             if (!changed) { continue; }
 
-            switch (filter->event & EventNameMask) {
-                case EventNameKeysDown:
-                    if (!(keys & changed & down)) { continue; }
-                    break;
-                case EventNameKeysUp:
-                    if (!(keys & changed & ~down)) { continue; }
-                    break;
-                case EventNameKeysChanged:
-                    break;
+            EventName type = filter->event & EventNameMask;
+
+            if (eventName == EventNameKeys) {
+                switch (type) {
+                    case EventNameKeysDown:
+                        if (!(keys & changed & down)) { continue; }
+                        break;
+                    case EventNameKeysUp:
+                        if (!(keys & changed & ~down)) { continue; }
+                        break;
+                    case EventNameKeysChanged:
+                        break;
+                    default:
+                        // A gesture filter
+                        continue;
+                }
+
+            } else if (type != eventName) {
+                continue;
+
+            } else if (type == EventNameKeysChord) {
+                if (keys != props.keys.changed) { continue; }
             }
 
-            event.payload.props.keys.down = down;
+            event.payload.props.keys = props.keys;
             event.payload.props.keys.changed = changed;
 
-        } else if (eventName & EventNameCustom) {
-            if (filter->event != eventName) { continue; }
+        } else if (category == EventCategoryMessage) {
+            if (routed) {
+                if (!isHandler(filter, eventName, props.message.method)) {
+                    continue;
+                }
+            } else if (filter->event != EventNameMessage) {
+                continue;
+            }
 
-            event.payload.props = props; // Does this work?
+            event.payload.props = props;
 
         } else {
-            printf("emit: unknown event: 0x%08x\n", eventName);
-            continue;
+            if (filter->event != eventName) { continue; }
+
+            event.payload.props = props;
         }
 
         event.callback = filter->callback;
@@ -122,68 +796,115 @@ void panel_emitEvent(EventName eventName, EventPayloadProps props) {
         event.payload.event = filter->event;
         event.payload.eventId = filter->id;
 
-        QueueHandle_t events = filter->panel->events;
-        BaseType_t status = xQueueSendToBack(events, &event, 0);
-        if (status != pdTRUE) {
-            printf("FAILED TO QUEUE EVENT: %02x", eventName);
-        /*
-            countFail++;
-            if (countFail == 1 || countFail == 100) {
-                printf("[%s] emit:RenderScene failed: to=panel-%d id=%d ok=%ld>
-                  taskName(NULL), filter->panel->id, filter->id, countOk,
-                  countFail, status);
-                if (countFail == 100) { countOk = countFail = 0; }
-            }
+        bool queued = false;
+        if (category == EventCategoryRenderScene) {
+            queued = queueRender(panel, &event);
         } else {
-            countOk++;
-            */
+            queued = (xQueueSendToBack(panel->events, &event, 0) == pdTRUE);
+            if (queued) { countEvent(&stats.queued); }
+        }
+
+        if (queued) {
+            xTaskNotifyGive(task);
+        } else {
+            countEvent(&stats.dropped);
         }
     }
 
-    xSemaphoreGive(lockEvents);
+    endRead(index);
 }
 
-// Caller must own the lockEvents mutex
-static EventFilter* getEmptyFilter() {
-    for (int i = 0; i < MAX_EVENT_FILTERS; i++) {
-        EventFilter *filter = &eventFilters[i];
+// Adds a filter for %%ctx%%. Caller must own the lockEvents mutex.
+static int addFilter(PanelContext *ctx, int category, EventName event,
+  EventCallback callback, void *arg) {
 
-        // Find an empty DispatchWait entry
-        if (filter->event != 0) { continue; }
+    if (tables[activeTable].offsets[EventCategoryCount] ==
+      MAX_EVENT_FILTERS) {
+        // @TODO: panic?
+        printf("No filter\n");
+        return -1;
+    }
 
-        return filter;
+    int filterId = nextFilterId++;
+
+    EventTable *table = beginWrite();
+
+    // After any existing filters for this panel, so they are
+    // dispatched in the order they were added
+    int index = findPanel(table, category, ctx);
+    while (index < table->offsets[category + 1] &&
+      table->filters[index].panel == ctx) {
+        index++;
+    }
+
+    int end = table->offsets[EventCategoryCount];
+    memmove(&table->filters[index + 1], &table->filters[index],
+      (end - index) * sizeof(EventFilter));
+    for (int i = category + 1; i <= EventCategoryCount; i++) {
+        table->offsets[i]++;
     }
 
-    return NULL;
+    EventFilter *filter = &table->filters[index];
+    filter->id = filterId;
+    filter->panel = ctx;
+
+    filter->event = event;
+    filter->callback = callback;
+    filter->arg = arg;
+
+    endWrite();
+
+    return filterId;
 }
 
 int panel_onEvent(EventName event, EventCallback callback, void *arg) {
     PanelContext *ctx = (void*)xTaskGetApplicationTaskTag(NULL);
     if (ctx == NULL) { return 0; }
 
-    static int nextFilterId = 1;
-
-    int filterId = nextFilterId++;
+    int category = getCategory(event);
+    if (category < 0) { return -1; }
 
     xSemaphoreTake(lockEvents, portMAX_DELAY);
+    int filterId = addFilter(ctx, category, event, callback, arg);
+    xSemaphoreGive(lockEvents);
 
-    EventFilter *filter = getEmptyFilter(event);
-    if (filter == NULL) {
-        // @TODO: panic?
-        printf("No filter\n");
-        xSemaphoreGive(lockEvents);
+    return filterId;
+}
+
+int panel_onMessage(const MessageHandler *handler, void *arg) {
+    PanelContext *ctx = (void*)xTaskGetApplicationTaskTag(NULL);
+    if (ctx == NULL) { return 0; }
+
+    if (handler->paramCount > MAX_MESSAGE_PARAMS ||
+      handler->paramsSize > MAX_MESSAGE_PARAMS_SIZE) {
         return -1;
     }
 
-    filter->id = filterId;
-    filter->panel = ctx;
+    int filterId = -1;
 
-    filter->event = event;
-    filter->callback = callback;
-    filter->arg = arg;
+    xSemaphoreTake(lockEvents, portMAX_DELAY);
+
+    for (int i = 0; i < MAX_MESSAGE_ROUTES; i++) {
+        MessageRoute *route = &routes[i];
+        if (route->filterId) { continue; }
+
+        // Before the filter is published, as emits read the handler
+        route->panel = ctx;
+        route->handler = handler;
+        route->arg = arg;
+
+        filterId = addFilter(ctx, EventCategoryMessage,
+          events_messageName(handler->method), dispatchMessage, route);
+        if (filterId == -1) { break; }
+
+        route->filterId = filterId;
+        break;
+    }
 
     xSemaphoreGive(lockEvents);
 
+    if (filterId == -1) { printf("No message route\n"); }
+
     return filterId;
 }
 
@@ -192,15 +913,56 @@ void panel_offEvent(int filterId) {
     if (ctx == NULL) { return; }
 
     xSemaphoreTake(lockEvents, portMAX_DELAY);
-    for (int i = 0; i < MAX_EVENT_FILTERS; i++) {
-        EventFilter *filter = &eventFilters[i];
-        if (filter->id == filterId) {
-            // Only a task can offEvent its own tasks
-            if (filter->panel == ctx) { filter->event = 0; }
-            break;
+
+    // Only a task can offEvent its own tasks
+    const EventTable *active = &tables[activeTable];
+    for (int category = 0; category < EventCategoryCount; category++) {
+        int index = findPanel(active, category, ctx);
+        for (; index < active->offsets[category + 1]; index++) {
+            const EventFilter *filter = &active->filters[index];
+            if (filter->panel != ctx) { break; }
+            if (filter->id != filterId) { continue; }
+
+            EventTable *table = beginWrite();
+            removeFilter(table, category, index);
+            endWrite();
+
+            xSemaphoreGive(lockEvents);
+            return;
         }
     }
 
     xSemaphoreGive(lockEvents);
 }
 
+int panel_setTimeout(EventCallback callback, uint32_t delay, void *arg) {
+    return setTimer(callback, delay, 0, arg);
+}
+
+int panel_setInterval(EventCallback callback, uint32_t interval,
+  void *arg) {
+
+    if (interval == 0) { interval = 1; }
+    return setTimer(callback, interval, interval, arg);
+}
+
+void panel_clearTimer(int timerId) {
+    PanelContext *ctx = (void*)xTaskGetApplicationTaskTag(NULL);
+    if (ctx == NULL || timerId <= 0) { return; }
+
+    // Only a task can clear its own timers
+    clearTimers(ctx, timerId);
+}
+
+void panel_setKeyTiming(uint32_t longPress, uint32_t repeatDelay,
+  uint32_t repeatInterval) {
+
+    PanelContext *ctx = (void*)xTaskGetApplicationTaskTag(NULL);
+    if (ctx == NULL) { return; }
+
+    ctx->keyTiming = (KeyTiming){
+        .longPress = longPress,
+        .repeatDelay = repeatDelay,
+        .repeatInterval = repeatInterval
+    };
+}
@@ -5,6 +5,8 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "firefly-cbor.h"
@@ -36,17 +38,34 @@ typedef enum EventName {
     // Render Scene (N.B. filter by equality, bottom bits unused)
     EventNameRenderScene    = ((0x01) << 24),
 
-    // Message events (N.B. filter by equality, bottom bits unused)
+    // Message events; info=method hash (see panel_onMessage). A
+    // filter for EventNameMessage alone receives any message for which
+    // the panel has no handler
     EventNameMessage        = ((0x02) << 24),
 
+    // Timer events (N.B. only from panel_setTimeout/setInterval; the
+    // eventId is the timer id)
+    EventNameTimer          = ((0x03) << 24),
+
     // Keypad events; info=keys (N.B. filter by & EventNameKeys)
     EventNameKeysDown       = ((0x11) << 24),
     EventNameKeysUp         = ((0x12) << 24),
-//    EventNameKeysPress      = ((0x13) << 24),  // @TODO: type repeat-rate
     EventNameKeysChanged    = ((0x14) << 24),
 //    EventNameKeysCancelled    = ((0x15) << 24),
     EventNameKeys           = ((0x10) << 24),
 
+    // Key gestures (see panel_setKeyTiming); changed=the keys which
+    // caused it. Keys already held when a panel becomes active are
+    // ignored until released.
+    //  - Press: a key went down, or auto-repeats while held
+    //    (EventKeysFlagsRepeat)
+    //  - LongPress: a key has been held for the long-press duration
+    //  - Chord: exactly the filter keys are held together (emitted as
+    //    the last one goes down)
+    EventNameKeysPress      = ((0x13) << 24),
+    EventNameKeysLongPress  = ((0x16) << 24),
+    EventNameKeysChord      = ((0x17) << 24),
+
     // Panel events; (N.B. filter by & EventNamePanel)
     EventNamePanelFocus     = ((0x21) << 24),
     EventNamePanelBlur      = ((0x22) << 24),
@@ -60,6 +79,9 @@ typedef enum EventName {
 
     // Mask to isolate the event category
     EventNameCategoryMask   = ((0xf0) << 24),
+
+    // Mask to isolate the filter info
+    EventNameInfoMask       = (0xffffff),
 } EventName;
 
 typedef struct EventRenderSceneProps {
@@ -69,12 +91,20 @@ typedef struct EventRenderSceneProps {
 typedef enum EventKeysFlags {
     EventKeysFlagsNone        = 0,
     EventKeysFlagsCancelled   = (1 << 0),
+    EventKeysFlagsRepeat      = (1 << 1),
 } EventKeysFlags;
 
+typedef struct EventTimerProps {
+    uint32_t ticks;
+} EventTimerProps;
+
 typedef struct EventKeysProps {
     Keys down;
     Keys changed;
     uint16_t flags;
+
+    // When the keys were latched
+    uint32_t ticks;
 } EventKeysProps;
 
 typedef struct EventPanelProps {
@@ -99,6 +129,7 @@ typedef struct EventCustomProps {
 // @TODO: rename; remove "Event" suffix;
 typedef union EventPayloadProps {
     EventRenderSceneProps render;
+    EventTimerProps timer;
     EventKeysProps keys;
     EventPanelProps panel;
 //    EventIncomingMessageProps incoming;
@@ -118,6 +149,82 @@ void panel_emitEvent(EventName eventName, EventPayloadProps props);
 int panel_onEvent(EventName event, EventCallback cb, void* arg);
 void panel_offEvent(int eventId);
 
+// Calls %%cb%% on the panel's task once, after %%delay%% ms (or every
+// %%interval%% ms until cleared). The callback receives EventNameTimer,
+// through the same queue as keys, so a panel which only needs to do
+// something periodically need not wake every frame. Returns the timer
+// id, or -1 if all timers are in use.
+int panel_setTimeout(EventCallback cb, uint32_t delay, void* arg);
+int panel_setInterval(EventCallback cb, uint32_t interval, void* arg);
+void panel_clearTimer(int timerId);
+
+// Sets the gesture timing (in ms) for the calling panel; a
+// %%repeatInterval%% of 0 disables auto-repeat. The defaults are
+// 1000ms, 400ms and 100ms.
+void panel_setKeyTiming(uint32_t longPress, uint32_t repeatDelay,
+  uint32_t repeatInterval);
+
+
+///////////////////////////////
+// Message handlers
+
+#define MAX_MESSAGE_PARAMS      (32)
+#define MAX_MESSAGE_PARAMS_SIZE (128)
+
+typedef enum MessageParamType {
+    // uint64_t
+    MessageParamTypeNumber = 1,
+
+    // bool
+    MessageParamTypeBoolean,
+
+    // MessageData (N.B. a String is not null-terminated)
+    MessageParamTypeData,
+    MessageParamTypeString,
+
+    // FfxCborCursor, for any value (such as a nested map)
+    MessageParamTypeCbor,
+} MessageParamType;
+
+// Data or a String within the message, which is only valid until the
+// reply begins
+typedef struct MessageData {
+    const uint8_t *data;
+    size_t length;
+} MessageData;
+
+// Binds the value for %%key%% in the params map to the field at
+// %%offset%% (i.e. offsetof) in the handler's params struct. A NULL
+// %%key%% binds the params themselves (as MessageParamTypeCbor).
+typedef struct MessageParam {
+    const char *key;
+    MessageParamType type;
+    bool required;
+    uint16_t offset;
+} MessageParam;
+
+// Called on the panel's task with the message %%id%% (to accept and
+// reply to) and its bound %%params%%, or NULL if the params did not
+// match the schema (the handler should reply with error 32602).
+typedef void (*MessageCallback)(uint32_t id, const void *params, void *arg);
+
+// A handler for a method, usually a static const. The params struct
+// (of %%paramsSize%% bytes) is zeroed, so any optional param which is
+// missing is 0.
+typedef struct MessageHandler {
+    const char *method;
+    MessageCallback callback;
+    const MessageParam *params;
+    size_t paramCount;
+    size_t paramsSize;
+} MessageHandler;
+
+// Routes messages for %%handler->method%% to the handler, with its
+// params bound from the CBOR in a single pass. Messages are routed
+// by a hash of the method, so panels need not compare the method of
+// every message. Returns the filter id (for panel_offEvent), or -1.
+int panel_onMessage(const MessageHandler *handler, void *arg);
+
 
 
 #ifdef __cplusplus
@@ -11,6 +11,13 @@
 #include "device-info.h"
 #include "utils.h"
 
+#if CONFIG_PIXIE_FSP_SERIAL
+#include "task-serial.h"
+#endif
+#if CONFIG_PIXIE_FSP_BLE
+#include "task-ble.h"
+#endif
+
 #include "panel-connect.h"
 #include "./panel-menu.h"
 #include "./panel-space.h"
@@ -26,6 +33,9 @@ void app_main() {
     // Initialie the events
     events_init();
 
+    // Create the panel tasks
+    panel_init();
+
     // Initialize NVS flash for wallet storage
     {
         esp_err_t ret = nvs_flash_init();
@@ -42,6 +52,10 @@ void app_main() {
         DeviceStatus status = device_init();
         printf("[main] device initialized: status=%d serial=%ld model=%ld\n",
           status, device_serialNumber(), device_modelNumber());
+
+        // Before any transport starts, which each use it
+        status = device_initSessionKey();
+        printf("[main] session key: status=%d\n", status);
     }
 
     // Start the IO task (handles the display, LEDs and keypad)
@@ -58,6 +72,38 @@ void app_main() {
         printf("[main] IO ready\n");
     }
 
+    // Start the FSP transports (each registers with the message worker
+    // once ready), after the session key they use is loaded
+#if CONFIG_PIXIE_FSP_SERIAL
+    {
+        uint32_t ready = 0;
+
+        TaskHandle_t taskSerialHandle = NULL;
+        BaseType_t status = xTaskCreatePinnedToCore(&taskSerialFunc,
+          "serial", 4096, &ready, 2, &taskSerialHandle, 0);
+        printf("[main] start serial task: status=%d\n", status);
+        assert(taskSerialHandle != NULL);
+
+        while (!ready) { delay(1); }
+        printf("[main] serial ready\n");
+    }
+#endif
+
+#if CONFIG_PIXIE_FSP_BLE
+    {
+        uint32_t ready = 0;
+
+        TaskHandle_t taskBleHandle = NULL;
+        BaseType_t status = xTaskCreatePinnedToCore(&taskBleFunc, "ble",
+          5120, &ready, 2, &taskBleHandle, 0);
+        printf("[main] start BLE task: status=%d\n", status);
+        assert(taskBleHandle != NULL);
+
+        while (!ready) { delay(1); }
+        printf("[main] BLE ready\n");
+    }
+#endif
+
 
     // Start the App Process; this is started in the main task, so
     // has high-priority. Don't doddle.
@@ -74,6 +120,45 @@ void app_main() {
             uxTaskGetStackHighWaterMark(NULL),
             uxTaskGetStackHighWaterMark(taskIoHandle),
             configTICK_RATE_HZ);
+
+        EventStats stats;
+        events_getStats(&stats);
+        printf("[main] events: queued=%ld coalesced=%ld dropped=%ld\n",
+          stats.queued, stats.coalesced, stats.dropped);
+
+        PanelStats panels;
+        panel_getStats(&panels);
+        printf("[main] panels: pushes=%ld push=%ldus max=%ldus slots=%ld/%ld stack-free=%ld\n",
+          panels.pushes, panels.lastPushTime, panels.maxPushTime,
+          panels.active, panels.maxActive, panels.stackFree);
+        printf("[main] hibernating: panels=%ld bytes=%ld\n",
+          panels.hibernating, panels.hibernateBytes);
+        printf("[main] watchdog: slow=%ld stalls=%ld\n",
+          panels.slowCallbacks, panels.stalls);
+        printf("[main] preload: hits=%ld misses=%ld\n",
+          panels.preloadHits, panels.preloadMisses);
+        printf("[main] scene: overflows=%ld\n", panel_getSceneOverflows());
+
+#if CONFIG_PIXIE_FSP_BLE
+        // Time spent holding up the BLE stack in the GATT callback
+        BleCallbackStats ble;
+        ble_getCallbackStats(&ble);
+        printf("[main] ble callback: count=%ld avg=%lldus max=%ldus\n",
+          ble.count, ble.count ? (ble.total / ble.count): 0, ble.max);
+#endif
+
+        CallbackProfile profiles[3];
+        size_t count = panel_getProfiles(profiles, 3);
+        for (int i = 0; i < count; i++) {
+            CallbackProfile *profile = &profiles[i];
+            printf("[main] callback: event=0x%08x callback=%p count=%ld slow=%ld max=%ldus hist=",
+              profile->event, profile->callback, profile->count,
+              profile->slow, profile->maxTime);
+            for (int b = 0; b < CALLBACK_BUCKETS; b++) {
+                printf("%s%ld", b ? "/": "", profile->buckets[b]);
+            }
+            printf("\n");
+        }
         delay(60000);
     }
 }
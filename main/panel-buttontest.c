@@ -28,7 +28,6 @@ typedef struct ButtonTestState {
     char button4Text[64];
     char hexText[32];
     
-    uint32_t southHoldStart;
 } ButtonTestState;
 
 static void updateButtonDisplay(ButtonTestState *state, Keys keys) {
@@ -76,30 +75,11 @@ static void keyChanged(EventPayload event, void *_state) {
     
     // Update visual display
     updateButtonDisplay(state, keys);
-    
-    // Handle exit with any button hold for 2 seconds
-    bool anyButtonPressed = (keys & (KeyCancel | KeyOk | KeyNorth | KeySouth)) != 0;
-    
-    if (anyButtonPressed) {
-        if (state->southHoldStart == 0) {
-            state->southHoldStart = ticks();
-        }
-    } else {
-        state->southHoldStart = 0;
-    }
 }
 
-static void render(EventPayload event, void *_state) {
-    ButtonTestState *state = _state;
-    
-    uint32_t now = ticks();
-    
-    // Check for hold-to-exit
-    if (state->southHoldStart > 0 && (now - state->southHoldStart) > 2000) {
-        printf("[buttontest] Exiting after 2-second button hold\n");
-        panel_pop();
-        return;
-    }
+static void longPress(EventPayload event, void *_state) {
+    printf("[buttontest] Exiting after 2-second button hold\n");
+    panel_pop();
 }
 
 static int init(FfxScene scene, FfxNode node, void* _state, void* arg) {
@@ -146,15 +126,15 @@ static int init(FfxScene scene, FfxNode node, void* _state, void* arg) {
     ffx_sceneGroup_appendChild(node, state->exitLabel);
     ffx_sceneNode_setPosition(state->exitLabel, (FfxPoint){ .x = 10, .y = 180 });
     
-    // Initialize state
-    state->southHoldStart = 0;
-    
     // Initialize display
     updateButtonDisplay(state, 0);
     
     // Register for all key events
     panel_onEvent(EventNameKeysChanged | KeyCancel | KeyOk | KeyNorth | KeySouth, keyChanged, state);
-    panel_onEvent(EventNameRenderScene, render, state);
+    
+    // Handle exit with any button hold for 2 seconds
+    panel_setKeyTiming(2000, 0, 0);
+    panel_onEvent(EventNameKeysLongPress | KeyCancel | KeyOk | KeyNorth | KeySouth, longPress, state);
     
     return 0;
 }
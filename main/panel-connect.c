@@ -4,8 +4,10 @@
 #include "freertos/task.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 
+#include "firefly-abi.h"
 #include "firefly-cbor.h"
 #include "firefly-crypto.h"
 #include "firefly-hash.h"
@@ -19,16 +21,138 @@
 typedef struct State {
     FfxScene scene;
     FfxNode panel;
+    FfxNode label;
 
     uint32_t ticks;
+
+    char call[128];
 } State;
 
+// Shows the decoded transaction calldata (e.g. "transfer(to: ...)"),
+// falling back to the function name (or selector) if it cannot be
+// decoded
+static void showCall(State *state, const MessageData *data) {
+    if (data->length == 0) { return; }
+
+    FfxAbiCursor abi;
+    ffx_abi_init(&abi, (uint8_t*)data->data, data->length);
+
+    if (ffx_abi_formatCall(&abi, state->call, sizeof(state->call)) == 0) {
+        if (abi.signature) {
+            int nameLength = strcspn(abi.signature, "(");
+            snprintf(state->call, sizeof(state->call), "%.*s(...)",
+              nameLength, abi.signature);
+        } else {
+            snprintf(state->call, sizeof(state->call), "0x%08lx(...)",
+              abi.selector);
+        }
+    }
+
+    ffx_sceneLabel_setText(state->label, state->call);
+}
+
+// getBytes(id("test-foobar-running-moose-34"))
+static uint8_t privateKey[] = {
+    15, 254, 74, 18, 107, 9, 94, 32, 109, 87, 148, 60, 35, 251, 109, 95,
+    51, 98, 149, 196, 4, 13, 42, 18, 147, 178, 165, 40, 128, 78, 67, 99
+};
+
+// The params of a transaction request
+typedef struct TxParams {
+    // The whole transaction, for serializing
+    FfxCborCursor tx;
+
+    MessageData data;
+} TxParams;
+
+static const MessageParam txParams[] = {
+    { .key = NULL, .type = MessageParamTypeCbor,
+      .offset = offsetof(TxParams, tx) },
+    { .key = "data", .type = MessageParamTypeData,
+      .offset = offsetof(TxParams, data) },
+};
+
+// Replies with the raw signed transaction, ready to broadcast
+static void signTransaction(uint32_t messageId, const void *_params,
+  void *arg) {
+
+    State *state = arg;
+    const TxParams *txParams = _params;
+
+    if (!panel_acceptMessage(messageId, NULL)) { return; }
+
+    if (txParams == NULL) {
+        panel_sendErrorReply(messageId, 32602, "invalid transaction");
+        return;
+    }
+
+    showCall(state, &txParams->data);
+
+    FfxCborCursor params;
+    ffx_cbor_clone(&params, (FfxCborCursor*)&txParams->tx);
+
+    // Determine the serialized length
+    size_t length = 0;
+    FfxTxStatus txStatus = ffx_tx_serializeUnsigned(&params, NULL, &length);
+    if (txStatus != FfxTxStatusBufferOverrun) {
+        panel_sendErrorReply(messageId, 32602, "invalid transaction");
+        return;
+    }
+
+    // The reply is written over the request, which still holds the
+    // params, so the transaction is serialized and signed beforehand
+    size_t maxLength = length + FFX_TX_SIGNATURE_OVERHEAD;
+    uint8_t *tx = malloc(maxLength);
+    if (tx == NULL) {
+        panel_sendErrorReply(messageId, 32603, "out of memory");
+        return;
+    }
+
+    txStatus = ffx_tx_serializeUnsigned(&params, tx, &length);
+    if (txStatus) {
+        free(tx);
+        panel_sendErrorReply(messageId, 32602, "invalid transaction");
+        return;
+    }
+
+    uint8_t digest[FFX_KECCAK256_DIGEST_LENGTH] = { 0 };
+    ffx_hash_keccak256(digest, tx, length);
+
+    uint8_t sig[FFX_SECP256K1_SIGNATURE_LENGTH] = { 0 };
+    if (!ffx_pk_signSecp256k1(privateKey, digest, sig)) {
+        free(tx);
+        panel_sendErrorReply(messageId, 32603, "signing failed");
+        return;
+    }
+
+    txStatus = ffx_tx_serializeSigned(tx, &length, maxLength, sig);
+    if (txStatus) {
+        free(tx);
+        panel_sendErrorReply(messageId, 32603, "serialization failed");
+        return;
+    }
+
+    // An overflowed result is replaced with an error by the commit
+    FfxCborBuilder reply;
+    if (panel_beginReply(messageId, &reply)) {
+        ffx_cbor_appendData(&reply, tx, length);
+        panel_commitReply(messageId, &reply);
+    }
+
+    free(tx);
+}
+
+static const MessageHandler signTransactionHandler = {
+    .method = "eth_signTransaction",
+    .callback = signTransaction,
+    .params = txParams,
+    .paramCount = sizeof(txParams) / sizeof(txParams[0]),
+    .paramsSize = sizeof(TxParams)
+};
+
+// Any other method signs the transaction hash
 static void onMessage(EventPayload event, void* arg) {
-    // getBytes(id("test-foobar-running-moose-34"))
-    uint8_t privateKey[] = {
-        15, 254, 74, 18, 107, 9, 94, 32, 109, 87, 148, 60, 35, 251, 109, 95,
-        51, 98, 149, 196, 4, 13, 42, 18, 147, 178, 165, 40, 128, 78, 67, 99
-    };
+    State *state = arg;
 
     uint32_t messageId = event.props.message.id;
     const char* method = event.props.message.method;
@@ -44,33 +168,34 @@ static void onMessage(EventPayload event, void* arg) {
         return;
     }
 
-    uint8_t digest[FFX_KECCAK256_DIGEST_LENGTH] = { 0 };
     {
-        size_t rlpLength = 256;
-        uint8_t *rlp = malloc(rlpLength);
-        memset(rlp, 0, rlpLength);
-
-        FfxTxStatus txStatus = ffx_tx_serializeUnsigned(&params, rlp,
-          &rlpLength);
-        printf("tx: status=%d length=%d\n", txStatus, rlpLength);
+        FfxCborCursor cursor;
+        ffx_cbor_clone(&cursor, &params);
 
-        printf("RLP: 0x");
-        for (int i = 0; i < rlpLength; i++) {
-            printf("%02x", rlp[i]);
+        MessageData data = { 0 };
+        if (ffx_cbor_followKey(&cursor, "data") == FfxCborStatusOK) {
+            ffx_cbor_getData(&cursor, (uint8_t**)&data.data, &data.length);
         }
-        printf("\n");
+        showCall(state, &data);
+    }
 
-        ffx_hash_keccak256(digest, rlp, rlpLength);
-        free(rlp);
+    // Never sign the empty digest of a transaction which did not hash
+    uint8_t digest[FFX_KECCAK256_DIGEST_LENGTH] = { 0 };
+    FfxTxStatus txStatus = ffx_tx_hashUnsigned(&params, digest);
+    if (txStatus) {
+        panel_sendErrorReply(messageId, 32602, "invalid transaction");
+        return;
     }
 
     uint8_t sig[FFX_SECP256K1_SIGNATURE_LENGTH] = { 0 };
-    int32_t status = ffx_pk_signSecp256k1(privateKey, digest, sig);
-    printf("sig: status=%ld\n", status);
+    if (!ffx_pk_signSecp256k1(privateKey, digest, sig)) {
+        panel_sendErrorReply(messageId, 32603, "signing failed");
+        return;
+    }
 
-    uint8_t *_reply = malloc(256);
+    // The params are consumed, so build the reply in place
     FfxCborBuilder reply;
-    ffx_cbor_build(&reply, _reply, 256);
+    if (!panel_beginReply(messageId, &reply)) { return; }
 
     ffx_cbor_appendMap(&reply, 3);
     ffx_cbor_appendString(&reply, "r");
@@ -80,9 +205,7 @@ static void onMessage(EventPayload event, void* arg) {
     ffx_cbor_appendString(&reply, "v");
     ffx_cbor_appendNumber(&reply, sig[64]);
 
-    //panel_sendErrorReply(4242, "This is an error message...");
-    panel_sendReply(messageId, &reply);
-    free(_reply);
+    panel_commitReply(messageId, &reply);
 }
 
 static int _init(FfxScene scene, FfxNode panel, void* _state, void* arg) {
@@ -97,8 +220,9 @@ static int _init(FfxScene scene, FfxNode panel, void* _state, void* arg) {
     ffx_sceneLabel_setOutlineColor(label, COLOR_BLACK);
     ffx_sceneNode_setPosition(label, ffx_point(120, 120));
     ffx_sceneGroup_appendChild(panel, label);
+    state->label = label;
 
-
+    panel_onMessage(&signTransactionHandler, state);
     panel_onEvent(EventNameMessage, onMessage, state);
 
     return 0;
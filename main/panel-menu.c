@@ -62,6 +62,24 @@ static void updateMenuDisplay(MenuState *app) {
     }
 }
 
+// Builds the highlighted panel while the menu is idle, if it can be
+static void preloadHighlighted(MenuState *app) {
+    switch(app->cursor) {
+        case 4:
+            preloadPanelSnake(NULL);
+            break;
+        case 5:
+            preloadPanelTetris(NULL);
+            break;
+    }
+}
+
+// A pushed panel consumed (or dropped) the preload, so build it again
+// once the menu is shown
+static void focus(EventPayload event, void *_app) {
+    preloadHighlighted(_app);
+}
+
 static void keyChanged(EventPayload event, void *_app) {
     MenuState *app = _app;
 
@@ -95,6 +113,11 @@ static void keyChanged(EventPayload event, void *_app) {
                 pushPanelButtonTest(NULL);
                 break;
         }
+
+        uint32_t hits, misses;
+        panel_getPreloadStats(&hits, &misses);
+        printf("[menu] preload: hits=%ld misses=%ld\n", hits, misses);
+
         return;
     }
     else if (event.props.keys.down & KeyNorth) {
@@ -105,6 +128,7 @@ static void keyChanged(EventPayload event, void *_app) {
             app->cursor--;
         }
         updateMenuDisplay(app);
+        preloadHighlighted(app);
     }
     else if (event.props.keys.down & KeySouth) {
         // Circular navigation down  
@@ -114,6 +138,7 @@ static void keyChanged(EventPayload event, void *_app) {
             app->cursor++;
         }
         updateMenuDisplay(app);
+        preloadHighlighted(app);
     }
 }
 
@@ -147,6 +172,10 @@ static int _init(FfxScene scene, FfxNode node, void *_app, void *arg) {
 
     panel_onEvent(EventNameKeysChanged | KeyNorth | KeySouth | KeyOk,
       keyChanged, app);
+    panel_onEvent(EventNamePanelFocus, focus, app);
+
+    // Nothing runs while covered, so free the task for the child
+    panel_enableHibernate(true);
 
     return 0;
 }
@@ -40,8 +40,6 @@ typedef struct PongState {
     bool gameOver;
     bool paused;
     Keys keys;
-    uint32_t southHoldStart;
-    uint32_t gameStartTime;
     char scoreText[32];
 } PongState;
 
@@ -151,7 +149,7 @@ static void updateGame(PongState *state) {
         state->playerScore++;  // Player scores when ball goes off left (AI side)
         resetBall(state);
         snprintf(state->scoreText, sizeof(state->scoreText), "Player %d - AI %d", state->playerScore, state->aiScore);
-        ffx_sceneLabel_setText(state->scoreLabel, state->scoreText);
+        panel_setText(state->scoreLabel, state->scoreText);
         
         if (state->playerScore >= 7) {
             state->gameOver = true;
@@ -160,7 +158,7 @@ static void updateGame(PongState *state) {
         state->aiScore++;  // AI scores when ball goes off right (player side)
         resetBall(state);
         snprintf(state->scoreText, sizeof(state->scoreText), "Player %d - AI %d", state->playerScore, state->aiScore);
-        ffx_sceneLabel_setText(state->scoreLabel, state->scoreText);
+        panel_setText(state->scoreLabel, state->scoreText);
         
         if (state->aiScore >= 7) {
             state->gameOver = true;
@@ -174,26 +172,47 @@ static void updateVisuals(PongState *state) {
     int offsetY = 60;
     
     // Player paddle at right side
-    ffx_sceneNode_setPosition(state->playerPaddle, (FfxPoint){ 
+    panel_setPosition(state->playerPaddle, (FfxPoint){ 
         .x = offsetX + GAME_WIDTH - PADDLE_WIDTH,
         .y = offsetY + (int)state->playerPaddleY
     });
     
     // AI paddle at left side
-    ffx_sceneNode_setPosition(state->aiPaddle, (FfxPoint){ 
+    panel_setPosition(state->aiPaddle, (FfxPoint){ 
         .x = offsetX,
         .y = offsetY + (int)state->aiPaddleY
     });
     
-    ffx_sceneNode_setPosition(state->ball, (FfxPoint){ 
+    panel_setPosition(state->ball, (FfxPoint){ 
         .x = offsetX + (int)state->ballX, 
         .y = offsetY + (int)state->ballY 
     });
 }
 
+static void togglePause(EventPayload event, void *_state) {
+    PongState *state = _state;
+    
+    if (state->gameOver) { return; }
+    
+    // Holding Ok (to exit) must not keep toggling the pause
+    if (event.props.keys.flags & EventKeysFlagsRepeat) { return; }
+    
+    state->paused = !state->paused;
+    
+    // Show/hide paused label
+    if (state->paused) {
+        ffx_sceneNode_setPosition(state->pausedLabel, (FfxPoint){ .x = 85, .y = 120 });
+    } else {
+        ffx_sceneNode_setPosition(state->pausedLabel, (FfxPoint){ .x = -300, .y = 120 });
+    }
+}
+
+static void exitGame(EventPayload event, void *_state) {
+    panel_pop();
+}
+
 static void keyChanged(EventPayload event, void *_state) {
     PongState *state = _state;
-    printf("[pong] keyChanged called! keys=0x%04x\n", event.props.keys.down);
     
     // Standardized controls:
     // Button 1 (KeyCancel) = Primary action (speed boost) 
@@ -201,47 +220,6 @@ static void keyChanged(EventPayload event, void *_state) {
     // Button 3 (KeyNorth) = Up/Right movement (90° counter-clockwise)
     // Button 4 (KeySouth) = Down/Left movement
     
-    static uint32_t okHoldStart = 0;
-    
-    // Ignore key events for first 500ms to prevent immediate exits from residual button state
-    if (state->gameStartTime == 0) {
-        state->gameStartTime = ticks();
-        okHoldStart = 0; // Reset static variable when game restarts
-        printf("[pong] Game start time set, ignoring keys for 500ms\n");
-        return;
-    }
-    if (ticks() - state->gameStartTime < 500) {
-        printf("[pong] Ignoring keys due to startup delay\n");
-        return;
-    }
-    
-    // Handle Ok button hold-to-exit, short press for pause
-    if (event.props.keys.down & KeyOk) {
-        if (okHoldStart == 0) {
-            okHoldStart = ticks();
-        }
-    } else {
-        if (okHoldStart > 0) {
-            uint32_t holdDuration = ticks() - okHoldStart;
-            if (holdDuration > 1000) { // 1 second hold
-                panel_pop();
-                return;
-            } else {
-                // Short press - pause/unpause
-                if (!state->gameOver) {
-                    state->paused = !state->paused;
-                    // Show/hide paused label
-                    if (state->paused) {
-                        ffx_sceneNode_setPosition(state->pausedLabel, (FfxPoint){ .x = 85, .y = 120 });
-                    } else {
-                        ffx_sceneNode_setPosition(state->pausedLabel, (FfxPoint){ .x = -300, .y = 120 });
-                    }
-                }
-            }
-            okHoldStart = 0;
-        }
-    }
-    
     if (state->gameOver) {
         if (event.props.keys.down & KeyCancel) {
             // Reset game with Cancel button
@@ -265,16 +243,11 @@ static void keyChanged(EventPayload event, void *_state) {
 static void render(EventPayload event, void *_state) {
     PongState *state = _state;
     
-    uint32_t now = ticks();
-    
-    // Check for hold-to-exit during gameplay
-    if (state->southHoldStart > 0 && (now - state->southHoldStart) > 1000) {
-        panel_pop();
-        return;
-    }
-    
+    // The paddles, ball and score change together
+    panel_beginScene();
     updateGame(state);
     updateVisuals(state);
+    panel_commitScene();
 }
 
 static int init(FfxScene scene, FfxNode node, void* _state, void* arg) {
@@ -330,15 +303,15 @@ static int init(FfxScene scene, FfxNode node, void* _state, void* arg) {
     state->gameOver = false;
     state->paused = false;
     state->keys = 0;
-    state->southHoldStart = 0;
-    state->gameStartTime = 0;
     
     resetBall(state);
     snprintf(state->scoreText, sizeof(state->scoreText), "Player %d - AI %d", state->playerScore, state->aiScore);
     ffx_sceneLabel_setText(state->scoreLabel, state->scoreText);
     
     // Register events (4 buttons: Cancel, Ok, North, South)
-    panel_onEvent(EventNameKeysChanged | KeyCancel | KeyOk | KeyNorth | KeySouth, keyChanged, state);
+    panel_onEvent(EventNameKeysChanged | KeyCancel | KeyNorth | KeySouth, keyChanged, state);
+    panel_onEvent(EventNameKeysPress | KeyOk, togglePause, state);
+    panel_onEvent(EventNameKeysLongPress | KeyOk, exitGame, state);
     panel_onEvent(EventNameRenderScene, render, state);
     
     return 0;
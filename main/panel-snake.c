@@ -44,12 +44,9 @@ typedef struct SnakeState {
     int score;
     bool gameOver;
     bool paused;
-    uint32_t lastMove;
     char scoreText[32];
     
     Keys currentKeys;
-    uint32_t southHoldStart;
-    uint32_t gameStartTime;
 } SnakeState;
 
 static void spawnFood(SnakeState *state) {
@@ -68,7 +65,7 @@ static void spawnFood(SnakeState *state) {
         if (!onSnake) break;
     } while (true);
     
-    ffx_sceneNode_setPosition(state->food, (FfxPoint){
+    panel_setPosition(state->food, (FfxPoint){
         .x = 35 + state->foodPos.x * GRID_SIZE,  // Add game area offset
         .y = 40 + state->foodPos.y * GRID_SIZE   // Add game area offset
     });
@@ -124,12 +121,12 @@ static void moveSnake(SnakeState *state) {
         spawnFood(state);
         
         snprintf(state->scoreText, sizeof(state->scoreText), "Score: %d", state->score);
-        ffx_sceneLabel_setText(state->scoreLabel, state->scoreText);
+        panel_setText(state->scoreLabel, state->scoreText);
     }
     
     // Update visual positions (add game area offset)
     for (int i = 0; i < state->snakeLength; i++) {
-        ffx_sceneNode_setPosition(state->snakeBody[i], (FfxPoint){
+        panel_setPosition(state->snakeBody[i], (FfxPoint){
             .x = 35 + state->snake[i].x * GRID_SIZE,  // Add game area offset
             .y = 40 + state->snake[i].y * GRID_SIZE   // Add game area offset
         });
@@ -137,66 +134,51 @@ static void moveSnake(SnakeState *state) {
     
     // Hide unused body segments
     for (int i = state->snakeLength; i < MAX_SNAKE_LENGTH; i++) {
-        ffx_sceneNode_setPosition(state->snakeBody[i], (FfxPoint){ .x = -100, .y = -100 });
+        panel_setPosition(state->snakeBody[i], (FfxPoint){ .x = -100, .y = -100 });
+    }
+}
+
+static void togglePause(EventPayload event, void *_state) {
+    SnakeState *state = _state;
+    
+    if (state->gameOver) { return; }
+    
+    // Holding Ok (to exit) must not keep toggling the pause
+    if (event.props.keys.flags & EventKeysFlagsRepeat) { return; }
+    
+    state->paused = !state->paused;
+    
+    // Show/hide paused label
+    if (state->paused) {
+        ffx_sceneNode_setPosition(state->pausedLabel, (FfxPoint){ .x = 85, .y = 120 });
+    } else {
+        ffx_sceneNode_setPosition(state->pausedLabel, (FfxPoint){ .x = -300, .y = 120 });
     }
 }
 
-static void keyChanged(EventPayload event, void *_state) {
-    printf("[snake] keyChanged called! keys=0x%04x\n", event.props.keys.down);
+static void exitGame(EventPayload event, void *_state) {
+    panel_pop();
+}
+
+static void keyPressed(EventPayload event, void *_state) {
     SnakeState *state = _state;
     
     // Update current keys for continuous movement
     state->currentKeys = event.props.keys.down;
     
+    // Holding a key turns only once
+    if (event.props.keys.flags & EventKeysFlagsRepeat) { return; }
+    
     // Standardized controls:
     // Button 1 (KeyCancel) = Primary action (rotate direction)
     // Button 2 (KeyOk) = Pause/Exit (hold 1s)
     // Button 3 (KeyNorth) = Up/Right movement (90° counter-clockwise like Le Space)  
     // Button 4 (KeySouth) = Down/Left movement
     
-    static uint32_t okHoldStart = 0;
-    
-    // Ignore key events for first 500ms to prevent immediate exits from residual button state
-    if (state->gameStartTime == 0) {
-        state->gameStartTime = ticks();
-        okHoldStart = 0; // Reset static variable when game restarts
-        printf("[snake] Game start time set, ignoring keys for 500ms\n");
-        return;
-    }
-    if (ticks() - state->gameStartTime < 500) {
-        printf("[snake] Ignoring keys due to startup delay\n");
-        return;
-    }
-    
-    // Handle Ok button hold-to-exit, short press for pause
-    if (event.props.keys.down & KeyOk) {
-        if (okHoldStart == 0) {
-            okHoldStart = ticks();
-        }
-    } else {
-        if (okHoldStart > 0) {
-            uint32_t holdDuration = ticks() - okHoldStart;
-            if (holdDuration > 1000) { // 1 second hold
-                panel_pop();
-                return;
-            } else {
-                // Short press - pause/unpause
-                if (!state->gameOver) {
-                    state->paused = !state->paused;
-                    // Show/hide paused label
-                    if (state->paused) {
-                        ffx_sceneNode_setPosition(state->pausedLabel, (FfxPoint){ .x = 85, .y = 120 });
-                    } else {
-                        ffx_sceneNode_setPosition(state->pausedLabel, (FfxPoint){ .x = -300, .y = 120 });
-                    }
-                }
-            }
-            okHoldStart = 0;
-        }
-    }
+    Keys keys = event.props.keys.changed;
     
     if (state->gameOver) {
-        if (event.props.keys.down & KeyCancel) {
+        if (keys & KeyCancel) {
             // Reset game with Cancel button
             state->snakeLength = 3;
             state->snake[0] = (Point){GRID_WIDTH-3, GRID_HEIGHT/2}; // Head on right side
@@ -226,7 +208,7 @@ static void keyChanged(EventPayload event, void *_state) {
     
     // Simple directional controls
     // Button 3 (North) = Turn Right (clockwise)
-    if (event.props.keys.down & KeyNorth) {
+    if (keys & KeyNorth) {
         switch (state->direction) {
             case DIR_UP:    state->nextDirection = DIR_RIGHT; break;
             case DIR_RIGHT: state->nextDirection = DIR_DOWN;  break;
@@ -236,7 +218,7 @@ static void keyChanged(EventPayload event, void *_state) {
     }
     
     // Button 4 (South) = Turn Left (counter-clockwise)
-    if (event.props.keys.down & KeySouth) {
+    if (keys & KeySouth) {
         switch (state->direction) {
             case DIR_UP:    state->nextDirection = DIR_LEFT;  break;
             case DIR_LEFT:  state->nextDirection = DIR_DOWN;  break;
@@ -246,7 +228,7 @@ static void keyChanged(EventPayload event, void *_state) {
     }
     
     // Button 1 (Cancel) = Primary action (rotate direction clockwise)
-    if (event.props.keys.down & KeyCancel) {
+    if (keys & KeyCancel) {
         switch (state->direction) {
             case DIR_UP:
                 if (state->direction != DIR_DOWN) state->nextDirection = DIR_RIGHT;
@@ -264,24 +246,17 @@ static void keyChanged(EventPayload event, void *_state) {
     }
 }
 
-static void render(EventPayload event, void *_state) {
+static void step(EventPayload event, void *_state) {
     SnakeState *state = _state;
     
-    uint32_t now = ticks();
-    
-    // Check for hold-to-exit during gameplay
-    if (state->southHoldStart > 0 && (now - state->southHoldStart) > 1000) {
-        panel_pop();
-        return;
-    }
-    
-    if (now - state->lastMove > 150) { // Move every 150ms
-        moveSnake(state);
-        state->lastMove = now;
-    }
+    // The body, food and score change together
+    panel_beginScene();
+    moveSnake(state);
+    panel_commitScene();
 }
 
-static int init(FfxScene scene, FfxNode node, void* _state, void* arg) {
+// Creates the snake segments, which may be preloaded
+static int build(FfxScene scene, FfxNode node, void* _state, void* arg) {
     SnakeState *state = _state;
     
     // Clear entire state first for fresh start
@@ -317,6 +292,12 @@ static int init(FfxScene scene, FfxNode node, void* _state, void* arg) {
     ffx_sceneBox_setColor(state->food, ffx_color_rgb(255, 0, 0));
     ffx_sceneGroup_appendChild(node, state->food);
     
+    return 0;
+}
+
+static int init(FfxScene scene, FfxNode node, void* _state, void* arg) {
+    SnakeState *state = _state;
+    
     // Initialize game state - start on RIGHT side (90° counter-clockwise layout)
     state->snakeLength = 3;
     state->snake[0] = (Point){GRID_WIDTH-3, GRID_HEIGHT/2}; // Head on right side
@@ -327,10 +308,7 @@ static int init(FfxScene scene, FfxNode node, void* _state, void* arg) {
     state->score = 0;
     state->gameOver = false;
     state->paused = false;
-    state->lastMove = ticks();
     state->currentKeys = 0;
-    state->southHoldStart = 0;
-    state->gameStartTime = 0;
     
     spawnFood(state);
     snprintf(state->scoreText, sizeof(state->scoreText), "Score: %d", state->score);
@@ -345,12 +323,19 @@ static int init(FfxScene scene, FfxNode node, void* _state, void* arg) {
     }
     
     // Register events (4 buttons: Cancel, Ok, North, South)
-    panel_onEvent(EventNameKeysChanged | KeyCancel | KeyOk | KeyNorth | KeySouth, keyChanged, state);
-    panel_onEvent(EventNameRenderScene, render, state);
+    panel_onEvent(EventNameKeysPress | KeyCancel | KeyNorth | KeySouth, keyPressed, state);
+    panel_onEvent(EventNameKeysPress | KeyOk, togglePause, state);
+    panel_onEvent(EventNameKeysLongPress | KeyOk, exitGame, state);
+    panel_setInterval(step, 150, state); // Move every 150ms
     
     return 0;
 }
 
 void pushPanelSnake(void* arg) {
-    panel_push(init, sizeof(SnakeState), PanelStyleSlideLeft, arg);
+    panel_pushBuilt(build, init, sizeof(SnakeState), PanelStyleSlideLeft,
+      arg);
+}
+
+bool preloadPanelSnake(void* arg) {
+    return panel_preload(build, sizeof(SnakeState), arg);
 }
\ No newline at end of file
@@ -5,8 +5,13 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include <stdbool.h>
+
 void pushPanelSnake(void* arg);
 
+// Builds the panel ahead of pushPanelSnake, see panel_preload
+bool preloadPanelSnake(void* arg);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -29,8 +29,6 @@ typedef struct SpaceState {
     bool running;
     bool paused;
 
-    uint32_t resetTimer;
-
     FfxScene scene;
     FfxNode panel;
     FfxNode ship;
@@ -99,11 +97,6 @@ static void render(EventPayload event, void *_app) {
     // Either hasn't started yet or game over
     if (!space->running) { return; }
 
-    // Reset button held down for more than 3s (legacy behavior)
-    if (space->keys == KeyOk && ticks() - space->resetTimer > 3000) {
-        panel_pop();
-    }
-
     // Don't update game logic when paused
     if (space->paused) { return; }
 
@@ -228,62 +221,60 @@ static void render(EventPayload event, void *_app) {
     ffx_sceneNode_setPosition(space->aliens, aliens);
 }
 
-static void keyChanged(EventPayload event, void *_app) {
+static void togglePause(EventPayload event, void *_app) {
     SpaceState *space = _app;
 
     if (!space->running) { return; }
 
-    uint32_t keys = event.props.keys.down;
-    space->keys = keys;
+    // Holding Ok (to exit) must not keep toggling the pause
+    if (event.props.keys.flags & EventKeysFlagsRepeat) { return; }
 
-    FfxPoint ship = ffx_sceneNode_getPosition(space->ship);
+    space->paused = !space->paused;
 
-    //printf("[space] high-water: %d\n", uxTaskGetStackHighWaterMark(NULL));
-
-    // Handle Ok button hold-to-exit, short press for pause
-    static uint32_t okHoldStart = 0;
-    
-    if (keys & KeyOk) {
-        if (okHoldStart == 0) {
-            okHoldStart = ticks();
-        }
-        space->resetTimer = ticks(); // Keep existing reset timer logic
+    // Show/hide paused label
+    if (space->paused) {
+        ffx_sceneNode_setPosition(space->pausedLabel, (FfxPoint){ .x = 85, .y = 120 });
     } else {
-        if (okHoldStart > 0) {
-            uint32_t holdDuration = ticks() - okHoldStart;
-            if (holdDuration > 1000) { // 1 second hold to exit
-                panel_pop();
-                return;
-            } else {
-                // Short press - pause/unpause
-                space->paused = !space->paused;
-                // Show/hide paused label
-                if (space->paused) {
-                    ffx_sceneNode_setPosition(space->pausedLabel, (FfxPoint){ .x = 85, .y = 120 });
-                } else {
-                    ffx_sceneNode_setPosition(space->pausedLabel, (FfxPoint){ .x = -300, .y = 120 });
-                }
-            }
-            okHoldStart = 0;
-        }
-        space->resetTimer = 0;
+        ffx_sceneNode_setPosition(space->pausedLabel, (FfxPoint){ .x = -300, .y = 120 });
     }
+}
+
+static void exitGame(EventPayload event, void *_app) {
+    SpaceState *space = _app;
+
+    if (!space->running) { return; }
+
+    panel_pop();
+}
+
+static void keyChanged(EventPayload event, void *_app) {
+    SpaceState *space = _app;
+
+    if (!space->running) { return; }
+
+    // Held keys move the ship each frame (see render)
+    space->keys = event.props.keys.down;
+}
+
+// Fires on press, and keeps firing while held
+static void fire(EventPayload event, void *_app) {
+    SpaceState *space = _app;
 
     // Don't process other controls when paused
-    if (space->paused) return;
+    if (!space->running || space->paused) { return; }
+
+    FfxPoint ship = ffx_sceneNode_getPosition(space->ship);
 
-    if (keys & KeyCancel) {
-        for (int i = 0; i < BULLETS; i++) {
-            FfxPoint b = ffx_sceneNode_getPosition(space->bullet[i]);
+    for (int i = 0; i < BULLETS; i++) {
+        FfxPoint b = ffx_sceneNode_getPosition(space->bullet[i]);
 
-            // Already in-flight
-            if (b.x > -10) { continue; }
+        // Already in-flight
+        if (b.x > -10) { continue; }
 
-            b.y = ship.y + 16;
-            b.x = 240 - 32 - 2;
-            ffx_sceneNode_setPosition(space->bullet[i], b);
-            break;
-        }
+        b.y = ship.y + 16;
+        b.x = 240 - 32 - 2;
+        ffx_sceneNode_setPosition(space->bullet[i], b);
+        break;
     }
 }
 
@@ -339,8 +330,11 @@ static int _init(FfxScene scene, FfxNode panel, void* panelState, void* arg) {
     ffx_sceneGroup_appendChild(panel, space->pausedLabel);
     ffx_sceneNode_setPosition(space->pausedLabel, (FfxPoint){ .x = -300, .y = 120 }); // Hidden initially
 
-    panel_onEvent(EventNameKeysChanged | KeyNorth | KeySouth | KeyOk | KeyCancel,
-      keyChanged, space);
+    panel_onEvent(EventNameKeysChanged | KeyNorth | KeySouth, keyChanged,
+      space);
+    panel_onEvent(EventNameKeysPress | KeyCancel, fire, space);
+    panel_onEvent(EventNameKeysPress | KeyOk, togglePause, space);
+    panel_onEvent(EventNameKeysLongPress | KeyOk, exitGame, space);
 
     panel_onEvent(EventNameRenderScene, render, space);
 
@@ -50,14 +50,12 @@ typedef struct TetrisState {
     int level;
     bool gameOver;
     bool paused;
-    uint32_t lastDrop;
     uint32_t dropSpeed;
+    int dropTimer;
     char scoreText[32];
     char linesText[32];
     
     Keys currentKeys;
-    uint32_t southHoldStart;
-    uint32_t gameStartTime;
 } TetrisState;
 
 // Tetris piece definitions (4x4 grids, 4 rotations each)
@@ -204,13 +202,16 @@ static void spawnPiece(TetrisState *state) {
 }
 
 static void updateVisuals(TetrisState *state) {
+    // Stage the whole board, so the piece is never drawn half-cleared
+    panel_beginScene();
+
     // Clear board visuals
     for (int y = 0; y < BOARD_HEIGHT; y++) {
         for (int x = 0; x < BOARD_WIDTH; x++) {
             if (state->grid[y][x] == 0) {
-                ffx_sceneBox_setColor(state->board[y][x], COLOR_BLACK);
+                panel_setBoxColor(state->board[y][x], COLOR_BLACK);
             } else {
-                ffx_sceneBox_setColor(state->board[y][x], pieceColors[state->grid[y][x] - 1]);
+                panel_setBoxColor(state->board[y][x], pieceColors[state->grid[y][x] - 1]);
             }
         }
     }
@@ -224,17 +225,54 @@ static void updateVisuals(TetrisState *state) {
                     int ny = state->pieceY + py;
                     
                     if (nx >= 0 && nx < BOARD_WIDTH && ny >= 0 && ny < BOARD_HEIGHT) {
-                        ffx_sceneBox_setColor(state->board[ny][nx], pieceColors[state->currentPiece]);
+                        panel_setBoxColor(state->board[ny][nx], pieceColors[state->currentPiece]);
                     }
                 }
             }
         }
     }
+
+    panel_commitScene();
+}
+
+static void togglePause(EventPayload event, void *_state) {
+    TetrisState *state = _state;
+    
+    if (state->gameOver) { return; }
+    
+    // Holding Ok (to exit) must not keep toggling the pause
+    if (event.props.keys.flags & EventKeysFlagsRepeat) { return; }
+    
+    state->paused = !state->paused;
+    
+    // Show/hide paused label
+    if (state->paused) {
+        ffx_sceneNode_setPosition(state->pausedLabel, (FfxPoint){ .x = 85, .y = 120 });
+    } else {
+        ffx_sceneNode_setPosition(state->pausedLabel, (FfxPoint){ .x = -300, .y = 120 });
+    }
+}
+
+static void exitGame(EventPayload event, void *_state) {
+    panel_pop();
 }
 
-static void keyChanged(EventPayload event, void *_state) {
+static void drop(EventPayload event, void *_state);
+
+// Drops the piece every %%dropSpeed%% ms, restarting the interval only
+// when the speed changes
+static void setDropSpeed(TetrisState *state, uint32_t dropSpeed) {
+    if (state->dropTimer > 0 && state->dropSpeed == dropSpeed) { return; }
+
+    panel_clearTimer(state->dropTimer);
+
+    state->dropSpeed = dropSpeed;
+    state->dropTimer = panel_setInterval(drop, dropSpeed, state);
+    if (state->dropTimer < 0) { printf("[tetris] no drop timer\n"); }
+}
+
+static void handleKeys(EventPayload event, void *_state) {
     TetrisState *state = _state;
-    printf("[tetris] keyChanged called! keys=0x%04x\n", event.props.keys.down);
     
     // Update current keys for continuous movement
     state->currentKeys = event.props.keys.down;
@@ -245,49 +283,16 @@ static void keyChanged(EventPayload event, void *_state) {
     // Button 3 (KeyNorth) = Up/Right movement (90° counter-clockwise)
     // Button 4 (KeySouth) = Down/Left movement
     
-    static uint32_t okHoldStart = 0;
+    Keys keys = event.props.keys.changed;
     
-    // Ignore key events for first 500ms to prevent immediate exits from residual button state
-    if (state->gameStartTime == 0) {
-        state->gameStartTime = ticks();
-        okHoldStart = 0; // Reset static variable when game restarts
-        printf("[tetris] Game start time set, ignoring keys for 500ms\n");
-        return;
-    }
-    if (ticks() - state->gameStartTime < 500) {
-        printf("[tetris] Ignoring keys due to startup delay\n");
-        return;
-    }
-    
-    // Handle Ok button hold-to-exit, short press for pause
-    if (event.props.keys.down & KeyOk) {
-        if (okHoldStart == 0) {
-            okHoldStart = ticks();
-        }
-    } else {
-        if (okHoldStart > 0) {
-            uint32_t holdDuration = ticks() - okHoldStart;
-            if (holdDuration > 1000) { // 1 second hold
-                panel_pop();
-                return;
-            } else {
-                // Short press - pause/unpause
-                if (!state->gameOver) {
-                    state->paused = !state->paused;
-                    // Show/hide paused label
-                    if (state->paused) {
-                        ffx_sceneNode_setPosition(state->pausedLabel, (FfxPoint){ .x = 85, .y = 120 });
-                    } else {
-                        ffx_sceneNode_setPosition(state->pausedLabel, (FfxPoint){ .x = -300, .y = 120 });
-                    }
-                }
-            }
-            okHoldStart = 0;
-        }
+    // Holding North or South keeps moving the piece; holding Cancel
+    // only rotates once
+    if (event.props.keys.flags & EventKeysFlagsRepeat) {
+        keys &= ~KeyCancel;
     }
     
     if (state->gameOver) {
-        if (event.props.keys.down & KeyCancel) {
+        if (keys & KeyCancel) {
             // Reset game with Cancel button
             memset(state->grid, 0, sizeof(state->grid));
             state->score = 0;
@@ -295,7 +300,7 @@ static void keyChanged(EventPayload event, void *_state) {
             state->level = 1;
             state->gameOver = false;
             state->paused = false;
-            state->dropSpeed = 1000;
+            setDropSpeed(state, 1000);
             spawnPiece(state);
             snprintf(state->scoreText, sizeof(state->scoreText), "Score: %d", state->score);
             snprintf(state->linesText, sizeof(state->linesText), "Lines: %d", state->lines);
@@ -308,7 +313,7 @@ static void keyChanged(EventPayload event, void *_state) {
     if (state->paused) return;
     
     // Button 1 (Cancel) = Primary action (rotate piece)
-    if (event.props.keys.down & KeyCancel) {
+    if (keys & KeyCancel) {
         int newRotation = (state->pieceRotation + 1) % 4;
         if (!checkCollision(state, state->pieceX, state->pieceY, newRotation)) {
             state->pieceRotation = newRotation;
@@ -317,37 +322,35 @@ static void keyChanged(EventPayload event, void *_state) {
     
     // Rotated controls: pieces fall left, up/down movement for positioning
     // Button 3 (North) = Move up
-    if (event.props.keys.down & KeyNorth) {
+    if (keys & KeyNorth) {
         if (!checkCollision(state, state->pieceX, state->pieceY - 1, state->pieceRotation)) {
             state->pieceY--;
         }
     }
     
     // Button 4 (South) = Move down  
-    if (event.props.keys.down & KeySouth) {
+    if (keys & KeySouth) {
         if (!checkCollision(state, state->pieceX, state->pieceY + 1, state->pieceRotation)) {
             state->pieceY++;
         }
     }
 }
 
-static void render(EventPayload event, void *_state) {
+static void keyPressed(EventPayload event, void *_state) {
+    handleKeys(event, _state);
+
+    // Retry the drop timer if none was available
+    TetrisState *state = _state;
+    setDropSpeed(state, state->dropSpeed);
+
+    // Only redraw when something may have moved
+    updateVisuals(_state);
+}
+
+static void drop(EventPayload event, void *_state) {
     TetrisState *state = _state;
     
-    uint32_t now = ticks();
-    
-    // Check for hold-to-exit during gameplay
-    if (state->southHoldStart > 0 && (now - state->southHoldStart) > 1000) {
-        panel_pop();
-        return;
-    }
-    
-    if (state->paused || state->gameOver) {
-        updateVisuals(state);
-        return;
-    }
-    
-    if (now - state->lastDrop > state->dropSpeed) {
+    if (!state->paused && !state->gameOver) {
         if (!checkCollision(state, state->pieceX + 1, state->pieceY, state->pieceRotation)) {
             state->pieceX++;  // Move right in rotated layout (left to right fall)
         } else {
@@ -359,8 +362,9 @@ static void render(EventPayload event, void *_state) {
                 state->lines += linesCleared;
                 state->score += linesCleared * 100 * state->level;
                 state->level = state->lines / 10 + 1;
-                state->dropSpeed = 1000 - (state->level - 1) * 50;
-                if (state->dropSpeed < 100) state->dropSpeed = 100;
+                int dropSpeed = 1000 - (state->level - 1) * 50;
+                if (dropSpeed < 100) dropSpeed = 100;
+                setDropSpeed(state, dropSpeed);
                 
                 snprintf(state->scoreText, sizeof(state->scoreText), "Score: %d", state->score);
                 snprintf(state->linesText, sizeof(state->linesText), "Lines: %d", state->lines);
@@ -370,13 +374,13 @@ static void render(EventPayload event, void *_state) {
             
             spawnPiece(state);
         }
-        state->lastDrop = now;
     }
     
     updateVisuals(state);
 }
 
-static int init(FfxScene scene, FfxNode node, void* _state, void* arg) {
+// Creates the board (200 boxes), which may be preloaded
+static int build(FfxScene scene, FfxNode node, void* _state, void* arg) {
     TetrisState *state = _state;
     
     // Clear entire state first for fresh start
@@ -417,6 +421,12 @@ static int init(FfxScene scene, FfxNode node, void* _state, void* arg) {
         }
     }
     
+    return 0;
+}
+
+static int init(FfxScene scene, FfxNode node, void* _state, void* arg) {
+    TetrisState *state = _state;
+    
     // Initialize game state values
     memset(state->grid, 0, sizeof(state->grid));
     state->score = 0;
@@ -424,25 +434,30 @@ static int init(FfxScene scene, FfxNode node, void* _state, void* arg) {
     state->level = 1;
     state->gameOver = false;
     state->paused = false;
-    state->dropSpeed = 1000;
-    state->lastDrop = ticks();
     state->currentKeys = 0;
-    state->southHoldStart = 0;
-    state->gameStartTime = 0;
+    state->dropTimer = 0;
     
     spawnPiece(state);
     snprintf(state->scoreText, sizeof(state->scoreText), "Score: %d", state->score);
     snprintf(state->linesText, sizeof(state->linesText), "Lines: %d", state->lines);
     ffx_sceneLabel_setText(state->scoreLabel, state->scoreText);
     ffx_sceneLabel_setText(state->linesLabel, state->linesText);
+    updateVisuals(state);
     
     // Register events (4 buttons: Cancel, Ok, North, South)
-    panel_onEvent(EventNameKeysChanged | KeyCancel | KeyOk | KeyNorth | KeySouth, keyChanged, state);
-    panel_onEvent(EventNameRenderScene, render, state);
+    panel_onEvent(EventNameKeysPress | KeyCancel | KeyNorth | KeySouth, keyPressed, state);
+    panel_onEvent(EventNameKeysPress | KeyOk, togglePause, state);
+    panel_onEvent(EventNameKeysLongPress | KeyOk, exitGame, state);
+    setDropSpeed(state, 1000);
     
     return 0;
 }
 
 void pushPanelTetris(void* arg) {
-    panel_push(init, sizeof(TetrisState), PanelStyleSlideLeft, arg);
+    panel_pushBuilt(build, init, sizeof(TetrisState), PanelStyleSlideLeft,
+      arg);
+}
+
+bool preloadPanelTetris(void* arg) {
+    return panel_preload(build, sizeof(TetrisState), arg);
 }
\ No newline at end of file
@@ -5,8 +5,13 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include <stdbool.h>
+
 void pushPanelTetris(void* arg);
 
+// Builds the panel ahead of pushPanelTetris, see panel_preload
+bool preloadPanelTetris(void* arg);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -3,6 +3,10 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "esp_timer.h"
+
+#include "firefly-lz.h"
+
 #include "panel.h"
 #include "events-private.h"
 
@@ -15,14 +19,105 @@ extern FfxScene scene;
 
 #define MAX_EVENT_BACKLOG  (8)
 
-typedef struct _PanelInit {
+// The most panels running at once (each pushed panel keeps its slot
+// until it is popped or hibernates)
+#define PANEL_POOL_SIZE    (4)
+
+// The deepest panel stack, including hibernating panels
+#define MAX_PANELS         (8)
+
+#define PANEL_STACK_SIZE   (4096)
+
+#define PANEL_PRIORITY     (1)
+
+// The largest panel state
+#define PANEL_STATE_SIZE   (2048)
+
+// The compressed state of all hibernating panels
+#define HIBERNATE_STORE_SIZE  (2048)
+
+// A callback taking longer than a frame drops frames
+#define CALLBACK_BUDGET       (16000)
+
+// The frames a full queue is tolerated before the panel is flagged
+#define STALL_FRAMES          (30)
+
+#define MAX_CALLBACK_PROFILES (32)
+
+/**
+ *  A worker task, with everything a running panel needs, created once
+ *  at boot so pushing a panel allocates nothing and popping one frees
+ *  nothing.
+ */
+typedef struct PanelSlot {
+    // The panel to start (or wake); set before notifying the task. If
+    // NULL, the task builds a preload instead
+    PanelContext *panel;
     PanelInit init;
-    int id;
-    size_t stateSize;
+    PanelBuild build;
+    size_t buildSize;
     void *arg;
-    uint32_t ready;
-    PanelStyle style;
-} _PanelInit;
+    volatile uint32_t pending;
+
+    // The task blocked in panel_push (or panel_pop, when waking a
+    // panel), notified once the panel is active
+    TaskHandle_t caller;
+    volatile uint32_t ready;
+
+    // Claimed to start or wake a panel and released once it has popped
+    // or hibernated
+    bool busy;
+
+    // The node of a built preload, whether the preload build has
+    // started and whether it was dropped while it was still building
+    FfxNode built;
+    bool started;
+    bool dropped;
+
+    TaskHandle_t task;
+    StaticTask_t taskBuffer;
+    StackType_t stack[PANEL_STACK_SIZE];
+
+    QueueHandle_t events;
+    StaticQueue_t eventQueue;
+    uint8_t eventStore[MAX_EVENT_BACKLOG * sizeof(EventDispatch)];
+
+    uint8_t state[PANEL_STATE_SIZE];
+} PanelSlot;
+
+static PanelSlot slots[PANEL_POOL_SIZE];
+
+// Each panel's context outlives its task while it hibernates (and its
+// filters and timers refer to it)
+static PanelContext contexts[MAX_PANELS];
+static bool contextBusy[MAX_PANELS];
+
+// Guards claiming and releasing slots and contexts
+static portMUX_TYPE lockSlots = portMUX_INITIALIZER_UNLOCKED;
+
+// The compressed states of hibernating panels, packed in the order
+// they hibernated (waking one closes its gap, so any may wake first)
+static uint8_t hibernateStore[HIBERNATE_STORE_SIZE];
+static size_t hibernateLength = 0;
+static uint16_t hibernateTable[FFX_LZ_TABLE_SIZE];
+
+// Guards the store and the decision to hibernate or wake a panel
+static StaticSemaphore_t lockHibernateBuffer;
+static SemaphoreHandle_t lockHibernate;
+
+static PanelStats stats = { 0 };
+
+// The slot holding the preload, if any; guarded by lockSlots
+static PanelSlot *preloadSlot = NULL;
+
+static CallbackProfile profiles[MAX_CALLBACK_PROFILES];
+static uint32_t profileCount = 0;
+
+static uint32_t callbackBudget = CALLBACK_BUDGET;
+static uint32_t stallFrames = STALL_FRAMES;
+
+// Guards the profiles
+static portMUX_TYPE lockProfiles = portMUX_INITIALIZER_UNLOCKED;
 
 PanelContext *activePanel = NULL;
 
@@ -44,28 +139,88 @@ static void _panelBlur(FfxNode node, FfxSceneActionStop stopType, void *arg) {
 }
 
 
-static void _panelInit(void *_arg) {
-    // Copy the PanelInit so we can unblock the caller and it can
-    // free this from its stack (by returning)
+// Adds a callback which took %%duration%% us to its profile
+static void _panelProfile(EventName event, EventCallback callback,
+  uint32_t duration) {
 
-    _PanelInit *panelInit = _arg;
+    // Messages are told apart by their method; everything else only
+    // by its event type
+    if ((event & EventNameMask) != EventNameMessage) {
+        event &= EventNameMask;
+    }
 
-    // Create the panel state
-    size_t stateSize = panelInit->stateSize ? panelInit->stateSize: 1;
-    uint8_t state[stateSize];
-    memset(state, 0, stateSize);
+    int bucket = 0;
+    while (bucket < CALLBACK_BUCKETS - 1 && duration >= (250 << bucket)) {
+        bucket++;
+    }
 
-    // Create an incoming event queue
-    StaticQueue_t eventQueue;
-    uint8_t eventStore[MAX_EVENT_BACKLOG * sizeof(EventDispatch)];
-    QueueHandle_t events = xQueueCreateStatic(MAX_EVENT_BACKLOG,
-      sizeof(EventDispatch), eventStore, &eventQueue);
-    assert(events != NULL);
+    bool slow = (duration > callbackBudget);
+
+    taskENTER_CRITICAL(&lockProfiles);
+
+    CallbackProfile *profile = NULL;
+    for (int i = 0; i < profileCount; i++) {
+        if (profiles[i].event != event) { continue; }
+        if (profiles[i].callback != callback) { continue; }
+        profile = &profiles[i];
+        break;
+    }
+
+    // Once full, new filters go unprofiled
+    if (profile == NULL && profileCount < MAX_CALLBACK_PROFILES) {
+        profile = &profiles[profileCount++];
+        profile->event = event;
+        profile->callback = callback;
+    }
+
+    if (profile) {
+        profile->count++;
+        profile->buckets[bucket]++;
+        if (slow) { profile->slow++; }
+        if (duration > profile->maxTime) { profile->maxTime = duration; }
+    }
+
+    taskEXIT_CRITICAL(&lockProfiles);
+
+    if (slow) {
+        taskENTER_CRITICAL(&lockSlots);
+        stats.slowCallbacks++;
+        taskEXIT_CRITICAL(&lockSlots);
+
+        printf("[panel] slow callback: event=0x%08x callback=%p dt=%ldus\n",
+          event, callback, duration);
+    }
+}
+
+// Calls the callback for %%dispatch%%, timing it
+static void _panelDispatch(PanelContext *panel, EventDispatch *dispatch) {
+    panel->dispatchCallback = dispatch->callback;
+    __atomic_store_n(&panel->dispatchEvent, dispatch->payload.event,
+      __ATOMIC_RELEASE);
+
+    int64_t start = esp_timer_get_time();
+    dispatch->callback(dispatch->payload, dispatch->arg);
+    uint32_t duration = esp_timer_get_time() - start;
+
+    __atomic_store_n(&panel->dispatchEvent, 0, __ATOMIC_RELEASE);
+
+    _panelProfile(dispatch->payload.event, dispatch->callback, duration);
+}
+
+// Starts the newly pushed panel in %%slot%%
+static void _panelStart(PanelSlot *slot, PanelContext *panel) {
+    // A preload is already built into the slot
+    bool preloaded = (slot->built != NULL);
+
+    // Reset the state and anything still queued for the last panel
+    // to use the slot
+    if (!preloaded) { memset(slot->state, 0, panel->stateSize); }
+    xQueueReset(slot->events);
 
     FfxPoint pNewStart = { 0 };
     FfxPoint pNewEnd = { 0 };
     FfxPoint pOldEnd = { 0 };
-    switch (panelInit->style) {
+    switch (panel->style) {
         case PanelStyleInstant:
             break;
         case PanelStyleCoverUp:
@@ -77,7 +232,8 @@ static void _panelInit(void *_arg) {
             break;
     }
 
-    FfxNode node = ffx_scene_createGroup(scene);
+    FfxNode node = preloaded ? slot->built: ffx_scene_createGroup(scene);
+    slot->built = NULL;
 
     if (pNewStart.x != 0 || pNewStart.y != 0) {
         ffx_sceneNode_setPosition(node, pNewStart);
@@ -85,22 +241,30 @@ static void _panelInit(void *_arg) {
 
     PanelContext *oldPanel = activePanel;
 
-    // Create the Panel context (attached to the task tag)
-    PanelContext panel = { 0 };
-    panel.id = panelInit->id;;
-    panel.state = state;
-    panel.events = events;
-    panel.node = node;
-    panel.parent = activePanel;
-    panel.style = panelInit->style;
-    vTaskSetApplicationTaskTag(NULL, (void*)&panel);
-
-    activePanel = &panel;
-
-    panelInit->ready = 1;
+    // Set up the Panel context (attached to the task tag)
+    panel->state = slot->state;
+    panel->events = slot->events;
+    panel->task = xTaskGetCurrentTaskHandle();
+    panel->keyTiming = (KeyTiming){
+        .longPress = KEY_LONG_PRESS,
+        .repeatDelay = KEY_REPEAT_DELAY,
+        .repeatInterval = KEY_REPEAT_INTERVAL
+    };
+    panel->node = node;
+    panel->parent = activePanel;
+    vTaskSetApplicationTaskTag(NULL, (void*)panel);
+
+    activePanel = panel;
+
+    // Unblock panel_push
+    slot->ready = 1;
+    if (slot->caller) { xTaskNotifyGive(slot->caller); }
 
     // Initialize the Panel with the callback
-    panelInit->init(scene, panel.node, panel.state, panelInit->arg);
+    if (slot->build && !preloaded) {
+        slot->build(scene, panel->node, panel->state, slot->arg);
+    }
+    slot->init(scene, panel->node, panel->state, slot->arg);
 
     ffx_sceneGroup_appendChild(ffx_scene_root(scene), node);
 
@@ -128,23 +292,408 @@ static void _panelInit(void *_arg) {
             .panel = { .id = activePanel->id }
         });
     }
+}
+
+// Compresses the state of %%panel%% (which is no longer active) into
+// the store, so its slot can be released. Returns false if it must
+// remain running.
+static bool _panelHibernate(PanelContext *panel) {
+    xSemaphoreTake(lockHibernate, portMAX_DELAY);
+
+    // Popped back to while this was deciding
+    if (panel == activePanel || panel->popped) {
+        xSemaphoreGive(lockHibernate);
+        return false;
+    }
+
+    events_suspend(panel);
+
+    // Something was delivered before it was suspended; remain running
+    // to dispatch it without the lock (a callback may pop), and try
+    // again once the queue is empty
+    if (uxQueueMessagesWaiting(panel->events)) {
+        events_resume(panel, panel->state);
+        xSemaphoreGive(lockHibernate);
+        return false;
+    }
+
+    uint8_t *compact = &hibernateStore[hibernateLength];
+    size_t length = ffx_lz_compress(panel->state, panel->stateSize,
+      compact, HIBERNATE_STORE_SIZE - hibernateLength, hibernateTable);
+
+    if (length == 0) {
+        // No room; remain running (and never try again)
+        panel->hibernate = false;
+        events_resume(panel, panel->state);
+        xSemaphoreGive(lockHibernate);
+        return false;
+    }
+
+    hibernateLength += length;
+    panel->compact = compact;
+    panel->compactLength = length;
+
+    taskENTER_CRITICAL(&lockSlots);
+    stats.hibernating++;
+    stats.hibernateBytes = hibernateLength;
+    taskEXIT_CRITICAL(&lockSlots);
+
+    xSemaphoreGive(lockHibernate);
+
+    return true;
+}
+
+// Restores the hibernating %%panel%% into %%slot%%
+static void _panelWake(PanelSlot *slot, PanelContext *panel) {
+    xSemaphoreTake(lockHibernate, portMAX_DELAY);
+
+    FfxLzDecoder decoder;
+    ffx_lz_initDecoder(&decoder, slot->state, panel->stateSize);
+    FfxLzStatus status = ffx_lz_decode(&decoder, panel->compact,
+      panel->compactLength);
+    assert(status == FfxLzStatusOK);
+    assert(ffx_lz_getDecodedLength(&decoder) == panel->stateSize);
+
+    // Close the gap, moving down any panel which hibernated after it
+    uint8_t *end = &panel->compact[panel->compactLength];
+    memmove(panel->compact, end, &hibernateStore[hibernateLength] - end);
+    for (int i = 0; i < MAX_PANELS; i++) {
+        PanelContext *other = &contexts[i];
+        if (other->compact && other->compact > panel->compact) {
+            other->compact -= panel->compactLength;
+        }
+    }
+
+    hibernateLength -= panel->compactLength;
+    panel->compact = NULL;
+    panel->compactLength = 0;
+
+    taskENTER_CRITICAL(&lockSlots);
+    stats.hibernating--;
+    stats.hibernateBytes = hibernateLength;
+    taskEXIT_CRITICAL(&lockSlots);
+
+    xSemaphoreGive(lockHibernate);
 
-    // Begin the event loop
+    xQueueReset(slot->events);
+
+    uint8_t *oldState = panel->state;
+    panel->state = slot->state;
+    panel->events = slot->events;
+    vTaskSetApplicationTaskTag(NULL, (void*)panel);
+
+    events_resume(panel, oldState);
+
+    // Unblock panel_pop
+    slot->ready = 1;
+    if (slot->caller) { xTaskNotifyGive(slot->caller); }
+}
+
+// Dispatches events for %%panel%% until it pops (returning true) or
+// hibernates
+static bool _panelLoop(PanelContext *panel) {
     EventDispatch dispatch = { 0 };
+    while (!panel->popped) {
+        // Covered by another panel
+        if (panel->hibernate && panel != activePanel &&
+          _panelHibernate(panel)) {
+            return false;
+        }
+
+        if (!events_receive(panel, &dispatch, 1000)) { continue; }
+
+        _panelDispatch(panel, &dispatch);
+    }
+
+    return true;
+}
+
+// Builds the preload in %%slot%% (at idle priority), which keeps the
+// slot until it is pushed, unless it was dropped while building
+static void _panelPreload(PanelSlot *slot) {
+    taskENTER_CRITICAL(&lockSlots);
+    slot->started = true;
+    taskEXIT_CRITICAL(&lockSlots);
+
+    memset(slot->state, 0, slot->buildSize);
+
+    FfxNode node = ffx_scene_createGroup(scene);
+    slot->build(scene, node, slot->state, slot->arg);
+
+    taskENTER_CRITICAL(&lockSlots);
+    bool dropped = slot->dropped;
+    if (!dropped) { slot->built = node; }
+    taskEXIT_CRITICAL(&lockSlots);
+
+    vTaskPrioritySet(NULL, PANEL_PRIORITY);
+
+    if (!dropped) { return; }
+
+    ffx_sceneNode_remove(node, true);
+
+    taskENTER_CRITICAL(&lockSlots);
+    slot->busy = false;
+    stats.active--;
+    taskEXIT_CRITICAL(&lockSlots);
+}
+
+// Drops any preload, returning its slot (released now if it is built,
+// otherwise once it is) or NULL if there was none
+static PanelSlot* _dropPreload() {
+    FfxNode node = NULL;
+
+    taskENTER_CRITICAL(&lockSlots);
+    PanelSlot *slot = preloadSlot;
+    preloadSlot = NULL;
+    if (slot && slot->built) {
+        node = slot->built;
+        slot->built = NULL;
+        slot->busy = false;
+        stats.active--;
+    } else if (slot) {
+        slot->dropped = true;
+    }
+    taskEXIT_CRITICAL(&lockSlots);
+
+    if (node) { ffx_sceneNode_remove(node, true); }
+
+    return slot;
+}
+
+static void _panelWorker(void *_arg) {
+    PanelSlot *slot = _arg;
+
     while (1) {
-        BaseType_t result = xQueueReceive(events, &dispatch, 1000);
-        if (result != pdPASS) { continue; }
+        // A notification may also be a stale event for the last panel
+        while (!slot->pending) { ulTaskNotifyTake(pdTRUE, portMAX_DELAY); }
+        slot->pending = 0;
+
+        PanelContext *panel = slot->panel;
+        if (panel == NULL) {
+            _panelPreload(slot);
+            continue;
+        }
+
+        if (panel->compact) {
+            _panelWake(slot, panel);
+        } else {
+            _panelStart(slot, panel);
+        }
+
+        bool popped = _panelLoop(panel);
+
+        vTaskSetApplicationTaskTag(NULL, NULL);
+
+        taskENTER_CRITICAL(&lockSlots);
+        slot->busy = false;
+        stats.active--;
+        if (popped) { contextBusy[panel - contexts] = false; }
+        taskEXIT_CRITICAL(&lockSlots);
+    }
+}
 
-        dispatch.callback(dispatch.payload, dispatch.arg);
+// Drops any preload and waits until its slot is released, returning
+// false if there was none
+static bool _reclaimPreload() {
+    PanelSlot *dropped = _dropPreload();
+    if (dropped == NULL) { return false; }
+
+    // Finish any build in progress at full priority
+    vTaskPrioritySet(dropped->task, PANEL_PRIORITY);
+
+    while (dropped->busy) { delay(1); }
+
+    return true;
+}
+
+// Claims a free slot, or returns NULL
+static PanelSlot* _claimSlot() {
+    PanelSlot *slot = NULL;
+
+    taskENTER_CRITICAL(&lockSlots);
+    for (int i = 0; i < PANEL_POOL_SIZE; i++) {
+        if (slots[i].busy) { continue; }
+        slot = &slots[i];
+        slot->busy = true;
+        stats.active++;
+        if (stats.active > stats.maxActive) { stats.maxActive = stats.active; }
+        break;
     }
+    taskEXIT_CRITICAL(&lockSlots);
+
+    return slot;
+}
+
+// Starts (or wakes) %%panel%% on %%slot%% and waits until it is active
+static void _runSlot(PanelSlot *slot, PanelContext *panel) {
+    slot->panel = panel;
+    slot->caller = xTaskGetCurrentTaskHandle();
+    slot->ready = 0;
+    slot->pending = 1;
+
+    xTaskNotifyGive(slot->task);
+
+    // Any other notification is an event, which events_receive finds
+    // in the queue regardless
+    while (!slot->ready) { ulTaskNotifyTake(pdTRUE, portMAX_DELAY); }
 }
 
 
 ///////////////////////////////
 // API
 
-void panel_push(PanelInit init, size_t stateSize, PanelStyle style,
-  void *arg) {
+void panel_init() {
+    lockHibernate = xSemaphoreCreateBinaryStatic(&lockHibernateBuffer);
+    xSemaphoreGive(lockHibernate);
+
+    for (int i = 0; i < PANEL_POOL_SIZE; i++) {
+        PanelSlot *slot = &slots[i];
+
+        slot->events = xQueueCreateStatic(MAX_EVENT_BACKLOG,
+          sizeof(EventDispatch), slot->eventStore, &slot->eventQueue);
+        assert(slot->events != NULL);
+
+        char name[configMAX_TASK_NAME_LEN];
+        snprintf(name, sizeof(name), "panel-%d", i);
+
+        slot->task = xTaskCreateStaticPinnedToCore(&_panelWorker, name,
+          PANEL_STACK_SIZE, slot, PANEL_PRIORITY, slot->stack,
+          &slot->taskBuffer, 0);
+        assert(slot->task != NULL);
+    }
+}
+
+void panel_getStats(PanelStats *result) {
+    taskENTER_CRITICAL(&lockSlots);
+    *result = stats;
+    taskEXIT_CRITICAL(&lockSlots);
+
+    result->stackFree = PANEL_STACK_SIZE;
+    for (int i = 0; i < PANEL_POOL_SIZE; i++) {
+        uint32_t stackFree = uxTaskGetStackHighWaterMark(slots[i].task);
+        if (stackFree < result->stackFree) { result->stackFree = stackFree; }
+    }
+}
+
+void panel_setWatchdog(uint32_t budget, uint32_t frames) {
+    callbackBudget = budget;
+    stallFrames = frames;
+}
+
+size_t panel_getProfiles(CallbackProfile *result, size_t count) {
+    size_t found = 0;
+    uint32_t taken = 0;
+
+    taskENTER_CRITICAL(&lockProfiles);
+    while (found < count) {
+        int slowest = -1;
+        for (int i = 0; i < profileCount; i++) {
+            if (taken & ((uint32_t)1 << i)) { continue; }
+            if (slowest == -1 ||
+              profiles[i].maxTime > profiles[slowest].maxTime) {
+                slowest = i;
+            }
+        }
+        if (slowest == -1) { break; }
+
+        taken |= ((uint32_t)1 << slowest);
+        result[found++] = profiles[slowest];
+    }
+    taskEXIT_CRITICAL(&lockProfiles);
+
+    return found;
+}
+
+void panel_checkStalls() {
+    for (int i = 0; i < MAX_PANELS; i++) {
+        PanelContext *panel = &contexts[i];
+
+        // Not running (hibernating panels have no queue to fill)
+        if (!contextBusy[i] || panel->compact || panel->events == NULL) {
+            continue;
+        }
+
+        if (uxQueueSpacesAvailable(panel->events)) {
+            panel->fullFrames = 0;
+            continue;
+        }
+
+        if (++panel->fullFrames != stallFrames) { continue; }
+
+        taskENTER_CRITICAL(&lockSlots);
+        stats.stalls++;
+        taskEXIT_CRITICAL(&lockSlots);
+
+        // Whatever it is running now is most likely the culprit
+        EventName event = __atomic_load_n(&panel->dispatchEvent,
+          __ATOMIC_ACQUIRE);
+        printf("[panel] stalled: panel=%d frames=%ld event=0x%08x callback=%p\n",
+          panel->id, stallFrames, event,
+          event ? panel->dispatchCallback: NULL);
+    }
+}
+
+// Pushes a panel, built first by %%build%% (unless it was preloaded) if
+// it is not NULL
+static void _panelPush(PanelBuild build, PanelInit init, size_t stateSize,
+  PanelStyle style, void *arg) {
+
+    int64_t start = esp_timer_get_time();
+
+    assert(stateSize <= PANEL_STATE_SIZE);
+
+    PanelContext *panel = NULL;
+
+    taskENTER_CRITICAL(&lockSlots);
+    for (int i = 0; i < MAX_PANELS; i++) {
+        if (contextBusy[i]) { continue; }
+        contextBusy[i] = true;
+        panel = &contexts[i];
+        break;
+    }
+    taskEXIT_CRITICAL(&lockSlots);
+
+    if (panel == NULL) {
+        printf("[panel] too many panels\n");
+        return;
+    }
+
+    // A preload of this panel already holds a slot; it only saved any
+    // time if its build had started
+    PanelSlot *slot = NULL;
+    bool started = false;
+    if (build) {
+        taskENTER_CRITICAL(&lockSlots);
+        if (preloadSlot && preloadSlot->build == build &&
+          preloadSlot->arg == arg) {
+            slot = preloadSlot;
+            started = slot->started;
+            preloadSlot = NULL;
+        }
+        taskEXIT_CRITICAL(&lockSlots);
+    }
+
+    bool preloaded = (slot != NULL);
+
+    if (preloaded) {
+        // Finish the build (if it is still running) at full priority
+        vTaskPrioritySet(slot->task, PANEL_PRIORITY);
+
+    } else {
+        slot = _claimSlot();
+
+        // Any other preload gives up its slot if none is free
+        if (slot == NULL && _reclaimPreload()) { slot = _claimSlot(); }
+    }
+
+    if (slot == NULL) {
+        taskENTER_CRITICAL(&lockSlots);
+        contextBusy[panel - contexts] = false;
+        taskEXIT_CRITICAL(&lockSlots);
+
+        printf("[panel] no free panel slot\n");
+        return;
+    }
 
     if (activePanel) {
         panel_emitEvent(EventNamePanelBlur, (EventPayloadProps){
@@ -153,35 +702,113 @@ void panel_push(PanelInit init, size_t stateSize, PanelStyle style,
     }
 
     static int nextPanelId = 1;
-    int panelId = nextPanelId++;
 
-    char name[configMAX_TASK_NAME_LEN];
-    snprintf(name, sizeof(name), "panel-%d", panelId);
+    memset(panel, 0, sizeof(PanelContext));
+    panel->id = nextPanelId++;
+    panel->style = style;
+    panel->stateSize = stateSize;
+
+    slot->init = init;
+    slot->build = build;
+    slot->arg = arg;
+
+    _runSlot(slot, panel);
+
+    uint32_t duration = esp_timer_get_time() - start;
 
-    TaskHandle_t handle = NULL;
-    _PanelInit panelInit = { 0 };
-    panelInit.id = panelId;
-    panelInit.init = init;
-    panelInit.style = style;
-    panelInit.stateSize = stateSize;
-    panelInit.arg = arg;
+    taskENTER_CRITICAL(&lockSlots);
+    stats.pushes++;
+    stats.lastPushTime = duration;
+    if (duration > stats.maxPushTime) { stats.maxPushTime = duration; }
+    if (build && started) {
+        stats.preloadHits++;
+    } else if (build) {
+        stats.preloadMisses++;
+    }
+    taskEXIT_CRITICAL(&lockSlots);
+}
 
-    BaseType_t status = xTaskCreatePinnedToCore(&_panelInit, name,
-      4096 + stateSize, &panelInit, 1, &handle, 0);
-        printf("[main] init panel task: status=%d\n", status);
-        assert(handle != NULL);
+void panel_push(PanelInit init, size_t stateSize, PanelStyle style,
+  void *arg) {
+    _panelPush(NULL, init, stateSize, style, arg);
+}
 
-    while (!panelInit.ready) { delay(2); } // ?? Maybe use event?
+void panel_pushBuilt(PanelBuild build, PanelInit init, size_t stateSize,
+  PanelStyle style, void *arg) {
+    _panelPush(build, init, stateSize, style, arg);
+}
+
+bool panel_preload(PanelBuild build, size_t stateSize, void *arg) {
+    assert(stateSize <= PANEL_STATE_SIZE);
+
+    taskENTER_CRITICAL(&lockSlots);
+    bool current = (preloadSlot && preloadSlot->build == build &&
+      preloadSlot->arg == arg);
+    taskEXIT_CRITICAL(&lockSlots);
+
+    if (current) { return true; }
+
+    _dropPreload();
+
+    PanelSlot *slot = _claimSlot();
+    if (slot == NULL) { return false; }
+
+    slot->panel = NULL;
+    slot->build = build;
+    slot->buildSize = stateSize;
+    slot->arg = arg;
+    slot->started = false;
+    slot->dropped = false;
+
+    taskENTER_CRITICAL(&lockSlots);
+    preloadSlot = slot;
+    taskEXIT_CRITICAL(&lockSlots);
+
+    // Only build while nothing else has work to do
+    vTaskPrioritySet(slot->task, tskIDLE_PRIORITY);
+
+    slot->pending = 1;
+    xTaskNotifyGive(slot->task);
+
+    return true;
+}
+
+void panel_getPreloadStats(uint32_t *hits, uint32_t *misses) {
+    taskENTER_CRITICAL(&lockSlots);
+    *hits = stats.preloadHits;
+    *misses = stats.preloadMisses;
+    taskEXIT_CRITICAL(&lockSlots);
 }
 
 void panel_pop() {
     PanelContext *panel = (void*)xTaskGetApplicationTaskTag(NULL);
+    if (panel->popped) { return; }
+    panel->popped = true;
 
     // Remove all existing events
     events_clearFilters(panel);
 
+    // No staged change may be applied to its nodes once removed
+    panel_flushScene();
+
     activePanel = panel->parent;
 
+    // Wake the parent before anything is emitted to it
+    xSemaphoreTake(lockHibernate, portMAX_DELAY);
+    bool wake = (activePanel->compact != NULL);
+    xSemaphoreGive(lockHibernate);
+
+    if (wake) {
+        // Each hibernating panel released a slot, so one is free (or
+        // about to be, if the panel that released it is still returning
+        // to the pool), unless a preload took it
+        PanelSlot *slot = NULL;
+        while ((slot = _claimSlot()) == NULL) {
+            if (!_reclaimPreload()) { delay(1); }
+        }
+        _runSlot(slot, activePanel);
+    }
+
     if (panel->style == PanelStyleInstant) {
         ffx_sceneNode_setPosition(activePanel->node, (FfxPoint){
             .x = 0, .y = 0
@@ -217,9 +844,14 @@ void panel_pop() {
               0, 300, FfxCurveEaseInQuad, NULL, NULL);
         }
     }
-    // @TODO: move to blur and set a flag to ensure no new events go to
-    //        the dead task
 
-    vTaskDelete(NULL);
+    // The event loop ends once the current callback returns, and the
+    // task returns to the pool
+}
+
+void panel_enableHibernate(bool enable) {
+    PanelContext *panel = (void*)xTaskGetApplicationTaskTag(NULL);
+    if (panel == NULL) { return; }
+    panel->hibernate = enable;
 }
 
@@ -31,9 +31,58 @@ typedef int (*PanelInit)(FfxScene scene, FfxNode node, void* state, void* arg);
 
 void panel_push(PanelInit init, size_t stateSize, PanelStyle style, void* arg);
 
-// Deletes the current panel task, returning control to previous panel in stack
+// Creates a panel's scene under %%node%% (and the state referring to
+// it), without adding any events or timers, so it can be built before
+// the panel is pushed
+typedef int (*PanelBuild)(FfxScene scene, FfxNode node, void* state, void* arg);
+
+// Pushes a panel created in two steps, %%build%% then %%init%%. If it
+// was preloaded (with the same %%arg%%) the built node and state are
+// used and only %%init%% runs (once the build is done, if it is still
+// running); otherwise both run, as for panel_push.
+void panel_pushBuilt(PanelBuild build, PanelInit init, size_t stateSize,
+  PanelStyle style, void* arg);
+
+// Builds a panel which is likely to be pushed soon on a spare panel
+// task at idle priority, replacing any other preload. Returns false if
+// no task is spare. A preload holds its task until it is pushed, or
+// until the task is needed for another panel.
+bool panel_preload(PanelBuild build, size_t stateSize, void* arg);
+
+// Pushes (with panel_pushBuilt) which found their preload, and which
+// had to build the panel
+void panel_getPreloadStats(uint32_t *hits, uint32_t *misses);
+
+// Ends the current panel once the current callback returns, returning
+// control to previous panel in stack (and its task to the pool)
 void panel_pop();
 
+// Allow the current panel to hibernate while another panel is pushed
+// over it; its state is compressed and its task returned to the pool,
+// and it is restored (and receives EventNamePanelFocus) once popped
+// back to. Its timers do not fire while it hibernates, and its state
+// must not point into itself, except for filter and timer args (which
+// are moved with it).
+void panel_enableHibernate(bool enable);
+
+
+///////////////////////////////
+// Scene API
+
+// Stages the scene changes the current panel makes with the functions
+// below until panel_commitScene, after which the IO task applies them
+// together at the next frame boundary, so a frame never shows only
+// part of an update. Outside of begin/commit they apply immediately.
+// Calls may nest; only the outermost commit applies the batch. A panel
+// popped before committing discards its batch. Within a batch, text
+// is limited to 255 bytes (longer text is truncated).
+void panel_beginScene();
+void panel_commitScene();
+
+void panel_setPosition(FfxNode node, FfxPoint position);
+void panel_setBoxColor(FfxNode node, color_ffxt color);
+void panel_setText(FfxNode node, const char *text);
+
 
 ///////////////////////////////
 // Pixel API
@@ -48,6 +97,17 @@ bool panel_acceptMessage(uint32_t id, FfxCborCursor *params);
 bool panel_sendErrorReply(uint32_t id, uint32_t code, char *message);
 bool panel_sendReply(uint32_t id, FfxCborBuilder *result);
 
+// Borrow a builder for the result of message %%id%%, which writes
+// directly into the transport's message buffer, avoiding any
+// intermediate buffer and copy. Once complete, call panel_commitReply
+// to send it.
+//
+// The incoming message buffer is released to make room for the reply,
+// so any params must be consumed before calling this (except within a
+// batch, which retains its requests until all are replied to).
+bool panel_beginReply(uint32_t id, FfxCborBuilder *result);
+bool panel_commitReply(uint32_t id, FfxCborBuilder *result);
+
 // @TODO: Remvoe this and automatically register messages
 //        on message events
 bool panel_isMessageEnabled();
@@ -1,7 +1,10 @@
 #include "esp_log.h"
 #include "esp_random.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
+#include "freertos/FreeRTOS.h"
 #include "freertos/FreeRTOSConfig.h"
+#include "freertos/task.h"
 
 // BLE
 #include "nimble/nimble_port.h"
@@ -13,13 +16,13 @@
 #include "services/gap/ble_svc_gap.h"
 #include "services/gatt/ble_svc_gatt.h"
 
-#include "firefly-cbor.h"
-#include "firefly-hash.h"
-#include "firefly-tx.h"
+#include "firefly-fsp.h"
+#include "firefly-governor.h"
 
 #include "build-defs.h"
 #include "device-info.h"
-#include "events.h"
+#include "panel.h"
+#include "transport.h"
 #include "utils.h"
 
 #include "task-ble.h"
@@ -34,30 +37,18 @@ typedef struct Payload {
 #define STATE_SUBSCRIBED        (1 << 1)
 #define STATE_ENCRYPTED         (1 << 2)
 
-typedef enum MessageState {
-    // Ready to receive data; data is rx
-    MessageStateReady     = 0,
+// The default ATT MTU, before any exchange
+#define DEFAULT_MTU         (23)
 
-    // Receiving data; data = rx
-    MessageStateReceiving,
+// The ATT header of a notification or indication
+#define ATT_HEADER          (3)
 
-    // Received data; data = rx
-    MessageStateReceived,
+// The largest frame (the largest ATT attribute is 512 bytes)
+#define MAX_FRAME_SIZE      (512 - ATT_HEADER)
 
-    // Processing data; data = tx
-    MessageStateProcessing,
-
-    // Sending data; data = tx
-    MessageStateSending
-} MessageState;
-
-
-static uint32_t nextMessageId = 1;
-
-// Length of CBOR overhead for replys (@TODO: too big, resize)
-#define CBOR_HEADER         (128)
-
-#define METHOD_LENGTH       (32)
+// Preferred link-layer data length (in octets and microseconds)
+#define PREFERRED_TX_OCTETS (251)
+#define PREFERRED_TX_TIME   (2120)
 
 typedef struct Connection {
     uint32_t state;
@@ -65,6 +56,12 @@ typedef struct Connection {
     // Task Handle to notify the BLE Task loop to wake up
     TaskHandle_t task;
 
+    // Time spent within the GATT access callback
+    BleCallbackStats callbackStats;
+
+    // Whether FSP was busy as of the last governor poll
+    bool busy;
+
     uint8_t address[6];
     uint8_t own_addr_type;
 
@@ -73,54 +70,38 @@ typedef struct Connection {
     uint16_t content;
     uint16_t logger;
     uint16_t battery_handle;
+} Connection;
 
-    bool enabled;
-
-    // An ID to reply with
-    uint32_t replyId;
+static Connection conn = { 0 };
 
-    // Unique id for each message
-    uint32_t messageId;
+// Guards the callback stats, which are updated on the NimBLE host task
+static portMUX_TYPE sendLock = portMUX_INITIALIZER_UNLOCKED;
 
-    FfxCborCursor message;
-    char method[METHOD_LENGTH];
-    FfxCborCursor params;
+// The FSP instance for the content characteristic
+static FfxFsp fsp;
 
-    MessageState messageState;
+// Room for an upload while a reply is being sent
+static uint8_t arena[2 * FFX_FSP_MESSAGE_ARENA_SIZE];
 
-    // The buffer to hold an incoming message
-    uint8_t data[MAX_MESSAGE_SIZE + CBOR_HEADER];
-
-    // Next expected offset for the incoming message
-    size_t offset;
-
-    // Total expected message size
-    size_t length;
-} Connection;
-
-static Connection conn = { 0 };
+// Chooses the connection and advertising parameters; it is fed from
+// both the NimBLE host task (GAP events) and the BLE task
+static FfxGovernor governor;
+static portMUX_TYPE governorLock = portMUX_INITIALIZER_UNLOCKED;
 
 
 ///////////////////////////////
 // Utilities
 
+static uint32_t now() {
+    return pdTICKS_TO_MS(ticks());
+}
+
 static void print_addr(const char *prefix, const void *addr) {
     const uint8_t *u8p = addr;
     printf("%s%02x:%02x:%02x:%02x:%02x:%02x\n", prefix,
       u8p[5], u8p[4], u8p[3], u8p[2], u8p[1], u8p[0]);
 }
 
-static void dumpBuffer(char *header, uint8_t *buffer, size_t length) {
-    printf("%s (length=%d)", header, length);
-    for (int i = 0; i < length; i++) {
-        if ((i % 16) == 0) { printf("\n    "); }
-        printf("%02x", buffer[i]);
-        if ((i % 4) == 3) { printf("  "); }
-    }
-    printf("\n");
-}
-
-
 ///////////////////////////////
 // BLE Description
 
@@ -150,146 +131,94 @@ static void dumpBuffer(char *header, uint8_t *buffer, size_t length) {
 
 
 ///////////////////////////////
-// Protocol Description
-
-#define CMD_QUERY                                   (0x03)
-#define CMD_RESET                                   (0x02)
-#define CMD_START_MESSAGE                           (0x06)
-#define CMD_CONTINUE_MESSAGE                        (0x07)
-
-#define STATUS_OK                                   (0x00)
-#define ERROR_BUSY                                  (0x91)
-#define ERROR_UNSUPPORTED_VERSION                   (0x81)
-#define ERROR_BAD_COMMAND                           (0x82)
-#define ERROR_BUFFER_OVERRUN                        (0x84)
-#define ERROR_MISSING_MESSAGE                       (0x85)
-#define ERROR_UNKNOWN                               (0x8f)
-
-// Internal value used to skip responding; must not collide with
-// any other STATUS_* or ERROR_*. The ERROR bit is clear.
-#define STATUS_SKIP                                  (0x7f)
-
-
-// See: main.c
-//void emitMessageEvents(uint32_t id, const char*method, FfxCborCursor *params);
-
-static void processMessage() {
-    conn.messageId = nextMessageId++;
+// BLE goop
 
-    if (conn.length < 32) {
-        printf("TO SHORT: @TODO\n");
-        return;
+// Sends an FSP frame on the content characteristic; once the host has
+// granted credits, as a notification (which requires no link-layer
+// round trip) rather than an indication
+static int bleSend(void *context, const uint8_t *data, size_t length) {
+    if ((conn.state & STATE_CONNECTED) == 0) {
+        printf("Not connected; cannot notify\n");
+        return -1;
     }
 
-    dumpBuffer("Process Message", conn.data, conn.length);
-
-    uint8_t checksum[32];
-    FfxSha256Context ctx;
-    ffx_hash_initSha256(&ctx);
-    ffx_hash_updateSha256(&ctx, &conn.data[32], conn.length - 32);
-    ffx_hash_finalSha256(&ctx, checksum);
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(data, length);
+    if (om == NULL) { return BLE_HS_ENOMEM; }
 
-    for (int i = 0; i < 32; i++) {
-        if (checksum[i] != conn.data[i]) {
-            printf("BAD CHECKSUM!\n");
-            return;
-        }
+    int rc = 0;
+    if (ffx_fsp_isCredited(&fsp)) {
+        rc = ble_gatts_notify_custom(conn.conn_handle, conn.content, om);
+    } else {
+        rc = ble_gatts_indicate_custom(conn.conn_handle, conn.content, om);
     }
+    if (rc) { printf("[ble] notify fail: handle=%d rc=%d\n", conn.content, rc); }
+    return rc;
+}
 
-    ffx_cbor_init(&conn.message, &conn.data[32], conn.length - 32);
-
-    // Dump the CBOR data to the console
-    ffx_cbor_dump(&conn.message);
-
-    uint32_t replyId = 0;
-    do {
-        FfxCborCursor cursor;
-        ffx_cbor_clone(&cursor, &conn.message);
-
-        FfxCborStatus status = ffx_cbor_followKey(&cursor, "id");
-        if (status || ffx_cbor_getType(&cursor) != FfxCborTypeNumber) {
-            break;
-        }
-
-        uint64_t value;
-        status = ffx_cbor_getValue(&cursor, &value);
-        if (value == 0 || value > 0x7fffffff) { break; }
-
-        replyId = value;
-    } while(0);
-
-    do {
-        if (replyId == 0) { break; }
-
-        FfxCborCursor cursor;
-        ffx_cbor_clone(&cursor, &conn.message);
-
-        FfxCborStatus status = ffx_cbor_followKey(&cursor, "method");
-        if (status || ffx_cbor_getType(&cursor) != FfxCborTypeString) {
-            replyId = 0;
-            break;
-        }
-
-        memset(conn.method, 0, METHOD_LENGTH);
-        size_t length = ffx_cbor_copyData(&cursor, (uint8_t*)conn.method,
-          METHOD_LENGTH - 1);
-        conn.method[length] = 0;
-
-        if (length == 0) {
-            replyId = 0;
-            break;
-        }
-    } while(0);
-
-    do {
-        if (replyId == 0) { break; }
-
-        FfxCborCursor *cursor = &conn.params;
-        ffx_cbor_clone(cursor, &conn.message);
-
-        FfxCborStatus status = ffx_cbor_followKey(cursor, "params");
-        if (status || (ffx_cbor_getType(cursor) != FfxCborTypeArray &&
-          ffx_cbor_getType(cursor) != FfxCborTypeMap)) {
-            replyId = 0;
-            break;
-        }
-    } while (0);
+static void bleWake(void *context) {
+    xTaskNotifyGive(conn.task);
+}
 
-    conn.replyId = replyId;
+// Requests the connection parameters the governor wants (if any) and
+// returns how long until it next needs polling (in ms), or 0 if only
+// an event can change anything
+static uint32_t governLink() {
+    bool busy = ffx_fsp_isBusy(&fsp);
+    conn.busy = busy;
+
+    uint32_t time = now();
+
+    FfxGovernorConnParams params;
+
+    taskENTER_CRITICAL(&governorLock);
+    ffx_governor_setBusy(&governor, time, busy);
+    bool update = ffx_governor_poll(&governor, time, &params);
+    uint32_t timeout = ffx_governor_getTimeout(&governor, time);
+    uint16_t connHandle = conn.conn_handle;
+    taskEXIT_CRITICAL(&governorLock);
+
+    if (!update) { return timeout; }
+
+    struct ble_gap_upd_params request = {
+        .itvl_min = params.minInterval,
+        .itvl_max = params.maxInterval,
+        .latency = params.latency,
+        .supervision_timeout = params.timeout,
+        .min_ce_len = 0,
+        .max_ce_len = 0
+    };
 
-    if (replyId) {
-        conn.messageState = MessageStateReceived;
+    int rc = ble_gap_update_params(connHandle, &request);
+    if (rc) {
+        printf("[ble] conn update fail: rc=%d\n", rc);
 
-        // This gets cloned within the emitMessageEvents.
-        //emitMessageEvents(replyId, conn.method, &conn.params);
-        panel_emitEvent(EventNameMessage, (EventPayloadProps){
-            .message = {
-                .id = replyId,
-                .method = conn.method,
-                .params = conn.params
-            }
-        });
-    } else {
-        conn.messageState = MessageStateReady;
+        // Back off, as if the central declined
+        taskENTER_CRITICAL(&governorLock);
+        ffx_governor_updated(&governor, time, rc, 0, 0);
+        timeout = ffx_governor_getTimeout(&governor, time);
+        taskEXIT_CRITICAL(&governorLock);
     }
+
+    return timeout;
 }
 
-///////////////////////////////
-// BLE goop
+// Request the fastest link the peer supports: the largest ATT MTU,
+// data length extension and the 2M PHY. Each is a request, which the
+// peer may decline; the results arrive as GAP events.
+static void requestThroughput(uint16_t connHandle) {
+    int rc = ble_gattc_exchange_mtu(connHandle, NULL, NULL);
+    if (rc) { printf("[ble] mtu exchange fail: rc=%d\n", rc); }
 
-static int notify(uint8_t *data, size_t length) {
-    if ((conn.state & STATE_CONNECTED) == 0) {
-        printf("Not connected; cannot notify\n");
-        return -1;
-    }
+    rc = ble_gap_set_data_len(connHandle, PREFERRED_TX_OCTETS,
+      PREFERRED_TX_TIME);
+    if (rc) { printf("[ble] data length fail: rc=%d\n", rc); }
 
-    struct os_mbuf *om = ble_hs_mbuf_from_flat(data, length);
-    int rc = ble_gatts_indicate_custom(conn.conn_handle, conn.content, om);
-    if (rc) { printf("[ble] indicate fail: handle=%d rc=%d\n", conn.content, rc); }
-    return rc;
+    rc = ble_gap_set_prefered_le_phy(connHandle, BLE_GAP_LE_PHY_2M_MASK,
+      BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY);
+    if (rc) { printf("[ble] phy update fail: rc=%d\n", rc); }
 }
 
-static int gattAccess(uint16_t conn_handle, uint16_t attr_handle,
+static int _gattAccess(uint16_t conn_handle, uint16_t attr_handle,
   struct ble_gatt_access_ctxt *ctx, void *arg) {
 
     bool isWrite = false;
@@ -320,135 +249,14 @@ static int gattAccess(uint16_t conn_handle, uint16_t attr_handle,
         int rc = os_mbuf_copydata(ctx->om, 0, length, req);
         if (rc) { printf("[ble] write fail: rc=%d\n", rc); }
 
-        // Response; maximum length is 14 bytes (include space for hash)
-        uint8_t resp[34] = { 0 };
-        resp[0] = STATUS_SKIP;
-        size_t offset = 1;
-
-        do {
-            // Error copying request
-            if (rc) { break; }
-
-            // No data to work with at all
-            if (length < 1) {
-                resp[0] = ERROR_BUFFER_OVERRUN;
-                break;
-            }
-
-            uint8_t cmd = req[0];
-
-            resp[offset++] = cmd;
-
-            if (cmd == CMD_QUERY) {
-                resp[0] = STATUS_OK;
-
-                resp[offset++] = CMD_QUERY;
-                resp[offset++] = 0x01;
-
-                resp[offset++] = conn.offset >> 8;
-                resp[offset++] = conn.offset & 0xff;
-
-                resp[offset++] = conn.length >> 8;
-                resp[offset++] = conn.length & 0xff;
-
-                uint32_t v = device_modelNumber();
-                resp[offset++] = (v >> 24) & 0xff;
-                resp[offset++] = (v >> 16) & 0xff;
-                resp[offset++] = (v >> 8) & 0xff;
-                resp[offset++] = v & 0xff;
-
-                v = device_serialNumber();
-                resp[offset++] = (v >> 24) & 0xff;
-                resp[offset++] = (v >> 16) & 0xff;
-                resp[offset++] = (v >> 8) & 0xff;
-                resp[offset++] = v & 0xff;
-
-            } else if (cmd == CMD_RESET) {
-
-                // Not in a state ready to receive
-                if (conn.messageState != MessageStateReady &&
-                  conn.messageState != MessageStateReceiving) {
-                    resp[0] = ERROR_BUSY;
-                    break;
-                }
-
-                conn.replyId = 0;
-                conn.offset = 0;
-                conn.length = 0;
-                conn.messageState = MessageStateReady;
-
-            } else if (cmd == CMD_START_MESSAGE) {
-
-                // Not ready to start a new message
-                if (conn.messageState != MessageStateReady) {
-                    resp[0] = ERROR_BUSY;
-                    break;
-                }
-
-                // Missing length parameter
-                if (length < 3) {
-                    resp[0] = ERROR_BUFFER_OVERRUN;
-                    break;
-                }
-
-                uint16_t msgLen = (req[1] << 8) | req[2];
-
-                // No message or a message is already started
-                if (msgLen == 0 || length < 4 || conn.offset != 0) {
-                    resp[0] = ERROR_MISSING_MESSAGE;
-                    break;
-                }
-
-                // Update the message
-                conn.length = msgLen;
-                conn.offset = length - 1 - 2;
-                conn.messageState = MessageStateReceiving;
-                memcpy(conn.data, &req[3], length - 1 - 2);
-
-                // Message ready to process!
-                if (conn.offset == conn.length) { processMessage(); }
-
-            } else if (cmd == CMD_CONTINUE_MESSAGE) {
-                if (conn.messageState != MessageStateReceiving) {
-                    resp[0] = ERROR_BUSY;
-                    break;
-                }
-
-                // Missing length parameter
-                if (length < 3) {
-                    resp[0] = ERROR_BUFFER_OVERRUN;
-                    break;
-                }
-
-                // No message to continue
-                if (conn.offset == 0) {
-                    resp[0] = ERROR_MISSING_MESSAGE;
-                    break;
-                }
-
-                uint16_t msgOffset = (req[1] << 8) | req[2];
+        if (rc == 0) {
+            ffx_fsp_receive(&fsp, req, length);
 
-                // Message offset is out of sync
-                if (length < 4 || msgOffset != conn.offset) {
-                    resp[0] = ERROR_MISSING_MESSAGE;
-                    break;
-                }
-
-                // Update the message
-                conn.offset += length - 1 - 2;
-                memcpy(&conn.data[msgOffset], &req[3], length - 1 - 2);
-
-                // Message ready to process!
-                if (conn.offset == conn.length) { processMessage(); }
-
-            } else {
-                resp[0] = ERROR_BAD_COMMAND;
+            // An upload began; let the governor speed up the link
+            if (!conn.busy && ffx_fsp_isBusy(&fsp)) {
+                xTaskNotifyGive(conn.task);
             }
-
-        } while (0);
-
-        // Send response if there is a response or error.
-        if (resp[0] != STATUS_SKIP) { notify(resp, offset); }
+        }
 
         return 0;
     }
@@ -469,7 +277,7 @@ static int gattAccess(uint16_t conn_handle, uint16_t attr_handle,
         // @TODO: does this still make sense? What should happen for
         //        an unsolicited read operation?
 
-        if (!conn.enabled) {
+        if (!panel_isMessageEnabled()) {
             // { v: 1, e: "HUP" }
             uint8_t data[] = {
                 0x00, 162, 97, 118, 1, 97, 101, 99,  72, 85, 80
@@ -503,6 +311,26 @@ static int gattAccess(uint16_t conn_handle, uint16_t attr_handle,
     return (rc == 0) ? 0: BLE_ATT_ERR_INSUFFICIENT_RES;
 }
 
+// Any time spent in here delays link-layer traffic, so track it
+static int gattAccess(uint16_t conn_handle, uint16_t attr_handle,
+  struct ble_gatt_access_ctxt *ctx, void *arg) {
+
+    int64_t start = esp_timer_get_time();
+
+    int rc = _gattAccess(conn_handle, attr_handle, ctx, arg);
+
+    uint32_t duration = esp_timer_get_time() - start;
+
+    taskENTER_CRITICAL(&sendLock);
+    BleCallbackStats *stats = &conn.callbackStats;
+    stats->count++;
+    stats->total += duration;
+    if (duration > stats->max) { stats->max = duration; }
+    taskEXIT_CRITICAL(&sendLock);
+
+    return rc;
+}
+
 static void _svrRegister(struct ble_gatt_register_ctxt *ctxt, void *arg) {
     char buf[BLE_UUID_STR_LEN];
 
@@ -571,6 +399,13 @@ static void _advertise() {
         }
     }
 
+    // Fast for a while after a disconnect, then slow; once the fast
+    // period ends, advertising completes and is restarted
+    FfxGovernorAdvParams params;
+    taskENTER_CRITICAL(&governorLock);
+    ffx_governor_getAdvertising(&governor, now(), &params);
+    taskEXIT_CRITICAL(&governorLock);
+
     // Advertisement
     //  - Undirected-connectable
     //  - general-discoverable
@@ -578,11 +413,18 @@ static void _advertise() {
     memset(&adv_params, 0, sizeof(adv_params));
     adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
     adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+    adv_params.itvl_min = params.minInterval;
+    adv_params.itvl_max = params.maxInterval;
+
+    int32_t duration = params.duration ? params.duration: BLE_HS_FOREVER;
+
+    printf("[ble] advertise: interval=%d-%d duration=%ld\n",
+      params.minInterval, params.maxInterval, duration);
 
     // Begin advertising
     {
         int rc = ble_gap_adv_start(conn.own_addr_type, NULL,
-          BLE_HS_FOREVER, &adv_params, _gapEvent, NULL);
+          duration, &adv_params, _gapEvent, NULL);
 
         if (rc != 0) {
             MODLOG_DFLT(ERROR, "error enabling advertisement; rc=%d\n", rc);
@@ -619,9 +461,27 @@ static int _gapEvent(struct ble_gap_event *event, void *_context) {
               event->connect.status);
 
             //Connection failed; resume advertising
-            if (event->connect.status != 0) { _advertise(); }
+            if (event->connect.status != 0) {
+                _advertise();
+                return 0;
+            }
+
             conn.conn_handle = event->connect.conn_handle;
             conn.state = STATE_CONNECTED;
+            ffx_fsp_setFrameSize(&fsp, DEFAULT_MTU - ATT_HEADER);
+
+            requestThroughput(conn.conn_handle);
+
+            {
+                struct ble_gap_conn_desc desc;
+                int rc = ble_gap_conn_find(conn.conn_handle, &desc);
+                if (rc == 0) {
+                    taskENTER_CRITICAL(&governorLock);
+                    ffx_governor_connected(&governor, now(), desc.conn_itvl,
+                      desc.conn_latency);
+                    taskEXIT_CRITICAL(&governorLock);
+                }
+            }
 
             return 0;
 
@@ -630,18 +490,56 @@ static int _gapEvent(struct ble_gap_event *event, void *_context) {
 
             conn.state = 0;
             conn.conn_handle = 0;
+            ffx_fsp_reset(&fsp);
+
+            taskENTER_CRITICAL(&governorLock);
+            ffx_governor_disconnected(&governor, now());
+            taskEXIT_CRITICAL(&governorLock);
 
             // Connection terminated; resume advertising
             _advertise();
             return 0;
 
-        case BLE_GAP_EVENT_CONN_UPDATE:
-            printf("[ble] conn_update: status=%d\n", event->conn_update.status);
-            return 0;
+        case BLE_GAP_EVENT_CONN_UPDATE: {
+            struct ble_gap_conn_desc desc = { 0 };
+            ble_gap_conn_find(event->conn_update.conn_handle, &desc);
+
+            printf("[ble] conn_update: status=%d interval=%d latency=%d "
+              "timeout=%d\n", event->conn_update.status, desc.conn_itvl,
+              desc.conn_latency, desc.supervision_timeout);
+
+            taskENTER_CRITICAL(&governorLock);
+            ffx_governor_updated(&governor, now(), event->conn_update.status,
+              desc.conn_itvl, desc.conn_latency);
+            taskEXIT_CRITICAL(&governorLock);
+
+            // The governor may want a different profile by now
+            xTaskNotifyGive(conn.task);
 
-        case BLE_GAP_EVENT_CONN_UPDATE_REQ:
-            printf("[ble] conn_update_req\n");
             return 0;
+        }
+
+        case BLE_GAP_EVENT_CONN_UPDATE_REQ: {
+            const struct ble_gap_upd_params *peer =
+              event->conn_update_req.peer_params;
+
+            FfxGovernorConnParams params = {
+                .minInterval = peer->itvl_min,
+                .maxInterval = peer->itvl_max,
+                .latency = peer->latency,
+                .timeout = peer->supervision_timeout
+            };
+
+            taskENTER_CRITICAL(&governorLock);
+            bool accept = ffx_governor_acceptRequest(&governor, &params);
+            taskEXIT_CRITICAL(&governorLock);
+
+            printf("[ble] conn_update_req: interval=%d-%d latency=%d "
+              "timeout=%d accept=%d\n", peer->itvl_min, peer->itvl_max,
+              peer->latency, peer->supervision_timeout, accept);
+
+            return accept ? 0: BLE_ERR_CONN_PARMS;
+        }
 
         case BLE_GAP_EVENT_ADV_COMPLETE:
             printf("[ble] adv_complete: reason=%d\n",
@@ -663,10 +561,18 @@ static int _gapEvent(struct ble_gap_event *event, void *_context) {
             return 0;
 
         case BLE_GAP_EVENT_NOTIFY_TX:
-            printf("[ble] notify_tx status=%d indication=%d\n",
-              event->notify_tx.status, event->notify_tx.indication);
+            // This fires for every paced notification, so only failures
+            // are worth the console write
+            if (event->notify_tx.status != 0 &&
+              event->notify_tx.status != BLE_HS_EDONE) {
+                printf("[ble] notify_tx status=%d indication=%d\n",
+                  event->notify_tx.status, event->notify_tx.indication);
+            }
 
-            if (event->notify_tx.status == BLE_HS_EDONE) {
+            // An indication was confirmed or a notification was handed
+            // to the controller (freeing its buffers)
+            if (event->notify_tx.status == BLE_HS_EDONE ||
+              (event->notify_tx.status == 0 && !event->notify_tx.indication)) {
                 xTaskNotifyGive(conn.task);
             }
 
@@ -675,6 +581,13 @@ static int _gapEvent(struct ble_gap_event *event, void *_context) {
         case BLE_GAP_EVENT_MTU:
             printf("[ble] mtu: connHandle=%d channelId=%d mtu=%d\n",
               event->mtu.conn_handle, event->mtu.channel_id, event->mtu.value);
+
+            if (event->mtu.conn_handle == conn.conn_handle) {
+                size_t frameSize = event->mtu.value - ATT_HEADER;
+                if (frameSize > MAX_FRAME_SIZE) { frameSize = MAX_FRAME_SIZE; }
+                ffx_fsp_setFrameSize(&fsp, frameSize);
+            }
+
             return 0;
 
         case BLE_GAP_EVENT_REPEAT_PAIRING: {
@@ -742,7 +655,7 @@ static int _gapEvent(struct ble_gap_event *event, void *_context) {
         case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
             printf("[ble] phy update complete: status=%d connHandle=%d txPhy=%d rxPhy=%d\n",
               event->phy_updated.status, event->phy_updated.conn_handle,
-              event->phy_updated.tx_phy, event->phy_updated.tx_phy);
+              event->phy_updated.tx_phy, event->phy_updated.rx_phy);
             return 0;
 
         case BLE_GAP_EVENT_ENC_CHANGE:
@@ -787,109 +700,14 @@ static void _runTask() {
 }
 
 ///////////////////////////////
-// Panel API
-
-void panel_enableMessage(bool enable) {
-    conn.enabled = enable;
-}
-
-bool panel_isMessageEnabled() { return conn.enabled; }
-
-
-bool panel_acceptMessage(uint32_t id, FfxCborCursor *params) {
-    if (conn.messageState != MessageStateReceived || id == 0 ||
-      id != conn.messageId) { return false; }
-
-    conn.messageState = MessageStateProcessing;
-
-    if (params) { ffx_cbor_clone(params, &conn.message); }
-
-    return true;
-}
-
-
-static void sendMessage(FfxCborBuilder *builder) {
-    size_t cborLength = ffx_cbor_getBuildLength(builder);
-
-    conn.length = cborLength + 32;
-    conn.messageState = MessageStateSending;
-    conn.messageId = 0;
-
-    FfxSha256Context ctx;
-    ffx_hash_initSha256(&ctx);
-    ffx_hash_updateSha256(&ctx, &conn.data[32], cborLength);
-    ffx_hash_finalSha256(&ctx, conn.data);
-
-    uint8_t resetMessage[] = { CMD_RESET };
-    notify(resetMessage, sizeof(resetMessage));
-}
-
-static void prepareReply(FfxCborBuilder *builder) {
-    memset(conn.data, 0, MAX_MESSAGE_SIZE + CBOR_HEADER);
-
-    ffx_cbor_build(builder, &conn.data[32],
-      MAX_MESSAGE_SIZE + CBOR_HEADER - 32);
-
-    ffx_cbor_appendMap(builder, 3);
-    {
-        ffx_cbor_appendString(builder, "v");
-        ffx_cbor_appendNumber(builder, 1);
-
-        ffx_cbor_appendString(builder, "id");
-        ffx_cbor_appendNumber(builder, conn.replyId);
-    }
-
-    conn.offset = 0;
-}
-
-bool panel_sendErrorReply(uint32_t id, uint32_t code, char *message) {
-    if (id == 0 || id != conn.messageId) { return false; }
-
-    size_t length = strlen(message);
-    if (length > 128) { return false; }
-
-    if (conn.messageState != MessageStateProcessing) { return false; }
-
-    FfxCborBuilder builder;
-    prepareReply(&builder);
-
-    // Append the Error payload (error: { code, message })
-    ffx_cbor_appendString(&builder, "error");
-    ffx_cbor_appendMap(&builder, 2);
-    {
-        ffx_cbor_appendString(&builder, "code");
-        ffx_cbor_appendNumber(&builder, code);
-
-        ffx_cbor_appendString(&builder, "message");
-        ffx_cbor_appendString(&builder, message);
-    }
-
-    sendMessage(&builder);
-
-    return true;
-}
-
-bool panel_sendReply(uint32_t id, FfxCborBuilder *result) {
-    if (id == 0 || id != conn.messageId) { return false; }
-
-    if (ffx_cbor_getBuildLength(result) > MAX_MESSAGE_SIZE) { return false; }
-    if (conn.messageState != MessageStateProcessing) { return false; }
-
-    FfxCborBuilder builder;
-    prepareReply(&builder);
-
-    // Append the payload
-    ffx_cbor_appendString(&builder, "result");
-    ffx_cbor_appendCborBuilder(&builder, result);
-
-    sendMessage(&builder);
+// BLE Task API
 
-    return true;
+void ble_getCallbackStats(BleCallbackStats *stats) {
+    taskENTER_CRITICAL(&sendLock);
+    *stats = conn.callbackStats;
+    taskEXIT_CRITICAL(&sendLock);
 }
 
-///////////////////////////////
-// BLE Task API
-
 // TEMP
 void ble_store_config_init(void);
 
@@ -901,6 +719,29 @@ void taskBleFunc(void* pvParameter) {
     vTaskGetInfo(NULL, &task, pdFALSE, pdFALSE);
     conn.task = task.xHandle;
 
+    ffx_governor_init(&governor, now());
+
+    // Run FSP over the content characteristic
+    {
+        FfxFspTransport transport = {
+            .context = &fsp,
+            .send = bleSend,
+            .wake = bleWake,
+            .received = transport_received,
+            .lock = transport_lock,
+            .unlock = transport_unlock,
+            .now = transport_now,
+            .random = transport_random,
+            .flowControlled = false
+        };
+
+        ffx_fsp_init(&fsp, &transport, device_modelNumber(),
+          device_serialNumber(), arena, sizeof(arena));
+        ffx_fsp_setFrameSize(&fsp, DEFAULT_MTU - ATT_HEADER);
+
+        transport_register(&fsp);
+    }
+
     // Device Information Service Data
 
     char disModelNumber[32];
@@ -1008,6 +849,7 @@ void taskBleFunc(void* pvParameter) {
             .val_handle = &conn.content,
             .flags = BLE_GATT_CHR_F_READ | BLE_ATT_F_READ_ENC
               | BLE_ATT_F_WRITE | BLE_ATT_F_WRITE_ENC | BLE_GATT_CHR_F_INDICATE
+              | BLE_GATT_CHR_F_NOTIFY
         }, {
             // Characteristic: Log
             .uuid = BLE_UUID16_DECLARE(UUID_CHR_FSP_LOGGER),
@@ -1056,6 +898,9 @@ void taskBleFunc(void* pvParameter) {
     //ble_hs_cfg.sm_our_key_dist = BLE_SM_PAIR_KEY_DIST_ENC;
     //ble_hs_cfg.sm_their_key_dist = BLE_SM_PAIR_KEY_DIST_ENC;
 
+    // Offer the largest MTU during any exchange
+    ble_att_set_preferred_mtu(BLE_ATT_MTU_MAX);
+
     ble_svc_gap_init();
     ble_svc_gatt_init();
     assert(ble_gatts_count_cfg(services) == 0);
@@ -1075,48 +920,17 @@ void taskBleFunc(void* pvParameter) {
     // Unblock the bootstrap task
     *ready = 1;
 
-    uint8_t *buffer = NULL;
-
     while (1) {
-        if (buffer) {
-            free(buffer);
-            buffer = NULL;
-        }
+        // Adjust the link to the transfer state, waking in time for the
+        // governor's next deadline
+        uint32_t timeout = governLink();
+        if (timeout == 0 || timeout > 3000) { timeout = 3000; }
 
         // Wait for a notification
-        ulTaskNotifyTake(pdFALSE, 3000);
-
-        // If pending send message, send the next chunk
-        if (conn.messageState == MessageStateSending) {
-
-            size_t length = conn.length - conn.offset;
-            if (length == 0) {
-                conn.offset = 0;
-                conn.length = 0;
-                conn.messageState = MessageStateReady;
-                continue;
-            }
-
-            if (length > 506) { length = 506; }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout));
 
-            buffer = malloc(512);
-
-            if (conn.offset == 0) {
-                buffer[0] = CMD_START_MESSAGE;
-                buffer[1] = conn.length >> 8;
-                buffer[2] = conn.length & 0xff;
-
-            } else {
-                buffer[0] = CMD_CONTINUE_MESSAGE;
-                buffer[1] = conn.offset >> 8;
-                buffer[2] = conn.offset & 0xff;
-            }
-
-            memcpy(&buffer[3], &conn.data[conn.offset], length);
-            conn.offset += length;
-
-            notify(buffer, length + 3);
-        }
+        // Send any pending reply
+        ffx_fsp_pump(&fsp);
 
         /*
         if (conn.state & STATE_SUBSCRIBED) {
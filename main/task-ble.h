@@ -5,29 +5,27 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 
-// 16kb
-#define MAX_MESSAGE_SIZE        (1 << 14)
-
 uint32_t ble_init();
 
-void taskBleFunc(void* pvParameter);
-
-typedef void* TransportContext;
+typedef struct BleCallbackStats {
+    // The number of GATT access callbacks
+    uint32_t count;
 
-typedef void (*MessageReceived)(TransportContext context,
-    uint32_t command, uint8_t *data, size_t length);
+    // Total and longest time spent within them (in microseconds)
+    uint64_t total;
+    uint32_t max;
+} BleCallbackStats;
 
-bool panel_isMessageEnabled();
-void panel_enableMessage(bool enable);
+// Copies the time spent within the NimBLE GATT access callback, which
+// holds up the BLE stack
+void ble_getCallbackStats(BleCallbackStats *stats);
 
-//void transport_task(void* pvParameter);
-//uint32_t transport_send(TransportContext context,
-//    uint32_t command, uint8_t *data, size_t length);
-
-//uint32_t transport_wait(TransportContext context);
+void taskBleFunc(void* pvParameter);
 
 size_t panel_copyMessage(uint32_t messageId, uint8_t *output);
 
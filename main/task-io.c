@@ -2,6 +2,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
 #include <driver/gpio.h>
 #include <hal/gpio_ll.h>
 #include "esp_random.h"
@@ -12,7 +16,7 @@
 #include "config.h"
 
 #include "panel.h"
-#include "events.h"
+#include "events-private.h"
 #include "pixels.h"
 #include "utils.h"
 
@@ -110,6 +114,113 @@ static Keys keypad_read(KeypadContext *context) {
 }
 
 
+///////////////////////////////
+// Gestures
+
+// Turns each latched keypad state into press, auto-repeat, long-press
+// and chord events, so panels need not track hold times themselves
+typedef struct GestureContext {
+    // When each key (by bit) went down, and when it next repeats
+    uint32_t pressed[8];
+    uint32_t nextRepeat[8];
+
+    // Keys whose long-press has been emitted
+    Keys longPressed;
+
+    // Keys held since before the active panel changed; ignored until
+    // released, so the press which opened a panel does not act on it
+    Keys stale;
+    PanelContext *panel;
+
+    // When the current set of keys down began (0 before any change)
+    uint32_t chordStart;
+} GestureContext;
+
+static void emitGesture(EventName event, Keys down, Keys keys,
+  uint16_t flags, uint32_t now) {
+
+    panel_emitEvent(event, (EventPayloadProps){
+        .keys = {
+            .down = down,
+            .changed = keys,
+            .flags = flags,
+            .ticks = now
+        }
+    });
+}
+
+static void gestures_update(GestureContext *context, Keys down,
+  Keys changed, uint32_t now) {
+
+    PanelContext *panel = activePanel;
+    if (panel != context->panel) {
+        context->panel = panel;
+        context->stale = down;
+    }
+    context->stale &= down;
+
+    KeyTiming timing = {
+        .longPress = KEY_LONG_PRESS,
+        .repeatDelay = KEY_REPEAT_DELAY,
+        .repeatInterval = KEY_REPEAT_INTERVAL
+    };
+    if (panel) { timing = panel->keyTiming; }
+
+    if (changed) { context->chordStart = now; }
+
+    Keys live = down & ~context->stale;
+    Keys pressed = changed & live;
+    Keys repeat = 0, longPress = 0;
+
+    for (int i = 0; i < 8; i++) {
+        Keys key = (1 << i);
+        if (!(live & key)) { continue; }
+
+        if (pressed & key) {
+            context->pressed[i] = now;
+            context->nextRepeat[i] = now + timing.repeatDelay;
+            context->longPressed &= ~key;
+            continue;
+        }
+
+        if (timing.repeatInterval &&
+          (int32_t)(now - context->nextRepeat[i]) >= 0) {
+            repeat |= key;
+
+            // Skip any repeats missed while frames were dropped
+            context->nextRepeat[i] += timing.repeatInterval;
+            if ((int32_t)(now - context->nextRepeat[i]) >= 0) {
+                context->nextRepeat[i] = now + timing.repeatInterval;
+            }
+        }
+
+        if (!(context->longPressed & key) &&
+          now - context->pressed[i] >= timing.longPress) {
+            longPress |= key;
+            context->longPressed |= key;
+        }
+    }
+
+    if (pressed) {
+        emitGesture(EventNameKeysPress, down, pressed, 0, now);
+    }
+
+    if (repeat) {
+        emitGesture(EventNameKeysPress, down, repeat, EventKeysFlagsRepeat,
+          now);
+    }
+
+    if (longPress) {
+        emitGesture(EventNameKeysLongPress, down, longPress, 0, now);
+    }
+
+    // A chord forms as a key joins another already held
+    if (pressed && (live & (live - 1))) {
+        emitGesture(EventNameKeysChord, down, live, 0, now);
+    }
+}
+
+
 ///////////////////////////////
 // Pixels
 
@@ -285,6 +396,202 @@ static void renderScene(uint8_t *fragment, uint32_t y0, void *context) {
 }
 
 
+///////////////////////////////
+// Scene Batches
+
+// Commands staged by a panel between panel_beginScene and
+// panel_commitScene; a full batch of board colors (e.g. Tetris) is
+// a little over 200
+#define SCENE_BATCH_SIZE       (256)
+#define SCENE_BATCH_TEXT       (256)
+
+typedef enum SceneOp {
+    SceneOpPosition = 1,
+    SceneOpBoxColor,
+    SceneOpText,
+} SceneOp;
+
+typedef struct SceneCommand {
+    FfxNode node;
+    SceneOp op;
+    union {
+        struct { int16_t x, y; } position;
+        color_ffxt color;
+        uint16_t text;                      // Offset into the batch text
+    } value;
+} SceneCommand;
+
+typedef struct SceneBatch {
+    SceneCommand commands[SCENE_BATCH_SIZE];
+    size_t count;
+    char text[SCENE_BATCH_TEXT];
+    size_t textLength;
+} SceneBatch;
+
+// One batch is recorded into while the other waits (at most a frame)
+// for the IO task to apply it
+static SceneBatch batches[2];
+static SceneBatch *recording = &batches[0];
+static SceneBatch *committed = NULL;
+
+// Only one panel records at a time; held from begin to commit
+static StaticSemaphore_t lockSceneBuffer;
+static SemaphoreHandle_t lockScene;
+static TaskHandle_t sceneWriter = NULL;
+static uint32_t sceneDepth = 0;
+
+// Batches split because they outgrew the buffers
+static uint32_t sceneOverflows = 0;
+
+// Hands the recorded batch to the IO task and records into the other
+static void publishBatch() {
+    if (recording->count == 0) { return; }
+
+    // The other batch is still waiting to be applied
+    while (__atomic_load_n(&committed, __ATOMIC_ACQUIRE)) { delay(1); }
+
+    SceneBatch *batch = recording;
+    recording = (batch == &batches[0]) ? &batches[1]: &batches[0];
+    __atomic_store_n(&committed, batch, __ATOMIC_RELEASE);
+}
+
+// Returns the next command to record %%op%% into, or NULL if the
+// calling task is not in a batch (and should apply it directly)
+static SceneCommand* stageCommand(FfxNode node, SceneOp op,
+  size_t textLength) {
+
+    if (sceneWriter == NULL) { return NULL; }
+    if (sceneWriter != xTaskGetCurrentTaskHandle()) { return NULL; }
+
+    // Too large for one batch; commit what is staged so far (so this
+    // batch is only atomic in parts) and continue in the next
+    if (recording->count == SCENE_BATCH_SIZE ||
+      recording->textLength + textLength > SCENE_BATCH_TEXT) {
+        __atomic_fetch_add(&sceneOverflows, 1, __ATOMIC_RELAXED);
+        publishBatch();
+    }
+
+    SceneCommand *command = &recording->commands[recording->count++];
+    command->node = node;
+    command->op = op;
+    return command;
+}
+
+// Called from the IO task at the frame boundary, before sequencing
+static void applyBatch() {
+    SceneBatch *batch = __atomic_load_n(&committed, __ATOMIC_ACQUIRE);
+    if (batch == NULL) { return; }
+
+    for (int i = 0; i < batch->count; i++) {
+        SceneCommand *command = &batch->commands[i];
+        switch (command->op) {
+            case SceneOpPosition:
+                ffx_sceneNode_setPosition(command->node, (FfxPoint){
+                    .x = command->value.position.x,
+                    .y = command->value.position.y
+                });
+                break;
+            case SceneOpBoxColor:
+                ffx_sceneBox_setColor(command->node, command->value.color);
+                break;
+            case SceneOpText:
+                ffx_sceneLabel_setText(command->node,
+                  &batch->text[command->value.text]);
+                break;
+        }
+    }
+
+    batch->count = 0;
+    batch->textLength = 0;
+
+    __atomic_store_n(&committed, NULL, __ATOMIC_RELEASE);
+}
+
+void panel_beginScene() {
+    if (sceneWriter == xTaskGetCurrentTaskHandle()) {
+        sceneDepth++;
+        return;
+    }
+
+    xSemaphoreTake(lockScene, portMAX_DELAY);
+    sceneWriter = xTaskGetCurrentTaskHandle();
+    sceneDepth = 1;
+}
+
+void panel_commitScene() {
+    if (sceneWriter != xTaskGetCurrentTaskHandle()) { return; }
+    if (--sceneDepth) { return; }
+
+    publishBatch();
+
+    sceneWriter = NULL;
+    xSemaphoreGive(lockScene);
+}
+
+void panel_flushScene() {
+    // Popped mid-batch; nothing recorded will ever be committed
+    if (sceneWriter == xTaskGetCurrentTaskHandle()) {
+        recording->count = 0;
+        recording->textLength = 0;
+
+        sceneWriter = NULL;
+        sceneDepth = 0;
+        xSemaphoreGive(lockScene);
+    }
+
+    while (__atomic_load_n(&committed, __ATOMIC_ACQUIRE)) { delay(1); }
+}
+
+void panel_setPosition(FfxNode node, FfxPoint position) {
+    SceneCommand *command = stageCommand(node, SceneOpPosition, 0);
+    if (command == NULL) {
+        ffx_sceneNode_setPosition(node, position);
+        return;
+    }
+
+    command->value.position.x = position.x;
+    command->value.position.y = position.y;
+}
+
+void panel_setBoxColor(FfxNode node, color_ffxt color) {
+    SceneCommand *command = stageCommand(node, SceneOpBoxColor, 0);
+    if (command == NULL) {
+        ffx_sceneBox_setColor(node, color);
+        return;
+    }
+
+    command->value.color = color;
+}
+
+void panel_setText(FfxNode node, const char *text) {
+    size_t length = strlen(text);
+
+    // Text which would never fit in a batch is truncated (at a UTF-8
+    // character boundary), so it is still applied in order
+    if (length >= SCENE_BATCH_TEXT) {
+        length = SCENE_BATCH_TEXT - 1;
+        while (length && (text[length] & 0xc0) == 0x80) { length--; }
+    }
+
+    SceneCommand *command = stageCommand(node, SceneOpText, length + 1);
+    if (command == NULL) {
+        ffx_sceneLabel_setText(node, text);
+        return;
+    }
+
+    char *copy = &recording->text[recording->textLength];
+    memcpy(copy, text, length);
+    copy[length] = 0;
+
+    command->value.text = recording->textLength;
+    recording->textLength += length + 1;
+}
+
+uint32_t panel_getSceneOverflows() {
+    return __atomic_load_n(&sceneOverflows, __ATOMIC_RELAXED);
+}
+
+
 ///////////////////////////////
 // Task
 
@@ -303,6 +610,9 @@ void taskIoFunc(void* pvParameter) {
     //  NULL);
     scene = ffx_scene_init(allocSpace, freeSpace, NULL, NULL, NULL);
 
+    lockScene = xSemaphoreCreateBinaryStatic(&lockSceneBuffer);
+    xSemaphoreGive(lockScene);
+
     FfxDisplayContext display;
     {
         uint32_t t0 = ticks();
@@ -450,8 +760,9 @@ void taskIoFunc(void* pvParameter) {
     // The IO is up; unblock the bootstrap process and start the app
     *ready = 1;
 
-    // How long the reset sequence has been held down for
-    uint32_t resetStart = 0;
+    // Gesture state, including how long the reset sequence has been
+    // held down for
+    GestureContext gestures = { 0 };
 
     // The time of the last frame; used to enforce a constant framerate
     // The special value 0 causes an immediate update
@@ -461,6 +772,10 @@ void taskIoFunc(void* pvParameter) {
         // Sample the keypad
         keypad_sample(&keypad);
 
+        // Dispatch any panel timers which are due (between frames, so
+        // a timer need not wait for the next one)
+        events_tickTimers(ticks());
+
         // Render a screen fragment; if the last fragment is
         // complete, the frame is complete
         uint32_t frameDone = ffx_display_renderFragment(display);
@@ -475,28 +790,30 @@ void taskIoFunc(void* pvParameter) {
             // Latch the keypad values de-bouncing with the inter-frame samples
             keypad_latch(&keypad);
 
-            // Check for holding the reset sequence to start a timer
-            if (keypad_didChange(&keypad, KeyAll)) {
-                if (keypad_read(&keypad) == KeyReset) {
-                    resetStart = ticks();
-                } else {
-                    resetStart = 0;
+            uint32_t latched = ticks();
+            Keys down = keypad_read(&keypad);
+            Keys changed = keypad_didChange(&keypad, KeyAll);
+
+            panel_emitEvent(EventNameKeys, (EventPayloadProps){
+                .keys = {
+                    .down = down,
+                    .changed = changed,
+                    .flags = 0,
+                    .ticks = latched
                 }
-            }
+            });
+
+            gestures_update(&gestures, down, changed, latched);
 
             // The reset sequence was held for 2s... reset!
-            if (keypad_read(&keypad) == KeyReset && resetStart && (ticks() - resetStart) > 2000) {
+            if (down == KeyReset && gestures.chordStart &&
+              (latched - gestures.chordStart) > 2000) {
                 esp_restart();
                 while(1) { }
             }
 
-            panel_emitEvent(EventNameKeys, (EventPayloadProps){
-                .keys = {
-                    .down = keypad_read(&keypad),
-                    .changed = keypad_didChange(&keypad, KeyAll),
-                    .flags = 0
-                }
-            });
+            // Apply any committed scene batch, all within this frame
+            applyBatch();
 
             ffx_scene_sequence(scene);
 
@@ -506,6 +823,8 @@ void taskIoFunc(void* pvParameter) {
                 .render = { .ticks = now }
             });
 
+            panel_checkStalls();
+
             BaseType_t didDelay = xTaskDelayUntil(&lastFrameTime, FRAMEDELAY);
 
             // We are falling behind, catch up by dropping frames
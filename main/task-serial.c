@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "driver/usb_serial_jtag.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "firefly-fsp.h"
+
+#include "device-info.h"
+#include "transport.h"
+
+#include "task-serial.h"
+
+
+// The USB driver ring buffers; at least a full frame each way
+#define BUFFER_SIZE         (2048)
+
+// How long a frame may wait for the host to drain the ring buffer
+#define WRITE_TIMEOUT       (50)
+
+// How often the transport task pumps without being woken (e.g. to
+// expire an unacknowledged reply or retry a failed write)
+#define PUMP_INTERVAL       (100)
+
+static FfxFsp fsp;
+static FfxFspStream stream;
+
+static TaskHandle_t task = NULL;
+
+// Frames are sent from both the receive and transport tasks, and must
+// not interleave
+static SemaphoreHandle_t writeLock = NULL;
+static uint8_t frame[FFX_FSP_STREAM_HEADER + FFX_FSP_MAX_FRAME_SIZE + 1];
+
+// The arena holds a single message, so an upload is refused (with
+// ERROR_BUSY) while a reply is retained; the host retries it
+static uint8_t arena[FFX_FSP_MESSAGE_ARENA_SIZE];
+
+
+///////////////////////////////
+// Transport callbacks
+
+static int serialSend(void *context, const uint8_t *data, size_t length) {
+    xSemaphoreTake(writeLock, portMAX_DELAY);
+
+    uint8_t crc = ffx_fsp_encodeStreamHeader(frame, data, length);
+    memcpy(&frame[FFX_FSP_STREAM_HEADER], data, length);
+    frame[FFX_FSP_STREAM_HEADER + length] = crc;
+
+    size_t total = FFX_FSP_STREAM_HEADER + length + 1;
+    int sent = usb_serial_jtag_write_bytes(frame, total,
+      pdMS_TO_TICKS(WRITE_TIMEOUT));
+
+    xSemaphoreGive(writeLock);
+
+    // A partial frame fails its CRC on the host, which recovers it
+    return (sent == (int)total) ? 0: -1;
+}
+
+static void serialWake(void *context) {
+    xTaskNotifyGive(task);
+}
+
+
+///////////////////////////////
+// Serial Task API
+
+static void taskSerialRxFunc(void* pvParameter) {
+    uint8_t buffer[128];
+    while (1) {
+        int length = usb_serial_jtag_read_bytes(buffer, sizeof(buffer),
+          portMAX_DELAY);
+        if (length <= 0) { continue; }
+        ffx_fsp_receiveStream(&fsp, &stream, buffer, length);
+    }
+}
+
+void taskSerialFunc(void* pvParameter) {
+    uint32_t *ready = (uint32_t*)pvParameter;
+    vTaskSetApplicationTaskTag( NULL, (void*)NULL);
+
+    TaskStatus_t taskStatus;
+    vTaskGetInfo(NULL, &taskStatus, pdFALSE, pdFALSE);
+    task = taskStatus.xHandle;
+
+    static StaticSemaphore_t writeLockBuffer;
+    writeLock = xSemaphoreCreateMutexStatic(&writeLockBuffer);
+
+    usb_serial_jtag_driver_config_t config = {
+        .tx_buffer_size = BUFFER_SIZE,
+        .rx_buffer_size = BUFFER_SIZE
+    };
+    ESP_ERROR_CHECK(usb_serial_jtag_driver_install(&config));
+
+    FfxFspTransport transport = {
+        .context = &fsp,
+        .send = serialSend,
+        .wake = serialWake,
+        .received = transport_received,
+        .lock = transport_lock,
+        .unlock = transport_unlock,
+        .now = transport_now,
+        .random = transport_random,
+
+        // Writes block until the host drains the ring buffer
+        .flowControlled = true
+    };
+
+    ffx_fsp_init(&fsp, &transport, device_modelNumber(),
+      device_serialNumber(), arena, sizeof(arena));
+
+    transport_register(&fsp);
+
+    // Receive on a separate task, so a reply is never held up by a
+    // blocking read
+    TaskHandle_t rxTask = NULL;
+    BaseType_t status = xTaskCreatePinnedToCore(&taskSerialRxFunc,
+      "serial-rx", 3072, NULL, 2, &rxTask, 0);
+    printf("[serial] start rx task: status=%d\n", status);
+    assert(rxTask != NULL);
+
+    // Unblock the bootstrap task
+    *ready = 1;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PUMP_INTERVAL));
+        ffx_fsp_pump(&fsp);
+    }
+}
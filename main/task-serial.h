@@ -0,0 +1,17 @@
+#ifndef __TASK_SERIAL_H__
+#define __TASK_SERIAL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+// Serves FSP over the USB-serial-JTAG port, so a tethered host can
+// send messages at wired speed. Frames use the FSP stream framing,
+// which the host separates from any console output on the same port.
+void taskSerialFunc(void* pvParameter);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __TASK_SERIAL_H__ */
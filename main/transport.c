@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "esp_random.h"
+
+#include "firefly-cbor.h"
+#include "firefly-fsp.h"
+
+#include "device-info.h"
+#include "events-private.h"
+#include "panel.h"
+#include "utils.h"
+
+#include "transport.h"
+
+
+typedef struct Pending {
+    FfxFsp *fsp;
+    FfxFspMessage *message;
+} Pending;
+
+static FfxFsp *transports[MAX_TRANSPORTS] = { 0 };
+static size_t transportCount = 0;
+
+// Completed uploads from every transport, waiting to be verified and
+// decoded off the receive path (e.g. the NimBLE host task)
+static QueueHandle_t pending = NULL;
+static TaskHandle_t worker = NULL;
+
+// Guards the FSP state of every transport; each critical section is
+// only a few instructions
+static portMUX_TYPE fspLock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool enabled = false;
+
+
+///////////////////////////////
+// Worker
+
+// Verifies and decodes completed uploads
+static void taskMessageFunc(void* pvParameter) {
+    while (1) {
+        Pending item;
+        xQueueReceive(pending, &item, portMAX_DELAY);
+
+        FfxFspMessage *message = item.message;
+
+        if (!ffx_fsp_processMessage(item.fsp, message)) {
+            printf("[transport] dropped invalid message\n");
+            continue;
+        }
+
+        // The message id (not the host id) identifies the message to
+        // the panel API; the event name routes it to any handler for
+        // the method
+        panel_emitEvent(events_messageName(message->method), (EventPayloadProps){
+            .message = {
+                .id = message->messageId,
+                .method = message->method,
+                .params = message->params
+            }
+        });
+    }
+}
+
+
+///////////////////////////////
+// Transport API
+
+void transport_register(FfxFsp *fsp) {
+    bool start = false;
+
+    // Unless disabled, a host must begin a session before any request;
+    // without the session key, every request is refused instead
+    {
+        uint8_t privkey[SESSION_KEY_LENGTH];
+        bool ready = (device_getSessionKey(privkey) == DeviceStatusOk);
+        bool ok = ffx_fsp_setIdentity(fsp, ready ? privkey: NULL,
+          SESSION_REQUIRED);
+        memset(privkey, 0, sizeof(privkey));
+
+        if (ok) {
+            printf("[transport] sessions enabled: required=%d\n",
+              SESSION_REQUIRED);
+        } else if (SESSION_REQUIRED) {
+            printf("[transport] no session key; refusing messages\n");
+        } else {
+            printf("[transport] no session key; sessions disabled\n");
+        }
+    }
+
+    taskENTER_CRITICAL(&fspLock);
+    if (transportCount < MAX_TRANSPORTS) {
+        transports[transportCount++] = fsp;
+        start = (transportCount == 1);
+    }
+    taskEXIT_CRITICAL(&fspLock);
+
+    if (!start) { return; }
+
+    // Start the message worker, below the NimBLE host priority
+    static StaticQueue_t pendingQueue;
+    static uint8_t pendingStore[MAX_TRANSPORTS * FFX_FSP_POOL_SIZE *
+      sizeof(Pending)];
+    pending = xQueueCreateStatic(MAX_TRANSPORTS * FFX_FSP_POOL_SIZE,
+      sizeof(Pending), pendingStore, &pendingQueue);
+    assert(pending != NULL);
+
+    BaseType_t status = xTaskCreatePinnedToCore(&taskMessageFunc,
+      "message", 4096, NULL, 2, &worker, 0);
+    printf("[transport] start message task: status=%d\n", status);
+    assert(worker != NULL);
+}
+
+// Hands a completed upload to the message worker; the receive path
+// must never block on verifying or decoding it.
+void transport_received(void *context, FfxFspMessage *message) {
+    Pending item = { .fsp = context, .message = message };
+
+    // The queue holds every slot of every transport, so this cannot fail
+    BaseType_t status = xQueueSendToBack(pending, &item, 0);
+    assert(status == pdTRUE);
+}
+
+void transport_lock(void *context) {
+    taskENTER_CRITICAL(&fspLock);
+}
+
+void transport_unlock(void *context) {
+    taskEXIT_CRITICAL(&fspLock);
+}
+
+uint32_t transport_now(void *context) {
+    return pdTICKS_TO_MS(ticks());
+}
+
+// Only used for session nonces, which must not repeat (the hardware
+// RNG is only truly random while the BLE radio is running)
+void transport_random(void *context, uint8_t *data, size_t length) {
+    esp_fill_random(data, length);
+}
+
+
+///////////////////////////////
+// Panel API
+
+// Each message id is unique across transports, so a reply is routed
+// to whichever transport has that message.
+
+void panel_enableMessage(bool enable) {
+    enabled = enable;
+}
+
+bool panel_isMessageEnabled() { return enabled; }
+
+bool panel_acceptMessage(uint32_t id, FfxCborCursor *params) {
+    for (int i = 0; i < transportCount; i++) {
+        if (ffx_fsp_acceptMessage(transports[i], id, params)) { return true; }
+    }
+    return false;
+}
+
+bool panel_sendErrorReply(uint32_t id, uint32_t code, char *message) {
+    for (int i = 0; i < transportCount; i++) {
+        if (ffx_fsp_sendErrorReply(transports[i], id, code, message)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool panel_beginReply(uint32_t id, FfxCborBuilder *result) {
+    for (int i = 0; i < transportCount; i++) {
+        if (ffx_fsp_beginReply(transports[i], id, result)) { return true; }
+    }
+    return false;
+}
+
+bool panel_commitReply(uint32_t id, FfxCborBuilder *result) {
+    for (int i = 0; i < transportCount; i++) {
+        if (ffx_fsp_commitReply(transports[i], id, result)) { return true; }
+    }
+    return false;
+}
+
+bool panel_sendReply(uint32_t id, FfxCborBuilder *result) {
+    for (int i = 0; i < transportCount; i++) {
+        if (ffx_fsp_sendReply(transports[i], id, result)) { return true; }
+    }
+    return false;
+}
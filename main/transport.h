@@ -0,0 +1,39 @@
+#ifndef __TRANSPORT_H__
+#define __TRANSPORT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+
+#include "firefly-fsp.h"
+
+
+// The most links (e.g. BLE and USB) which may serve FSP at once
+#define MAX_TRANSPORTS          (2)
+
+// Whether a host must begin a session before sending any message; if
+// 0, plain messages are accepted too (for hosts without sessions), and
+// only those sent within a session are protected
+#define SESSION_REQUIRED        (1)
+
+// Registers %%fsp%%, so its requests are emitted to panels and any
+// replies are routed back to it, and enables sessions with the device
+// session key. Call from the transport task before it begins
+// receiving.
+void transport_register(FfxFsp *fsp);
+
+// FfxFspTransport callbacks shared by all device transports. The
+// received callback requires the context be the FfxFsp.
+void transport_received(void *context, FfxFspMessage *message);
+void transport_lock(void *context);
+void transport_unlock(void *context);
+uint32_t transport_now(void *context);
+void transport_random(void *context, uint8_t *data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __TRANSPORT_H__ */